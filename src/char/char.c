@@ -21,6 +21,7 @@
 #include "int_elemental.h"
 #include "int_party.h"
 #include "int_storage.h"
+#include "int_writer.h"
 #include "char.h"
 #include "inter.h"
 
@@ -75,6 +76,7 @@ char bonus_script_db[256] = "bonus_script";
 int save_log = 1;
 
 static DBMap *char_db_; // int char_id -> struct mmo_charstatus*
+static DBMap *char_resave_db; // int char_id -> 1, characters whose last save failed (save_workers)
 
 char db_path[1024] = "db";
 
@@ -351,6 +353,8 @@ void set_char_online(int map_id, int char_id, int account_id)
 
 	//Set char online in guild cache. If char is in memory, use the guild id on it, otherwise seek it.
 	cp = (struct mmo_charstatus *)idb_get(char_db_, char_id);
+	if( !cp ) //The guild is read from the row, which guild saves write with the saves of the account
+		inter_writer_flush(WRITER_ACCOUNT, account_id);
 	inter_guild_CharOnline(char_id, cp ? cp->guild_id : -1);
 
 	//Notify login server
@@ -374,6 +378,9 @@ void set_char_offline(int char_id, int account_id)
 		inter_guild_CharOffline(char_id, cp ? cp->guild_id : -1);
 		if( cp )
 			idb_remove(char_db_, char_id);
+		memitemdata_uncache(char_id, TABLE_INVENTORY);
+		memitemdata_uncache(char_id, TABLE_CART);
+		memitemdata_uncache(account_id, TABLE_STORAGE);
 
 		if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `online`='0' WHERE `char_id`='%d' LIMIT 1", char_db, char_id) )
 			Sql_ShowDebug(sql_handle);
@@ -489,36 +496,53 @@ static DBData create_charstatus(DBKey key, va_list args)
 	return db_ptr2data(cp);
 }
 
-int inventory_to_sql(const struct item items[], int max, int id);
+/// Called when a save of a character was written (see inter_writer_hook).
+/// When it failed, the next save writes the whole character.
+static void mmo_char_written(int char_id, intptr_t data, const int *values, int count)
+{
+	if( count < 0 )
+		idb_iput(char_resave_db, char_id, 1);
+}
 
-int mmo_char_tosql(int char_id, struct mmo_charstatus *p)
+/// Saves a character, writing what differs from the cached copy.
+/// 'sections' are the e_charsave_section that can differ, the others are not compared.
+/// Returns 0 when everything was saved.
+int mmo_char_tosql(int char_id, struct mmo_charstatus *p, int sections)
 {
 	int i = 0;
 	int count = 0;
 	int diff = 0;
 	char save_status[128]; //For displaying save information. [Skotlex]
-	struct mmo_charstatus *cp;
+	struct mmo_charstatus *cp; //Copy that is compared
+	struct mmo_charstatus *cached;
 	int errors = 0; //If there are any errors while saving, "cp" will not be updated at the end.
+	bool recording;
 	StringBuf buf;
 
 	if (char_id != p->char_id)
 		return 0;
 
-	cp = (struct mmo_charstatus *)idb_ensure(char_db_, char_id, create_charstatus);
+	cp = cached = (struct mmo_charstatus *)idb_ensure(char_db_, char_id, create_charstatus);
+	if( idb_exists(char_resave_db, char_id) ) //The last save failed, everything is written again
+		cp = (struct mmo_charstatus *)aCalloc(1, sizeof(struct mmo_charstatus));
+
+	//Written later by the save writer (save_workers)
+	if( (recording = inter_writer_begin(WRITER_ACCOUNT, p->account_id)) )
+		inter_writer_hook(mmo_char_written, char_id, 0, NULL, 0);
 
 	StringBuf_Init(&buf);
 	memset(save_status, 0, sizeof(save_status));
 
 	//Map inventory data
-	if( memcmp(p->inventory, cp->inventory, sizeof(p->inventory)) ) {
-		if (!inventory_to_sql(p->inventory, MAX_INVENTORY, p->char_id))
+	if( (sections&CHARSAVE_INVENTORY) && memcmp(p->inventory, cp->inventory, sizeof(p->inventory)) ) {
+		if (!memitemdata_to_sql(p->inventory, MAX_INVENTORY, p->char_id, TABLE_INVENTORY))
 			strcat(save_status, " inventory");
 		else
 			errors++;
 	}
 
 	//Map cart data
-	if( memcmp(p->cart, cp->cart, sizeof(p->cart)) ) {
+	if( (sections&CHARSAVE_CART) && memcmp(p->cart, cp->cart, sizeof(p->cart)) ) {
 		if (!memitemdata_to_sql(p->cart, MAX_CART, p->char_id, TABLE_CART))
 			strcat(save_status, " cart");
 		else
@@ -526,7 +550,7 @@ int mmo_char_tosql(int char_id, struct mmo_charstatus *p)
 	}
 
 	//Map storage data
-	if( memcmp(p->storage.items, cp->storage.items, sizeof(p->storage.items)) ) {
+	if( (sections&CHARSAVE_STORAGE) && memcmp(p->storage.items, cp->storage.items, sizeof(p->storage.items)) ) {
 		if (!memitemdata_to_sql(p->storage.items, MAX_STORAGE, p->account_id, TABLE_STORAGE))
 			strcat(save_status, " storage");
 		else
@@ -627,7 +651,7 @@ int mmo_char_tosql(int char_id, struct mmo_charstatus *p)
 	}
 
 	//Memo points
-	if( memcmp(p->memo_point, cp->memo_point, sizeof(p->memo_point)) ) {
+	if( (sections&CHARSAVE_MEMO) && memcmp(p->memo_point, cp->memo_point, sizeof(p->memo_point)) ) {
 		char esc_mapname[NAME_LENGTH * 2 + 1];
 
 		//`memo` (`memo_id`,`char_id`,`map`,`x`,`y`)
@@ -658,13 +682,13 @@ int mmo_char_tosql(int char_id, struct mmo_charstatus *p)
 	}
 
 	//FIXME: is this neccessary? [ultramage]
-	for( i = 0; i < MAX_SKILL; i++ )
+	for( i = 0; i < MAX_SKILL && (sections&CHARSAVE_SKILL); i++ )
 		if( (p->skill[i].lv != 0) && (p->skill[i].id == 0) )
 			p->skill[i].id = i; //Fix skill tree
 
 
 	//Skills
-	if( memcmp(p->skill, cp->skill, sizeof(p->skill)) ) {
+	if( (sections&CHARSAVE_SKILL) && memcmp(p->skill, cp->skill, sizeof(p->skill)) ) {
 		//`skill` (`char_id`, `id`, `lv`)
 		if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `char_id`='%d'", skill_db, p->char_id) ) {
 			Sql_ShowDebug(sql_handle);
@@ -700,7 +724,7 @@ int mmo_char_tosql(int char_id, struct mmo_charstatus *p)
 	}
 
 	diff = 0;
-	for( i = 0; i < MAX_FRIENDS; i++ ) {
+	for( i = 0; i < MAX_FRIENDS && (sections&CHARSAVE_FRIENDS); i++ ) {
 		if( p->friends[i].char_id != cp->friends[i].char_id ||
 			p->friends[i].account_id != cp->friends[i].account_id ) {
 			diff = 1;
@@ -738,7 +762,7 @@ int mmo_char_tosql(int char_id, struct mmo_charstatus *p)
 	StringBuf_Clear(&buf);
 	StringBuf_Printf(&buf, "REPLACE INTO `%s` (`char_id`, `hotkey`, `type`, `itemskill_id`, `skill_lvl`) VALUES ", hotkey_db);
 	diff = 0;
-	for( i = 0; i < ARRAYLENGTH(p->hotkeys); i++ ) {
+	for( i = 0; i < ARRAYLENGTH(p->hotkeys) && (sections&CHARSAVE_HOTKEYS); i++ ) {
 		if( memcmp(&p->hotkeys[i], &cp->hotkeys[i], sizeof(struct hotkey)) ) {
 			if( diff )
 				StringBuf_AppendStr(&buf, ",");// not the first hotkey
@@ -754,45 +778,125 @@ int mmo_char_tosql(int char_id, struct mmo_charstatus *p)
 			strcat(save_status, " hotkeys");
 	}
 #endif
+	if( recording )
+		inter_writer_end();
 	StringBuf_Destroy(&buf);
 	if( save_status[0] != '\0' && save_log )
 		ShowInfo("Saved char %d - %s:%s.\n", char_id, p->name, save_status);
-	if( !errors )
-		memcpy(cp, p, sizeof(struct mmo_charstatus));
-	return 0;
+	if( !errors ) {
+		memcpy(cached, p, sizeof(struct mmo_charstatus));
+		idb_remove(char_resave_db, char_id);
+	}
+	if( cp != cached )
+		aFree(cp);
+	return errors;
 }
 
-/// Saves an array of 'item' entries into the specified table.
-int memitemdata_to_sql(const struct item items[], int max, int id, int tableswitch)
+/// Rows of an item table of an owner, as they are in the database.
+/// rows[i] is the row of the item of slot i at the last load or save, item.id
+/// being the `id` of the row (0 for an empty slot).
+/// While a recorded save is queued (save_workers), its new rows have no id yet.
+struct item_rows {
+	int max;
+	int pending; // New rows waiting for their id (memitemdata_written)
+	uint32 generation; // Changed at each memitemdata_cache
+	struct item rows[1];
+};
+static DBMap *item_rows_db[TABLE_MAX]; // int id -> struct item_rows*
+static uint32 item_rows_generation;
+
+/// Remembers the rows of items that were just read from the table, in slot order.
+void memitemdata_cache(const struct item items[], int max, int id, int tableswitch)
 {
-	StringBuf buf;
-	SqlStmt *stmt;
-	int i;
-	int j;
-	const char *tablename;
-	const char *selectoption;
-	struct item item; // Temp storage variable
-	bool *flag; // Bit array for inventory matching
-	bool found;
-	int errors = 0;
+	struct item_rows *ir;
 
-	switch (tableswitch) {
-		case TABLE_INVENTORY:     tablename = inventory_db;     selectoption = "char_id";    break;
-		case TABLE_CART:          tablename = cart_db;          selectoption = "char_id";    break;
-		case TABLE_STORAGE:       tablename = storage_db;       selectoption = "account_id"; break;
-		case TABLE_GUILD_STORAGE: tablename = guild_storage_db; selectoption = "guild_id";   break;
-		default:
-			ShowError("Invalid table name!\n");
-			return 1;
+	if( tableswitch < 0 || tableswitch >= TABLE_MAX )
+		return;
+	ir = (struct item_rows *)idb_get(item_rows_db[tableswitch], id);
+	if( ir == NULL || ir->max != max ) {
+		ir = (struct item_rows *)aMalloc(sizeof(struct item_rows) + (max - 1) * sizeof(struct item));
+		ir->max = max;
+		idb_put(item_rows_db[tableswitch], id, ir);
+	}
+	memcpy(ir->rows, items, max * sizeof(struct item));
+	ir->pending = 0;
+	ir->generation = ++item_rows_generation;
+}
+
+/// Forgets the rows of an owner (all owners if id is -1), after the table was changed by other means.
+/// The next save reads them again.
+void memitemdata_uncache(int id, int tableswitch)
+{
+	if( tableswitch < 0 || tableswitch >= TABLE_MAX )
+		return;
+	if( id == -1 )
+		db_clear(item_rows_db[tableswitch]);
+	else
+		idb_remove(item_rows_db[tableswitch], id);
+}
+
+/// Called when a recorded save of item rows was written (see inter_writer_hook).
+/// 'values' are the ids of the new rows, in the order of the INSERT.
+/// 'data' is the generation and the table of the cached rows.
+static void memitemdata_written(int id, intptr_t data, const int *values, int count)
+{
+	int tableswitch = (int)(data&0xF);
+	struct item_rows *ir = (struct item_rows *)idb_get(item_rows_db[tableswitch], id);
+	int i = 0, n;
+
+	if( ir == NULL )
+		return;
+	if( count < 0 ) { //The rows are not what was cached, read them again at the next save
+		memitemdata_uncache(id, tableswitch);
+		return;
+	}
+	if( ((ir->generation<<4)|tableswitch) != (uint32)data || !ir->pending )
+		return; //Cached again since
+	for( n = 0; n < count; n++ ) {
+		ARR_FIND(i, ir->max, i, ir->rows[i].nameid && !ir->rows[i].id);
+		if( i == ir->max )
+			break;
+		ir->rows[i].id = values[n];
 	}
+	if( n == ir->pending )
+		ir->pending = 0;
+	else
+		memitemdata_uncache(id, tableswitch);
+}
+
+/// Whether two items are the same item (can be the same row).
+static bool memitemdata_same(const struct item *a, const struct item *b)
+{
+	int j;
 
-	// The following code compares inventory with current database values
-	// and performs modification/deletion/insertion only on relevant rows.
-	// This approach is more complicated than a trivial delete&insert, but
-	// it significantly reduces cpu load on the database server.
+	if( a->nameid != b->nameid )
+		return false;
+	ARR_FIND(0, MAX_SLOTS, j, a->card[j] != b->card[j]);
+	return (j == MAX_SLOTS);
+}
 
+/// Whether the row of an item must be updated.
+static bool memitemdata_changed(const struct item *a, const struct item *b, bool favorite)
+{
+	return ( a->amount != b->amount || a->equip != b->equip || a->identify != b->identify ||
+		a->refine != b->refine || a->attribute != b->attribute || a->expire_time != b->expire_time ||
+		a->bound != b->bound || a->unique_id != b->unique_id || (favorite && a->favorite != b->favorite) );
+}
+
+/// Reads the rows of an owner into a new array.
+/// Returns the number of rows, or -1 on error.
+static int memitemdata_fromsql(struct item **out, const char *tablename, const char *selectoption, int id, bool favorite)
+{
+	StringBuf buf;
+	SqlStmt *stmt;
+	struct item item;
+	int count = 0, size = 0;
+	int j;
+
+	*out = NULL;
+	memset(&item, 0, sizeof(item));
 	StringBuf_Init(&buf);
-	StringBuf_AppendStr(&buf, "SELECT `id`, `nameid`, `amount`, `equip`, `identify`, `refine`, `attribute`, `expire_time`, `bound`, `unique_id`");
+	StringBuf_Printf(&buf, "SELECT `id`, `nameid`, `amount`, `equip`, `identify`, `refine`, `attribute`, `expire_time`, `bound`, `unique_id`, %s", (favorite ? "`favorite`" : "'0'"));
 	for( j = 0; j < MAX_SLOTS; ++j )
 		StringBuf_Printf(&buf, ", `card%d`", j);
 	StringBuf_Printf(&buf, " FROM `%s` WHERE `%s`='%d'", tablename, selectoption, id);
@@ -802,253 +906,269 @@ int memitemdata_to_sql(const struct item items[], int max, int id, int tableswit
 		SqlStmt_ShowDebug(stmt);
 		SqlStmt_Free(stmt);
 		StringBuf_Destroy(&buf);
-		return 1;
+		return -1;
 	}
+	StringBuf_Destroy(&buf);
 
-	SqlStmt_BindColumn(stmt, 0, SQLDT_INT,          &item.id,          0, NULL, NULL);
-	SqlStmt_BindColumn(stmt, 1, SQLDT_USHORT,       &item.nameid,      0, NULL, NULL);
-	SqlStmt_BindColumn(stmt, 2, SQLDT_SHORT,        &item.amount,      0, NULL, NULL);
-	SqlStmt_BindColumn(stmt, 3, SQLDT_UINT,         &item.equip,       0, NULL, NULL);
-	SqlStmt_BindColumn(stmt, 4, SQLDT_CHAR,         &item.identify,    0, NULL, NULL);
-	SqlStmt_BindColumn(stmt, 5, SQLDT_CHAR,         &item.refine,      0, NULL, NULL);
-	SqlStmt_BindColumn(stmt, 6, SQLDT_CHAR,         &item.attribute,   0, NULL, NULL);
-	SqlStmt_BindColumn(stmt, 7, SQLDT_UINT,         &item.expire_time, 0, NULL, NULL);
-	SqlStmt_BindColumn(stmt, 8, SQLDT_UINT,         &item.bound,       0, NULL, NULL);
-	SqlStmt_BindColumn(stmt, 9, SQLDT_UINT64,       &item.unique_id,   0, NULL, NULL);
+	SqlStmt_BindColumn(stmt, 0,  SQLDT_INT,          &item.id,          0, NULL, NULL);
+	SqlStmt_BindColumn(stmt, 1,  SQLDT_USHORT,       &item.nameid,      0, NULL, NULL);
+	SqlStmt_BindColumn(stmt, 2,  SQLDT_SHORT,        &item.amount,      0, NULL, NULL);
+	SqlStmt_BindColumn(stmt, 3,  SQLDT_UINT,         &item.equip,       0, NULL, NULL);
+	SqlStmt_BindColumn(stmt, 4,  SQLDT_CHAR,         &item.identify,    0, NULL, NULL);
+	SqlStmt_BindColumn(stmt, 5,  SQLDT_CHAR,         &item.refine,      0, NULL, NULL);
+	SqlStmt_BindColumn(stmt, 6,  SQLDT_CHAR,         &item.attribute,   0, NULL, NULL);
+	SqlStmt_BindColumn(stmt, 7,  SQLDT_UINT,         &item.expire_time, 0, NULL, NULL);
+	SqlStmt_BindColumn(stmt, 8,  SQLDT_CHAR,         &item.bound,       0, NULL, NULL);
+	SqlStmt_BindColumn(stmt, 9,  SQLDT_UINT64,       &item.unique_id,   0, NULL, NULL);
+	SqlStmt_BindColumn(stmt, 10, SQLDT_CHAR,         &item.favorite,    0, NULL, NULL);
 	for( j = 0; j < MAX_SLOTS; ++j )
-		SqlStmt_BindColumn(stmt, 10+j, SQLDT_USHORT, &item.card[j],     0, NULL, NULL);
-
-	// Bit array indicating which inventory items have already been matched
-	flag = (bool*) aCalloc(max, sizeof(bool));
+		SqlStmt_BindColumn(stmt, 11+j, SQLDT_USHORT, &item.card[j],     0, NULL, NULL);
 
 	while( SQL_SUCCESS == SqlStmt_NextRow(stmt) ) {
-		found = false;
-		// Search for the presence of the item in the char's inventory
-		for( i = 0; i < max; ++i ) {
-			// Skip empty and already matched entries
-			if( items[i].nameid == 0 || flag[i] )
-				continue;
-
-			if( items[i].nameid == item.nameid &&
-				items[i].card[0] == item.card[0] &&
-				items[i].card[2] == item.card[2] &&
-				items[i].card[3] == item.card[3] )
-			{ // They are the same item.
-				ARR_FIND(0, MAX_SLOTS, j, items[i].card[j] != item.card[j]);
-				if( j == MAX_SLOTS &&
-					items[i].amount == item.amount &&
-					items[i].equip == item.equip &&
-					items[i].identify == item.identify &&
-					items[i].refine == item.refine &&
-					items[i].attribute == item.attribute &&
-					items[i].expire_time == item.expire_time &&
-					items[i].bound == item.bound &&
-					items[i].unique_id == item.unique_id )
-					; // Do nothing.
-				else {
-					// Update all fields.
-					StringBuf_Clear(&buf);
-					StringBuf_Printf(&buf, "UPDATE `%s` SET `amount`='%d', `equip`='%d', `identify`='%d', `refine`='%d',`attribute`='%d', `expire_time`='%u', `bound`='%d', `unique_id`='%"PRIu64"'",
-						tablename, items[i].amount, items[i].equip, items[i].identify, items[i].refine, items[i].attribute, items[i].expire_time, items[i].bound, items[i].unique_id);
-					for( j = 0; j < MAX_SLOTS; ++j )
-						StringBuf_Printf(&buf, ", `card%d`=%hu", j, items[i].card[j]);
-					StringBuf_Printf(&buf, " WHERE `id`='%d' LIMIT 1", item.id);
-
-					if( SQL_ERROR == Sql_QueryStr(sql_handle, StringBuf_Value(&buf)) ) {
-						Sql_ShowDebug(sql_handle);
-						errors++;
-					}
-				}
-
-				found = flag[i] = true; // Item dealt with.
-				break; // Skip to next item in the db.
-			}
-		}
-		if( !found ) { // Item not present in inventory, remove it.
-			if( SQL_ERROR == Sql_Query(sql_handle, "DELETE from `%s` where `id`='%d' LIMIT 1", tablename, item.id) ) {
-				Sql_ShowDebug(sql_handle);
-				errors++;
-			}
+		if( count == size ) {
+			size += 32;
+			RECREATE(*out, struct item, size);
 		}
+		memcpy(&(*out)[count++], &item, sizeof(item));
 	}
 	SqlStmt_Free(stmt);
+	return count;
+}
 
-	StringBuf_Clear(&buf);
-	StringBuf_Printf(&buf, "INSERT INTO `%s`(`%s`, `nameid`, `amount`, `equip`, `identify`, `refine`, `attribute`, `expire_time`, `bound`, `unique_id`", tablename, selectoption);
-	for( j = 0; j < MAX_SLOTS; ++j )
-		StringBuf_Printf(&buf, ", `card%d`", j);
-	StringBuf_AppendStr(&buf, ") VALUES ");
-
-	found = false;
-	// Insert non-matched items into the db as new items
-	for( i = 0; i < max; ++i ) {
-		// Skip empty and already matched entries
-		if( !(items[i].nameid) || flag[i] )
-			continue;
-
-		if( found )
-			StringBuf_AppendStr(&buf, ",");
-		else
-			found = true;
-
-		StringBuf_Printf(&buf, "('%d', '%hu', '%d', '%d', '%d', '%d', '%d', '%u', '%d', '%"PRIu64"'",
-			id, items[i].nameid, items[i].amount, items[i].equip, items[i].identify, items[i].refine, items[i].attribute, items[i].expire_time, items[i].bound, items[i].unique_id);
-		for( j = 0; j < MAX_SLOTS; ++j )
-			StringBuf_Printf(&buf, ", '%hu'", items[i].card[j]);
-		StringBuf_AppendStr(&buf, ")");
-	}
+/// Appends the values of the columns of an item row.
+static void memitemdata_values(StringBuf *buf, const struct item *item, int owner, bool favorite)
+{
+	int j;
 
-	if( found && SQL_ERROR == Sql_QueryStr(sql_handle, StringBuf_Value(&buf)) ) {
-		Sql_ShowDebug(sql_handle);
-		errors++;
-	}
+	StringBuf_AppendStr(buf, "(");
+	if( item->id )
+		StringBuf_Printf(buf, "'%d', ", item->id);
+	StringBuf_Printf(buf, "'%d', '%hu', '%d', '%u', '%d', '%d', '%d', '%u', '%d', '%"PRIu64"'",
+		owner, item->nameid, item->amount, item->equip, item->identify, item->refine, item->attribute, item->expire_time, item->bound, item->unique_id);
+	if( favorite )
+		StringBuf_Printf(buf, ", '%d'", item->favorite);
+	for( j = 0; j < MAX_SLOTS; ++j )
+		StringBuf_Printf(buf, ", '%hu'", item->card[j]);
+	StringBuf_AppendStr(buf, ")");
+}
 
-	StringBuf_Destroy(&buf);
-	aFree(flag);
+/// Appends the start of an INSERT of item rows.
+static void memitemdata_insert(StringBuf *buf, const char *tablename, const char *selectoption, bool id, bool favorite)
+{
+	int j;
 
-	return errors;
+	StringBuf_Printf(buf, "INSERT INTO `%s` (%s`%s`, `nameid`, `amount`, `equip`, `identify`, `refine`, `attribute`, `expire_time`, `bound`, `unique_id`", tablename, (id ? "`id`, " : ""), selectoption);
+	if( favorite )
+		StringBuf_AppendStr(buf, ", `favorite`");
+	for( j = 0; j < MAX_SLOTS; ++j )
+		StringBuf_Printf(buf, ", `card%d`", j);
+	StringBuf_AppendStr(buf, ") VALUES ");
 }
 
-/**
- * Pretty much a copy of memitemdata_to_sql except it handles inventory_db exclusively,
- * this is required because inventory db is the only one with the 'favorite' column.
- */
-int inventory_to_sql(const struct item items[], int max, int id) {
+/// Saves an array of 'item' entries into the specified table.
+///
+/// The items are compared with the rows of the owner that the char-server
+/// remembers (memitemdata_cache, or read once when it has none), and only the
+/// changes are written, in one transaction:
+/// one DELETE of the removed rows, one INSERT ... ON DUPLICATE KEY UPDATE of the
+/// changed rows and one INSERT of the new rows, whose ids are then read back.
+/// While a save is recorded (save_workers), the statements are part of its
+/// transaction and the ids are read back when it is written (memitemdata_written).
+/// Returns the number of errors; the rows are read again at the next save after one.
+int memitemdata_to_sql(const struct item items[], int max, int id, int tableswitch)
+{
 	StringBuf buf;
-	SqlStmt *stmt;
-	int i;
-	int j;
-	struct item item; // Temp storage variable
-	bool *flag; // Bit array for inventory matching
-	bool found;
+	const char *tablename;
+	const char *selectoption;
+	struct item_rows *ir;
+	struct item *old; // Rows in the database
+	int count; // Number of rows in 'old'
+	struct item *loaded = NULL;
+	int *slot_row; // Index in 'old' of the row of each slot, -1 if none
+	bool *matched; // Rows of 'old' that have an item
+	bool favorite = (tableswitch == TABLE_INVENTORY); // Only the inventory has the 'favorite' column
+	int deleted = 0, updated = 0, inserted = 0;
+	int i, k;
 	int errors = 0;
+	bool recording = inter_writer_recording();
 
-	// The following code compares inventory with current database values
-	// and performs modification/deletion/insertion only on relevant rows.
-	// This approach is more complicated than a trivial delete&insert, but
-	// it significantly reduces cpu load on the database server.
-
-	StringBuf_Init(&buf);
-	StringBuf_AppendStr(&buf, "SELECT `id`, `nameid`, `amount`, `equip`, `identify`, `refine`, `attribute`, `expire_time`, `favorite`, `bound`, `unique_id`");
-	for( j = 0; j < MAX_SLOTS; ++j )
-		StringBuf_Printf(&buf, ", `card%d`", j);
-	StringBuf_Printf(&buf, " FROM `%s` WHERE `char_id`='%d'", inventory_db, id);
-
-	stmt = SqlStmt_Malloc(sql_handle);
-	if( SQL_ERROR == SqlStmt_PrepareStr(stmt, StringBuf_Value(&buf)) || SQL_ERROR == SqlStmt_Execute(stmt) ) {
-		SqlStmt_ShowDebug(stmt);
-		SqlStmt_Free(stmt);
-		StringBuf_Destroy(&buf);
-		return 1;
+	switch (tableswitch) {
+		case TABLE_INVENTORY:     tablename = inventory_db;     selectoption = "char_id";    break;
+		case TABLE_CART:          tablename = cart_db;          selectoption = "char_id";    break;
+		case TABLE_STORAGE:       tablename = storage_db;       selectoption = "account_id"; break;
+		case TABLE_GUILD_STORAGE: tablename = guild_storage_db; selectoption = "guild_id";   break;
+		default:
+			ShowError("Invalid table name!\n");
+			return 1;
 	}
 
-	SqlStmt_BindColumn(stmt, 0,  SQLDT_INT,           &item.id,          0, NULL, NULL);
-	SqlStmt_BindColumn(stmt, 1,  SQLDT_USHORT,        &item.nameid,      0, NULL, NULL);
-	SqlStmt_BindColumn(stmt, 2,  SQLDT_SHORT,         &item.amount,      0, NULL, NULL);
-	SqlStmt_BindColumn(stmt, 3,  SQLDT_UINT,          &item.equip,       0, NULL, NULL);
-	SqlStmt_BindColumn(stmt, 4,  SQLDT_CHAR,          &item.identify,    0, NULL, NULL);
-	SqlStmt_BindColumn(stmt, 5,  SQLDT_CHAR,          &item.refine,      0, NULL, NULL);
-	SqlStmt_BindColumn(stmt, 6,  SQLDT_CHAR,          &item.attribute,   0, NULL, NULL);
-	SqlStmt_BindColumn(stmt, 7,  SQLDT_UINT,          &item.expire_time, 0, NULL, NULL);
-	SqlStmt_BindColumn(stmt, 8,  SQLDT_CHAR,          &item.favorite,    0, NULL, NULL);
-	SqlStmt_BindColumn(stmt, 9,  SQLDT_CHAR,          &item.bound,       0, NULL, NULL);
-	SqlStmt_BindColumn(stmt, 10, SQLDT_UINT64,        &item.unique_id,   0, NULL, NULL);
-	for( j = 0; j < MAX_SLOTS; ++j )
-		SqlStmt_BindColumn(stmt, 11+j, SQLDT_USHORT, &item.card[j],     0, NULL, NULL);
+	ir = (struct item_rows *)idb_get(item_rows_db[tableswitch], id);
+	if( recording && (ir == NULL || ir->max != max || ir->pending) ) {
+		//The rows are read, or get their ids, after the queued saves of the owner
+		inter_writer_sync();
+		ir = (struct item_rows *)idb_get(item_rows_db[tableswitch], id);
+	}
+	if( ir != NULL && ir->max == max && !ir->pending ) {
+		old = ir->rows;
+		count = max;
+	} else if( (count = memitemdata_fromsql(&loaded, tablename, selectoption, id, favorite)) >= 0 )
+		old = loaded;
+	else
+		return 1;
 
-	// Bit array indicating which inventory items have already been matched
-	flag = (bool*)aCalloc(max, sizeof(bool));
+	slot_row = (int *)aMalloc(max * sizeof(int));
+	matched = (bool *)aCalloc(count + 1, sizeof(bool));
 
-	while( SQL_SUCCESS == SqlStmt_NextRow(stmt) ) {
-		found = false;
-		// Search for the presence of the item in the char's inventory
-		for( i = 0; i < max; ++i ) {
-			// Skip empty and already matched entries
-			if( items[i].nameid == 0 || flag[i] )
-				continue;
+	// Items that kept their slot
+	for( i = 0; i < max; ++i ) {
+		slot_row[i] = -1;
+		if( items[i].nameid && i < count && old[i].id && memitemdata_same(&items[i], &old[i]) ) {
+			slot_row[i] = i;
+			matched[i] = true;
+		}
+	}
+	// Items that moved
+	for( i = 0; i < max; ++i ) {
+		if( !items[i].nameid || slot_row[i] != -1 )
+			continue;
+		ARR_FIND(0, count, k, !matched[k] && old[k].id && memitemdata_same(&items[i], &old[k]));
+		if( k < count ) {
+			slot_row[i] = k;
+			matched[k] = true;
+		}
+	}
 
-			if( items[i].nameid == item.nameid &&
-				items[i].card[0] == item.card[0] &&
-				items[i].card[2] == item.card[2] &&
-				items[i].card[3] == item.card[3] )
-			{ // They are the same item.
-				ARR_FIND(0, MAX_SLOTS, j, items[i].card[j] != item.card[j]);
-				if( j == MAX_SLOTS &&
-					items[i].amount == item.amount &&
-					items[i].equip == item.equip &&
-					items[i].identify == item.identify &&
-					items[i].refine == item.refine &&
-					items[i].attribute == item.attribute &&
-					items[i].expire_time == item.expire_time &&
-					items[i].favorite == item.favorite &&
-					items[i].bound == item.bound &&
-					items[i].unique_id == item.unique_id )
-					; // Do nothing.
-				else {
-					// Update all fields.
-					StringBuf_Clear(&buf);
-					StringBuf_Printf(&buf, "UPDATE `%s` SET `amount`='%d', `equip`='%d', `identify`='%d', `refine`='%d',`attribute`='%d', `expire_time`='%u', `favorite`='%d', `bound`='%d', `unique_id`='%"PRIu64"'",
-						inventory_db, items[i].amount, items[i].equip, items[i].identify, items[i].refine, items[i].attribute, items[i].expire_time, items[i].favorite, items[i].bound, items[i].unique_id);
-					for( j = 0; j < MAX_SLOTS; ++j )
-						StringBuf_Printf(&buf, ", `card%d`=%hu", j, items[i].card[j]);
-					StringBuf_Printf(&buf, " WHERE `id`='%d' LIMIT 1", item.id);
-
-					if( SQL_ERROR == Sql_QueryStr(sql_handle, StringBuf_Value(&buf)) ) {
-						Sql_ShowDebug(sql_handle);
-						errors++;
-					}
-				}
+	StringBuf_Init(&buf);
+	if( !recording && SQL_ERROR == Sql_QueryStr(sql_handle, "START TRANSACTION") ) {
+		Sql_ShowDebug(sql_handle);
+		errors++;
+	}
 
-				found = flag[i] = true; // Item dealt with.
-				break; // Skip to next item in the db.
-			}
-		}
-		if( !found ) { // Item not present in inventory, remove it.
-			if( SQL_ERROR == Sql_Query(sql_handle, "DELETE from `%s` where `id`='%d' LIMIT 1", inventory_db, item.id) ) {
-				Sql_ShowDebug(sql_handle);
-				errors++;
-			}
+	// Rows without an item
+	for( k = 0; k < count && !errors; ++k ) {
+		if( !old[k].id || matched[k] )
+			continue;
+		if( deleted++ )
+			StringBuf_AppendStr(&buf, ",");
+		else
+			StringBuf_Printf(&buf, "DELETE FROM `%s` WHERE `id` IN (", tablename);
+		StringBuf_Printf(&buf, "'%d'", old[k].id);
+	}
+	if( deleted ) {
+		StringBuf_AppendStr(&buf, ")");
+		if( SQL_ERROR == Sql_QueryStr(sql_handle, StringBuf_Value(&buf)) ) {
+			Sql_ShowDebug(sql_handle);
+			errors++;
 		}
 	}
-	SqlStmt_Free(stmt);
 
+	// Rows of changed items
 	StringBuf_Clear(&buf);
-	StringBuf_Printf(&buf, "INSERT INTO `%s` (`char_id`, `nameid`, `amount`, `equip`, `identify`, `refine`, `attribute`, `expire_time`, `favorite`, `bound`, `unique_id`", inventory_db);
-	for( j = 0; j < MAX_SLOTS; ++j )
-		StringBuf_Printf(&buf, ", `card%d`", j);
-	StringBuf_AppendStr(&buf, ") VALUES ");
+	for( i = 0; i < max && !errors; ++i ) {
+		struct item tmp;
 
-	found = false;
-	// Insert non-matched items into the db as new items
-	for( i = 0; i < max; ++i ) {
-		// Skip empty and already matched entries
-		if( items[i].nameid == 0 || flag[i] )
+		if( slot_row[i] == -1 || !memitemdata_changed(&items[i], &old[slot_row[i]], favorite) )
 			continue;
-
-		if( found )
+		if( updated++ )
 			StringBuf_AppendStr(&buf, ",");
 		else
-			found = true;
-
-		StringBuf_Printf(&buf, "('%d', '%hu', '%d', '%d', '%d', '%d', '%d', '%u', '%d', '%d', '%"PRIu64"'",
-			id, items[i].nameid, items[i].amount, items[i].equip, items[i].identify, items[i].refine, items[i].attribute, items[i].expire_time, items[i].favorite, items[i].bound, items[i].unique_id);
-		for( j = 0; j < MAX_SLOTS; ++j )
-			StringBuf_Printf(&buf, ", '%hu'", items[i].card[j]);
-		StringBuf_AppendStr(&buf, ")");
+			memitemdata_insert(&buf, tablename, selectoption, true, favorite);
+		memcpy(&tmp, &items[i], sizeof(tmp));
+		tmp.id = old[slot_row[i]].id;
+		memitemdata_values(&buf, &tmp, id, favorite);
+	}
+	if( updated ) {
+		StringBuf_AppendStr(&buf, " ON DUPLICATE KEY UPDATE `amount`=VALUES(`amount`), `equip`=VALUES(`equip`), `identify`=VALUES(`identify`), `refine`=VALUES(`refine`),"
+			" `attribute`=VALUES(`attribute`), `expire_time`=VALUES(`expire_time`), `bound`=VALUES(`bound`), `unique_id`=VALUES(`unique_id`)");
+		if( favorite )
+			StringBuf_AppendStr(&buf, ", `favorite`=VALUES(`favorite`)");
+		if( SQL_ERROR == Sql_QueryStr(sql_handle, StringBuf_Value(&buf)) ) {
+			Sql_ShowDebug(sql_handle);
+			errors++;
+		}
 	}
 
-	if( found && SQL_ERROR == Sql_QueryStr(sql_handle, StringBuf_Value(&buf)) ) {
+	// Rows of new items
+	StringBuf_Clear(&buf);
+	for( i = 0; i < max && !errors; ++i ) {
+		struct item tmp;
+
+		if( !items[i].nameid || slot_row[i] != -1 )
+			continue;
+		if( inserted++ )
+			StringBuf_AppendStr(&buf, ",");
+		else
+			memitemdata_insert(&buf, tablename, selectoption, false, favorite);
+		memcpy(&tmp, &items[i], sizeof(tmp));
+		tmp.id = 0;
+		memitemdata_values(&buf, &tmp, id, favorite);
+	}
+	if( inserted && SQL_ERROR == Sql_QueryStr(sql_handle, StringBuf_Value(&buf)) ) {
 		Sql_ShowDebug(sql_handle);
 		errors++;
 	}
 
+	if( errors || (!recording && SQL_ERROR == Sql_QueryStr(sql_handle, "COMMIT")) ) {
+		if( !errors++ )
+			Sql_ShowDebug(sql_handle);
+		Sql_QueryStr(sql_handle, "ROLLBACK");
+	}
+
+	if( !errors ) { // Remember the rows as they are now
+		struct item *rows = (struct item *)aCalloc(max, sizeof(struct item));
+
+		for( i = 0; i < max; ++i ) {
+			if( !items[i].nameid )
+				continue;
+			memcpy(&rows[i], &items[i], sizeof(struct item));
+			rows[i].id = (slot_row[i] != -1 ? old[slot_row[i]].id : 0);
+			if( !favorite )
+				rows[i].favorite = 0;
+		}
+		if( recording ) { // The new rows get their ids once the save is written
+			memitemdata_cache(rows, max, id, tableswitch);
+			ir = (struct item_rows *)idb_get(item_rows_db[tableswitch], id);
+			ir->pending = inserted;
+			StringBuf_Clear(&buf);
+			StringBuf_Printf(&buf, "SELECT `id` FROM `%s` WHERE `%s`='%d' AND `id`>=LAST_INSERT_ID() ORDER BY `id` LIMIT %d", tablename, selectoption, id, inserted);
+			inter_writer_hook(memitemdata_written, id, (intptr_t)((ir->generation<<4)|tableswitch), (inserted ? StringBuf_Value(&buf) : NULL), inserted);
+		} else {
+			uint64 first_id = (inserted ? Sql_LastInsertId(sql_handle) : 0);
+			int n = 0;
+
+			// The new rows get increasing ids, in the order of the INSERT
+			if( inserted && SQL_SUCCESS == Sql_Query(sql_handle, "SELECT `id` FROM `%s` WHERE `%s`='%d' AND `id`>='%"PRIu64"' ORDER BY `id` LIMIT %d", tablename, selectoption, id, first_id, inserted) ) {
+				char *data;
+
+				i = 0;
+				while( SQL_SUCCESS == Sql_NextRow(sql_handle) ) {
+					ARR_FIND(i, max, i, rows[i].nameid && !rows[i].id);
+					if( i == max )
+						break;
+					Sql_GetData(sql_handle, 0, &data, NULL);
+					rows[i].id = atoi(data);
+					n++;
+				}
+				Sql_FreeResult(sql_handle);
+			}
+			if( n == inserted )
+				memitemdata_cache(rows, max, id, tableswitch);
+			else // Read again at the next save
+				memitemdata_uncache(id, tableswitch);
+		}
+		aFree(rows);
+	} else
+		memitemdata_uncache(id, tableswitch);
+
 	StringBuf_Destroy(&buf);
-	aFree(flag);
+	aFree(matched);
+	aFree(slot_row);
+	if( loaded )
+		aFree(loaded);
 
 	return errors;
 }
 
-
 int mmo_char_tobuf(uint8 *buf, struct mmo_charstatus *p);
 
 //=====================================================================================================
@@ -1060,6 +1180,7 @@ int mmo_chars_fromsql(struct char_session_data *sd, uint8 *buf)
 	int j = 0, i;
 	char last_map[MAP_NAME_LENGTH_EXT];
 
+	inter_writer_flush(WRITER_ACCOUNT, sd->account_id);
 	stmt = SqlStmt_Malloc(sql_handle);
 	if( stmt == NULL ) {
 		SqlStmt_ShowDebug(stmt);
@@ -1258,6 +1379,11 @@ int mmo_char_fromsql(int char_id, struct mmo_charstatus *p, bool load_everything
 		return 0;
 	}
 
+	if( inter_writer_flush(WRITER_ACCOUNT, p->account_id) ) { //Saves of the account were queued, read what they wrote
+		SqlStmt_Free(stmt);
+		return mmo_char_fromsql(char_id, p, load_everything);
+	}
+
 	p->last_point.map = mapindex_name2id(last_map);
 	p->save_point.map = mapindex_name2id(save_map);
 
@@ -1435,13 +1561,20 @@ int mmo_char_fromsql(int char_id, struct mmo_charstatus *p, bool load_everything
 
 	cp = idb_ensure(char_db_, char_id, create_charstatus);
 	memcpy(cp, p, sizeof(struct mmo_charstatus));
+	memitemdata_cache(p->inventory, MAX_INVENTORY, char_id, TABLE_INVENTORY);
+	memitemdata_cache(p->cart, MAX_CART, char_id, TABLE_CART);
 	return 1;
 }
 
 //==========================================================================================================
 int mmo_char_sql_init(void)
 {
-	char_db_= idb_alloc(DB_OPT_RELEASE_DATA);
+	int i;
+
+	char_db_= idb_alloc(DB_OPT_RELEASE_DATA|DB_OPT_FLAT);
+	char_resave_db = idb_alloc(DB_OPT_BASE);
+	for( i = 0; i < TABLE_MAX; i++ )
+		item_rows_db[i] = idb_alloc(DB_OPT_RELEASE_DATA);
 
 	//the 'set offline' part is now in check_login_conn ...
 	//if the server connects to loginserver
@@ -1658,10 +1791,13 @@ int divorce_char_sql(int partner_id1, int partner_id2)
 {
 	unsigned char buf[64];
 
+	inter_writer_flush(WRITER_ACCOUNT, -1); //The partners are in other accounts
 	if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `partner_id`='0' WHERE `char_id`='%d' OR `char_id`='%d' LIMIT 2", char_db, partner_id1, partner_id2) )
 		Sql_ShowDebug(sql_handle);
 	if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE (`nameid`='%hu' OR `nameid`='%hu') AND (`char_id`='%d' OR `char_id`='%d') LIMIT 2", inventory_db, WEDDING_RING_M, WEDDING_RING_F, partner_id1, partner_id2) )
 		Sql_ShowDebug(sql_handle);
+	memitemdata_uncache(partner_id1, TABLE_INVENTORY);
+	memitemdata_uncache(partner_id2, TABLE_INVENTORY);
 
 	WBUFW(buf,0) = 0x2b12;
 	WBUFL(buf,2) = partner_id1;
@@ -1707,6 +1843,7 @@ int delete_char_sql(int char_id)
 
 	Sql_EscapeStringLen(sql_handle, esc_name, name, min(len, NAME_LENGTH));
 	Sql_FreeResult(sql_handle);
+	inter_writer_flush(WRITER_ACCOUNT, account_id); //Queued saves of the character are written before it is deleted
 
 	//Check for config char del condition [Lupus]
 	//@TODO: Move this out to packet processing (0x68/0x1fb).
@@ -1781,10 +1918,12 @@ int delete_char_sql(int char_id)
 	/* Delete inventory */
 	if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `char_id`='%d'", inventory_db, char_id) )
 		Sql_ShowDebug(sql_handle);
+	memitemdata_uncache(char_id, TABLE_INVENTORY);
 
 	/* Delete cart inventory */
 	if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `char_id`='%d'", cart_db, char_id) )
 		Sql_ShowDebug(sql_handle);
+	memitemdata_uncache(char_id, TABLE_CART);
 
 	/* Delete memo areas */
 	if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `char_id`='%d'", memo_db, char_id) )
@@ -2547,6 +2686,8 @@ int parse_fromlogin(int fd) {
 					if( node != NULL )
 						node->sex = sex;
 
+					inter_writer_flush(WRITER_ACCOUNT, acc);
+
 					// Get characters
 					if( SQL_ERROR == Sql_Query(sql_handle, "SELECT `char_id`,`class`,`guild_id` FROM `%s` WHERE `account_id` = '%d'", char_db, acc) )
 						Sql_ShowDebug(sql_handle);
@@ -2586,6 +2727,7 @@ int parse_fromlogin(int fd) {
 
 						if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `equip`='0' WHERE `char_id`='%d'", inventory_db, char_id[i]) )
 							Sql_ShowDebug(sql_handle);
+						memitemdata_uncache(char_id[i], TABLE_INVENTORY);
 
 						if( SQL_ERROR == Sql_Query(sql_handle,
 							"UPDATE `%s` SET `class`='%d', `weapon`='0', `shield`='0', `head_top`='0', `head_mid`='0',"
@@ -2789,6 +2931,7 @@ void char_read_fame_list(void)
 	char *data;
 	size_t len;
 
+	inter_writer_flush(WRITER_ACCOUNT, -1); //The fame of every character is read
 	// Empty ranking lists
 	memset(smith_fame_list, 0, sizeof(smith_fame_list));
 	memset(chemist_fame_list, 0, sizeof(chemist_fame_list));
@@ -3033,6 +3176,98 @@ void mapif_on_disconnect(int id)
 }
 
 
+/// Tells a map-server to send the complete character on its next save,
+/// when a partial save could not be applied or a save could not be written.
+/// 0x2b2c <aid>.L <cid>.L
+static void mapif_charsave_reset(int fd, int account_id, int char_id)
+{
+	WFIFOHEAD(fd,10);
+	WFIFOW(fd,0) = 0x2b2c;
+	WFIFOL(fd,2) = account_id;
+	WFIFOL(fd,6) = char_id;
+	WFIFOSET(fd,10);
+}
+
+
+/// Copies the changed slots of a partial save into an array
+/// <count>.W { <index>.W <slot>.?B }*
+static bool char_delta_slots(const uint8 *buf, int *offs, int len, void *array, size_t size, int max)
+{
+	int count, i;
+
+	if( *offs + 2 > len )
+		return false;
+	count = RBUFW(buf,*offs);
+	*offs += 2;
+	if( *offs + count * (2 + (int)size) > len )
+		return false;
+	for( i = 0; i < count; i++ ) {
+		int index = RBUFW(buf,*offs);
+
+		if( index >= max )
+			return false;
+		memcpy((uint8 *)array + index * size, RBUFP(buf,*offs + 2), size);
+		*offs += 2 + size;
+	}
+	return true;
+}
+
+
+/// Applies a partial save (0x2b29, see chrif_save_delta) to a character.
+/// Returns the e_charsave_section that changed, or -1 if the packet is invalid.
+static int char_delta_apply(struct mmo_charstatus *p, const uint8 *buf, int len)
+{
+	const size_t head = offsetof(struct mmo_charstatus, memo_point), tail = offsetof(struct mmo_charstatus, show_equip);
+	int sections = RBUFW(buf,12), offs = 14;
+
+	if( sections&CHARSAVE_STATUS ) {
+		if( offs + head + sizeof(struct mmo_charstatus) - tail > len )
+			return -1;
+		memcpy(p, RBUFP(buf,offs), head);
+		offs += head;
+		memcpy((uint8 *)p + tail, RBUFP(buf,offs), sizeof(struct mmo_charstatus) - tail);
+		offs += sizeof(struct mmo_charstatus) - tail;
+	}
+	if( sections&CHARSAVE_MEMO ) {
+		if( offs + sizeof(p->memo_point) > len )
+			return -1;
+		memcpy(p->memo_point, RBUFP(buf,offs), sizeof(p->memo_point));
+		offs += sizeof(p->memo_point);
+	}
+	if( (sections&CHARSAVE_INVENTORY) && !char_delta_slots(buf, &offs, len, p->inventory, sizeof(struct item), MAX_INVENTORY) )
+		return -1;
+	if( (sections&CHARSAVE_CART) && !char_delta_slots(buf, &offs, len, p->cart, sizeof(struct item), MAX_CART) )
+		return -1;
+	if( sections&CHARSAVE_STORAGE ) {
+		if( offs + 4 > len )
+			return -1;
+		p->storage.storage_amount = RBUFL(buf,offs);
+		offs += 4;
+		if( !char_delta_slots(buf, &offs, len, p->storage.items, sizeof(struct item), MAX_STORAGE) )
+			return -1;
+	}
+	if( (sections&CHARSAVE_SKILL) && !char_delta_slots(buf, &offs, len, p->skill, sizeof(struct s_skill), MAX_SKILL) )
+		return -1;
+	if( sections&CHARSAVE_FRIENDS ) {
+		if( offs + sizeof(p->friends) > len )
+			return -1;
+		memcpy(p->friends, RBUFP(buf,offs), sizeof(p->friends));
+		offs += sizeof(p->friends);
+	}
+#ifdef HOTKEY_SAVING
+	if( sections&CHARSAVE_HOTKEYS ) {
+		if( offs + sizeof(p->hotkeys) > len )
+			return -1;
+		memcpy(p->hotkeys, RBUFP(buf,offs), sizeof(p->hotkeys));
+		offs += sizeof(p->hotkeys);
+	}
+#endif
+	if( offs != len )
+		return -1;
+	return sections;
+}
+
+
 int mapif_parse_reqcharban(int fd) {
 	if( RFIFOREST(fd) < 10 + NAME_LENGTH )
 		return 0;
@@ -3383,10 +3618,12 @@ int parse_frommap(int fd)
 						struct mmo_charstatus char_dat;
 
 						memcpy(&char_dat, RFIFOP(fd,13), sizeof(struct mmo_charstatus));
-						mmo_char_tosql(cid, &char_dat);
+						if( mmo_char_tosql(cid, &char_dat, CHARSAVE_ALL) && !RFIFOB(fd,12) )
+							mapif_charsave_reset(fd, aid, cid); //The next partial save would miss what was not written
 					} else { //This may be valid on char-server reconnection, when re-sending characters that already logged off.
 						ShowError("parse_from_map (save-char): Received data for non-existant/offline character (%d:%d).\n", aid, cid);
 						set_char_online(id, cid, aid);
+						mapif_charsave_reset(fd, aid, cid);
 					}
 
 					if( RFIFOB(fd,12) ) { //Flag, set character offline after saving. [Skotlex]
@@ -3401,6 +3638,33 @@ int parse_frommap(int fd)
 				}
 				break;
 
+			case 0x2b29: //Receive the changed sections of a character from map-server for saving
+				if( RFIFOREST(fd) < 4 || RFIFOREST(fd) < RFIFOW(fd,2) )
+					return 0;
+				{
+					int aid = RFIFOL(fd,4), cid = RFIFOL(fd,8), size = RFIFOW(fd,2);
+					struct online_char_data *character;
+					struct mmo_charstatus *cp;
+
+					if( (cp = (struct mmo_charstatus *)idb_get(char_db_, cid)) != NULL &&
+						(character = (struct online_char_data *)idb_get(online_char_db, aid)) != NULL &&
+						character->char_id == cid )
+					{
+						struct mmo_charstatus char_dat;
+						int sections;
+
+						memcpy(&char_dat, cp, sizeof(struct mmo_charstatus));
+						if( (sections = char_delta_apply(&char_dat, RFIFOP(fd,0), size)) < 0 ) {
+							ShowError("parse_from_map (save-char): Invalid partial save of character (%d:%d).\n", aid, cid);
+							mapif_charsave_reset(fd, aid, cid);
+						} else if( mmo_char_tosql(cid, &char_dat, sections) )
+							mapif_charsave_reset(fd, aid, cid);
+					} else //Not cached (char-server restart), or not online anymore
+						mapif_charsave_reset(fd, aid, cid);
+					RFIFOSKIP(fd,size);
+				}
+				break;
+
 			case 0x2b02: //Req char selection
 				if( RFIFOREST(fd) < 22 )
 					return 0;
@@ -4052,6 +4316,7 @@ static void char_delete2_req(int fd, struct char_session_data *sd)
 	// This check is imposed by Aegis to avoid dead entries in databases
 	// _it is not needed_ as we clear data properly
 	if( char_del_aegis ) {
+		inter_writer_flush(WRITER_ACCOUNT, sd->account_id); //Party and guild changes of the row are queued with the saves of the account
 		if( SQL_SUCCESS != Sql_Query(sql_handle, "SELECT `party_id`, `guild_id` FROM `%s` WHERE `char_id`='%d'", char_db, char_id) ||
 			SQL_SUCCESS != Sql_NextRow(sql_handle) ) {
 			Sql_ShowDebug(sql_handle);
@@ -4822,11 +5087,14 @@ int parse_console(const char *buf)
 			ShowInfo(CL_CYAN"Console: "CL_BOLD"I'm Alive."CL_RESET"\n");
 	} else if( strcmpi("ers_report", type) == 0 )
 		ers_report();
+	else if( strcmpi("save_queue", type) == 0 )
+		inter_writer_report();
 	else if( strcmpi("help", type) == 0 ) {
 		ShowInfo("Available commands:\n");
 		ShowInfo("\t server:shutdown => Stops the server.\n");
 		ShowInfo("\t server:alive => Checks if the server is running.\n");
 		ShowInfo("\t ers_report => Displays database usage.\n");
+		ShowInfo("\t save_queue => Displays the queue of the save writer.\n");
 	}
 
 	return 0;
@@ -5726,6 +5994,8 @@ int char_config_read(const char *cfgName)
 
 void do_final(void)
 {
+	int i;
+
 	ShowStatus("Terminating...\n");
 
 	set_all_offline(-1);
@@ -5743,6 +6013,9 @@ void do_final(void)
 		Sql_ShowDebug(sql_handle);
 
 	char_db_->destroy(char_db_, NULL);
+	db_destroy(char_resave_db);
+	for( i = 0; i < TABLE_MAX; i++ )
+		item_rows_db[i]->destroy(item_rows_db[i], NULL);
 	online_char_db->destroy(online_char_db, NULL);
 	auth_db->destroy(auth_db, NULL);
 
@@ -34,9 +34,12 @@ enum {
 	TABLE_CART,
 	TABLE_STORAGE,
 	TABLE_GUILD_STORAGE,
+	TABLE_MAX
 };
 
 int memitemdata_to_sql(const struct item items[], int max, int id, int tableswitch);
+void memitemdata_cache(const struct item items[], int max, int id, int tableswitch);
+void memitemdata_uncache(int id, int tableswitch);
 
 int mapif_sendall(unsigned char *buf, unsigned int len);
 int mapif_sendallwos(int fd, unsigned char *buf, unsigned int len);
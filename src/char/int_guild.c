@@ -12,6 +12,7 @@
 #include "char.h"
 #include "inter.h"
 #include "int_guild.h"
+#include "int_writer.h"
 
 #include <string.h>
 #include <stdio.h>
@@ -85,15 +86,45 @@ static int guild_save_timer(int tid, unsigned int tick, int id, intptr_t data)
 	return 0;
 }
 
+/// Sets the guild of the row of a member (0 to clear it).
+/// The row belongs to the character, so the write is queued with the saves of its account.
+static void inter_guild_setmember_tosql(int account_id, int char_id, int guild_id)
+{
+	bool recording = inter_writer_begin(WRITER_ACCOUNT, account_id);
+
+	if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `guild_id` = '%d' WHERE `char_id` = '%d'", char_db, guild_id, char_id) )
+		Sql_ShowDebug(sql_handle);
+	if( recording )
+		inter_writer_end();
+}
+
 int inter_guild_removemember_tosql(int account_id, int char_id)
 {
 	if( SQL_ERROR == Sql_Query(sql_handle, "DELETE from `%s` where `account_id` = '%d' and `char_id` = '%d'", guild_member_db, account_id, char_id) )
 		Sql_ShowDebug(sql_handle);
-	if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `guild_id` = '0' WHERE `char_id` = '%d'", char_db, char_id) )
-		Sql_ShowDebug(sql_handle);
+	inter_guild_setmember_tosql(account_id, char_id, 0);
 	return 0;
 }
 
+/// Called when a save of a guild was written (see inter_writer_hook).
+/// When it failed, what it saved is saved again with the next save of the guild.
+static void inter_guild_written(int guild_id, intptr_t flag, const int *values, int count)
+{
+	struct guild *g;
+	int i;
+
+	if( count >= 0 || (g = (struct guild *)idb_get(guild_db_, guild_id)) == NULL )
+		return;
+	if( flag&GS_MEMBER )
+		for( i = 0; i < g->max_member; i++ )
+			if( g->member[i].account_id )
+				g->member[i].modified |= GS_MEMBER_MODIFIED;
+	if( flag&GS_POSITION )
+		for( i = 0; i < MAX_GUILDPOSITION; i++ )
+			g->position[i].modified |= GS_POSITION_MODIFIED;
+	g->save_flag |= (flag&GS_MASK);
+}
+
 // Save guild into sql
 int inter_guild_tosql(struct guild *g,int flag)
 {
@@ -117,6 +148,7 @@ int inter_guild_tosql(struct guild *g,int flag)
 	char esc_master[NAME_LENGTH * 2 + 1];
 	char new_guild = 0;
 	int i = 0;
+	bool recording = false;
 
 	if( g->guild_id <= 0 && g->guild_id != -1 ) return 0;
 
@@ -147,6 +179,11 @@ int inter_guild_tosql(struct guild *g,int flag)
 		}
 	}
 
+	if( inter_writer_begin(WRITER_GUILD, g->guild_id) ) {
+		recording = true;
+		inter_writer_hook(inter_guild_written, g->guild_id, flag, NULL, 0);
+	}
+
 	// If we need an update on an existing guild or more update on the new guild
 	if( ((flag&GS_BASIC_MASK) && !new_guild) || ((flag&(GS_BASIC_MASK&~GS_BASIC)) && new_guild) )
 	{
@@ -231,11 +268,8 @@ int inter_guild_tosql(struct guild *g,int flag)
 					m->hair, m->hair_color, m->gender,
 					m->class_, m->lv, m->exp, m->exp_payper, m->online, m->position, esc_name) )
 					Sql_ShowDebug(sql_handle);
-				if( m->modified&GS_MEMBER_NEW || new_guild == 1 ) {
-					if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `guild_id` = '%d' WHERE `char_id` = '%d'",
-						char_db, g->guild_id, m->char_id) )
-						Sql_ShowDebug(sql_handle);
-				}
+				if( m->modified&GS_MEMBER_NEW || new_guild == 1 )
+					inter_guild_setmember_tosql(m->account_id, m->char_id, g->guild_id);
 				m->modified = GS_MEMBER_UNMODIFIED;
 			}
 		}
@@ -311,6 +345,8 @@ int inter_guild_tosql(struct guild *g,int flag)
 		}
 	}
 
+	if( recording )
+		inter_writer_end();
 	if( save_log )
 		ShowInfo("Saved guild (%d - %s):%s\n", g->guild_id, g->name, t_info);
 	return 1;
@@ -335,6 +371,7 @@ struct guild * inter_guild_fromsql(int guild_id)
 #ifdef NOISY
 	ShowInfo("Guild load request (%d)...\n", guild_id);
 #endif
+	inter_writer_flush(WRITER_GUILD, guild_id);
 
 	if( SQL_ERROR == Sql_Query(sql_handle, "SELECT g.`name`,c.`name`,g.`guild_lv`,g.`connect_member`,g.`max_member`,g.`average_lv`,g.`exp`,g.`next_exp`,g.`skill_point`,g.`mes1`,g.`mes2`,g.`emblem_len`,g.`emblem_id`,g.`emblem_data` "
 		"FROM `%s` g LEFT JOIN `%s` c ON c.`char_id` = g.`char_id` WHERE g.`guild_id`='%d'", guild_db, char_db, guild_id) )
@@ -1240,13 +1277,13 @@ int mapif_parse_GuildAddMember(int fd,int guild_id,struct guild_member *m)
 int mapif_parse_GuildLeave(int fd, int guild_id, int account_id, int char_id, int flag, const char *mes)
 {
 	int i;
+	bool recording;
 
 	struct guild *g = inter_guild_fromsql(guild_id);
 	if( g == NULL )
 	{
 		// Unknown guild, just update the player
-		if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `guild_id`='0' WHERE `account_id`='%d' AND `char_id`='%d'", char_db, account_id, char_id) )
-			Sql_ShowDebug(sql_handle);
+		inter_guild_setmember_tosql(account_id, char_id, 0);
 		// mapif_guild_withdraw(guild_id,account_id,char_id,flag,g->member[i].name,mes);
 		return 0;
 	}
@@ -1278,7 +1315,10 @@ int mapif_parse_GuildLeave(int fd, int guild_id, int account_id, int char_id, in
 	}
 
 	mapif_guild_withdraw(guild_id,account_id,char_id,flag,g->member[i].name,mes);
+	recording = inter_writer_begin(WRITER_GUILD, guild_id); // After the saves of the guild
 	inter_guild_removemember_tosql(g->member[i].account_id,g->member[i].char_id);
+	if( recording )
+		inter_writer_end();
 
 	memset(&g->member[i],0,sizeof(struct guild_member));
 
@@ -1351,6 +1391,7 @@ int mapif_parse_GuildChangeMemberInfoShort(int fd,int guild_id,int account_id,in
 int mapif_parse_BreakGuild(int fd,int guild_id)
 {
 	struct guild * g;
+	int i;
 	
 	g = inter_guild_fromsql(guild_id);
 	if(g==NULL)
@@ -1358,6 +1399,7 @@ int mapif_parse_BreakGuild(int fd,int guild_id)
 
 	// Delete guild from sql
 	//printf("- Delete guild %d from guild\n",guild_id);
+	inter_writer_flush(WRITER_GUILD, guild_id);
 	if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `guild_id` = '%d'", guild_db, guild_id) )
 		Sql_ShowDebug(sql_handle);
 
@@ -1369,6 +1411,7 @@ int mapif_parse_BreakGuild(int fd,int guild_id)
 
 	if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `guild_id` = '%d'", guild_storage_db, guild_id) )
 		Sql_ShowDebug(sql_handle);
+	memitemdata_uncache(guild_id, TABLE_GUILD_STORAGE);
 
 	if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `guild_id` = '%d' OR `alliance_id` = '%d'", guild_alliance_db, guild_id, guild_id) )
 		Sql_ShowDebug(sql_handle);
@@ -1383,6 +1426,9 @@ int mapif_parse_BreakGuild(int fd,int guild_id)
 		Sql_ShowDebug(sql_handle);
 
 	//printf("- Update guild %d of char\n",guild_id);
+	for( i = 0; i < g->max_member; i++ ) // In order with the saves of the members
+		if( g->member[i].account_id )
+			inter_guild_setmember_tosql(g->member[i].account_id, g->member[i].char_id, 0);
 	if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `guild_id`='0' WHERE `guild_id`='%d'", char_db, guild_id) )
 		Sql_ShowDebug(sql_handle);
 
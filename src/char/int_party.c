@@ -13,6 +13,7 @@
 #include "char.h"
 #include "inter.h"
 #include "int_party.h"
+#include "int_writer.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -27,6 +28,7 @@ struct party_data {
 
 static struct party_data *party_pt;
 static DBMap *party_db_; // int party_id -> struct party_data *
+static DBMap *party_member_db_; // int party_id -> int, queued writes of the party of member rows (save_workers)
 
 int mapif_party_broken(int party_id,int flag);
 int party_check_empty(struct party_data *p);
@@ -119,12 +121,48 @@ static void int_party_calc_state(struct party_data *p)
 	}
 }
 
+/// Called when a write of the party of a member row was written (see inter_writer_hook).
+static void inter_party_member_written(int party_id, intptr_t data, const int *values, int count)
+{
+	int pending = (int)idb_iget(party_member_db_, party_id);
+
+	if( pending > 1 )
+		idb_iput(party_member_db_, party_id, pending - 1);
+	else
+		idb_remove(party_member_db_, party_id);
+}
+
+/// Sets (join) or clears the party of the row of a member.
+/// The row belongs to the character, so the write is queued with the saves of its account.
+static void inter_party_member_tosql(int party_id, int account_id, int char_id, bool join)
+{
+	bool recording = inter_writer_begin(WRITER_ACCOUNT, account_id);
+
+	if( recording ) {
+		idb_iput(party_member_db_, party_id, (int)idb_iget(party_member_db_, party_id) + 1);
+		inter_writer_hook(inter_party_member_written, party_id, 0, NULL, 0);
+	}
+	if( join ) {
+		if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `party_id`='%d' WHERE `account_id`='%d' AND `char_id`='%d'",
+			char_db, party_id, account_id, char_id) )
+			Sql_ShowDebug(sql_handle);
+	} else {
+		if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `party_id`='0' WHERE `party_id`='%d' AND `account_id`='%d' AND `char_id`='%d'",
+			char_db, party_id, account_id, char_id) )
+			Sql_ShowDebug(sql_handle);
+	}
+	if( recording )
+		inter_writer_end();
+}
+
 // Save party to mysql
 int inter_party_tosql(struct party *p, int flag, int index)
 {
 	// 'party' ('party_id','name','exp','item','leader_id','leader_char')
 	char esc_name[NAME_LENGTH*2+1];// escaped party name
 	int party_id;
+	bool recording;
+	int i;
 
 	if( p == NULL || p->party_id == 0 )
 		return 0;
@@ -137,11 +175,17 @@ int inter_party_tosql(struct party *p, int flag, int index)
 
 	if( flag & PS_BREAK )
 	{// Break the party
+		recording = inter_writer_begin(WRITER_PARTY, party_id);
+		for( i = 0; i < MAX_PARTY; i++ ) // In order with the saves of the members
+			if( p->member[i].account_id )
+				inter_party_member_tosql(party_id, p->member[i].account_id, p->member[i].char_id, false);
 		// we'll skip name-checking and just reset everyone with the same party id [celest]
 		if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `party_id`='0' WHERE `party_id`='%d'", char_db, party_id) )
 			Sql_ShowDebug(sql_handle);
 		if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `party_id`='%d'", party_db, party_id) )
 			Sql_ShowDebug(sql_handle);
+		if( recording )
+			inter_writer_end();
 		//Remove from memory
 		idb_remove(party_db_, party_id);
 		return 1;
@@ -160,6 +204,8 @@ int inter_party_tosql(struct party *p, int flag, int index)
 		party_id = p->party_id = (int)Sql_LastInsertId(sql_handle);
 	}
 
+	recording = inter_writer_begin(WRITER_PARTY, party_id);
+
 	if( flag & PS_BASIC )
 	{// Update party info.
 		if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `name`='%s', `exp`='%d', `item`='%d' WHERE `party_id`='%d'",
@@ -174,20 +220,14 @@ int inter_party_tosql(struct party *p, int flag, int index)
 			Sql_ShowDebug(sql_handle);
 	}
 	
-	if( flag & PS_ADDMEMBER )
-	{// Add one party member.
-		if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `party_id`='%d' WHERE `account_id`='%d' AND `char_id`='%d'",
-			char_db, party_id, p->member[index].account_id, p->member[index].char_id) )
-			Sql_ShowDebug(sql_handle);
-	}
+	if( flag & PS_ADDMEMBER ) // Add one party member.
+		inter_party_member_tosql(party_id, p->member[index].account_id, p->member[index].char_id, true);
 
-	if( flag & PS_DELMEMBER )
-	{// Remove one party member.
-		if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `party_id`='0' WHERE `party_id`='%d' AND `account_id`='%d' AND `char_id`='%d'",
-			char_db, party_id, p->member[index].account_id, p->member[index].char_id) )
-			Sql_ShowDebug(sql_handle);
-	}
+	if( flag & PS_DELMEMBER ) // Remove one party member.
+		inter_party_member_tosql(party_id, p->member[index].account_id, p->member[index].char_id, false);
 
+	if( recording )
+		inter_writer_end();
 	if( save_log )
 		ShowInfo("Party Saved (%d - %s)\n", party_id, p->name);
 	return 1;
@@ -217,6 +257,9 @@ struct party_data *inter_party_fromsql(int party_id)
 
 	p = party_pt;
 	memset(p, 0, sizeof(struct party_data));
+	inter_writer_flush(WRITER_PARTY, party_id);
+	if( idb_exists(party_member_db_, party_id) ) // The member rows are queued with the saves of their accounts
+		inter_writer_flush(WRITER_ACCOUNT, -1);
 
 	if( SQL_ERROR == Sql_Query(sql_handle, "SELECT `party_id`, `name`,`exp`,`item`, `leader_id`, `leader_char` FROM `%s` WHERE `party_id`='%d'", party_db, party_id) )
 	{
@@ -270,6 +313,7 @@ int inter_party_sql_init(void)
 {
 	//memory alloc
 	party_db_ = idb_alloc(DB_OPT_RELEASE_DATA);
+	party_member_db_ = idb_alloc(DB_OPT_BASE);
 	party_pt = (struct party_data *)aCalloc(sizeof(struct party_data), 1);
 	if (!party_pt) {
 		ShowFatalError("inter_party_sql_init: Out of Memory!\n");
@@ -288,6 +332,7 @@ int inter_party_sql_init(void)
 void inter_party_sql_final(void)
 {
 	party_db_->destroy(party_db_, NULL);
+	db_destroy(party_member_db_);
 	aFree(party_pt);
 	return;
 }
@@ -604,6 +649,7 @@ int mapif_parse_PartyLeave(int fd, int party_id, int account_id, int char_id)
 	p = inter_party_fromsql(party_id);
 	if( p == NULL )
 	{// Party does not exists?
+		inter_party_member_tosql(party_id, account_id, char_id, false); // In order with the saves of the character
 		if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `party_id`='0' WHERE `party_id`='%d'", char_db, party_id) )
 			Sql_ShowDebug(sql_handle);
 		return 0;
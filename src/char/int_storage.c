@@ -9,6 +9,7 @@
 #include "../common/sql.h"
 #include "char.h"
 #include "inter.h"
+#include "int_writer.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -20,7 +21,11 @@
 /// Save storage data to sql
 int storage_tosql(int account_id, struct storage_data* p)
 {
+	bool recording = inter_writer_begin(WRITER_ACCOUNT, account_id);
+
 	memitemdata_to_sql(p->items, MAX_STORAGE, account_id, TABLE_STORAGE);
+	if( recording )
+		inter_writer_end();
 	return 0;
 }
 
@@ -32,6 +37,7 @@ int storage_fromsql(int account_id, struct storage_data* p)
 
 	memset(p, 0, sizeof(struct storage_data)); //Clean up memory
 	p->storage_amount = 0;
+	inter_writer_flush(WRITER_ACCOUNT, account_id);
 
 	// Storage {`account_id`/`id`/`nameid`/`amount`/`equip`/`identify`/`refine`/`attribute`/`card0`/`card1`/`card2`/`card3`}
 	StringBuf_Init(&buf);
@@ -67,6 +73,7 @@ int storage_fromsql(int account_id, struct storage_data* p)
 	}
 	p->storage_amount = i;
 	Sql_FreeResult(sql_handle);
+	memitemdata_cache(p->items, MAX_STORAGE, account_id, TABLE_STORAGE);
 
 	ShowInfo("storage load complete from DB - id: %d (total: %d)\n", account_id, p->storage_amount);
 	return 1;
@@ -75,7 +82,11 @@ int storage_fromsql(int account_id, struct storage_data* p)
 /// Save guild_storage data to sql
 int guild_storage_tosql(int guild_id, struct guild_storage *p)
 {
+	bool recording = inter_writer_begin(WRITER_GUILD, guild_id);
+
 	memitemdata_to_sql(p->items, MAX_GUILD_STORAGE, guild_id, TABLE_GUILD_STORAGE);
+	if( recording )
+		inter_writer_end();
 	ShowInfo ("guild storage save to DB - guild: %d\n", guild_id);
 	return 0;
 }
@@ -89,6 +100,7 @@ int guild_storage_fromsql(int guild_id, struct guild_storage *p)
 	memset(p, 0, sizeof(struct guild_storage)); //Clean up memory
 	p->storage_amount = 0;
 	p->guild_id = guild_id;
+	inter_writer_flush(WRITER_GUILD, guild_id);
 
 	//Storage {`guild_id`/`id`/`nameid`/`amount`/`equip`/`identify`/`refine`/`attribute`/`card0`/`card1`/`card2`/`card3`}
 	StringBuf_Init(&buf);
@@ -124,6 +136,7 @@ int guild_storage_fromsql(int guild_id, struct guild_storage *p)
 	}
 	p->storage_amount = i;
 	Sql_FreeResult(sql_handle);
+	memitemdata_cache(p->items, MAX_GUILD_STORAGE, guild_id, TABLE_GUILD_STORAGE);
 
 	ShowInfo("guild storage load complete from DB - id: %d (total: %d)\n", guild_id, p->storage_amount);
 	return 0;
@@ -144,14 +157,18 @@ void inter_storage_sql_final(void)
 // Delete char storage
 int inter_storage_delete(int account_id)
 {
+	inter_writer_flush(WRITER_ACCOUNT, account_id);
 	if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `account_id`='%d'", storage_db, account_id) )
 		Sql_ShowDebug(sql_handle);
+	memitemdata_uncache(account_id, TABLE_STORAGE);
 	return 0;
 }
 int inter_guild_storage_delete(int guild_id)
 {
+	inter_writer_flush(WRITER_GUILD, guild_id);
 	if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `guild_id`='%d'", guild_storage_db, guild_id) )
 		Sql_ShowDebug(sql_handle);
+	memitemdata_uncache(guild_id, TABLE_GUILD_STORAGE);
 	return 0;
 }
 
@@ -288,6 +305,7 @@ int mapif_parse_itembound_retrieve(int fd)
 	int j, guild_id = RFIFOW(fd,10);
 	uint32 char_id = RFIFOL(fd,2), account_id = RFIFOL(fd,6);
 
+	inter_writer_flush(WRITER_ACCOUNT, -1); // The bound items are deleted from every inventory
 	StringBuf_Init(&buf);
 
 	//Get bound items from player's inventory
@@ -346,6 +364,7 @@ int mapif_parse_itembound_retrieve(int fd)
 		mapif_itembound_ack(fd, account_id, guild_id);
 		return 1;
 	}
+	memitemdata_uncache(-1, TABLE_INVENTORY);
 
 	//Send the deleted items to map-server to store them in guild storage [Cydh]
 	mapif_itembound_store2gstorage(fd, guild_id, items, count);
@@ -0,0 +1,543 @@
+// Copyright (c) Athena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#include "../common/cbasetypes.h"
+#include "../common/db.h"
+#include "../common/malloc.h"
+#include "../common/mutex.h"
+#include "../common/showmsg.h"
+#include "../common/sql.h"
+#include "../common/strlib.h"
+#include "../common/thread.h"
+#include "../common/timer.h"
+#include "../common/utils.h" // cap_value
+#include "inter.h"
+#include "int_writer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int save_workers = 2; // Threads writing the saves, 0 to write them right away
+int save_queue_warning = 200; // Number of queued saves that is reported
+
+/// Maximum number of writer threads
+#define WRITER_MAX_WORKERS 16
+
+/// State of a save job
+enum writer_state {
+	WRITER_QUEUED,  // Waiting for its thread, more saves can be added to it
+	WRITER_RUNNING, // Being written
+	WRITER_DONE,    // Written, waiting for writer_collect
+};
+
+/// Header of a statement of a job, followed by the query
+struct writer_statement {
+	uint32 length; // Length of the query
+	int32 hook;    // Hook that gets the rows of the query, -1 for none
+};
+
+/// Function called once a job was written (inter_writer_hook)
+struct writer_hook {
+	WriterHook func;
+	int id;
+	intptr_t data;
+	int max;     // Values the query can give
+	int count;   // Values given by the query
+	int *values;
+};
+
+/// Save job: the statements of one or more saves of a route and id,
+/// written by a thread in one transaction
+struct writer_job {
+	struct writer_job *next; // In the queue of the thread, then in the done list
+	enum writer_route route;
+	int id;
+	enum writer_state state; // Protected by writer.lock
+	char *data; // Statements
+	size_t length, size;
+	struct writer_hook *hooks;
+	int hook_count, hook_size;
+	bool failed;
+	char error[256]; // Error of the failed statement
+	struct writer_job *outer; // Job that was being recorded when this one started
+	int nesting; // Calls of inter_writer_begin for this job
+};
+
+/// Writer thread
+struct writer_worker {
+	rAthread thread;
+	racond wake;
+	Sql *handle; // Connection of the thread
+	struct writer_job *head, *tail; // Queue (protected by writer.lock)
+};
+
+/// Save writer (save_workers)
+/// The saves are recorded on the main thread (Sql_SetRecorder) instead of being
+/// run, and a pool of threads with their own connections writes them, one
+/// transaction per job. The jobs of a route and id always go to the same
+/// thread, so they are written in order. A save is added to the last job of
+/// its route and id while that job is still queued.
+/// A row is always written through the route of its entity: a guild or party
+/// save that changes the row of a character records that statement on the
+/// account of the character (inter_writer_begin inside the guild or party save).
+/// Whatever reads what the saves write must call inter_writer_flush first.
+static struct {
+	struct writer_worker worker[WRITER_MAX_WORKERS];
+	int workers; // Running threads, 0 when the saves are written right away
+	ramutex lock;
+	racond done; // Signaled when a job is done
+	struct writer_job *done_head, *done_tail; // Done jobs (protected by lock)
+	DBMap *last[WRITER_MAX]; // int id -> struct writer_job*, last job of each route and id
+	struct writer_job *recording; // Job being recorded, its outer jobs are recorded after it
+	int depth; // Queued and running jobs (protected by lock)
+	bool terminate; // Protected by lock
+	int saves, coalesced, written, failed, peak; // Statistics
+	int timer;
+} writer;
+
+
+static const char *writer_route_name(enum writer_route route)
+{
+	switch( route ) {
+		case WRITER_ACCOUNT: return "account";
+		case WRITER_GUILD:   return "guild";
+		case WRITER_PARTY:   return "party";
+		default:             return "unknown";
+	}
+}
+
+/// Thread of the jobs of a route and id
+static struct writer_worker *writer_worker_of(enum writer_route route, int id)
+{
+	return &writer.worker[((uint32)id * 31 + (uint32)route) % (uint32)writer.workers];
+}
+
+/// Appends a statement to a job
+static void writer_append(struct writer_job *job, const char *query, size_t length, int hook)
+{
+	struct writer_statement st;
+	size_t need = job->length + sizeof(st) + length;
+
+	if( need > job->size ) {
+		job->size = max(need, job->size * 2);
+		RECREATE(job->data, char, job->size);
+	}
+	st.length = (uint32)length;
+	st.hook = hook;
+	memcpy(job->data + job->length, &st, sizeof(st));
+	memcpy(job->data + job->length + sizeof(st), query, length);
+	job->length = need;
+}
+
+/// Receives the queries of sql_handle while a save is recorded
+static void writer_record(const char *query, size_t query_len, void *data)
+{
+	writer_append((struct writer_job *)data, query, query_len, -1);
+}
+
+static void writer_free(struct writer_job *job)
+{
+	int i;
+
+	for( i = 0; i < job->hook_count; i++ )
+		if( job->hooks[i].values )
+			aFree(job->hooks[i].values);
+	if( job->hooks )
+		aFree(job->hooks);
+	if( job->data )
+		aFree(job->data);
+	aFree(job);
+}
+
+/// Adds the statements and hooks of 'job' to the queued job 'last'
+static void writer_merge(struct writer_job *last, struct writer_job *job)
+{
+	size_t pos;
+
+	for( pos = 0; pos < job->length; ) { // The hooks of 'job' come after the ones of 'last'
+		struct writer_statement st;
+
+		memcpy(&st, job->data + pos, sizeof(st));
+		if( st.hook >= 0 ) {
+			st.hook += last->hook_count;
+			memcpy(job->data + pos, &st, sizeof(st));
+		}
+		pos += sizeof(st) + st.length;
+	}
+	if( job->length ) {
+		if( last->length + job->length > last->size ) {
+			last->size = last->length + job->length;
+			RECREATE(last->data, char, last->size);
+		}
+		memcpy(last->data + last->length, job->data, job->length);
+		last->length += job->length;
+	}
+	if( job->hook_count ) {
+		RECREATE(last->hooks, struct writer_hook, last->hook_count + job->hook_count);
+		memcpy(last->hooks + last->hook_count, job->hooks, job->hook_count * sizeof(struct writer_hook));
+		last->hook_count += job->hook_count;
+		last->hook_size = last->hook_count;
+		job->hook_count = 0; // The values belong to 'last' now
+	}
+}
+
+/// Writes a job in one transaction (writer thread).
+/// Only the functions of sql.c that are safe for a thread are used (see Sql_ConnectThread).
+static void writer_run(Sql *handle, struct writer_job *job)
+{
+	size_t pos = 0;
+
+	if( SQL_ERROR == Sql_QueryRaw(handle, "START TRANSACTION", 17) )
+		job->failed = true;
+	while( !job->failed && pos < job->length ) {
+		struct writer_statement st;
+		const char *query = job->data + pos + sizeof(st);
+
+		memcpy(&st, job->data + pos, sizeof(st));
+		pos += sizeof(st) + st.length;
+		if( SQL_ERROR == Sql_QueryRaw(handle, query, st.length) ) {
+			job->failed = true;
+			break;
+		}
+		if( st.hook >= 0 ) { // Values of the hook
+			struct writer_hook *hook = &job->hooks[st.hook];
+			char *data;
+
+			while( hook->count < hook->max && SQL_SUCCESS == Sql_NextRow(handle) ) {
+				Sql_GetData(handle, 0, &data, NULL);
+				hook->values[hook->count++] = (data ? atoi(data) : 0);
+			}
+		}
+	}
+	Sql_FreeResult(handle);
+	if( job->failed || SQL_ERROR == Sql_QueryRaw(handle, "COMMIT", 6) ) {
+		job->failed = true;
+		safestrncpy(job->error, Sql_Error(handle), sizeof(job->error));
+		Sql_QueryRaw(handle, "ROLLBACK", 8);
+	}
+}
+
+/// Writer thread.
+/// Writes the jobs of its queue until inter_writer_sql_final, then writes what is left.
+static void *writer_main(void *param)
+{
+	struct writer_worker *w = (struct writer_worker *)param;
+
+	Sql_ThreadInit();
+	for(;;) {
+		struct writer_job *job;
+
+		ramutex_lock(writer.lock);
+		while( w->head == NULL && !writer.terminate )
+			racond_wait(w->wake, writer.lock, -1);
+		if( (job = w->head) == NULL ) { // Terminating and nothing left
+			ramutex_unlock(writer.lock);
+			break;
+		}
+		if( (w->head = job->next) == NULL )
+			w->tail = NULL;
+		job->next = NULL;
+		job->state = WRITER_RUNNING;
+		ramutex_unlock(writer.lock);
+
+		writer_run(w->handle, job);
+
+		ramutex_lock(writer.lock);
+		job->state = WRITER_DONE;
+		if( writer.done_tail )
+			writer.done_tail->next = job;
+		else
+			writer.done_head = job;
+		writer.done_tail = job;
+		writer.depth--;
+		racond_broadcast(writer.done);
+		ramutex_unlock(writer.lock);
+	}
+	Sql_ThreadEnd();
+
+	return NULL;
+}
+
+/// Finishes the done jobs: reports the failed ones and calls the hooks
+static void writer_collect(void)
+{
+	struct writer_job *job;
+
+	ramutex_lock(writer.lock);
+	job = writer.done_head;
+	writer.done_head = writer.done_tail = NULL;
+	ramutex_unlock(writer.lock);
+
+	while( job ) {
+		struct writer_job *next = job->next;
+		int i;
+
+		if( job->failed ) {
+			ShowSQL("Save writer: failed to save %s %d, %s\n", writer_route_name(job->route), job->id, job->error);
+			writer.failed++;
+		} else
+			writer.written++;
+		if( idb_get(writer.last[job->route], job->id) == job )
+			idb_remove(writer.last[job->route], job->id);
+		for( i = 0; i < job->hook_count; i++ ) {
+			struct writer_hook *hook = &job->hooks[i];
+
+			if( job->failed )
+				hook->func(hook->id, hook->data, NULL, -1);
+			else
+				hook->func(hook->id, hook->data, hook->values, hook->count);
+		}
+		writer_free(job);
+		job = next;
+	}
+}
+
+/// Finishes the done jobs and reports a long queue
+static int writer_timer(int tid, unsigned int tick, int id, intptr_t data)
+{
+	writer_collect();
+	if( save_queue_warning > 0 && writer.depth >= save_queue_warning )
+		ShowWarning("Save writer: %d saves are queued, the database is not keeping up (see save_workers).\n", writer.depth);
+	return 0;
+}
+
+/// Starts recording the saves of a route and id, until inter_writer_end.
+/// Calls can be nested: an inner call of the same route and id is part of the
+/// outer save, one of another route or id records a save of its own, which
+/// is queued when it ends.
+/// Returns false when the saves are written right away.
+bool inter_writer_begin(enum writer_route route, int id)
+{
+	struct writer_job *job = writer.recording;
+
+	if( writer.workers == 0 )
+		return false;
+	if( job && job->route == route && job->id == id ) {
+		job->nesting++;
+		return true;
+	}
+	CREATE(job, struct writer_job, 1);
+	job->route = route;
+	job->id = id;
+	job->state = WRITER_QUEUED;
+	job->outer = writer.recording;
+	job->nesting = 1;
+	writer.recording = job;
+	Sql_SetRecorder(sql_handle, writer_record, job);
+	return true;
+}
+
+/// Stops recording and queues the recorded save.
+/// It is added to the last job of its route and id when that one is still queued.
+void inter_writer_end(void)
+{
+	struct writer_job *job = writer.recording, *last;
+	struct writer_worker *w;
+
+	if( job == NULL || --job->nesting > 0 )
+		return;
+	writer.recording = job->outer;
+	if( writer.recording ) // Back to the outer save
+		Sql_SetRecorder(sql_handle, writer_record, writer.recording);
+	else
+		Sql_SetRecorder(sql_handle, NULL, NULL);
+	job->outer = NULL;
+	if( job->length == 0 && job->hook_count == 0 ) { // Nothing to write
+		writer_free(job);
+		return;
+	}
+	writer.saves++;
+
+	last = (struct writer_job *)idb_get(writer.last[job->route], job->id);
+	ramutex_lock(writer.lock);
+	if( last && last->state == WRITER_QUEUED ) {
+		writer_merge(last, job);
+		ramutex_unlock(writer.lock);
+		writer.coalesced++;
+		writer_free(job);
+		return;
+	}
+	w = writer_worker_of(job->route, job->id);
+	if( w->tail )
+		w->tail->next = job;
+	else
+		w->head = job;
+	w->tail = job;
+	if( ++writer.depth > writer.peak )
+		writer.peak = writer.depth;
+	racond_signal(w->wake);
+	ramutex_unlock(writer.lock);
+
+	idb_put(writer.last[job->route], job->id, job);
+}
+
+/// Whether a save is being recorded.
+bool inter_writer_recording(void)
+{
+	return (writer.recording != NULL);
+}
+
+/// Calls 'func' on the main thread once the save being recorded was written.
+/// 'query' (optional) is run after the statements recorded so far, in the same
+/// connection, and the first column of at most 'max' of its rows is given to 'func'.
+void inter_writer_hook(WriterHook func, int id, intptr_t data, const char *query, int max)
+{
+	struct writer_job *job = writer.recording;
+	struct writer_hook *hook;
+
+	if( job == NULL )
+		return;
+	if( job->hook_count == job->hook_size ) {
+		job->hook_size += 4;
+		RECREATE(job->hooks, struct writer_hook, job->hook_size);
+	}
+	hook = &job->hooks[job->hook_count];
+	memset(hook, 0, sizeof(*hook));
+	hook->func = func;
+	hook->id = id;
+	hook->data = data;
+	if( query && max > 0 ) {
+		hook->max = max;
+		CREATE(hook->values, int, max);
+		writer_append(job, query, strlen(query), job->hook_count);
+	}
+	job->hook_count++;
+}
+
+/// Waits until the saves of a route and id are written (all the saves when id is -1)
+/// and finishes them. Returns true if there were saves to wait for.
+bool inter_writer_flush(enum writer_route route, int id)
+{
+	struct writer_job *job = NULL;
+	bool pending;
+
+	if( writer.workers == 0 )
+		return false;
+	if( id >= 0 && (job = (struct writer_job *)idb_get(writer.last[route], id)) == NULL )
+		return false;
+
+	ramutex_lock(writer.lock);
+	if( job ) {
+		while( job->state != WRITER_DONE )
+			racond_wait(writer.done, writer.lock, -1);
+		pending = true;
+	} else {
+		pending = (writer.depth > 0 || writer.done_head != NULL);
+		while( writer.depth > 0 )
+			racond_wait(writer.done, writer.lock, -1);
+	}
+	ramutex_unlock(writer.lock);
+
+	writer_collect();
+	return pending;
+}
+
+/// Waits for the earlier saves of the route and id being recorded (all the
+/// saves when none is), before the save reads what they write.
+void inter_writer_sync(void)
+{
+	if( writer.recording )
+		inter_writer_flush(writer.recording->route, writer.recording->id);
+	else
+		inter_writer_flush(WRITER_ACCOUNT, -1);
+}
+
+/// Number of queued and running save jobs.
+int inter_writer_depth(void)
+{
+	return writer.depth;
+}
+
+/// Shows the state of the save writer on the console.
+void inter_writer_report(void)
+{
+	if( writer.workers == 0 ) {
+		ShowInfo("Save writer: disabled, the saves are written right away.\n");
+		return;
+	}
+	ShowInfo("Save writer: %d threads, %d jobs queued (%d at most).\n", writer.workers, writer.depth, writer.peak);
+	ShowInfo("Save writer: %d saves, %d added to a queued job, %d jobs written, %d failed.\n", writer.saves, writer.coalesced, writer.written, writer.failed);
+}
+
+/// Starts the writer threads (save_workers)
+void inter_writer_sql_init(void)
+{
+	int i, count = cap_value(save_workers, 0, WRITER_MAX_WORKERS);
+
+	for( i = 0; i < WRITER_MAX; i++ )
+		writer.last[i] = idb_alloc(DB_OPT_BASE);
+	if( count == 0 )
+		return;
+
+	writer.lock = ramutex_create();
+	writer.done = racond_create();
+	writer.terminate = false;
+	for( i = 0; i < count; i++ ) {
+		struct writer_worker *w = &writer.worker[i];
+
+		w->handle = Sql_Malloc();
+		if( SQL_ERROR == Sql_ConnectThread(w->handle, char_server_id, char_server_pw, char_server_ip, (uint16)char_server_port, char_server_db) )
+			exit(EXIT_FAILURE);
+		if( *default_codepage ) {
+			if( SQL_ERROR == Sql_SetEncoding(w->handle, default_codepage) )
+				Sql_ShowDebug(w->handle);
+		}
+		w->wake = racond_create();
+		if( (w->thread = rathread_create(writer_main, w)) == NULL ) {
+			ShowError("inter_writer_sql_init: Cannot start save writer thread %d.\n", i + 1);
+			racond_destroy(w->wake);
+			Sql_Free(w->handle);
+			w->handle = NULL;
+			break;
+		}
+		writer.workers++;
+	}
+
+	if( writer.workers == 0 ) {
+		ShowError("inter_writer_sql_init: No save writer thread, saves will be written right away.\n");
+		racond_destroy(writer.done);
+		ramutex_destroy(writer.lock);
+		return;
+	}
+
+	add_timer_func_list(writer_timer, "writer_timer");
+	writer.timer = add_timer_interval(gettick() + 1000, writer_timer, 0, 0, 1000);
+	ShowStatus("Writing the saves from %d threads.\n", writer.workers);
+}
+
+/// Writes the queued saves and stops the writer threads.
+/// The saves made after it are written right away.
+void inter_writer_sql_final(void)
+{
+	int i;
+
+	if( writer.workers ) {
+		ramutex_lock(writer.lock);
+		writer.terminate = true;
+		for( i = 0; i < writer.workers; i++ )
+			racond_signal(writer.worker[i].wake);
+		ramutex_unlock(writer.lock);
+
+		for( i = 0; i < writer.workers; i++ ) { // They write what is queued first
+			struct writer_worker *w = &writer.worker[i];
+
+			rathread_wait(w->thread, NULL);
+			w->thread = NULL;
+			racond_destroy(w->wake);
+			Sql_Free(w->handle);
+			w->handle = NULL;
+		}
+
+		delete_timer(writer.timer, writer_timer);
+		writer_collect();
+		ShowStatus("Save writer: %d saves in %d jobs, %d failed.\n", writer.saves, writer.written + writer.failed, writer.failed);
+
+		racond_destroy(writer.done);
+		ramutex_destroy(writer.lock);
+		writer.workers = 0;
+	}
+
+	for( i = 0; i < WRITER_MAX; i++ )
+		db_destroy(writer.last[i]);
+}
@@ -0,0 +1,35 @@
+// Copyright (c) Athena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#ifndef _INT_WRITER_SQL_H_
+#define _INT_WRITER_SQL_H_
+
+/// Routes of the saves. The saves of the same route and id are written in order.
+enum writer_route {
+	WRITER_ACCOUNT, // Characters, storage and registries, by account_id
+	WRITER_GUILD,   // Guilds and guild storage, by guild_id
+	WRITER_PARTY,   // Parties, by party_id
+	WRITER_MAX
+};
+
+/// Called on the main thread once a save was written (see inter_writer_hook).
+/// 'values' are the first column of the rows of the query, 'count' is their number.
+/// When the save failed, 'values' is NULL and 'count' is -1.
+typedef void (*WriterHook)(int id, intptr_t data, const int *values, int count);
+
+extern int save_workers;
+extern int save_queue_warning;
+
+bool inter_writer_begin(enum writer_route route, int id);
+void inter_writer_end(void);
+bool inter_writer_recording(void);
+void inter_writer_hook(WriterHook func, int id, intptr_t data, const char *query, int max);
+bool inter_writer_flush(enum writer_route route, int id);
+void inter_writer_sync(void);
+int inter_writer_depth(void);
+void inter_writer_report(void);
+
+void inter_writer_sql_init(void);
+void inter_writer_sql_final(void);
+
+#endif /* _INT_WRITER_SQL_H_ */
@@ -20,6 +20,7 @@
 #include "int_auction.h"
 #include "int_quest.h"
 #include "int_elemental.h"
+#include "int_writer.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -589,12 +590,16 @@ int inter_accreg_tosql(int account_id, int char_id, struct accreg* reg, int type
 {
 	StringBuf buf;
 	int i;
+	bool recording = false;
 
 	if( account_id <= 0 )
 		return 0;
 	reg->account_id = account_id;
 	reg->char_id = char_id;
 
+	if( type == 2 || type == 3 )
+		recording = inter_writer_begin(WRITER_ACCOUNT, account_id);
+
 	//`global_reg_value` (`type`, `account_id`, `char_id`, `str`, `value`)
 	switch( type ) {
 		case 3: //Char Reg
@@ -615,8 +620,11 @@ int inter_accreg_tosql(int account_id, int char_id, struct accreg* reg, int type
 			return 0;
 	}
 
-	if( reg->reg_num <= 0 )
+	if( reg->reg_num <= 0 ) {
+		if( recording )
+			inter_writer_end();
 		return 0;
+	}
 
 	StringBuf_Init(&buf);
 	StringBuf_Printf(&buf, "INSERT INTO `%s` (`type`,`account_id`,`char_id`,`str`,`value`) VALUES ", reg_db);
@@ -643,6 +651,8 @@ int inter_accreg_tosql(int account_id, int char_id, struct accreg* reg, int type
 	}
 
 	StringBuf_Destroy(&buf);
+	if( recording )
+		inter_writer_end();
 
 	return 1;
 }
@@ -660,6 +670,7 @@ int inter_accreg_fromsql(int account_id,int char_id, struct accreg *reg, int typ
 	memset(reg, 0, sizeof(struct accreg));
 	reg->account_id = account_id;
 	reg->char_id = char_id;
+	inter_writer_flush(WRITER_ACCOUNT, account_id);
 
 	//`global_reg_value` (`type`, `account_id`, `char_id`, `str`, `value`)
 	switch( type ) {
@@ -740,6 +751,10 @@ static int inter_config_read(const char *cfgName)
 			party_share_level = (unsigned int)atof(w2);
 		else if(!strcmpi(w1, "log_inter"))
 			log_inter = atoi(w2);
+		else if(!strcmpi(w1, "save_workers"))
+			save_workers = atoi(w2);
+		else if(!strcmpi(w1, "save_queue_warning"))
+			save_queue_warning = atoi(w2);
 		else if(!strcmpi(w1, "import"))
 			inter_config_read(w2);
 	}
@@ -801,6 +816,7 @@ int inter_init_sql(const char *file)
 	inter_accreg_sql_init();
 	inter_mail_sql_init();
 	inter_auction_sql_init();
+	inter_writer_sql_init();
 
 	geoip_init();
 	return 0;
@@ -811,6 +827,7 @@ void inter_final(void)
 {
 	wis_db->destroy(wis_db, NULL);
 
+	inter_writer_sql_final(); // Before the caches the saves refer to are gone
 	inter_guild_sql_final();
 	inter_storage_sql_final();
 	inter_party_sql_final();
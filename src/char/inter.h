@@ -21,6 +21,13 @@ int inter_log(char *fmt,...);
 
 extern unsigned int party_share_level;
 
+extern int char_server_port;
+extern char char_server_ip[32];
+extern char char_server_id[32];
+extern char char_server_pw[32];
+extern char char_server_db[32];
+extern char default_codepage[32];
+
 extern Sql *sql_handle;
 extern Sql *lsql_handle;
 
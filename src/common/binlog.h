@@ -0,0 +1,128 @@
+// Copyright (c) Athena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#ifndef _BINLOG_H_
+#define _BINLOG_H_
+
+#include "../common/cbasetypes.h"
+#include "../common/mmo.h" // NAME_LENGTH, MAP_NAME_LENGTH
+
+/// Binary log segments (log_binary), written by the map-server and read by the logconv tool.
+///
+/// A segment starts with a binlog_header, followed by records. A record is a
+/// binlog_record and 'length' bytes of data, which is one of the structures below.
+/// A string at the end of the data is cut after its terminating zero.
+/// Maps are numbered: a BINLOG_MAPNAME record gives the name of a number and comes
+/// before the first record of the block that uses it.
+/// Every BINLOG_INDEX_INTERVAL records, a BINLOG_INDEX record closes the block of
+/// records before it. The last record of a segment that was closed properly is
+/// a BINLOG_INDEX record, so a reader can walk the blocks from the end and skip
+/// those outside of the time it wants.
+/// Values are written in the byte order of the map-server.
+
+#define BINLOG_MAGIC 0x474F4C52 // "RLOG"
+#define BINLOG_VERSION 1
+
+/// Records in a block
+#define BINLOG_INDEX_INTERVAL 4096
+
+/// Length of the messages of binlog_message and binlog_chat
+#define BINLOG_MESSAGE_LENGTH 256
+
+/// Types of records.
+/// Log records come first, in the order of the log tables.
+enum binlog_type {
+	BINLOG_BRANCH = 0, // binlog_branch
+	BINLOG_PICK,       // binlog_pick
+	BINLOG_ZENY,       // binlog_zeny
+	BINLOG_MVPDROP,    // binlog_mvpdrop
+	BINLOG_GM,         // binlog_message
+	BINLOG_NPC,        // binlog_message
+	BINLOG_CHAT,       // binlog_chat
+	BINLOG_CASH,       // binlog_cash
+	BINLOG_MAPNAME,    // Name of the map of the record, cut
+	BINLOG_INDEX,      // binlog_index
+	BINLOG_MAX
+};
+
+/// Header of a segment
+struct binlog_header {
+	uint32 magic; // BINLOG_MAGIC
+	uint16 version; // BINLOG_VERSION
+	uint16 unused;
+	uint32 created; // Unix time
+};
+
+/// Header of a record
+struct binlog_record {
+	uint32 time; // Unix time
+	uint16 length; // Of the data after the header
+	uint16 map; // Number of the map (BINLOG_MAPNAME), 0 if none
+	uint8 type; // enum binlog_type
+	uint8 unused[3];
+};
+
+/// Index of a block, the data of BINLOG_INDEX
+struct binlog_index {
+	uint32 previous; // Offset of the previous BINLOG_INDEX record, 0 if none
+	uint32 block; // Offset of the first record of the block
+	uint32 records; // Log records in the block
+	uint32 time_min, time_max; // Time of the oldest and newest log records of the block
+};
+
+struct binlog_branch {
+	int32 account_id, char_id;
+	char name[NAME_LENGTH];
+};
+
+struct binlog_pick {
+	uint64 unique_id;
+	int32 id; // Character or monster
+	int32 amount;
+	uint16 nameid;
+	uint16 card[4];
+	char type; // Pick type character
+	uint8 refine;
+	uint8 bound;
+	uint8 unused[3];
+};
+
+struct binlog_zeny {
+	int32 char_id, src_id;
+	int32 amount;
+	char type; // Pick type character
+	uint8 unused[3];
+};
+
+struct binlog_mvpdrop {
+	int32 char_id, monster_id;
+	uint32 mvpexp;
+	uint16 prize;
+	uint16 unused;
+};
+
+/// Atcommands and 'logmes' messages
+struct binlog_message {
+	int32 account_id, char_id;
+	char name[NAME_LENGTH];
+	char message[BINLOG_MESSAGE_LENGTH];
+};
+
+struct binlog_chat {
+	int32 type_id, src_charid, src_accountid;
+	int16 x, y;
+	char type; // Chat type character
+	uint8 unused[3];
+	char dst_name[NAME_LENGTH];
+	char message[BINLOG_MESSAGE_LENGTH];
+};
+
+struct binlog_cash {
+	int32 char_id;
+	int32 amount;
+	char type; // Pick type character
+	char cash_type; // Cash type character
+	uint8 unused[2];
+};
+
+#endif /* _BINLOG_H_ */
@@ -27,6 +27,17 @@
  *  readjusted in <code>O(lg(n))</code> time.
  *  {@link http://www.cs.mcgill.ca/~cs251/OldCourses/1997/topic18/}
  *
+ *  <B>Flat databases (DB_OPT_FLAT):</B>
+ *  Databases can instead use a resizable open-addressing table with linear
+ *  probing. The table slots only hold the hash of the key (the key itself
+ *  for numeric keys) and the index of the entry, so a lookup is usually a
+ *  single cache line and string keys are only compared when the stored
+ *  hashes match. The entries are allocated in blocks that never move, so
+ *  the data pointers returned by the interface stay valid just like with
+ *  the tree nodes.
+ *  Removed entries are only reused after the last free_lock is released,
+ *  so iterators keep working while entries are added or removed.
+ *
  *  <B>How to add new database types:</B>
  *  1. Add the identifier of the new database type to the enum DBType
  *  2. If not already there, add the data type of the key to the union DBKey
@@ -47,6 +58,8 @@
  *  - create a db that organizes itself by splaying
  *
  *  HISTORY:
+ *    2026/10/18 - Added string keys to DB_OPT_FLAT and faster string hashers.
+ *    2026/10/18 - Added open-addressing tables for numeric keys (DB_OPT_FLAT).
  *    2012/03/09 - Added enum for data types (int, uint, void*)
  *    2008/02/19 - Fixed db_obj_get not handling deleted entries correctly.
  *    2007/11/09 - Added an iterator to the database.
@@ -83,6 +96,8 @@
  *  DBNColor        - Enumeration of colors of the nodes.                    *
  *  DBNode          - Structure of a node in RED-BLACK trees.                *
  *  struct db_free  - Structure that holds a deleted node to be freed.       *
+ *  struct db_flat_entry - Structure of an entry of a flat database.         *
+ *  struct db_flat_slot  - Structure of a slot of a flat database.           *
  *  DBMap_impl      - Struture of the database.                              *
  *  stats           - Statistics about the database system.                  *
 \*****************************************************************************/
@@ -153,6 +168,63 @@ struct db_free {
 	DBNode *root;
 };
 
+/**
+ * Number of bits of the entry index that address an entry inside a block of
+ * a flat database.
+ * @private
+ * @see DBMap_impl#flat_blocks
+ */
+#define DB_FLAT_BLOCK_BITS 8
+#define DB_FLAT_BLOCK_SIZE (1<<DB_FLAT_BLOCK_BITS)
+#define DB_FLAT_BLOCK_MASK (DB_FLAT_BLOCK_SIZE-1)
+
+/**
+ * Initial number of slots of a flat database (power of 2).
+ * @private
+ * @see DBMap_impl#flat_slots
+ */
+#define DB_FLAT_MIN_SLOTS 16
+
+/**
+ * End of the free and pending entry lists of a flat database.
+ * @private
+ */
+#define DB_FLAT_NONE UINT32_MAX
+
+/**
+ * Entry of a flat database with the specified index.
+ * @private
+ */
+#define db_flat_entry(db,i) (&(db)->flat_blocks[(i)>>DB_FLAT_BLOCK_BITS][(i)&DB_FLAT_BLOCK_MASK])
+
+/**
+ * An entry of a flat database.
+ * @param key Key of this database entry
+ * @param data Data of this database entry
+ * @param next Next entry in the pending or free list
+ * @param deleted If the entry is deleted
+ * @private
+ * @see DBMap_impl#flat_blocks
+ */
+struct db_flat_entry {
+	DBKey key;
+	DBData data;
+	uint32 next;
+	unsigned deleted : 1;
+};
+
+/**
+ * A slot of the open-addressing table of a flat database.
+ * @param hash Hash of the key of the entry (the key itself in numeric databases)
+ * @param entry Index of the entry plus 1, 0 if the slot is empty
+ * @private
+ * @see DBMap_impl#flat_slots
+ */
+struct db_flat_slot {
+	uint32 hash;
+	uint32 entry;
+};
+
 /**
  * Complete database structure.
  * @param vtable Interface of the database
@@ -172,6 +244,14 @@ struct db_free {
  * @param item_count Number of items in the database
  * @param maxlen Maximum length of strings in DB_STRING and DB_ISTRING databases
  * @param global_lock Global lock of the database
+ * @param flat_slots Open-addressing table of a flat database
+ * @param flat_blocks Blocks of entries of a flat database
+ * @param flat_block_count Number of allocated blocks in flat_blocks
+ * @param flat_mask Number of slots in flat_slots minus 1
+ * @param flat_shift Shift applied to the hash to get the slot
+ * @param flat_count Number of used entries (including deleted ones)
+ * @param flat_free List of deleted entries that can be reused
+ * @param flat_pending List of deleted entries waiting for the free_lock
  * @private
  * @see #db_alloc(const char*,int,DBType,DBOptions,unsigned short)
  */
@@ -198,13 +278,22 @@ typedef struct DBMap_impl {
 	uint32 item_count;
 	unsigned short maxlen;
 	unsigned global_lock : 1;
+	// Flat database (DB_OPT_FLAT)
+	struct db_flat_slot *flat_slots;
+	struct db_flat_entry **flat_blocks;
+	uint32 flat_block_count;
+	uint32 flat_mask;
+	uint32 flat_shift;
+	uint32 flat_count;
+	uint32 flat_free;
+	uint32 flat_pending;
 } DBMap_impl;
 
 /**
  * Complete iterator structure.
  * @param vtable Interface of the iterator
  * @param db Parent database
- * @param ht_index Current index of the hashtable
+ * @param ht_index Current index of the hashtable (entry index in flat databases)
  * @param node Current node
  * @private
  * @see #DBIterator
@@ -330,6 +419,12 @@ static struct db_stats {
  *  db_dup_key_free    - Free the duplicated key.                            *
  *  db_free_add        - Add a node to the free_list of a database.          *
  *  db_free_remove     - Remove a node from the free_list of a database.     *
+ *  db_flat_hash       - Initial slot of a hash in a flat database.          *
+ *  db_flat_keyhash    - Hash of a key in a flat database.                   *
+ *  db_flat_find       - Find the slot of a key in a flat database.          *
+ *  db_flat_grow       - Double the slots of a flat database.                *
+ *  db_flat_insert     - Add an entry to a flat database.                    *
+ *  db_flat_erase      - Remove an entry from a flat database.               *
  *  db_free_lock       - Increment the free_lock of a database.              *
  *  db_free_unlock     - Decrement the free_lock of a database.              *
  *         If it was the last lock, frees the nodes in free_list.            *
@@ -764,6 +859,169 @@ static void db_free_remove(DBMap_impl* db, DBNode node)
 	db->item_count++;
 }
 
+/**
+ * Returns the slot where the search for a hash starts in a flat database.
+ * Uses fibonacci hashing so sequential keys are spread over the table.
+ * @param db Target database
+ * @param hash Hash of the key
+ * @return Index of the initial slot
+ * @private
+ */
+static inline uint32 db_flat_hash(DBMap_impl* db, uint32 hash)
+{
+	return (uint32)(hash*UINT32_C(2654435769))>>db->flat_shift;
+}
+
+/**
+ * Returns the hash stored in the slots of a flat database for the key.
+ * Numeric keys are used directly.
+ * @param db Target database
+ * @param key Key being hashed
+ * @return Hash of the key
+ * @private
+ */
+static inline uint32 db_flat_keyhash(DBMap_impl* db, DBKey key)
+{
+	if (db->type == DB_INT || db->type == DB_UINT)
+		return key.ui;
+	return db->hash(key, db->maxlen);
+}
+
+/**
+ * Finds the slot of the key in a flat database.
+ * String keys are only compared when the stored hash matches.
+ * @param db Target database
+ * @param key Key being searched
+ * @return Slot of the key or NULL if not found
+ * @private
+ */
+static inline struct db_flat_slot* db_flat_find(DBMap_impl* db, DBKey key)
+{
+	struct db_flat_slot *slot;
+	uint32 hash = db_flat_keyhash(db, key);
+	uint32 i;
+
+	for (i = db_flat_hash(db, hash); ; i = (i + 1)&db->flat_mask) {
+		slot = &db->flat_slots[i];
+		if (slot->entry == 0)
+			return NULL;
+		if (slot->hash == hash && (db->type == DB_INT || db->type == DB_UINT ||
+			db->cmp(key, db_flat_entry(db, slot->entry - 1)->key, db->maxlen) == 0))
+			return slot;
+	}
+}
+
+/**
+ * Doubles the number of slots of a flat database.
+ * The entries are not moved, only the slots are rehashed.
+ * @param db Target database
+ * @private
+ * @see #db_flat_insert(DBMap_impl*,DBKey)
+ */
+static void db_flat_grow(DBMap_impl* db)
+{
+	struct db_flat_slot *old_slots = db->flat_slots;
+	uint32 old_size = db->flat_mask + 1;
+	uint32 i, j;
+
+	CREATE(db->flat_slots, struct db_flat_slot, old_size<<1);
+	db->flat_mask = (old_size<<1) - 1;
+	db->flat_shift--;
+	for (i = 0; i < old_size; i++) {
+		if (old_slots[i].entry == 0)
+			continue;
+		for (j = db_flat_hash(db, old_slots[i].hash); db->flat_slots[j].entry; j = (j + 1)&db->flat_mask)
+			;
+		db->flat_slots[j] = old_slots[i];
+	}
+	aFree(old_slots);
+}
+
+/**
+ * Adds a new entry with the key to a flat database.
+ * The key must not exist in the database yet and is not duplicated.
+ * @param db Target database
+ * @param key Key of the new entry
+ * @return New entry, with empty data
+ * @private
+ * @see #db_flat_erase(DBMap_impl*,struct db_flat_slot*)
+ */
+static struct db_flat_entry* db_flat_insert(DBMap_impl* db, DBKey key)
+{
+	struct db_flat_entry *entry;
+	uint32 hash = db_flat_keyhash(db, key);
+	uint32 idx, i;
+
+	if (db->item_count >= db->flat_mask - (db->flat_mask>>2)) // keep the load under 3/4
+		db_flat_grow(db);
+	if (db->flat_free != DB_FLAT_NONE) { // reuse a deleted entry
+		idx = db->flat_free;
+		entry = db_flat_entry(db, idx);
+		db->flat_free = entry->next;
+	} else {
+		if (db->flat_count == (db->flat_block_count<<DB_FLAT_BLOCK_BITS)) { // all blocks are full
+			RECREATE(db->flat_blocks, struct db_flat_entry*, db->flat_block_count + 1);
+			CREATE(db->flat_blocks[db->flat_block_count], struct db_flat_entry, DB_FLAT_BLOCK_SIZE);
+			db->flat_block_count++;
+		}
+		idx = db->flat_count++;
+		entry = db_flat_entry(db, idx);
+	}
+	memset(entry, 0, sizeof(*entry));
+	entry->key = key;
+	entry->next = DB_FLAT_NONE;
+	for (i = db_flat_hash(db, hash); db->flat_slots[i].entry; i = (i + 1)&db->flat_mask)
+		;
+	db->flat_slots[i].hash = hash;
+	db->flat_slots[i].entry = idx + 1;
+	db->item_count++;
+	return entry;
+}
+
+/**
+ * Removes the entry of a slot from a flat database.
+ * Marks the entry as deleted and adds it to the pending list, it's only
+ * reused after the last free_lock is released.
+ * If the key isn't duplicated, the key is duplicated and released.
+ * The following slots of the cluster are shifted back, so no tombstones
+ * are needed.
+ * @param db Target database
+ * @param slot Slot of the entry
+ * @private
+ * @see #db_flat_insert(DBMap_impl*,DBKey)
+ * @see #db_free_unlock(DBMap_impl*)
+ */
+static void db_flat_erase(DBMap_impl* db, struct db_flat_slot *slot)
+{
+	struct db_flat_entry *entry = db_flat_entry(db, slot->entry - 1);
+	uint32 i = (uint32)(slot - db->flat_slots);
+	uint32 j = i;
+
+	if (!(db->options&DB_OPT_DUP_KEY)) { // Make sure we have a key until the entry is freed
+		DBKey old_key = entry->key;
+		entry->key = db_dup_key(db, entry->key);
+		db->release(old_key, entry->data, DB_RELEASE_KEY);
+	}
+	entry->deleted = 1;
+	entry->next = db->flat_pending;
+	db->flat_pending = slot->entry - 1;
+	db->item_count--;
+	for (;;) {
+		uint32 k;
+
+		j = (j + 1)&db->flat_mask;
+		if (db->flat_slots[j].entry == 0)
+			break;
+		k = db_flat_hash(db, db->flat_slots[j].hash);
+		// The slot stays if its initial slot is cyclically in ]i,j]
+		if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+		db->flat_slots[i] = db->flat_slots[j];
+		i = j;
+	}
+	db->flat_slots[i].entry = 0;
+}
+
 /**
  * Increment the free_lock of the database.
  * @param db Target database
@@ -787,6 +1045,7 @@ static void db_free_lock(DBMap_impl* db)
  * Decrement the free_lock of the database.
  * If it was the last lock, frees the nodes of the database.
  * Keeps the tree balanced.
+ * In flat databases the pending entries are moved to the free list.
  * NOTE: Frees the duplicated keys of the nodes
  * @param db Target database
  * @private
@@ -816,6 +1075,16 @@ static void db_free_unlock(DBMap_impl* db)
 		ers_free(db->nodes, db->free_list[i].node);
 	}
 	db->free_count = 0;
+
+	while (db->flat_pending != DB_FLAT_NONE) {
+		struct db_flat_entry *entry = db_flat_entry(db, db->flat_pending);
+		uint32 next = entry->next;
+
+		db_dup_key_free(db, entry->key);
+		entry->next = db->flat_free;
+		db->flat_free = db->flat_pending;
+		db->flat_pending = next;
+	}
 }
 
 /*****************************************************************************\
@@ -828,6 +1097,9 @@ static void db_free_unlock(DBMap_impl* db)
  *  db_istring_cmp     - Default comparator for DB_ISTRING databases.        *
  *  db_int_hash        - Default hasher for DB_INT databases.                *
  *  db_uint_hash       - Default hasher for DB_UINT databases.               *
+ *  db_hash_mix        - Mix a block of a string key into the hash.          *
+ *  db_hash_final      - Final avalanche of a string hash.                   *
+ *  db_hash_tolower    - Lowercase a block of a string key.                  *
  *  db_string_hash     - Default hasher for DB_STRING databases.             *
  *  db_istring_hash    - Default hasher for DB_ISTRING databases.            *
  *  db_release_nothing - Releaser that releases nothing.                     *
@@ -952,8 +1224,59 @@ static unsigned int db_uint_hash(DBKey key, unsigned short maxlen)
 	return key.ui;
 }
 
+/**
+ * Mixes a 4-byte block of a string key into the hash (murmur3 round).
+ * @param hash Current hash
+ * @param block Block of the key
+ * @return New hash
+ * @private
+ */
+static inline uint32 db_hash_mix(uint32 hash, uint32 block)
+{
+	block *= UINT32_C(0xcc9e2d51);
+	block = (block<<15)|(block>>17);
+	block *= UINT32_C(0x1b873593);
+	hash ^= block;
+	hash = (hash<<13)|(hash>>19);
+	return hash*5 + UINT32_C(0xe6546b64);
+}
+
+/**
+ * Final avalanche of a string hash (murmur3 fmix32).
+ * @param hash Current hash
+ * @return Final hash
+ * @private
+ */
+static inline uint32 db_hash_final(uint32 hash)
+{
+	hash ^= hash>>16;
+	hash *= UINT32_C(0x85ebca6b);
+	hash ^= hash>>13;
+	hash *= UINT32_C(0xc2b2ae35);
+	hash ^= hash>>16;
+	return hash;
+}
+
+/**
+ * Lowercases the ASCII letters of a 4-byte block, like TOLOWER does
+ * for every character.
+ * @param block Block of the key
+ * @return Lowercased block
+ * @private
+ */
+static inline uint32 db_hash_tolower(uint32 block)
+{
+	uint32 heptets = block&UINT32_C(0x7f7f7f7f);
+	uint32 ge_A = heptets + UINT32_C(0x3f3f3f3f); // high bit set if >= 'A'
+	uint32 gt_Z = heptets + UINT32_C(0x25252525); // high bit set if > 'Z'
+	uint32 upper = ~block&(ge_A^gt_Z)&UINT32_C(0x80808080);
+
+	return block|(upper>>2);
+}
+
 /**
  * Default hasher for DB_STRING databases.
+ * Hashes the key 4 bytes at a time.
  * @param key Key to be hashed
  * @param maxlen Maximum length of the key to hash
  * @return hash of the key
@@ -964,23 +1287,28 @@ static unsigned int db_uint_hash(DBKey key, unsigned short maxlen)
 static unsigned int db_string_hash(DBKey key, unsigned short maxlen)
 {
 	const char *k = key.str;
-	unsigned int hash = 0;
-	unsigned short i;
+	size_t len = strnlen(k, maxlen);
+	uint32 hash = (uint32)len;
+	uint32 block;
 
 	DB_COUNTSTAT(db_string_hash);
 
-	for (i = 0; *k; ++i) {
-		hash = (hash*33 + ((unsigned char)*k))^(hash>>24);
-		k++;
-		if (i == maxlen)
-			break;
+	for (; len >= 4; len -= 4, k += 4) {
+		memcpy(&block, k, 4);
+		hash = db_hash_mix(hash, block);
+	}
+	if (len) {
+		block = 0;
+		memcpy(&block, k, len);
+		hash = db_hash_mix(hash, block);
 	}
 
-	return hash;
+	return db_hash_final(hash);
 }
 
 /**
  * Default hasher for DB_ISTRING databases.
+ * Hashes the lowercased key 4 bytes at a time.
  * @param key Key to be hashed
  * @param maxlen Maximum length of the key to hash
  * @return hash of the key
@@ -990,19 +1318,23 @@ static unsigned int db_string_hash(DBKey key, unsigned short maxlen)
 static unsigned int db_istring_hash(DBKey key, unsigned short maxlen)
 {
 	const char *k = key.str;
-	unsigned int hash = 0;
-	unsigned short i;
+	size_t len = strnlen(k, maxlen);
+	uint32 hash = (uint32)len;
+	uint32 block;
 
 	DB_COUNTSTAT(db_istring_hash);
 
-	for (i = 0; *k; i++) {
-		hash = (hash*33 + ((unsigned char)TOLOWER(*k)))^(hash>>24);
-		k++;
-		if (i == maxlen)
-			break;
+	for (; len >= 4; len -= 4, k += 4) {
+		memcpy(&block, k, 4);
+		hash = db_hash_mix(hash, db_hash_tolower(block));
+	}
+	if (len) {
+		block = 0;
+		memcpy(&block, k, len);
+		hash = db_hash_mix(hash, db_hash_tolower(block));
 	}
 
-	return hash;
+	return db_hash_final(hash);
 }
 
 /**
@@ -1104,6 +1436,7 @@ static void db_release_both(DBKey key, DBData data, DBRelease which)
  *  db_obj_size     - Return the size of the database.                       *
  *  db_obj_type     - Return the type of the database.                       *
  *  db_obj_options  - Return the options of the database.                    *
+ *  dbit_flat_*, db_flat_* - Versions of the above for flat databases.       *
 \*****************************************************************************/
 
 /**
@@ -2126,7 +2459,15 @@ static int db_obj_vdestroy(DBMap *self, DBApply func, va_list args)
 	aFree(db->free_list);
 	db->free_list = NULL;
 	db->free_max = 0;
-	ers_destroy(db->nodes);
+	if (db->options&DB_OPT_FLAT) {
+		uint32 i;
+
+		for (i = 0; i < db->flat_block_count; i++)
+			aFree(db->flat_blocks[i]);
+		aFree(db->flat_blocks);
+		aFree(db->flat_slots);
+	} else
+		ers_destroy(db->nodes);
 	db_free_unlock(db);
 	aFree(db);
 	return sum;
@@ -2231,6 +2572,520 @@ static DBOptions db_obj_options(DBMap *self)
 	return options;
 }
 
+/**
+ * Fetches the first entry in a flat database.
+ * @param self Iterator
+ * @param out_key Key of the entry
+ * @return Data of the entry
+ * @protected
+ * @see DBIterator#first
+ */
+static DBData* dbit_flat_first(DBIterator *self, DBKey* out_key)
+{
+	DBIterator_impl* it = (DBIterator_impl*)self;
+
+	DB_COUNTSTAT(dbit_first);
+	// position before the first entry
+	it->ht_index = -1;
+	// get next entry
+	return self->next(self, out_key);
+}
+
+/**
+ * Fetches the last entry in a flat database.
+ * @param self Iterator
+ * @param out_key Key of the entry
+ * @return Data of the entry
+ * @protected
+ * @see DBIterator#last
+ */
+static DBData* dbit_flat_last(DBIterator *self, DBKey* out_key)
+{
+	DBIterator_impl* it = (DBIterator_impl*)self;
+
+	DB_COUNTSTAT(dbit_last);
+	// position after the last entry
+	it->ht_index = (int)it->db->flat_count;
+	// get previous entry
+	return self->prev(self, out_key);
+}
+
+/**
+ * Fetches the next entry in a flat database.
+ * The entries are visited in the order of their blocks.
+ * @param self Iterator
+ * @param out_key Key of the entry
+ * @return Data of the entry
+ * @protected
+ * @see DBIterator#next
+ */
+static DBData* dbit_flat_next(DBIterator *self, DBKey* out_key)
+{
+	DBIterator_impl* it = (DBIterator_impl*)self;
+	DBMap_impl* db = it->db;
+
+	DB_COUNTSTAT(dbit_next);
+	if( it->ht_index < -1 )
+		it->ht_index = -1;
+	while( (uint32)(++it->ht_index) < db->flat_count )
+	{
+		struct db_flat_entry *entry = db_flat_entry(db, (uint32)it->ht_index);
+
+		if( !entry->deleted )
+		{// found next entry
+			if( out_key )
+				memcpy(out_key, &entry->key, sizeof(DBKey));
+			return &entry->data;
+		}
+	}
+	it->ht_index = (int)db->flat_count;
+	return NULL;// not found
+}
+
+/**
+ * Fetches the previous entry in a flat database.
+ * @param self Iterator
+ * @param out_key Key of the entry
+ * @return Data of the entry
+ * @protected
+ * @see DBIterator#prev
+ */
+static DBData* dbit_flat_prev(DBIterator *self, DBKey* out_key)
+{
+	DBIterator_impl* it = (DBIterator_impl*)self;
+	DBMap_impl* db = it->db;
+
+	DB_COUNTSTAT(dbit_prev);
+	if( it->ht_index > (int)db->flat_count )
+		it->ht_index = (int)db->flat_count;
+	while( --it->ht_index >= 0 )
+	{
+		struct db_flat_entry *entry = db_flat_entry(db, (uint32)it->ht_index);
+
+		if( !entry->deleted )
+		{// found previous entry
+			if( out_key )
+				memcpy(out_key, &entry->key, sizeof(DBKey));
+			return &entry->data;
+		}
+	}
+	it->ht_index = -1;
+	return NULL;// not found
+}
+
+/**
+ * Returns true if the fetched entry of a flat database exists.
+ * @param self Iterator
+ * @return true if the entry exists
+ * @protected
+ * @see DBIterator#exists
+ */
+static bool dbit_flat_exists(DBIterator *self)
+{
+	DBIterator_impl* it = (DBIterator_impl*)self;
+
+	DB_COUNTSTAT(dbit_exists);
+	return (it->ht_index >= 0 && (uint32)it->ht_index < it->db->flat_count &&
+		!db_flat_entry(it->db, (uint32)it->ht_index)->deleted);
+}
+
+/**
+ * Removes the current entry from a flat database.
+ * @param self Iterator
+ * @param out_data Data of the removed entry.
+ * @return 1 if entry was removed, 0 otherwise
+ * @protected
+ * @see DBIterator#remove
+ */
+static int dbit_flat_remove(DBIterator *self, DBData *out_data)
+{
+	DBIterator_impl* it = (DBIterator_impl*)self;
+	DBMap_impl* db = it->db;
+	struct db_flat_entry *entry;
+	struct db_flat_slot *slot;
+
+	DB_COUNTSTAT(dbit_remove);
+	if( !self->exists(self) )
+		return 0;
+	entry = db_flat_entry(db, (uint32)it->ht_index);
+	slot = db_flat_find(db, entry->key);
+	if( slot == NULL )
+		return 0;
+	if( out_data )
+		memcpy(out_data, &entry->data, sizeof(DBData));
+	db->release(entry->key, entry->data, DB_RELEASE_DATA);
+	db_flat_erase(db, slot);
+	return 1;
+}
+
+/**
+ * Returns a new iterator for a flat database.
+ * @param self Database
+ * @return New iterator
+ * @protected
+ * @see DBMap#iterator
+ */
+static DBIterator *db_flat_iterator(DBMap *self)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	DBIterator_impl* it;
+
+	DB_COUNTSTAT(db_iterator);
+	CREATE(it, struct DBIterator_impl, 1);
+	/* Interface of the iterator */
+	it->vtable.first   = dbit_flat_first;
+	it->vtable.last    = dbit_flat_last;
+	it->vtable.next    = dbit_flat_next;
+	it->vtable.prev    = dbit_flat_prev;
+	it->vtable.exists  = dbit_flat_exists;
+	it->vtable.remove  = dbit_flat_remove;
+	it->vtable.destroy = dbit_obj_destroy;
+	/* Initial state (before the first entry) */
+	it->db = db;
+	it->ht_index = -1;
+	it->node = NULL;
+	/* Lock the database */
+	db_free_lock(db);
+	return &it->vtable;
+}
+
+/**
+ * Returns true if the entry exists in a flat database.
+ * @param self Interface of the database
+ * @param key Key that identifies the entry
+ * @return true is the entry exists
+ * @protected
+ * @see DBMap#exists
+ */
+static bool db_flat_exists(DBMap *self, DBKey key)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+
+	DB_COUNTSTAT(db_exists);
+	if (db == NULL) return false; // nullpo candidate
+	if (!(db->options&DB_OPT_ALLOW_NULL_KEY) && db_is_key_null(db->type, key)) {
+		return false; // nullpo candidate
+	}
+
+	return (db_flat_find(db, key) != NULL);
+}
+
+/**
+ * Get the data of the entry identified by the key in a flat database.
+ * Lookups don't change the database, so no lock is needed.
+ * @param self Interface of the database
+ * @param key Key that identifies the entry
+ * @return Data of the entry or NULL if not found
+ * @protected
+ * @see DBMap#get
+ */
+static DBData* db_flat_get(DBMap *self, DBKey key)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	struct db_flat_slot *slot;
+
+	DB_COUNTSTAT(db_get);
+	if (db == NULL) return NULL; // nullpo candidate
+	if (!(db->options&DB_OPT_ALLOW_NULL_KEY) && db_is_key_null(db->type, key)) {
+		ShowError("db_get: Attempted to retrieve non-allowed NULL key for db allocated at %s:%d\n",db->alloc_file, db->alloc_line);
+		return NULL; // nullpo candidate
+	}
+
+	slot = db_flat_find(db, key);
+	if (slot == NULL)
+		return NULL;
+	return &db_flat_entry(db, slot->entry - 1)->data;
+}
+
+/**
+ * Get the data of the entries matched by <code>match</code> in a flat database.
+ * @param self Interface of the database
+ * @param buf Buffer to put the data of the matched entries
+ * @param max Maximum number of data entries to be put into buf
+ * @param match Function that matches the database entries
+ * @param args Extra arguments for match
+ * @return The number of entries that matched
+ * @protected
+ * @see DBMap#vgetall
+ */
+static unsigned int db_flat_vgetall(DBMap *self, DBData **buf, unsigned int max, DBMatcher match, va_list args)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	unsigned int ret = 0;
+	uint32 i;
+
+	DB_COUNTSTAT(db_vgetall);
+	if (db == NULL) return 0; // nullpo candidate
+	if (match == NULL) return 0; // nullpo candidate
+
+	db_free_lock(db);
+	for (i = 0; i < db->flat_count; i++) {
+		struct db_flat_entry *entry = db_flat_entry(db, i);
+		va_list argscopy;
+
+		if (entry->deleted)
+			continue;
+		va_copy(argscopy, args);
+		if (match(entry->key, entry->data, argscopy) == 0) {
+			if (buf && ret < max)
+				buf[ret] = &entry->data;
+			ret++;
+		}
+		va_end(argscopy);
+	}
+	db_free_unlock(db);
+	return ret;
+}
+
+/**
+ * Get the data of the entry identified by the key in a flat database.
+ * If the entry does not exist, an entry is added with the data returned by 
+ * <code>create</code>.
+ * @param self Interface of the database
+ * @param key Key that identifies the entry
+ * @param create Function used to create the data if the entry doesn't exist
+ * @param args Extra arguments for create
+ * @return Data of the entry
+ * @protected
+ * @see DBMap#vensure
+ */
+static DBData* db_flat_vensure(DBMap *self, DBKey key, DBCreateData create, va_list args)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	struct db_flat_entry *entry;
+	struct db_flat_slot *slot;
+	va_list argscopy;
+
+	DB_COUNTSTAT(db_vensure);
+	if (db == NULL) return NULL; // nullpo candidate
+	if (create == NULL) {
+		ShowError("db_ensure: Create function is NULL for db allocated at %s:%d\n",db->alloc_file, db->alloc_line);
+		return NULL; // nullpo candidate
+	}
+	if (!(db->options&DB_OPT_ALLOW_NULL_KEY) && db_is_key_null(db->type, key)) {
+		ShowError("db_ensure: Attempted to use non-allowed NULL key for db allocated at %s:%d\n",db->alloc_file, db->alloc_line);
+		return NULL; // nullpo candidate
+	}
+
+	slot = db_flat_find(db, key);
+	if (slot)
+		return &db_flat_entry(db, slot->entry - 1)->data;
+
+	if (db->item_count == UINT32_MAX) {
+		ShowError("db_vensure: item_count overflow, aborting item insertion.\n"
+				"Database allocated at %s:%d",
+				db->alloc_file, db->alloc_line);
+		return NULL;
+	}
+	db_free_lock(db);
+	entry = db_flat_insert(db, key);
+	// put key and data in the entry
+	if (db->options&DB_OPT_DUP_KEY) {
+		entry->key = db_dup_key(db, key);
+		if (db->options&DB_OPT_RELEASE_KEY)
+			db->release(key, entry->data, DB_RELEASE_KEY);
+	}
+	va_copy(argscopy, args);
+	entry->data = create(key, argscopy);
+	va_end(argscopy);
+	db_free_unlock(db);
+	return &entry->data;
+}
+
+/**
+ * Put the data identified by the key in a flat database.
+ * @param self Interface of the database
+ * @param key Key that identifies the data
+ * @param data Data to be put in the database
+ * @param out_data Previous data if the entry exists
+ * @return 1 if if the entry already exists, 0 otherwise
+ * @protected
+ * @see DBMap#put
+ */
+static int db_flat_put(DBMap *self, DBKey key, DBData data, DBData *out_data)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	struct db_flat_entry *entry;
+	struct db_flat_slot *slot;
+	int retval = 0;
+
+	DB_COUNTSTAT(db_put);
+	if (db == NULL) return 0; // nullpo candidate
+	if (db->global_lock) {
+		ShowError("db_put: Database is being destroyed, aborting entry insertion.\n"
+				"Database allocated at %s:%d\n",
+				db->alloc_file, db->alloc_line);
+		return 0; // nullpo candidate
+	}
+	if (!(db->options&DB_OPT_ALLOW_NULL_KEY) && db_is_key_null(db->type, key)) {
+		ShowError("db_put: Attempted to use non-allowed NULL key for db allocated at %s:%d\n",db->alloc_file, db->alloc_line);
+		return 0; // nullpo candidate
+	}
+	if (!(db->options&DB_OPT_ALLOW_NULL_DATA) && (data.type == DB_DATA_PTR && data.u.ptr == NULL)) {
+		ShowError("db_put: Attempted to use non-allowed NULL data for db allocated at %s:%d\n",db->alloc_file, db->alloc_line);
+		return 0; // nullpo candidate
+	}
+
+	if (db->item_count == UINT32_MAX) {
+		ShowError("db_put: item_count overflow, aborting item insertion.\n"
+				"Database allocated at %s:%d",
+				db->alloc_file, db->alloc_line);
+		return 0;
+	}
+	db_free_lock(db);
+	slot = db_flat_find(db, key);
+	if (slot) { // equal entry, replace
+		entry = db_flat_entry(db, slot->entry - 1);
+		db->release(entry->key, entry->data, DB_RELEASE_BOTH);
+		if (out_data)
+			memcpy(out_data, &entry->data, sizeof(*out_data));
+		retval = 1;
+	} else
+		entry = db_flat_insert(db, key);
+	// put key and data in the entry
+	if (db->options&DB_OPT_DUP_KEY) {
+		entry->key = db_dup_key(db, key);
+		if (db->options&DB_OPT_RELEASE_KEY)
+			db->release(key, data, DB_RELEASE_KEY);
+	} else {
+		entry->key = key;
+	}
+	entry->data = data;
+	db_free_unlock(db);
+	return retval;
+}
+
+/**
+ * Remove an entry from a flat database.
+ * @param self Interface of the database
+ * @param key Key that identifies the entry
+ * @param out_data Previous data if the entry exists
+ * @return 1 if if the entry already exists, 0 otherwise
+ * @protected
+ * @see #db_flat_erase(DBMap_impl*,struct db_flat_slot*)
+ * @see DBMap#remove
+ */
+static int db_flat_remove(DBMap *self, DBKey key, DBData *out_data)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	struct db_flat_slot *slot;
+	int retval = 0;
+
+	DB_COUNTSTAT(db_remove);
+	if (db == NULL) return 0; // nullpo candidate
+	if (db->global_lock) {
+		ShowError("db_remove: Database is being destroyed. Aborting entry deletion.\n"
+				"Database allocated at %s:%d\n",
+				db->alloc_file, db->alloc_line);
+		return 0; // nullpo candidate
+	}
+	if (!(db->options&DB_OPT_ALLOW_NULL_KEY) && db_is_key_null(db->type, key)) {
+		ShowError("db_remove: Attempted to use non-allowed NULL key for db allocated at %s:%d\n",db->alloc_file, db->alloc_line);
+		return 0; // nullpo candidate
+	}
+
+	db_free_lock(db);
+	slot = db_flat_find(db, key);
+	if (slot) {
+		struct db_flat_entry *entry = db_flat_entry(db, slot->entry - 1);
+
+		if (out_data)
+			memcpy(out_data, &entry->data, sizeof(*out_data));
+		retval = 1;
+		db->release(entry->key, entry->data, DB_RELEASE_DATA);
+		db_flat_erase(db, slot);
+	}
+	db_free_unlock(db);
+	return retval;
+}
+
+/**
+ * Apply <code>func</code> to every entry in a flat database.
+ * @param self Interface of the database
+ * @param func Function to be applied
+ * @param args Extra arguments for func
+ * @return Sum of the values returned by func
+ * @protected
+ * @see DBMap#vforeach
+ */
+static int db_flat_vforeach(DBMap *self, DBApply func, va_list args)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	int sum = 0;
+	uint32 i;
+
+	DB_COUNTSTAT(db_vforeach);
+	if (db == NULL) return 0; // nullpo candidate
+	if (func == NULL) {
+		ShowError("db_foreach: Passed function is NULL for db allocated at %s:%d\n",db->alloc_file, db->alloc_line);
+		return 0; // nullpo candidate
+	}
+
+	db_free_lock(db);
+	for (i = 0; i < db->flat_count; i++) {
+		struct db_flat_entry *entry = db_flat_entry(db, i);
+		va_list argscopy;
+
+		if (entry->deleted)
+			continue;
+		va_copy(argscopy, args);
+		sum += func(entry->key, &entry->data, argscopy);
+		va_end(argscopy);
+	}
+	db_free_unlock(db);
+	return sum;
+}
+
+/**
+ * Removes all entries from a flat database.
+ * The blocks of entries are kept for reuse, they are freed when the 
+ * database is destroyed.
+ * @param self Interface of the database
+ * @param func Function to be applied to every entry before deleting
+ * @param args Extra arguments for func
+ * @return Sum of values returned by func
+ * @protected
+ * @see DBMap#vclear
+ */
+static int db_flat_vclear(DBMap *self, DBApply func, va_list args)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	int sum = 0;
+	uint32 i;
+
+	DB_COUNTSTAT(db_vclear);
+	if (db == NULL) return 0; // nullpo candidate
+
+	db_free_lock(db);
+	for (i = 0; i < db->flat_count; i++) {
+		struct db_flat_entry *entry = db_flat_entry(db, i);
+
+		if (entry->deleted)
+			continue;
+		if (func) {
+			va_list argscopy;
+			va_copy(argscopy, args);
+			sum += func(entry->key, &entry->data, argscopy);
+			va_end(argscopy);
+		}
+		db->release(entry->key, entry->data, DB_RELEASE_BOTH);
+		entry->deleted = 1;
+	}
+	while (db->flat_pending != DB_FLAT_NONE) { // free the duplicated keys of the deleted entries
+		struct db_flat_entry *entry = db_flat_entry(db, db->flat_pending);
+
+		db_dup_key_free(db, entry->key);
+		db->flat_pending = entry->next;
+	}
+	memset(db->flat_slots, 0, (db->flat_mask + 1)*sizeof(struct db_flat_slot));
+	db->flat_count = 0;
+	db->flat_free = DB_FLAT_NONE;
+	db->flat_pending = DB_FLAT_NONE;
+	db->item_count = 0;
+	db_free_unlock(db);
+	return sum;
+}
+
 /*****************************************************************************\
  *  (5) Section with public functions.
  *  db_fix_options     - Apply database type restrictions to the options.
@@ -2441,7 +3296,8 @@ DBMap *db_alloc(const char *file, int line, DBType type, DBOptions options, unsi
 	db->free_max = 0;
 	db->free_lock = 0;
 	/* Other */
-	db->nodes = ers_new(sizeof(struct dbn),"db.c::db_alloc",ERS_OPT_NONE);
+	if (!(options&DB_OPT_FLAT))
+		db->nodes = ers_new(sizeof(struct dbn),"db.c::db_alloc",ERS_OPT_NONE);
 	db->cmp = db_default_cmp(type);
 	db->hash = db_default_hash(type);
 	db->release = db_default_release(type, options);
@@ -2457,6 +3313,24 @@ DBMap *db_alloc(const char *file, int line, DBType type, DBOptions options, unsi
 	if( db->maxlen == 0 && (type == DB_STRING || type == DB_ISTRING) )
 		db->maxlen = UINT16_MAX;
 
+	/* Flat database */
+	db->flat_free = DB_FLAT_NONE;
+	db->flat_pending = DB_FLAT_NONE;
+	if (options&DB_OPT_FLAT) {
+		db->vtable.iterator = db_flat_iterator;
+		db->vtable.exists   = db_flat_exists;
+		db->vtable.get      = db_flat_get;
+		db->vtable.vgetall  = db_flat_vgetall;
+		db->vtable.vensure  = db_flat_vensure;
+		db->vtable.put      = db_flat_put;
+		db->vtable.remove   = db_flat_remove;
+		db->vtable.vforeach = db_flat_vforeach;
+		db->vtable.vclear   = db_flat_vclear;
+		CREATE(db->flat_slots, struct db_flat_slot, DB_FLAT_MIN_SLOTS);
+		db->flat_mask = DB_FLAT_MIN_SLOTS - 1;
+		db->flat_shift = 32 - 4; // log2(DB_FLAT_MIN_SLOTS)
+	}
+
 	return &db->vtable;
 }
 
@@ -115,6 +115,8 @@ typedef enum DBType {
  * @param DB_OPT_RELEASE_BOTH Releases both key and data.
  * @param DB_OPT_ALLOW_NULL_KEY Allow NULL keys in the database.
  * @param DB_OPT_ALLOW_NULL_DATA Allow NULL data in the database.
+ * @param DB_OPT_FLAT Stores the entries in a resizable open-addressing table 
+ *          instead of the hashtable of RED-BLACK trees.
  * @public
  * @see #db_fix_options(DBType,DBOptions)
  * @see #db_default_release(DBType,DBOptions)
@@ -128,6 +130,7 @@ typedef enum DBOptions {
 	DB_OPT_RELEASE_BOTH    = 6,
 	DB_OPT_ALLOW_NULL_KEY  = 8,
 	DB_OPT_ALLOW_NULL_DATA = 16,
+	DB_OPT_FLAT            = 32,
 } DBOptions;
 
 /**
@@ -6,13 +6,13 @@
 typedef struct EVDP_DATA EVDP_DATA;
 
 
-//#idef EVDP_EPOLL
+#if defined(__linux__)
 #include <sys/epoll.h>
 struct EVDP_DATA{
 	struct epoll_event ev_data;
 	bool ev_added;
 };
-//#endif
+#endif
 
 
 enum EVDP_EVENTFLAGS{
@@ -48,7 +48,7 @@ void evdp_final();
  *	Upon successfull call (changed connections) this function will write the connection
  *	Identifier & event  to the out_fds array. 
  *
- * @return 	0 -> Timeout, 	> 0 no of changed connections.
+ * @return 	0 -> Timeout (or interrupted by a signal), 	> 0 no of changed connections.
  */
 int32 evdp_wait(EVDP_EVENT *out_fds,	int32 max_events, 	int32 timeout_ticks);
 
@@ -70,8 +70,8 @@ int32 evdp_wait(EVDP_EVENT *out_fds,	int32 max_events, 	int32 timeout_ticks);
  * @param *ep	event data pointer for the connection 
  *
  * @note: 
- *	Listener type sockets are edge triggered, (see epoll manual for more information)
- *  - This basicaly means that youll receive one event, adn you have to accept until accept returns an error (nothing to accept)
+ *	Listener type sockets are level triggered, (see epoll manual for more information)
+ *  - This basicaly means that youll receive an event on every wait as long as there are pending connections to accept.
  *
  * MONITORS by default:   IN
  * 
@@ -8,6 +8,8 @@
 //
 //
 
+#if defined(__linux__)
+
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
@@ -19,15 +21,20 @@
 #include <sys/socket.h>
 
 #include "../common/cbasetypes.h"
+#include "../common/malloc.h"
 #include "../common/showmsg.h"
 #include "../common/evdp.h"
 
 
-#define EPOLL_MAX_PER_CYCLE 10	// Max Events to coalesc. per cycle. 
+#define EPOLL_MAX_PER_CYCLE 10	// Size hint for epoll_create (ignored by recent kernels).
 
 
 static int epoll_fd = -1;
 
+// Buffer for the events reported by epoll_wait, grows as requested by evdp_wait.
+static struct epoll_event *l_events = NULL;
+static int32 l_events_max = 0;
+
 
 void evdp_init(){
 		
@@ -47,20 +54,28 @@ void evdp_final(){
 		epoll_fd = -1;
 	}
 	
+	if(l_events != NULL){
+		aFree(l_events);
+		l_events = NULL;
+		l_events_max = 0;
+	}
+	
 }//end: evdp_final()
 
 
 int32 evdp_wait(EVDP_EVENT *out_fds, int32 max_events, int32 timeout_ticks){
-	struct epoll_event l_events[EPOLL_MAX_PER_CYCLE];
 	register struct epoll_event *ev;
 	register int nfds, n;
 	
-	if(max_events > EPOLL_MAX_PER_CYCLE)
-		max_events = EPOLL_MAX_PER_CYCLE;
+	if(max_events > l_events_max){
+		RECREATE(l_events, struct epoll_event, max_events);
+		l_events_max = max_events;
+	}
 	
 	nfds = epoll_wait( epoll_fd,  l_events,		max_events,		timeout_ticks);
 	if(nfds == -1){
-		// @TODO: check if core is in shutdown mode.  if - ignroe error.
+		if(errno == EINTR)
+			return 0; // interrupted by a signal, treat as timeout.
 		
 		ShowFatalError("evdp [EPOLL]: epoll_wait returned bad / unexpected status (errno: %u / %s)\n", errno, strerror(errno));
 		exit(1); //..
@@ -109,7 +124,7 @@ void evdp_remove(int32 fd,  EVDP_DATA *ep){
 
 bool evdp_addlistener(int32 fd, EVDP_DATA *ep){
 	
-	ep->ev_data.events = EPOLLET|EPOLLIN;
+	ep->ev_data.events = EPOLLIN;
 	ep->ev_data.data.fd = fd;
 	
 	// No check here for 'added ?'
@@ -230,3 +245,5 @@ void evdp_writable_remove(int32 fd, EVDP_DATA *ep){
 	
 	return;	
 }//end: evdp_writable_remove()
+
+#endif // __linux__
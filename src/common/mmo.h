@@ -433,6 +433,19 @@ struct mmo_charstatus {
 	uint32 uniqueitem_counter;
 };
 
+//Sections of mmo_charstatus sent by a partial save (map-server -> char-server 0x2b29)
+enum e_charsave_section {
+	CHARSAVE_STATUS    = 0x01, //Every field outside of the arrays below
+	CHARSAVE_MEMO      = 0x02,
+	CHARSAVE_INVENTORY = 0x04, //Changed slots only (same for cart, storage and skills)
+	CHARSAVE_CART      = 0x08,
+	CHARSAVE_STORAGE   = 0x10,
+	CHARSAVE_SKILL     = 0x20,
+	CHARSAVE_FRIENDS   = 0x40,
+	CHARSAVE_HOTKEYS   = 0x80,
+	CHARSAVE_ALL       = 0xFF,
+};
+
 typedef enum mail_status {
 	MAIL_NEW,
 	MAIL_UNREAD,
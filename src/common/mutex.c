@@ -200,11 +200,15 @@ void racond_wait( racond c,  ramutex m,  sysint timeout_ticks){
 	if(timeout_ticks < 0){
 		pthread_cond_wait( &c->hCond,  &m->hMutex );
 	}else{
+		// The deadline is an absolute time of the realtime clock
+		struct timeval now;
 		struct timespec wtime;
-		int64 exact_timeout = gettick() + timeout_ticks;
-	
-		wtime.tv_sec = exact_timeout/1000;
-		wtime.tv_nsec = (exact_timeout%1000)*1000000;
+		int64 nsec;
+
+		gettimeofday(&now, NULL);
+		nsec = (int64)now.tv_usec * 1000 + (int64)(timeout_ticks % 1000) * 1000000;
+		wtime.tv_sec = now.tv_sec + (time_t)(timeout_ticks / 1000 + nsec / 1000000000);
+		wtime.tv_nsec = (long)(nsec % 1000000000);
 		
 		pthread_cond_timedwait( &c->hCond,  &m->hMutex,  &wtime);
 	}
@@ -209,7 +209,13 @@ char* sErr(int code)
 	#define MSG_NOSIGNAL 0
 #endif
 
+#ifdef SOCKET_EPOLL
+// Events reported by the last evdp_wait(); the sockets that are ready to be read.
+static EVDP_EVENT* epoll_events = NULL;
+static int epoll_maxevents = 1024;
+#else
 fd_set readfds;
+#endif
 int fd_max;
 time_t last_tick;
 time_t stall_time = 60;
@@ -221,6 +227,17 @@ int naddr_ = 0;   // # of ip addresses
 // Larger packets cause a buffer overflow and stack corruption.
 static size_t socket_max_client_packet = 24576;
 
+// Maximum time (in msec) client bound data may wait in the write fifo so
+// that more packets go out per send() call. 0 sends on every loop iteration.
+static int send_max_latency = 0;
+// Size at which held client data is sent without waiting for send_max_latency.
+static size_t send_batch_size = 1400;
+// Whether some client data was held back in the last send pass.
+static bool send_held = false;
+
+// Outgoing packets and send() calls, to measure how many packets each call carries
+static unsigned int socket_packets_o = 0, socket_sends_o = 0;
+
 #ifdef SHOW_SERVER_STATS
 // Data I/O statistics
 static size_t socket_data_i = 0, socket_data_ci = 0, socket_data_qi = 0;
@@ -238,15 +255,24 @@ static time_t socket_data_last_tick = 0;
 // The connection is closed if it goes over the limit.
 #define WFIFO_MAX (1*1024*1024)
 
-struct socket_data* session[FD_SETSIZE];
+struct socket_data* session[MAXCONN];
 
 #ifdef SEND_SHORTLIST
-int send_shortlist_array[FD_SETSIZE];// we only support FD_SETSIZE sockets, limit the array to that
+int send_shortlist_array[MAXCONN];// we only support MAXCONN sockets, limit the array to that
 int send_shortlist_count = 0;// how many fd's are in the shortlist
-uint32 send_shortlist_set[(FD_SETSIZE+31)/32];// to know if specific fd's are already in the shortlist
+uint32 send_shortlist_set[(MAXCONN+31)/32];// to know if specific fd's are already in the shortlist
+#endif
+
+#ifdef PARSE_SHORTLIST
+int parse_shortlist_array[MAXCONN];// we only support MAXCONN sockets, limit the array to that
+int parse_shortlist_count = 0;// how many fd's are in the shortlist
+uint32 parse_shortlist_set[(MAXCONN+31)/32];// to know if specific fd's are already in the shortlist
+static int socket_stall_timer(int tid, unsigned int tick, int id, intptr_t data);
 #endif
 
 static int create_session(int fd, RecvFunc func_recv, SendFunc func_send, ParseFunc func_parse);
+static void socket_watch(int fd, bool listener);
+static void socket_unwatch(int fd);
 
 #ifndef MINICORE
 	int ip_rules = 1;
@@ -335,6 +361,9 @@ void set_eof(int fd)
 #ifdef SEND_SHORTLIST
 		// Add this socket to the shortlist for eof handling.
 		send_shortlist_add_fd(fd);
+#endif
+#ifdef PARSE_SHORTLIST
+		parse_shortlist_add_fd(fd);
 #endif
 		session[fd]->flag.eof = 1;
 	}
@@ -364,6 +393,9 @@ int recv_to_fifo(int fd)
 
 	session[fd]->rdata_size += len;
 	session[fd]->rdata_tick = last_tick;
+#ifdef PARSE_SHORTLIST
+	parse_shortlist_add_fd(fd);
+#endif
 #ifdef SHOW_SERVER_STATS
 	socket_data_i += len;
 	socket_data_qi += len;
@@ -385,6 +417,7 @@ int send_from_fifo(int fd)
 		return 0; // nothing to send
 
 	len = sSend(fd, (const char *) session[fd]->wdata, (int)session[fd]->wdata_size, MSG_NOSIGNAL);
+	socket_sends_o++;
 
 	if( len == SOCKET_ERROR ) { //An exception has occured
 		if( sErrno != S_EWOULDBLOCK ) {
@@ -417,6 +450,20 @@ int send_from_fifo(int fd)
 	return 0;
 }
 
+/// Returns true if the pending data of fd should wait for more packets
+/// before being sent (see send_max_latency).
+static bool send_hold(int fd)
+{
+	struct socket_data *s = session[fd];
+
+	if( send_max_latency <= 0 || s->flag.server || s->flag.eof || s->wdata_size >= send_batch_size )
+		return false;
+	if( DIFF_TICK(gettick(), s->wdata_tick) >= send_max_latency )
+		return false;
+	send_held = true;
+	return true;
+}
+
 /// Best effort - there's no warranty that the data will be sent.
 void flush_fifo(int fd)
 {
@@ -453,9 +500,9 @@ int connect_client(int listen_fd)
 		sClose(fd);
 		return -1;
 	}
-	if( fd >= FD_SETSIZE )
+	if( fd >= MAXCONN )
 	{// socket number too big
-		ShowError("connect_client: New socket #%d is greater than can we handle! Increase the value of FD_SETSIZE (currently %d) for your OS to fix this!\n", fd, FD_SETSIZE);
+		ShowError("connect_client: New socket #%d is greater than can we handle! Increase the value of MAXCONN (currently %d) to fix this!\n", fd, MAXCONN);
 		sClose(fd);
 		return -1;
 	}
@@ -471,10 +518,10 @@ int connect_client(int listen_fd)
 #endif
 
 	if( fd_max <= fd ) fd_max = fd + 1;
-	sFD_SET(fd,&readfds);
 
 	create_session(fd, recv_to_fifo, send_from_fifo, default_func_parse);
 	session[fd]->client_addr = ntohl(client_address.sin_addr.s_addr);
+	socket_watch(fd, false);
 
 	return fd;
 }
@@ -498,9 +545,9 @@ int make_listen_bind(uint32 ip, uint16 port)
 		sClose(fd);
 		return -1;
 	}
-	if( fd >= FD_SETSIZE )
+	if( fd >= MAXCONN )
 	{// socket number too big
-		ShowError("make_listen_bind: New socket #%d is greater than can we handle! Increase the value of FD_SETSIZE (currently %d) for your OS to fix this!\n", fd, FD_SETSIZE);
+		ShowError("make_listen_bind: New socket #%d is greater than can we handle! Increase the value of MAXCONN (currently %d) to fix this!\n", fd, MAXCONN);
 		sClose(fd);
 		return -1;
 	}
@@ -524,11 +571,11 @@ int make_listen_bind(uint32 ip, uint16 port)
 	}
 
 	if(fd_max <= fd) fd_max = fd + 1;
-	sFD_SET(fd, &readfds);
 
 	create_session(fd, connect_client, null_send, null_parse);
 	session[fd]->client_addr = 0; // just listens
 	session[fd]->rdata_tick = 0; // disable timeouts on this socket
+	socket_watch(fd, true);
 
 	return fd;
 }
@@ -550,9 +597,9 @@ int make_connection(uint32 ip, uint16 port, bool silent, int timeout) {
 		sClose(fd);
 		return -1;
 	}
-	if( fd >= FD_SETSIZE )
+	if( fd >= MAXCONN )
 	{// socket number too big
-		ShowError("make_connection: New socket #%d is greater than can we handle! Increase the value of FD_SETSIZE (currently %d) for your OS to fix this!\n", fd, FD_SETSIZE);
+		ShowError("make_connection: New socket #%d is greater than can we handle! Increase the value of MAXCONN (currently %d) to fix this!\n", fd, MAXCONN);
 		sClose(fd);
 		return -1;
 	}
@@ -577,10 +624,10 @@ int make_connection(uint32 ip, uint16 port, bool silent, int timeout) {
 	set_nonblocking(fd, 1);
 
 	if (fd_max <= fd) fd_max = fd + 1;
-	sFD_SET(fd,&readfds);
 
 	create_session(fd, recv_to_fifo, send_from_fifo, default_func_parse);
 	session[fd]->client_addr = ntohl(remote_address.sin_addr.s_addr);
+	socket_watch(fd, false);
 
 	return fd;
 }
@@ -596,9 +643,39 @@ static int create_session(int fd, RecvFunc func_recv, SendFunc func_send, ParseF
 	session[fd]->func_send  = func_send;
 	session[fd]->func_parse = func_parse;
 	session[fd]->rdata_tick = last_tick;
+	session[fd]->stall_tid = INVALID_TIMER;
+#ifdef PARSE_SHORTLIST
+	if( fd > 0 )// session[0] is never parsed
+		session[fd]->stall_tid = add_timer(gettick() + (unsigned int)(stall_time + 1) * 1000, socket_stall_timer, fd, 0);
+#endif
 	return 0;
 }
 
+/// Starts monitoring the socket for incoming data (or connections).
+static void socket_watch(int fd, bool listener)
+{
+#ifdef SOCKET_EPOLL
+	if( listener )
+		evdp_addlistener(fd, &session[fd]->evdp);
+	else
+		evdp_addclient(fd, &session[fd]->evdp);
+#else
+	sFD_SET(fd, &readfds);
+#endif
+}
+
+/// Stops monitoring the socket.
+/// Needs to be done before closing the socket.
+static void socket_unwatch(int fd)
+{
+#ifdef SOCKET_EPOLL
+	if( session[fd] )
+		evdp_remove(fd, &session[fd]->evdp);
+#else
+	sFD_CLR(fd, &readfds);
+#endif
+}
+
 static void delete_session(int fd)
 {
 	if( session_isValid(fd) ) {
@@ -722,6 +799,9 @@ int WFIFOSET(int fd, size_t len)
 			return 0;
 		}
 
+		if( s->wdata_size == 0 && send_max_latency > 0 )
+			s->wdata_tick = gettick(); // start of the batch
+		socket_packets_o++;
 	}
 	s->wdata_size += len;
 #ifdef SHOW_SERVER_STATS
@@ -747,12 +827,15 @@ int WFIFOSET(int fd, size_t len)
 
 int do_sockets(int next)
 {
+#ifndef SOCKET_EPOLL
 	fd_set rfd;
 	struct timeval timeout;
+#endif
 	int ret,i;
 
 	// PRESEND Timers are executed before do_sendrecv and can send packets and/or set sessions to eof.
 	// Send remaining data and process client-side disconnects here.
+	send_held = false;
 #ifdef SEND_SHORTLIST
 	send_shortlist_do_sends();
 #else
@@ -761,11 +844,30 @@ int do_sockets(int next)
 		if(!session[i])
 			continue;
 
-		if(session[i]->wdata_size)
+		if(session[i]->wdata_size && !send_hold(i))
 			session[i]->func_send(i);
 	}
 #endif
 
+	// wake up in time to send the data that was held back
+	if( send_held && next > send_max_latency )
+		next = send_max_latency;
+
+#ifdef SOCKET_EPOLL
+	// can timeout until the next tick
+	// (interrupted by a signal is reported as a timeout)
+	ret = evdp_wait(epoll_events, epoll_maxevents, next);
+
+	last_tick = time(NULL);
+
+	// only the sockets that became ready are reported
+	for( i = 0; i < ret; ++i )
+	{
+		int fd = epoll_events[i].fd;
+		if( session[fd] )
+			session[fd]->func_recv(fd);
+	}
+#else
 	// can timeout until the next tick
 	timeout.tv_sec  = next/1000;
 	timeout.tv_usec = next%1000*1000;
@@ -804,6 +906,7 @@ int do_sockets(int next)
 		}
 	}
 #endif
+#endif // SOCKET_EPOLL
 
 	// POSTSEND Send remaining data and handle eof sessions.
 #ifdef SEND_SHORTLIST
@@ -814,7 +917,7 @@ int do_sockets(int next)
 		if(!session[i])
 			continue;
 
-		if(session[i]->wdata_size)
+		if(session[i]->wdata_size && !send_hold(i))
 			session[i]->func_send(i);
 
 		if(session[i]->flag.eof) //func_send can't free a session, this is safe.
@@ -825,6 +928,9 @@ int do_sockets(int next)
 #endif
 
 	// parse input data on each socket
+#ifdef PARSE_SHORTLIST
+	parse_shortlist_do_parse();
+#else
 	for(i = 1; i < fd_max; i++)
 	{
 		if(!session[i])
@@ -852,12 +958,13 @@ int do_sockets(int next)
 		}
 		RFIFOFLUSH(i);
 	}
+#endif
 
 #ifdef SHOW_SERVER_STATS
 	if (last_tick != socket_data_last_tick) {
 		char buf[1024];
 
-		sprintf(buf, "In: %.03f kB/s (%.03f kB/s, Q: %.03f kB) | Out: %.03f kB/s (%.03f kB/s, Q: %.03f kB) | RAM: %.03f MB", socket_data_i/1024., socket_data_ci/1024., socket_data_qi/1024., socket_data_o/1024., socket_data_co/1024., socket_data_qo/1024., malloc_usage()/1024.);
+		sprintf(buf, "In: %.03f kB/s (%.03f kB/s, Q: %.03f kB) | Out: %.03f kB/s (%.03f kB/s, Q: %.03f kB, %.02f pkt/send) | RAM: %.03f MB", socket_data_i/1024., socket_data_ci/1024., socket_data_qi/1024., socket_data_o/1024., socket_data_co/1024., socket_data_qo/1024., socket_sends_o ? (double)socket_packets_o/socket_sends_o : 0., malloc_usage()/1024.);
 #ifdef _WIN32
 		SetConsoleTitle(buf);
 #else
@@ -866,6 +973,7 @@ int do_sockets(int next)
 		socket_data_last_tick = last_tick;
 		socket_data_i = socket_data_ci = 0;
 		socket_data_o = socket_data_co = 0;
+		socket_packets_o = socket_sends_o = 0;
 	}
 #endif
 
@@ -1166,6 +1274,17 @@ int socket_config_read(const char* cfgName)
 			access_debug = config_switch(w2);
 		else if (!strcmpi(w1,"socket_max_client_packet"))
 			socket_max_client_packet = strtoul(w2, NULL, 0);
+#endif
+		else if (!strcmpi(w1,"send_max_latency"))
+			send_max_latency = min(max(atoi(w2), 0), 1000);
+		else if (!strcmpi(w1,"send_batch_size"))
+			send_batch_size = (size_t)max(atoi(w2), 1);
+#ifdef SOCKET_EPOLL
+		else if (!strcmpi(w1,"epoll_maxevents")) {
+			epoll_maxevents = atoi(w2);
+			if( epoll_maxevents < 16 )
+				epoll_maxevents = 16;
+		}
 #endif
 		else if (!strcmpi(w1, "import"))
 			socket_config_read(w2);
@@ -1209,16 +1328,22 @@ void socket_final(void)
 	aFree(session[0]->session_data);
 	aFree(session[0]);
 	session[0] = NULL;
+
+#ifdef SOCKET_EPOLL
+	aFree(epoll_events);
+	epoll_events = NULL;
+	evdp_final();
+#endif
 }
 
 /// Closes a socket.
 void do_close(int fd)
 {
-	if( fd <= 0 ||fd >= FD_SETSIZE )
+	if( fd <= 0 ||fd >= MAXCONN )
 		return;// invalid
 
 	flush_fifo(fd); // Try to send what's left (although it might not succeed since it's a nonblocking socket)
-	sFD_CLR(fd, &readfds);// this needs to be done before closing the socket
+	socket_unwatch(fd);// this needs to be done before closing the socket
 	sShutdown(fd, SHUT_RDWR); // Disallow further reads/writes
 	sClose(fd); // We don't really care if these closing functions return an error, we are just shutting down and not reusing this socket.
 	if (session[fd]) delete_session(fd);
@@ -1309,7 +1434,7 @@ int socket_getips(uint32* ips, int max)
 void socket_init(void)
 {
 	char *SOCKET_CONF_FILENAME = "conf/packet_athena.conf";
-	unsigned int rlim_cur = FD_SETSIZE;
+	unsigned int rlim_cur = MAXCONN;
 
 #ifdef WIN32
 	{// Start up windows networking
@@ -1329,14 +1454,14 @@ void socket_init(void)
 #elif defined(HAVE_SETRLIMIT) && !defined(CYGWIN)
 	// NOTE: getrlimit and setrlimit have bogus behaviour in cygwin.
 	//       "Number of fds is virtually unlimited in cygwin" (sys/param.h)
-	{// set socket limit to FD_SETSIZE
+	{// set socket limit to MAXCONN
 		struct rlimit rlp;
 		if( 0 == getrlimit(RLIMIT_NOFILE, &rlp) )
 		{
-			rlp.rlim_cur = FD_SETSIZE;
+			rlp.rlim_cur = MAXCONN;
 			if( 0 != setrlimit(RLIMIT_NOFILE, &rlp) )
 			{// failed, try setting the maximum too (permission to change system limits is required)
-				rlp.rlim_max = FD_SETSIZE;
+				rlp.rlim_max = MAXCONN;
 				if( 0 != setrlimit(RLIMIT_NOFILE, &rlp) )
 				{// failed
 					const char *errmsg = error_msg();
@@ -1349,7 +1474,7 @@ void socket_init(void)
 					// report limit
 					getrlimit(RLIMIT_NOFILE, &rlp);
 					rlim_cur = rlp.rlim_cur;
-					ShowWarning("socket_init: failed to set socket limit to %d, setting to maximum allowed (original limit=%d, current limit=%d, maximum allowed=%d, %s).\n", FD_SETSIZE, rlim_ori, (int)rlp.rlim_cur, (int)rlp.rlim_max, errmsg);
+					ShowWarning("socket_init: failed to set socket limit to %d, setting to maximum allowed (original limit=%d, current limit=%d, maximum allowed=%d, %s).\n", MAXCONN, rlim_ori, (int)rlp.rlim_cur, (int)rlp.rlim_max, errmsg);
 				}
 			}
 		}
@@ -1359,16 +1484,28 @@ void socket_init(void)
 	// Get initial local ips
 	naddr_ = socket_getips(addr_,16);
 
+#ifndef SOCKET_EPOLL
 	sFD_ZERO(&readfds);
+#endif
 #if defined(SEND_SHORTLIST)
 	memset(send_shortlist_set, 0, sizeof(send_shortlist_set));
 #endif
 
 	socket_config_read(SOCKET_CONF_FILENAME);
 
+#ifdef SOCKET_EPOLL
+	evdp_init();
+	CREATE(epoll_events, EVDP_EVENT, epoll_maxevents);
+#endif
+
 	// Initialise last send-receive tick
 	last_tick = time(NULL);
 
+#ifdef PARSE_SHORTLIST
+	memset(parse_shortlist_set, 0, sizeof(parse_shortlist_set));
+	add_timer_func_list(socket_stall_timer, "socket_stall_timer");
+#endif
+
 	// session[0] is now currently used for disconnected sessions of the map server, and as such,
 	// Should hold enough buffer (it is a vacuum so to speak) as it is never flushed. [Skotlex]
 	create_session(0, null_recv, null_send, null_parse); //@FIXME this is causing leak
@@ -1385,7 +1522,7 @@ void socket_init(void)
 
 bool session_isValid(int fd)
 {
-	return ( fd > 0 && fd < FD_SETSIZE && session[fd] != NULL );
+	return ( fd > 0 && fd < MAXCONN && session[fd] != NULL );
 }
 
 bool session_isActive(int fd)
@@ -1534,7 +1671,7 @@ void send_shortlist_do_sends()
 		send_shortlist_array[i] = send_shortlist_array[send_shortlist_count];
 		send_shortlist_array[send_shortlist_count] = 0;
 
-		if( fd <= 0 || fd >= FD_SETSIZE )
+		if( fd <= 0 || fd >= MAXCONN )
 		{
 			ShowDebug("send_shortlist_do_sends: fd is out of range, corrupted memory? (fd=%d)\n", fd);
 			continue;
@@ -1549,8 +1686,8 @@ void send_shortlist_do_sends()
 		// check for the eof state.
 		if( session[fd] )
 		{
-			// Send data
-			if( session[fd]->wdata_size )
+			// Send data, unless it is being held for more packets
+			if( session[fd]->wdata_size && !send_hold(fd) )
 				session[fd]->func_send(fd);
 
 			// If it's been marked as eof, call the parse func on it so that
@@ -1566,3 +1703,120 @@ void send_shortlist_do_sends()
 	}
 }
 #endif
+
+#ifdef PARSE_SHORTLIST
+// Add a fd to the shortlist so that its parse function is called on the
+// next loop.
+void parse_shortlist_add_fd(int fd)
+{
+	int i;
+	int bit;
+
+	if( !session_isValid(fd) )
+		return;// out of range
+
+	i = fd/32;
+	bit = fd%32;
+
+	if( (parse_shortlist_set[i]>>bit)&1 )
+		return;// already in the list
+
+	if( parse_shortlist_count >= ARRAYLENGTH(parse_shortlist_array) )
+	{
+		ShowDebug("parse_shortlist_add_fd: shortlist is full, ignoring... (fd=%d shortlist.count=%d shortlist.length=%d)\n", fd, parse_shortlist_count, ARRAYLENGTH(parse_shortlist_array));
+		return;
+	}
+
+	// set the bit
+	parse_shortlist_set[i] |= 1<<bit;
+	// Add to the end of the shortlist array.
+	parse_shortlist_array[parse_shortlist_count++] = fd;
+}
+
+// Call the parse function of the sockets in the shortlist.
+void parse_shortlist_do_parse(void)
+{
+	int i;
+
+	for( i = parse_shortlist_count-1; i >= 0; --i )
+	{
+		int fd = parse_shortlist_array[i];
+		int idx = fd/32;
+		int bit = fd%32;
+
+		// Remove fd from shortlist, move the last fd to the current position
+		--parse_shortlist_count;
+		parse_shortlist_array[i] = parse_shortlist_array[parse_shortlist_count];
+		parse_shortlist_array[parse_shortlist_count] = 0;
+
+		if( fd <= 0 || fd >= MAXCONN )
+		{
+			ShowDebug("parse_shortlist_do_parse: fd is out of range, corrupted memory? (fd=%d)\n", fd);
+			continue;
+		}
+		if( ((parse_shortlist_set[idx]>>bit)&1) == 0 )
+		{
+			ShowDebug("parse_shortlist_do_parse: fd is not set, why is it in the shortlist? (fd=%d)\n", fd);
+			continue;
+		}
+		parse_shortlist_set[idx]&=~(1<<bit);// unset fd
+
+		if( !session[fd] )
+			continue;
+
+		session[fd]->func_parse(fd);
+
+		if( !session[fd] )
+			continue;
+
+		// after parse, check client's RFIFO size to know if there is an invalid packet (too big and not parsed)
+		if( session[fd]->rdata_size == RFIFO_SIZE && session[fd]->max_rdata == RFIFO_SIZE ) {
+			set_eof(fd);
+			continue;
+		}
+		RFIFOFLUSH(fd);
+
+		// Parse functions may leave data for later (packet limit per loop,
+		// waiting for another server...), so keep it in the shortlist.
+		if( RFIFOREST(fd) > 0 )
+			parse_shortlist_add_fd(fd);
+	}
+}
+
+/// Timer function.
+/// Checks if the session stalled (nothing received for stall_time seconds).
+/// The timer is not deleted when the session is closed, it just expires.
+static int socket_stall_timer(int tid, unsigned int tick, int id, intptr_t data)
+{
+	struct socket_data* s;
+	int idle;
+
+	if( !session_isValid(id) || session[id]->stall_tid != tid )
+		return 0;// session was closed
+
+	s = session[id];
+	s->stall_tid = INVALID_TIMER;
+
+	if( !s->rdata_tick || s->flag.eof )
+		return 0;// timeouts disabled or already closing
+
+	idle = DIFF_TICK(last_tick, s->rdata_tick);
+	if( idle <= stall_time )
+	{// check again when it would time out
+		s->stall_tid = add_timer(tick + (unsigned int)(stall_time - idle + 1) * 1000, socket_stall_timer, id, 0);
+		return 0;
+	}
+
+	if( s->flag.server ) {/* server is special */
+		if( s->flag.ping != 2 )/* only update if necessary otherwise it'd resend the ping unnecessarily */
+			s->flag.ping = 1;
+		// the parse function sends the ping and disconnects if it takes too long
+		parse_shortlist_add_fd(id);
+		s->stall_tid = add_timer(tick + 1000, socket_stall_timer, id, 0);
+	} else {
+		ShowInfo("Session #%d timed out\n", id);
+		set_eof(id);
+	}
+	return 0;
+}
+#endif
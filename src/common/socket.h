@@ -17,6 +17,26 @@
 
 #include <time.h>
 
+/// Use the epoll event dispatcher (see evdp.h) instead of select() to wait for
+/// network events. Only the sockets that became ready are reported, and the
+/// number of connections is no longer bound by FD_SETSIZE.
+/// Define SOCKET_SELECT to fall back to the portable select() loop.
+#if defined(__linux__) && !defined(SOCKET_SELECT)
+#define SOCKET_EPOLL
+#endif
+
+#ifdef SOCKET_EPOLL
+	#include "../common/evdp.h"
+	// Maximum number of concurrent connections (sessions).
+	#ifndef MAXCONN
+	#define MAXCONN 16384
+	#endif
+#else
+	// select() can't handle more than FD_SETSIZE sockets
+	#undef MAXCONN
+	#define MAXCONN FD_SETSIZE
+#endif
+
 #define FIFOSIZE_SERVERLINK 256*1024
 
 // socket I/O macros
@@ -85,19 +105,25 @@ struct socket_data
 	size_t max_rdata, max_wdata;
 	size_t rdata_size, wdata_size;
 	size_t rdata_pos;
+	unsigned int wdata_tick; // when the oldest pending data was queued (only tracked when send_max_latency is set)
 	time_t rdata_tick; // time of last recv (for detecting timeouts); zero when timeout is disabled
+	int stall_tid; // timer that checks for timeouts (see stall_time)
 
 	RecvFunc func_recv;
 	SendFunc func_send;
 	ParseFunc func_parse;
 
 	void* session_data; // stores application-specific data related to the session
+
+#ifdef SOCKET_EPOLL
+	EVDP_DATA evdp; // event dispatcher registration of this socket
+#endif
 };
 
 
 // Data prototype declaration
 
-extern struct socket_data* session[FD_SETSIZE];
+extern struct socket_data* session[MAXCONN];
 
 extern int fd_max;
 
@@ -163,4 +189,17 @@ void send_shortlist_add_fd(int fd);
 void send_shortlist_do_sends();
 #endif
 
+/// Only parse the sockets that received data, have unparsed data left or
+/// need eof handling, instead of calling the parse function of every session
+/// on each loop. Timeouts (stall_time) are checked by a timer per session.
+#define PARSE_SHORTLIST
+
+#ifdef PARSE_SHORTLIST
+// Add a fd to the shortlist so that its parse function is called on the
+// next loop.
+void parse_shortlist_add_fd(int fd);
+// Call the parse function of the sockets in the shortlist.
+void parse_shortlist_do_parse(void);
+#endif
+
 #endif /* _SOCKET_H_ */
@@ -31,6 +31,8 @@ struct Sql
 	MYSQL_ROW row;
 	unsigned long *lengths;
 	int keepalive;
+	SqlRecorder recorder; // Receives the queries instead of the server (Sql_SetRecorder)
+	void *recorder_data;
 };
 
 
@@ -79,6 +81,8 @@ Sql *Sql_Malloc(void)
 	self->lengths = NULL;
 	self->result = NULL;
 	self->keepalive = INVALID_TIMER;
+	self->recorder = NULL;
+	self->recorder_data = NULL;
 	self->handle.reconnect = 1;
 	return self;
 }
@@ -112,6 +116,40 @@ int Sql_Connect(Sql *self, const char *user, const char *passwd, const char *hos
 
 
 
+/// Establishes a connection for a thread other than the main one.
+int Sql_ConnectThread(Sql *self, const char *user, const char *passwd, const char *host, uint16 port, const char *db)
+{
+	if( self == NULL )
+		return SQL_ERROR;
+
+	StringBuf_Clear(&self->buf);
+	if( !mysql_real_connect(&self->handle, host, user, passwd, db, (unsigned int)port, NULL/*unix_socket*/, 0/*clientflag*/) )
+	{
+		ShowSQL("%s\n", mysql_error(&self->handle));
+		return SQL_ERROR;
+	}
+
+	return SQL_SUCCESS;
+}
+
+
+
+/// Prepares the calling thread for Sql_QueryRaw.
+void Sql_ThreadInit(void)
+{
+	mysql_thread_init();
+}
+
+
+
+/// Releases what Sql_ThreadInit set up for the calling thread.
+void Sql_ThreadEnd(void)
+{
+	mysql_thread_end();
+}
+
+
+
 /// Retrieves the timeout of the connection.
 int Sql_GetTimeout(Sql *self, uint32 *out_timeout)
 {
@@ -268,6 +306,11 @@ int Sql_QueryV(Sql *self, const char *query, va_list args)
 	Sql_FreeResult(self);
 	StringBuf_Clear(&self->buf);
 	StringBuf_Vprintf(&self->buf, query, args);
+	if( self->recorder )
+	{
+		self->recorder(StringBuf_Value(&self->buf), (size_t)StringBuf_Length(&self->buf), self->recorder_data);
+		return SQL_SUCCESS;
+	}
 	if( mysql_real_query(&self->handle, StringBuf_Value(&self->buf), (unsigned long)StringBuf_Length(&self->buf)) )
 	{
 		ShowSQL("DB error - %s\n", mysql_error(&self->handle));
@@ -295,6 +338,11 @@ int Sql_QueryStr(Sql *self, const char *query)
 	Sql_FreeResult(self);
 	StringBuf_Clear(&self->buf);
 	StringBuf_AppendStr(&self->buf, query);
+	if( self->recorder )
+	{
+		self->recorder(StringBuf_Value(&self->buf), (size_t)StringBuf_Length(&self->buf), self->recorder_data);
+		return SQL_SUCCESS;
+	}
 	if( mysql_real_query(&self->handle, StringBuf_Value(&self->buf), (unsigned long)StringBuf_Length(&self->buf)) )
 	{
 		ShowSQL("DB error - %s\n", mysql_error(&self->handle));
@@ -313,6 +361,44 @@ int Sql_QueryStr(Sql *self, const char *query)
 
 
 
+/// Executes a query without the memory manager or the console.
+int Sql_QueryRaw(Sql *self, const char *query, size_t query_len)
+{
+	if( self == NULL )
+		return SQL_ERROR;
+
+	Sql_FreeResult(self);
+	if( mysql_real_query(&self->handle, query, (unsigned long)query_len) )
+		return SQL_ERROR;
+	self->result = mysql_store_result(&self->handle);
+	if( mysql_errno(&self->handle) != 0 )
+		return SQL_ERROR;
+	return SQL_SUCCESS;
+}
+
+
+
+/// Sets the function that receives the queries instead of the server.
+void Sql_SetRecorder(Sql *self, SqlRecorder func, void *data)
+{
+	if( self == NULL )
+		return;
+	self->recorder = func;
+	self->recorder_data = data;
+}
+
+
+
+/// Returns the description of the last error of the connection.
+const char *Sql_Error(Sql *self)
+{
+	if( self == NULL )
+		return "";
+	return mysql_error(&self->handle);
+}
+
+
+
 /// Returns the number of the AUTO_INCREMENT column of the last INSERT/UPDATE query.
 uint64 Sql_LastInsertId(Sql *self)
 {
@@ -76,6 +76,28 @@ int Sql_Connect(Sql* self, const char* user, const char* passwd, const char* hos
 
 
 
+/// Establishes a connection for a thread other than the main one.
+/// No keepalive timer is set up, the handle reconnects by itself when needed.
+/// The thread can only use Sql_QueryRaw, Sql_Error, Sql_Ping and the functions
+/// that read a result (Sql_NextRow, Sql_GetData, Sql_FreeResult) with it,
+/// since the other functions use the memory manager or the console.
+///
+/// @return SQL_SUCCESS or SQL_ERROR
+int Sql_ConnectThread(Sql* self, const char* user, const char* passwd, const char* host, uint16 port, const char* db);
+
+
+
+/// Prepares the calling thread for Sql_QueryRaw.
+/// Must be called by the thread before it uses a handle, and paired with Sql_ThreadEnd.
+void Sql_ThreadInit(void);
+
+
+
+/// Releases what Sql_ThreadInit set up for the calling thread.
+void Sql_ThreadEnd(void);
+
+
+
 
 /// Retrieves the timeout of the connection.
 ///
@@ -150,6 +172,33 @@ int Sql_QueryStr(Sql* self, const char* query);
 
 
 
+/// Executes a query.
+/// The query is used directly and errors are not shown (see Sql_Error).
+/// Neither the memory manager nor the console are used, so it is safe
+/// for a thread other than the main one (see Sql_ConnectThread).
+///
+/// @return SQL_SUCCESS or SQL_ERROR
+int Sql_QueryRaw(Sql* self, const char* query, size_t query_len);
+
+
+
+/// Function that receives the queries of a handle instead of the server (see Sql_SetRecorder).
+typedef void (*SqlRecorder)(const char* query, size_t query_len, void* data);
+
+/// Makes Sql_Query, Sql_QueryV and Sql_QueryStr pass their queries to 'func'
+/// instead of running them. They succeed and there is no result.
+/// With a NULL 'func', the queries are run again.
+void Sql_SetRecorder(Sql* self, SqlRecorder func, void* data);
+
+
+
+/// Returns the description of the last error of the connection.
+///
+/// @return Error message, empty if there was no error
+const char* Sql_Error(Sql* self);
+
+
+
 /// Returns the number of the AUTO_INCREMENT column of the last INSERT/UPDATE query.
 ///
 /// @return Value of the auto-increment column
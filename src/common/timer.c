@@ -47,8 +47,35 @@ static int free_timer_list_pos = 0;
 /// @return negative if tid1 is top, positive if tid2 is top, 0 if equal
 #define DIFFTICK_MINTOPCMP(tid1,tid2) DIFF_TICK(timer_data[tid1].tick,timer_data[tid2].tick)
 
+#if defined(ENABLE_TIMER_WHEEL)
+// Hierarchical timing wheel (O(1) insert/cancel/reschedule).
+// The root wheel has one slot per millisecond for the next 256ms, each
+// upper level covers 64 slots of the level below it (32 bits in total).
+// Timers are moved down a level (cascaded) when the root wheel wraps.
+#define TW_ROOT_BITS 8
+#define TW_LEVEL_BITS 6
+#define TW_LEVELS 4
+#define TW_ROOT_SIZE (1<<TW_ROOT_BITS)
+#define TW_LEVEL_SIZE (1<<TW_LEVEL_BITS)
+#define TW_ROOT_MASK (TW_ROOT_SIZE-1)
+#define TW_LEVEL_MASK (TW_LEVEL_SIZE-1)
+#define TW_SLOTS (TW_ROOT_SIZE+TW_LEVELS*TW_LEVEL_SIZE)
+
+// wheel slots (heads of doubly linked lists of tid's)
+static int timer_wheel[TW_SLOTS];
+static int timer_wheel_count = 0;
+// next tick to be processed by the wheel
+static unsigned int timer_wheel_tick = 0;
+
+// links of each timer (same index as timer_data)
+static struct timer_link {
+	int prev, next;
+	int slot; // -1 if not in the wheel
+} *timer_links = NULL;
+#else
 // timer heap (binary heap of tid's)
 static BHEAP_VAR(int, timer_heap);
+#endif
 
 
 // server startup time
@@ -62,8 +89,157 @@ struct timer_func_list {
 	struct timer_func_list* next;
 	TimerFunc func;
 	char* name;
+	struct timer_profile profile;
 } *tfl_root = NULL;
 
+/*----------------------------
+ * 	Timer profiler
+ *----------------------------*/
+// Hash of the timer functions (open addressing), so do_timer can find the
+// profile of a function without walking tfl_root.
+#define TIMER_PROFILE_HASH 1024
+static struct timer_func_list* tfl_hash[TIMER_PROFILE_HASH];
+// Profile of the functions that were not registered with add_timer_func_list.
+static struct timer_profile tfl_unknown;
+static bool timer_profiling = false;
+static unsigned int timer_profile_start = 0;
+
+#define timer_profile_hash(func) ((unsigned int)(((uintptr_t)(func))>>4)&(TIMER_PROFILE_HASH-1))
+
+/// Returns a timestamp in microseconds, used to measure the execution time of timer functions.
+static uint64 timer_profile_clock(void)
+{
+#if defined(WIN32)
+	static LARGE_INTEGER freq = { 0 };
+	LARGE_INTEGER count;
+
+	if( !freq.QuadPart )
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (uint64)(count.QuadPart * 1000000 / freq.QuadPart);
+#elif defined(HAVE_MONOTONIC_CLOCK)
+	struct timespec tval;
+	clock_gettime(CLOCK_MONOTONIC, &tval);
+	return (uint64)tval.tv_sec * 1000000 + tval.tv_nsec / 1000;
+#else
+	struct timeval tval;
+	gettimeofday(&tval, NULL);
+	return (uint64)tval.tv_sec * 1000000 + tval.tv_usec;
+#endif
+}
+
+/// Adds a timer function to the profiler hash.
+static void timer_profile_insert(struct timer_func_list* tfl)
+{
+	unsigned int i = timer_profile_hash(tfl->func), n;
+
+	for( n = 0; n < TIMER_PROFILE_HASH; ++n, i = (i+1)&(TIMER_PROFILE_HASH-1) ) {
+		if( tfl_hash[i] == NULL ) {
+			tfl_hash[i] = tfl;
+			return;
+		}
+	}
+	ShowWarning("timer_profile_insert: hash is full, '%s' will be profiled as unknown.\n", tfl->name);
+}
+
+/// Returns the profile of a timer function.
+static struct timer_profile* timer_profile_get(TimerFunc func)
+{
+	unsigned int i = timer_profile_hash(func), n;
+
+	for( n = 0; n < TIMER_PROFILE_HASH && tfl_hash[i] != NULL; ++n, i = (i+1)&(TIMER_PROFILE_HASH-1) ) {
+		if( tfl_hash[i]->func == func )
+			return &tfl_hash[i]->profile;
+	}
+	return &tfl_unknown;
+}
+
+/// Accounts an execution of a timer function.
+static void timer_profile_add(TimerFunc func, int late, uint64 elapsed)
+{
+	struct timer_profile* profile = timer_profile_get(func);
+
+	profile->calls++;
+	profile->total_time += elapsed;
+	if( profile->max_time < elapsed )
+		profile->max_time = elapsed;
+	if( late > 0 ) {
+		profile->total_late += late;
+		if( profile->max_late < (unsigned int)late )
+			profile->max_late = late;
+	}
+}
+
+/// Enables/disables the timer profiler.
+void timer_profile_enable(bool enable)
+{
+	if( enable && !timer_profiling )
+		timer_profile_reset();
+	timer_profiling = enable;
+}
+
+/// Returns true if the timer profiler is enabled.
+bool timer_profile_enabled(void)
+{
+	return timer_profiling;
+}
+
+/// Clears the data collected by the timer profiler.
+void timer_profile_reset(void)
+{
+	struct timer_func_list* tfl;
+
+	for( tfl = tfl_root; tfl != NULL; tfl = tfl->next )
+		memset(&tfl->profile, 0, sizeof(tfl->profile));
+	memset(&tfl_unknown, 0, sizeof(tfl_unknown));
+	timer_profile_start = gettick();
+}
+
+/// Sorts timer functions by total execution time (biggest first).
+static int timer_profile_cmp(const void* a, const void* b)
+{
+	const struct timer_profile* p1 = &(*(struct timer_func_list* const*)a)->profile;
+	const struct timer_profile* p2 = &(*(struct timer_func_list* const*)b)->profile;
+	return ( p1->total_time < p2->total_time ) ? 1 : ( p1->total_time > p2->total_time ) ? -1 : 0;
+}
+
+/// Displays the data collected by the timer profiler, sorted by total execution time.
+void timer_profile_report(void)
+{
+	struct timer_func_list* tfl;
+	struct timer_func_list** list;
+	int i, n = 0;
+
+	if( !timer_profiling ) {
+		ShowInfo("Timer profiler is disabled.\n");
+		return;
+	}
+
+	for( tfl = tfl_root; tfl != NULL; tfl = tfl->next )
+		++n;
+	CREATE(list, struct timer_func_list*, n + 1);
+	for( n = 0, tfl = tfl_root; tfl != NULL; tfl = tfl->next )
+		if( tfl->profile.calls )
+			list[n++] = tfl;
+	qsort(list, n, sizeof(struct timer_func_list*), timer_profile_cmp);
+
+	ShowMessage(CL_BOLD"[Timer profile of the last %u seconds, delays in ms]\n"CL_NORMAL, DIFF_TICK(gettick(), timer_profile_start) / 1000);
+	ShowMessage("\t%-30s %10s %12s %10s %10s %10s %10s\n", "function", "calls", "total(ms)", "avg(us)", "max(us)", "avg delay", "max delay");
+	for( i = 0; i < n; ++i ) {
+		const struct timer_profile* p = &list[i]->profile;
+
+		ShowMessage("\t%-30s %10u %12.3f %10u %10u %10u %10u\n", list[i]->name, p->calls, p->total_time / 1000.,
+			(unsigned int)(p->total_time / p->calls), (unsigned int)p->max_time, (unsigned int)(p->total_late / p->calls), p->max_late);
+	}
+	if( tfl_unknown.calls ) {
+		const struct timer_profile* p = &tfl_unknown;
+
+		ShowMessage("\t%-30s %10u %12.3f %10u %10u %10u %10u\n", "unknown timer function", p->calls, p->total_time / 1000.,
+			(unsigned int)(p->total_time / p->calls), (unsigned int)p->max_time, (unsigned int)(p->total_late / p->calls), p->max_late);
+	}
+	aFree(list);
+}
+
 /// Sets the name of a timer function.
 int add_timer_func_list(TimerFunc func, char* name)
 {
@@ -82,6 +258,7 @@ int add_timer_func_list(TimerFunc func, char* name)
 		tfl->func = func;
 		tfl->name = aStrdup(name);
 		tfl_root = tfl;
+		timer_profile_insert(tfl);
 	}
 	return 0;
 }
@@ -194,6 +371,74 @@ unsigned int gettick(void)
 #endif
 //////////////////////////////////////////////////////////////////////////
 
+#if defined(ENABLE_TIMER_WHEEL)
+/*======================================
+ * 	CORE : Timer Wheel
+ *--------------------------------------*/
+
+/// Adds a timer to the slot of the wheel that matches its tick.
+static void timer_wheel_link(int tid)
+{
+	unsigned int expires = timer_data[tid].tick;
+	int delta = DIFF_TICK(expires, timer_wheel_tick);
+	int slot, head;
+
+	if( delta < 0 )// already expired, process it as soon as possible
+		slot = timer_wheel_tick&TW_ROOT_MASK;
+	else if( delta < TW_ROOT_SIZE )
+		slot = expires&TW_ROOT_MASK;
+	else {
+		int level = 0;
+
+		while( level < TW_LEVELS-1 && delta >= 1<<(TW_ROOT_BITS+(level+1)*TW_LEVEL_BITS) )
+			++level;
+		slot = TW_ROOT_SIZE + level*TW_LEVEL_SIZE + ((expires>>(TW_ROOT_BITS+level*TW_LEVEL_BITS))&TW_LEVEL_MASK);
+	}
+
+	head = timer_wheel[slot];
+	timer_links[tid].prev = INVALID_TIMER;
+	timer_links[tid].next = head;
+	timer_links[tid].slot = slot;
+	if( head != INVALID_TIMER )
+		timer_links[head].prev = tid;
+	timer_wheel[slot] = tid;
+	++timer_wheel_count;
+}
+
+/// Removes a timer from the wheel.
+static void timer_wheel_unlink(int tid)
+{
+	struct timer_link* link = &timer_links[tid];
+
+	if( link->prev != INVALID_TIMER )
+		timer_links[link->prev].next = link->next;
+	else
+		timer_wheel[link->slot] = link->next;
+	if( link->next != INVALID_TIMER )
+		timer_links[link->next].prev = link->prev;
+	link->prev = link->next = INVALID_TIMER;
+	link->slot = -1;
+	--timer_wheel_count;
+}
+
+/// Moves the timers of a slot of an upper level to the levels below.
+/// Returns the index of the slot in its level.
+static int timer_wheel_cascade(int level, int index)
+{
+	int slot = TW_ROOT_SIZE + level*TW_LEVEL_SIZE + index;
+	int tid = timer_wheel[slot];
+
+	timer_wheel[slot] = INVALID_TIMER;
+	while( tid != INVALID_TIMER ) {
+		int next = timer_links[tid].next;
+
+		--timer_wheel_count;
+		timer_wheel_link(tid);
+		tid = next;
+	}
+	return index;
+}
+#else
 /*======================================
  * 	CORE : Timer Heap
  *--------------------------------------*/
@@ -204,6 +449,7 @@ static void push_timer_heap(int tid)
 	BHEAP_ENSURE(timer_heap, 1, 256);
 	BHEAP_PUSH(timer_heap, tid, DIFFTICK_MINTOPCMP, swap);
 }
+#endif
 
 /*==========================
  * 	Timer Management
@@ -233,6 +479,14 @@ static int acquire_timer(void)
 		else
 			CREATE(timer_data, struct TimerData, timer_data_max);
 		memset(timer_data + (timer_data_max - 256), 0, sizeof(struct TimerData)*256);
+#if defined(ENABLE_TIMER_WHEEL)
+		RECREATE(timer_links, struct timer_link, timer_data_max);
+		for( tid = timer_data_max - 256; tid < timer_data_max; ++tid ) {
+			timer_links[tid].prev = timer_links[tid].next = INVALID_TIMER;
+			timer_links[tid].slot = -1;
+		}
+		tid = timer_data_num;
+#endif
 	}
 
 	if( tid >= timer_data_num )
@@ -241,6 +495,28 @@ static int acquire_timer(void)
 	return tid;
 }
 
+/// Puts a timer id back in the list of free timers.
+static void release_timer(int tid)
+{
+	timer_data[tid].type = 0;
+	if (free_timer_list_pos >= free_timer_list_max) {
+		free_timer_list_max += 256;
+		RECREATE(free_timer_list,int,free_timer_list_max);
+		memset(free_timer_list + (free_timer_list_max - 256), 0, 256 * sizeof(int));
+	}
+	free_timer_list[free_timer_list_pos++] = tid;
+}
+
+/// Adds a timer to the timer_heap (or the wheel)
+static void push_timer(int tid)
+{
+#if defined(ENABLE_TIMER_WHEEL)
+	timer_wheel_link(tid);
+#else
+	push_timer_heap(tid);
+#endif
+}
+
 /// Starts a new timer that is deleted once it expires (single-use).
 /// Returns the timer's id.
 int add_timer(unsigned int tick, TimerFunc func, int id, intptr_t data)
@@ -254,7 +530,7 @@ int add_timer(unsigned int tick, TimerFunc func, int id, intptr_t data)
 	timer_data[tid].data     = data;
 	timer_data[tid].type     = TIMER_ONCE_AUTODEL;
 	timer_data[tid].interval = 1000;
-	push_timer_heap(tid);
+	push_timer(tid);
 
 	return tid;
 }
@@ -277,7 +553,7 @@ int add_timer_interval(unsigned int tick, TimerFunc func, int id, intptr_t data,
 	timer_data[tid].data     = data;
 	timer_data[tid].type     = TIMER_INTERVAL;
 	timer_data[tid].interval = interval;
-	push_timer_heap(tid);
+	push_timer(tid);
 
 	return tid;
 }
@@ -303,7 +579,17 @@ int delete_timer(int tid, TimerFunc func)
 	}
 
 	timer_data[tid].func = NULL;
+#if defined(ENABLE_TIMER_WHEEL)
+	if( timer_links[tid].slot != -1 )
+	{// cancel right away, no dead entry is left behind
+		timer_wheel_unlink(tid);
+		release_timer(tid);
+	}
+	else// being executed, do_timer releases it
+		timer_data[tid].type = TIMER_ONCE_AUTODEL|(timer_data[tid].type&TIMER_REMOVE_HEAP);
+#else
 	timer_data[tid].type = TIMER_ONCE_AUTODEL;
+#endif
 
 	return 0;
 }
@@ -319,6 +605,25 @@ int addtick_timer(int tid, unsigned int tick)
 /// Returns the new tick value, or -1 if it fails.
 int settick_timer(int tid, unsigned int tick)
 {
+#if defined(ENABLE_TIMER_WHEEL)
+	if( tid < 0 || tid >= timer_data_num || timer_links[tid].slot == -1 )
+	{
+		ShowError("settick_timer: no such timer %d (%p(%s))\n", tid, timer_data[tid].func, search_timer_func_list(timer_data[tid].func));
+		return -1;
+	}
+
+	if( (int)tick == -1 )
+		tick = 0;// add 1ms to avoid the error value -1
+
+	if( timer_data[tid].tick == tick )
+		return (int)tick;// nothing to do, already in propper position
+
+	// unlink and link adjusted timer
+	timer_wheel_unlink(tid);
+	timer_data[tid].tick = tick;
+	timer_wheel_link(tid);
+	return (int)tick;
+#else
 	size_t i;
 
 	// search timer position
@@ -340,10 +645,101 @@ int settick_timer(int tid, unsigned int tick)
 	timer_data[tid].tick = tick;
 	BHEAP_PUSH(timer_heap, tid, DIFFTICK_MINTOPCMP, swap);
 	return (int)tick;
+#endif
+}
+
+/// Executes a timer that was removed from the heap (or the wheel) and
+/// releases or restarts it afterwards.
+static void run_timer(int tid, unsigned int tick, int diff)
+{
+	timer_data[tid].type |= TIMER_REMOVE_HEAP;
+
+	if( timer_data[tid].func )
+	{
+		TimerFunc func = timer_data[tid].func;
+		uint64 start = 0;
+
+		if( timer_profiling )
+			start = timer_profile_clock();
+
+		if( diff < -1000 )
+			// timer was delayed for more than 1 second, use current tick instead
+			func(tid, tick, timer_data[tid].id, timer_data[tid].data);
+		else
+			func(tid, timer_data[tid].tick, timer_data[tid].id, timer_data[tid].data);
+
+		if( timer_profiling )
+			timer_profile_add(func, -diff, timer_profile_clock() - start);
+	}
+
+	// in the case the function didn't change anything...
+	if( timer_data[tid].type & TIMER_REMOVE_HEAP )
+	{
+		timer_data[tid].type &= ~TIMER_REMOVE_HEAP;
+
+		switch( timer_data[tid].type )
+		{
+		default:
+		case TIMER_ONCE_AUTODEL:
+			release_timer(tid);
+		break;
+		case TIMER_INTERVAL:
+			if( DIFF_TICK(timer_data[tid].tick, tick) < -1000 )
+				timer_data[tid].tick = tick + timer_data[tid].interval;
+			else
+				timer_data[tid].tick += timer_data[tid].interval;
+			push_timer(tid);
+		break;
+		}
+	}
 }
 
 /// Executes all expired timers.
 /// Returns the value of the smallest non-expired timer (or 1 second if there aren't any).
+#if defined(ENABLE_TIMER_WHEEL)
+int do_timer(unsigned int tick)
+{
+	int diff, i;
+
+	// process all slots up to the current tick
+	while( DIFF_TICK(tick, timer_wheel_tick) >= 0 )
+	{
+		int index = timer_wheel_tick&TW_ROOT_MASK;
+		int tid;
+
+		// root wheel wrapped, bring down the timers of the upper levels
+		if( !index )
+		{
+			int level;
+
+			for( level = 0; level < TW_LEVELS; ++level )
+				if( timer_wheel_cascade(level, (timer_wheel_tick>>(TW_ROOT_BITS+level*TW_LEVEL_BITS))&TW_LEVEL_MASK) )
+					break;
+		}
+
+		// timers added to this slot while processing it are also executed
+		while( (tid = timer_wheel[index]) != INVALID_TIMER )
+		{
+			timer_wheel_unlink(tid);
+			run_timer(tid, tick, DIFF_TICK(timer_data[tid].tick, tick));
+		}
+
+		++timer_wheel_tick;
+	}
+
+	// time until the next non-empty slot (or until the root wheel wraps)
+	for( i = 0; i < TW_ROOT_SIZE; ++i )
+	{
+		unsigned int next = timer_wheel_tick + i;
+
+		if( timer_wheel[next&TW_ROOT_MASK] != INVALID_TIMER || !(next&TW_ROOT_MASK) || i >= TIMER_MAX_INTERVAL )
+			break;
+	}
+	diff = DIFF_TICK(timer_wheel_tick + i, tick);
+
+	return cap_value(diff, TIMER_MIN_INTERVAL, TIMER_MAX_INTERVAL);
+}
+#else
 int do_timer(unsigned int tick)
 {
 	int diff = TIMER_MAX_INTERVAL; // return value
@@ -359,46 +755,59 @@ int do_timer(unsigned int tick)
 
 		// remove timer
 		BHEAP_POP(timer_heap, DIFFTICK_MINTOPCMP, swap);
-		timer_data[tid].type |= TIMER_REMOVE_HEAP;
+		run_timer(tid, tick, diff);
+	}
 
-		if( timer_data[tid].func )
-		{
-			if( diff < -1000 )
-				// timer was delayed for more than 1 second, use current tick instead
-				timer_data[tid].func(tid, tick, timer_data[tid].id, timer_data[tid].data);
-			else
-				timer_data[tid].func(tid, timer_data[tid].tick, timer_data[tid].id, timer_data[tid].data);
-		}
+	return cap_value(diff, TIMER_MIN_INTERVAL, TIMER_MAX_INTERVAL);
+}
+#endif
 
-		// in the case the function didn't change anything...
-		if( timer_data[tid].type & TIMER_REMOVE_HEAP )
-		{
-			timer_data[tid].type &= ~TIMER_REMOVE_HEAP;
-
-			switch( timer_data[tid].type )
-			{
-			default:
-			case TIMER_ONCE_AUTODEL:
-				timer_data[tid].type = 0;
-				if (free_timer_list_pos >= free_timer_list_max) {
-					free_timer_list_max += 256;
-					RECREATE(free_timer_list,int,free_timer_list_max);
-					memset(free_timer_list + (free_timer_list_max - 256), 0, 256 * sizeof(int));
-				}
-				free_timer_list[free_timer_list_pos++] = tid;
-			break;
-			case TIMER_INTERVAL:
-				if( DIFF_TICK(timer_data[tid].tick, tick) < -1000 )
-					timer_data[tid].tick = tick + timer_data[tid].interval;
-				else
-					timer_data[tid].tick += timer_data[tid].interval;
-				push_timer_heap(tid);
-			break;
-			}
-		}
+/// Sorts timer functions by address.
+static int timer_report_cmp(const void* a, const void* b)
+{
+	TimerFunc f1 = *(const TimerFunc*)a, f2 = *(const TimerFunc*)b;
+	return ( f1 < f2 ) ? -1 : ( f1 > f2 ) ? 1 : 0;
+}
+
+/// Displays the usage of the timer subsystem and the number of live timers
+/// of each timer function.
+void timer_report(void)
+{
+	TimerFunc* funcs;
+	int tid, i, live = 0, dead = 0;
+
+	CREATE(funcs, TimerFunc, max(timer_data_num,1));
+	for( tid = 0; tid < timer_data_num; ++tid ) {
+		if( !timer_data[tid].type )
+			continue;// free
+		if( timer_data[tid].func )
+			funcs[live++] = timer_data[tid].func;
+		else
+			++dead;// deleted, waiting to expire
 	}
 
-	return cap_value(diff, TIMER_MIN_INTERVAL, TIMER_MAX_INTERVAL);
+#if defined(ENABLE_TIMER_WHEEL)
+	ShowMessage(CL_BOLD"[Timer report (timing wheel)]\n"CL_NORMAL);
+	ShowMessage("\ttimers in the wheel : %d\n", timer_wheel_count);
+#else
+	ShowMessage(CL_BOLD"[Timer report (binary heap)]\n"CL_NORMAL);
+	ShowMessage("\ttimers in the heap  : %u\n", (unsigned int)BHEAP_LENGTH(timer_heap));
+#endif
+	ShowMessage("\tallocated timers    : %d\n", timer_data_max);
+	ShowMessage("\tlive timers         : %d\n", live);
+	ShowMessage("\tdeleted timers      : %d\n", dead);
+	ShowMessage("\tfree timers         : %d\n", free_timer_list_pos);
+
+	qsort(funcs, live, sizeof(TimerFunc), timer_report_cmp);
+	for( i = 0; i < live; ) {
+		int j = i;
+
+		while( j < live && funcs[j] == funcs[i] )
+			++j;
+		ShowMessage("\t%-30s : %d\n", search_timer_func_list(funcs[i]), j - i);
+		i = j;
+	}
+	aFree(funcs);
 }
 
 unsigned long get_uptime(void)
@@ -515,6 +924,11 @@ void timer_init(void)
 #endif
 
 	time(&start_time);
+
+#if defined(ENABLE_TIMER_WHEEL)
+	memset(timer_wheel, INVALID_TIMER, sizeof(timer_wheel));
+	timer_wheel_tick = gettick_nocache();
+#endif
 }
 
 void timer_final(void)
@@ -529,6 +943,10 @@ void timer_final(void)
 	}
 
 	if (timer_data) aFree(timer_data);
+#if defined(ENABLE_TIMER_WHEEL)
+	if (timer_links) aFree(timer_links);
+#else
 	BHEAP_CLEAR(timer_heap);
+#endif
 	if (free_timer_list) aFree(free_timer_list);
 }
@@ -34,6 +34,14 @@ struct TimerData {
 	intptr_t data;
 };
 
+// Execution statistics of a timer function (see timer_profile_enable)
+struct timer_profile {
+	unsigned int calls;
+	uint64 total_time, max_time; // execution time (microseconds)
+	uint64 total_late; // sum of the delays between the scheduled and the current tick (milliseconds)
+	unsigned int max_late;
+};
+
 // Function prototype declaration
 
 unsigned int gettick(void);
@@ -56,6 +64,12 @@ void split_time(int time, int* year, int* month, int* day, int* hour, int* minut
 double solve_time(char* modif_p);
 
 int do_timer(unsigned int tick);
+void timer_report(void);
+
+void timer_profile_enable(bool enable);
+bool timer_profile_enabled(void);
+void timer_profile_reset(void);
+void timer_profile_report(void);
 void timer_init(void);
 void timer_final(void);
 
@@ -3686,6 +3686,7 @@ ACMD_FUNC(reload)
 		memcpy(&prev_config, &battle_config, sizeof(prev_config));
 
 		battle_config_read(BATTLE_CONF_FILENAME);
+		status_bonus_cache_clear();
 
 		if( prev_config.item_rate_mvp          != battle_config.item_rate_mvp
 		||  prev_config.item_rate_common       != battle_config.item_rate_common
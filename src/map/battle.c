@@ -2107,6 +2107,116 @@ static int battle_skill_damage(struct block_list *src, struct block_list *target
 }
 #endif
 
+/// Caster side values of a skill attack, which don't depend on the target.
+struct s_battle_skill_info {
+	int nk, inf, blewcount;
+	short div_;
+	short range; //BF_SHORT/BF_LONG, 0 when it depends on the distance to the target
+	short ele, sc_ele; //Skill element, sc_ele is the caster's status element when ele is -2
+	uint16 atk_id; //Skill the bonuses below were looked up for
+	int skillatk, adjust;
+};
+
+/// Area attack in progress (see battle_area_begin).
+/// Every target of the area shares the caster side values looked up for the first one.
+static struct {
+	int depth;
+	bool valid;
+	int src_id;
+	uint16 skill_id, skill_lv;
+	unsigned int tick;
+	struct s_battle_skill_info info;
+} battle_area;
+
+/** Starts hitting the targets of an area attack
+ * Nested calls for the same src/skill/tick keep the values already looked up.
+ * @param src_id: Caster
+ * @param skill_id
+ * @param skill_lv
+ * @param tick
+ */
+void battle_area_begin(int src_id, uint16 skill_id, uint16 skill_lv, unsigned int tick)
+{
+	if(battle_area.src_id != src_id || battle_area.skill_id != skill_id || battle_area.skill_lv != skill_lv || battle_area.tick != tick) {
+		battle_area.valid = false;
+		battle_area.src_id = src_id;
+		battle_area.skill_id = skill_id;
+		battle_area.skill_lv = skill_lv;
+		battle_area.tick = tick;
+	}
+	battle_area.depth++;
+}
+
+/// Done hitting the targets of an area attack
+void battle_area_end(void)
+{
+	if(battle_area.depth > 0)
+		battle_area.depth--;
+}
+
+/// Drops the values looked up for bl, called whenever its status is recalculated
+void battle_area_clear(struct block_list *bl)
+{
+	if(battle_area.src_id == bl->id)
+		battle_area.valid = false;
+}
+
+/** Looks up the caster side values of a skill attack
+ * @param src: Caster
+ * @param skill_id
+ * @param skill_lv
+ * @param info: Storage used when there's no area attack in progress for this skill
+ * @return The values of the area attack in progress, or info filled in
+ */
+static struct s_battle_skill_info *battle_skill_info(struct block_list *src, uint16 skill_id, uint16 skill_lv, struct s_battle_skill_info *info)
+{
+	struct map_session_data *sd = BL_CAST(BL_PC, src);
+
+	if(battle_area.depth && battle_area.src_id == src->id && battle_area.skill_id == skill_id && battle_area.skill_lv == skill_lv) {
+		if(battle_area.valid)
+			return &battle_area.info;
+		battle_area.valid = true;
+		info = &battle_area.info;
+	}
+
+	info->nk = skill_get_nk(skill_id);
+	info->inf = skill_get_inf(skill_id);
+	info->div_ = skill_get_num(skill_id, skill_lv);
+	info->blewcount = skill_get_blewcount(skill_id, skill_lv);
+	if(sd)
+		info->blewcount += battle_blewcount_bonus(sd, skill_id);
+
+	//Skill Range Criteria, see battle_range_type
+	if(skill_get_inf2(skill_id)&INF2_TRAP || skill_id == NJ_KIRIKAGE)
+		info->range = BF_SHORT;
+	else if(battle_config.skillrange_by_distance && (src->type&battle_config.skillrange_by_distance))
+		info->range = 0;
+	else
+		info->range = (skill_get_range2(src, skill_id, skill_lv) < 5 ? BF_SHORT : BF_LONG);
+
+	info->ele = skill_get_ele(skill_id, skill_lv);
+	info->sc_ele = (info->ele == -2 ? status_get_attack_sc_element(src, status_get_sc(src)) : ELE_NEUTRAL);
+	info->atk_id = 0;
+	return info;
+}
+
+/** Looks up the skill damage bonuses of the caster for skill id
+ * @param info: Values from battle_skill_info
+ * @param src: Caster
+ * @param id: Skill the bonuses are given for
+ */
+static void battle_skill_info_bonus(struct s_battle_skill_info *info, struct block_list *src, uint16 id)
+{
+	struct map_session_data *sd = BL_CAST(BL_PC, src);
+
+	if(id && info->atk_id == id)
+		return;
+
+	info->atk_id = id;
+	info->skillatk = (sd ? pc_skillatk_bonus(sd, id) : 0);
+	info->adjust = battle_adjust_skill_damage(src->m, id);
+}
+
 struct Damage battle_calc_magic_attack(struct block_list *src, struct block_list *target, uint16 skill_id, uint16 skill_lv, int mflag);
 struct Damage battle_calc_misc_attack(struct block_list *src, struct block_list *target, uint16 skill_id, uint16 skill_lv, int mflag);
 
@@ -4953,7 +5063,7 @@ struct Damage battle_calc_weapon_final_atk_modifiers(struct Damage wd, struct bl
  *	Initial refactoring by Baalberith
  *	Refined and optimized by helvetica
  */
-static struct Damage initialize_weapon_data(struct block_list *src, struct block_list *target, uint16 skill_id, uint16 skill_lv, int wflag)
+static struct Damage initialize_weapon_data(struct block_list *src, struct block_list *target, uint16 skill_id, uint16 skill_lv, int wflag, struct s_battle_skill_info *info)
 {
 	struct status_data *sstatus = status_get_status_data(src);
 	struct status_data *tstatus = status_get_status_data(target);
@@ -4961,14 +5071,14 @@ static struct Damage initialize_weapon_data(struct block_list *src, struct block
 	struct Damage wd;
 
 	wd.type = DMG_NORMAL; //Normal attack
-	wd.div_ = (skill_id ? skill_get_num(skill_id, skill_lv) : 1);
+	wd.div_ = (skill_id ? info->div_ : 1);
 	//Amotion should be 0 for ground skills
-	wd.amotion = (skill_id && skill_get_inf(skill_id)&INF_GROUND_SKILL) ? 0 : sstatus->amotion;
+	wd.amotion = (skill_id && info->inf&INF_GROUND_SKILL) ? 0 : sstatus->amotion;
 	//Counter attack DOES obey ASPD delay on official, uncomment if you want the old (bad) behavior [helvetica]
 	//if(skill_id == KN_AUTOCOUNTER)
 		//wd.amotion >>= 1;
 	wd.dmotion = tstatus->dmotion;
-	wd.blewcount = skill_get_blewcount(skill_id, skill_lv);
+	wd.blewcount = (skill_id ? info->blewcount : 0);
 	wd.miscflag = wflag;
 	wd.flag = BF_WEAPON; //Initial Flag
 	//Baphomet card's splash damage is counted as a skill [Inkfish]
@@ -4982,11 +5092,8 @@ static struct Damage initialize_weapon_data(struct block_list *src, struct block
 
 	wd.dmg_lv = ATK_DEF; //This assumption simplifies the assignation later
 
-	if(sd)
-		wd.blewcount += battle_blewcount_bonus(sd, skill_id);
-
 	if(skill_id) {
-		wd.flag |= battle_range_type(src, target, skill_id, skill_lv);
+		wd.flag |= (info->range ? info->range : battle_range_type(src, target, skill_id, skill_lv));
 		switch(skill_id) {
 			case MH_SONIC_CRAW: {
 					TBL_HOM *hd = BL_CAST(BL_HOM, src);
@@ -5110,6 +5217,7 @@ struct Damage battle_calc_weapon_attack(struct block_list *src, struct block_lis
 	struct Damage wd;
 	struct status_change *sc, *tsc;
 	struct status_data *tstatus;
+	struct s_battle_skill_info skill_info, *info;
 	int right_element, left_element, nk;
 	uint16 id;
 	uint16 lv;
@@ -5126,7 +5234,12 @@ struct Damage battle_calc_weapon_attack(struct block_list *src, struct block_lis
 	tsc = status_get_sc(target);
 	tstatus = status_get_status_data(target);
 
-	wd = initialize_weapon_data(src, target, skill_id, skill_lv, wflag);
+	if(skill_id)
+		info = battle_skill_info(src, skill_id, skill_lv, &skill_info);
+	else
+		memset((info = &skill_info), 0, sizeof(skill_info));
+
+	wd = initialize_weapon_data(src, target, skill_id, skill_lv, wflag, info);
 
 	right_element = battle_get_weapon_element(wd, src, target, skill_id, skill_lv, EQI_HAND_R);
 	left_element = battle_get_weapon_element(wd, src, target, skill_id, skill_lv, EQI_HAND_L);
@@ -5237,8 +5350,10 @@ struct Damage battle_calc_weapon_attack(struct block_list *src, struct block_lis
 				break;
 		}
 
+		battle_skill_info_bonus(info, src, id);
+
 		//Add any miscellaneous player skill ATK rate bonuses
-		if(sd && (i = pc_skillatk_bonus(sd, id))) {
+		if(sd && (i = info->skillatk)) {
 			ATK_ADDRATE(wd.damage, wd.damage2, i);
 			RE_ALLATK_ADDRATE(wd, i);
 		}
@@ -5248,7 +5363,7 @@ struct Damage battle_calc_weapon_attack(struct block_list *src, struct block_lis
 			RE_ALLATK_ADDRATE(wd, -i);
 		}
 
-		if((i = battle_adjust_skill_damage(src->m, id))) {
+		if((i = info->adjust)) {
 			ATK_RATE(wd.damage, wd.damage2, i);
 			RE_ALLATK_RATE(wd, i);
 		}
@@ -5555,6 +5670,7 @@ struct Damage battle_calc_magic_attack(struct block_list *src, struct block_list
 	struct status_change *sc, *tsc;
 	struct Damage ad;
 	struct status_data *sstatus, *tstatus;
+	struct s_battle_skill_info skill_info, *info;
 	struct {
 		unsigned imdef : 1;
 		unsigned infdef : 1;
@@ -5570,18 +5686,19 @@ struct Damage battle_calc_magic_attack(struct block_list *src, struct block_list
 
 	sstatus = status_get_status_data(src);
 	tstatus = status_get_status_data(target);
+	info = battle_skill_info(src, skill_id, skill_lv, &skill_info);
 
 	//Initial Values
 	ad.damage = 1;
-	ad.div_ = skill_get_num(skill_id, skill_lv);
+	ad.div_ = info->div_;
 	//Amotion should be 0 for ground skills.
-	ad.amotion = (skill_get_inf(skill_id)&INF_GROUND_SKILL ? 0 : sstatus->amotion);
+	ad.amotion = (info->inf&INF_GROUND_SKILL ? 0 : sstatus->amotion);
 	ad.dmotion = tstatus->dmotion;
-	ad.blewcount = skill_get_blewcount(skill_id, skill_lv);
+	ad.blewcount = info->blewcount;
 	ad.miscflag = mflag;
 	ad.flag = BF_MAGIC|BF_SKILL;
 	ad.dmg_lv = ATK_DEF;
-	nk = skill_get_nk(skill_id);
+	nk = info->nk;
 	flag.imdef = (nk&NK_IGNORE_DEF ? 1 : 0);
 
 	sd = BL_CAST(BL_PC, src);
@@ -5590,14 +5707,14 @@ struct Damage battle_calc_magic_attack(struct block_list *src, struct block_list
 	tsc = status_get_sc(target);
 
 	//Initialize variables that will be used afterwards
-	s_ele = skill_get_ele(skill_id, skill_lv);
+	s_ele = info->ele;
 
 	if(s_ele == -1) { //Skill takes the weapon's element
 		s_ele = sstatus->rhw.ele;
 		if(sd && sd->spiritcharm_type != CHARM_TYPE_NONE && sd->spiritcharm >= MAX_SPIRITCHARM)
 			s_ele = sd->spiritcharm_type; //Summoning 10 spiritcharm will endow your weapon
 	} else if(s_ele == -2) //Use status element
-		s_ele = status_get_attack_sc_element(src, status_get_sc(src));
+		s_ele = info->sc_ele;
 	else if(s_ele == -3) //Use random element
 		s_ele = rnd()%ELE_ALL;
 
@@ -5629,13 +5746,11 @@ struct Damage battle_calc_magic_attack(struct block_list *src, struct block_list
 	}
 
 	//Set miscellaneous data that needs be filled
-	if(sd) {
+	if(sd)
 		sd->state.arrow_atk = 0;
-		ad.blewcount += battle_blewcount_bonus(sd, skill_id);
-	}
 
 	//Skill Range Criteria
-	ad.flag |= battle_range_type(src, target, skill_id, skill_lv);
+	ad.flag |= (info->range ? info->range : battle_range_type(src, target, skill_id, skill_lv));
 	flag.infdef = (tstatus->mode&MD_PLANT ? 1 : 0);
 
 	if(target->type == BL_SKILL) {
@@ -6167,20 +6282,22 @@ struct Damage battle_calc_magic_attack(struct block_list *src, struct block_list
 				break;
 		}
 
+		battle_skill_info_bonus(info, src, id);
+
 		if(sd) {
 			if(!flag.imdef &&
 				((sd->bonus.ignore_mdef_ele&(1<<tstatus->def_ele)) || (sd->bonus.ignore_mdef_ele&(1<<ELE_ALL)) ||
 				(sd->bonus.ignore_mdef_race&(1<<tstatus->race)) || (sd->bonus.ignore_mdef_race&(1<<RC_ALL)) ||
 				(sd->bonus.ignore_mdef_class&(1<<tstatus->class_)) || (sd->bonus.ignore_mdef_class&(1<<CLASS_ALL))))
 				flag.imdef = 1; //Ignore MDEF
-			if((i = pc_skillatk_bonus(sd, id)))
+			if((i = info->skillatk))
 				MATK_ADDRATE(i); //Damage rate bonuses
 		}
 
 		if(tsd && (i = pc_sub_skillatk_bonus(tsd, id)))
 			MATK_ADDRATE(-i);
 
-		if((i = battle_adjust_skill_damage(src->m, id)))
+		if((i = info->adjust))
 			MATK_RATE(i);
 
 		if(!flag.imdef) {
@@ -6353,6 +6470,7 @@ struct Damage battle_calc_misc_attack(struct block_list *src, struct block_list
 	struct map_session_data *sd, *tsd;
 	struct Damage md; //DO NOT CONFUSE with md of mob_data!
 	struct status_data *sstatus, *tstatus;
+	struct s_battle_skill_info skill_info, *info;
 
 	memset(&md, 0, sizeof(md));
 
@@ -6364,25 +6482,25 @@ struct Damage battle_calc_misc_attack(struct block_list *src, struct block_list
 	sstatus = status_get_status_data(src);
 	tstatus = status_get_status_data(target);
 
+	info = battle_skill_info(src, skill_id, skill_lv, &skill_info);
+
 	//Some initial values
-	md.amotion = (skill_get_inf(skill_id)&INF_GROUND_SKILL ? 0 : sstatus->amotion);
+	md.amotion = (info->inf&INF_GROUND_SKILL ? 0 : sstatus->amotion);
 	md.dmotion = tstatus->dmotion;
-	md.div_ = skill_get_num(skill_id, skill_lv);
-	md.blewcount = skill_get_blewcount(skill_id, skill_lv);
+	md.div_ = info->div_;
+	md.blewcount = info->blewcount;
 	md.miscflag = mflag;
 	md.flag = BF_MISC|BF_SKILL;
 	md.dmg_lv = ATK_DEF;
-	nk = skill_get_nk(skill_id);
+	nk = info->nk;
 
 	sd = BL_CAST(BL_PC, src);
 	tsd = BL_CAST(BL_PC, target);
 
-	if(sd) {
+	if(sd)
 		sd->state.arrow_atk = 0;
-		md.blewcount += battle_blewcount_bonus(sd, skill_id);
-	}
 
-	s_ele = skill_get_ele(skill_id, skill_lv);
+	s_ele = info->ele;
 	if(s_ele < 0 && s_ele != -3) {
 		if(skill_id == HT_BLITZBEAT || skill_id == SN_FALCONASSAULT)
 			s_ele = (sd && sd->bonus.arrow_ele ? sd->bonus.arrow_ele : sstatus->rhw.ele);
@@ -6392,7 +6510,7 @@ struct Damage battle_calc_misc_attack(struct block_list *src, struct block_list
 		s_ele = rnd()%ELE_ALL;
 
 	//Skill Range Criteria
-	md.flag |= battle_range_type(src, target, skill_id, skill_lv);
+	md.flag |= (info->range ? info->range : battle_range_type(src, target, skill_id, skill_lv));
 
 	switch(skill_id) {
 		case TF_THROWSTONE:
@@ -6732,13 +6850,15 @@ struct Damage battle_calc_misc_attack(struct block_list *src, struct block_list
 			break;
 	}
 
-	if(sd && (i = pc_skillatk_bonus(sd, id)))
+	battle_skill_info_bonus(info, src, id);
+
+	if(sd && (i = info->skillatk))
 		md.damage += md.damage * i / 100;
 
 	if(tsd && (i = pc_sub_skillatk_bonus(tsd, id)))
 		md.damage -= md.damage * i / 100;
 
-	if((i = battle_adjust_skill_damage(src->m, id)))
+	if((i = info->adjust))
 		md.damage = md.damage * i / 100;
 
 	if(md.damage > 0) {
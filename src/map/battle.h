@@ -119,6 +119,11 @@ bool battle_check_range(struct block_list *src, struct block_list *bl, int range
 
 void battle_consume_ammo(struct map_session_data *sd, uint16 skill_id, uint16 skill_lv);
 
+//Area attacks share the caster side values between their targets
+void battle_area_begin(int src_id, uint16 skill_id, uint16 skill_lv, unsigned int tick);
+void battle_area_end(void);
+void battle_area_clear(struct block_list *bl);
+
 bool target_has_infinite_defense(struct block_list *target, uint16 skill_id, int flag);
 
 //Settings
@@ -45,7 +45,7 @@ static const int packet_len_table[0x3d] = { // U - used, F - free
 	11,10,10,-1,11,-1,266,10,	// 2b10-2b17: U->2b10, U->2b11, U->2b12, U->2b13, U->2b14, U->2b15, U->2b16, U->2b17
 	 2,10, 2,-1,-1,-1, 2, 7,	// 2b18-2b1f: U->2b18, U->2b19, U->2b1a, U->2b1b, U->2b1c, U->2b1d, U->2b1e, U->2b1f
 	-1,10, 8, 2, 2,14,19,19,	// 2b20-2b27: U->2b20, U->2b21, U->2b22, U->2b23, U->2b24, U->2b25, U->2b26, U->2b27
-	-1, 0, 6,15, 0, 6,-1,-1,	// 2b28-2b2f: U->2b28, F->2b29, U->2b2a, U->2b2b, F->2b2c, U->2b2d, U->2b2e, U->2b2f
+	-1,-1, 6,15,10, 6,-1,-1,	// 2b28-2b2f: U->2b28, U->2b29, U->2b2a, U->2b2b, U->2b2c, U->2b2d, U->2b2e, U->2b2f
 };
 
 //Used Packets:
@@ -98,10 +98,10 @@ static const int packet_len_table[0x3d] = { // U - used, F - free
 //2b26: Outgoing, chrif_authreq -> 'client authentication request'
 //2b27: Incoming, chrif_authfail -> 'client authentication failed'
 //2b28: Outgoing, chrif_req_charban -> 'ban a specific char'
-//2b29: FREE
+//2b29: Outgoing, chrif_save_delta -> 'charsave of char XY account XY (changed sections only)'
 //2b2a: Outgoing, chrif_req_charunban -> 'unban a specific char'
 //2b2b: Incoming, chrif_parse_ack_vipActive -> vip info result
-//2b2c: FREE
+//2b2c: Incoming, chrif_parse_save_reset -> 'partial save failed, send the complete struct next time'
 //2b2d: Outgoing, chrif_bsdata_request -> request bonus_script for pc_authok'ed char.
 //2b2e: Outgoing, chrif_bsdata_save -> Send bonus_script of player for saving.
 //2b2f: Incoming, chrif_bsdata_received -> received bonus_script of player for loading.
@@ -164,8 +164,10 @@ bool chrif_auth_delete(int account_id, int char_id, enum sd_state state) {
 		if( node->char_dat )
 			aFree(node->char_dat);
 
-		if( node->sd )
+		if( node->sd ) {
+			chrif_save_reset(node->sd);
 			aFree(node->sd);
+		}
 
 		ers_free(auth_db_ers, node);
 		idb_remove(auth_db,account_id);
@@ -270,6 +272,191 @@ int chrif_isconnected(void) {
 	return (char_fd > 0 && session[char_fd] != NULL && chrif_state == 2);
 }
 
+//Fields of the CHARSAVE_STATUS section: up to memo_point and from show_equip
+#define CHARSAVE_HEAD offsetof(struct mmo_charstatus, memo_point)
+#define CHARSAVE_TAIL offsetof(struct mmo_charstatus, show_equip)
+
+/**
+ * Finds the slots of an array that changed since the last save
+ * @param cur : Current array
+ * @param sent : Array the char-server has
+ * @param size : Size of a slot
+ * @param max : Number of slots
+ * @param index : Receives the changed slots
+ * @return Number of changed slots
+ */
+static int chrif_delta_find(const void *cur, const void *sent, size_t size, int max, uint16 *index) {
+	int i, count = 0;
+
+	for (i = 0; i < max; i++) {
+		if (memcmp((const uint8 *)cur + i * size, (const uint8 *)sent + i * size, size))
+			index[count++] = i;
+	}
+
+	return count;
+}
+
+/**
+ * Writes changed slots to the partial save packet and marks them as sent
+ * <count>.W { <index>.W <slot>.?B }*
+ * @return Offset after the slots
+ */
+static int chrif_delta_slots(int offs, const void *cur, void *sent, size_t size, const uint16 *index, int count) {
+	int i;
+
+	WFIFOW(char_fd,offs) = count;
+	offs += 2;
+	for (i = 0; i < count; i++) {
+		WFIFOW(char_fd,offs) = index[i];
+		memcpy(WFIFOP(char_fd,offs + 2), (const uint8 *)cur + index[i] * size, size);
+		memcpy((uint8 *)sent + index[i] * size, (const uint8 *)cur + index[i] * size, size);
+		offs += 2 + size;
+	}
+
+	return offs;
+}
+
+/**
+ * Saves the sections of a character that changed since the last save (delta_save).
+ * Compares the status with the copy of what the char-server has (sd->status_sent),
+ * so the char-server does not compare nor receive the complete struct.
+ * 0x2b29 <len>.W <aid>.L <cid>.L <sections>.W { <section> }*
+ *   CHARSAVE_STATUS: <fields before memo_point>.?B <fields from show_equip>.?B
+ *   CHARSAVE_MEMO: <memo_point>.?B
+ *   CHARSAVE_INVENTORY, CHARSAVE_CART, CHARSAVE_SKILL: <count>.W { <index>.W <slot>.?B }*
+ *   CHARSAVE_STORAGE: <storage_amount>.L <count>.W { <index>.W <item>.?B }*
+ *   CHARSAVE_FRIENDS: <friends>.?B
+ *   CHARSAVE_HOTKEYS: <hotkeys>.?B
+ * @param sd : Player to save
+ * @return True if sent, false if the complete struct should be sent instead
+ */
+static bool chrif_save_delta(struct map_session_data *sd) {
+	static uint16 inventory[MAX_INVENTORY], cart[MAX_CART], storage[MAX_STORAGE], skill[MAX_SKILL];
+	struct mmo_charstatus *cur = &sd->status, *sent = sd->status_sent;
+	const struct point *last_point = (map[sd->bl.m].instance_id ? &cur->save_point : &cur->last_point); //Fake the position on instance maps
+	int inventory_count, cart_count, storage_count, skill_count;
+	int sections = 0, len = 14, offs = 14;
+
+	if (memcmp(cur, sent, offsetof(struct mmo_charstatus, last_point)) ||
+		memcmp(last_point, &sent->last_point, sizeof(struct point)) ||
+		memcmp(&cur->save_point, &sent->save_point, CHARSAVE_HEAD - offsetof(struct mmo_charstatus, save_point)) ||
+		memcmp((uint8 *)cur + CHARSAVE_TAIL, (uint8 *)sent + CHARSAVE_TAIL, sizeof(struct mmo_charstatus) - CHARSAVE_TAIL))
+	{
+		sections |= CHARSAVE_STATUS;
+		len += CHARSAVE_HEAD + sizeof(struct mmo_charstatus) - CHARSAVE_TAIL;
+	}
+	if (memcmp(cur->memo_point, sent->memo_point, sizeof(cur->memo_point))) {
+		sections |= CHARSAVE_MEMO;
+		len += sizeof(cur->memo_point);
+	}
+	if ((inventory_count = chrif_delta_find(cur->inventory, sent->inventory, sizeof(struct item), MAX_INVENTORY, inventory)) > 0) {
+		sections |= CHARSAVE_INVENTORY;
+		len += 2 + inventory_count * (2 + sizeof(struct item));
+	}
+	if ((cart_count = chrif_delta_find(cur->cart, sent->cart, sizeof(struct item), MAX_CART, cart)) > 0) {
+		sections |= CHARSAVE_CART;
+		len += 2 + cart_count * (2 + sizeof(struct item));
+	}
+	if ((storage_count = chrif_delta_find(cur->storage.items, sent->storage.items, sizeof(struct item), MAX_STORAGE, storage)) > 0 ||
+		cur->storage.storage_amount != sent->storage.storage_amount)
+	{
+		sections |= CHARSAVE_STORAGE;
+		len += 6 + storage_count * (2 + sizeof(struct item));
+	}
+	if ((skill_count = chrif_delta_find(cur->skill, sent->skill, sizeof(struct s_skill), MAX_SKILL, skill)) > 0) {
+		sections |= CHARSAVE_SKILL;
+		len += 2 + skill_count * (2 + sizeof(struct s_skill));
+	}
+	if (memcmp(cur->friends, sent->friends, sizeof(cur->friends))) {
+		sections |= CHARSAVE_FRIENDS;
+		len += sizeof(cur->friends);
+	}
+#ifdef HOTKEY_SAVING
+	if (memcmp(cur->hotkeys, sent->hotkeys, sizeof(cur->hotkeys))) {
+		sections |= CHARSAVE_HOTKEYS;
+		len += sizeof(cur->hotkeys);
+	}
+#endif
+
+	if (len >= sizeof(struct mmo_charstatus) + 13)
+		return false; //Not smaller than the complete struct
+
+	WFIFOHEAD(char_fd,len);
+	WFIFOW(char_fd,0) = 0x2b29;
+	WFIFOW(char_fd,2) = len;
+	WFIFOL(char_fd,4) = cur->account_id;
+	WFIFOL(char_fd,8) = cur->char_id;
+	WFIFOW(char_fd,12) = sections;
+
+	if (sections&CHARSAVE_STATUS) {
+		memcpy(sent, cur, CHARSAVE_HEAD);
+		memcpy(&sent->last_point, last_point, sizeof(struct point));
+		memcpy((uint8 *)sent + CHARSAVE_TAIL, (uint8 *)cur + CHARSAVE_TAIL, sizeof(struct mmo_charstatus) - CHARSAVE_TAIL);
+		memcpy(WFIFOP(char_fd,offs), sent, CHARSAVE_HEAD);
+		offs += CHARSAVE_HEAD;
+		memcpy(WFIFOP(char_fd,offs), (uint8 *)sent + CHARSAVE_TAIL, sizeof(struct mmo_charstatus) - CHARSAVE_TAIL);
+		offs += sizeof(struct mmo_charstatus) - CHARSAVE_TAIL;
+	}
+	if (sections&CHARSAVE_MEMO) {
+		memcpy(sent->memo_point, cur->memo_point, sizeof(cur->memo_point));
+		memcpy(WFIFOP(char_fd,offs), cur->memo_point, sizeof(cur->memo_point));
+		offs += sizeof(cur->memo_point);
+	}
+	if (sections&CHARSAVE_INVENTORY)
+		offs = chrif_delta_slots(offs, cur->inventory, sent->inventory, sizeof(struct item), inventory, inventory_count);
+	if (sections&CHARSAVE_CART)
+		offs = chrif_delta_slots(offs, cur->cart, sent->cart, sizeof(struct item), cart, cart_count);
+	if (sections&CHARSAVE_STORAGE) {
+		sent->storage.storage_amount = cur->storage.storage_amount;
+		WFIFOL(char_fd,offs) = cur->storage.storage_amount;
+		offs = chrif_delta_slots(offs + 4, cur->storage.items, sent->storage.items, sizeof(struct item), storage, storage_count);
+	}
+	if (sections&CHARSAVE_SKILL)
+		offs = chrif_delta_slots(offs, cur->skill, sent->skill, sizeof(struct s_skill), skill, skill_count);
+	if (sections&CHARSAVE_FRIENDS) {
+		memcpy(sent->friends, cur->friends, sizeof(cur->friends));
+		memcpy(WFIFOP(char_fd,offs), cur->friends, sizeof(cur->friends));
+		offs += sizeof(cur->friends);
+	}
+#ifdef HOTKEY_SAVING
+	if (sections&CHARSAVE_HOTKEYS) {
+		memcpy(sent->hotkeys, cur->hotkeys, sizeof(cur->hotkeys));
+		memcpy(WFIFOP(char_fd,offs), cur->hotkeys, sizeof(cur->hotkeys));
+		offs += sizeof(cur->hotkeys);
+	}
+#endif
+
+	WFIFOSET(char_fd,len);
+	return true;
+}
+
+/**
+ * Forgets what the char-server has of a character, the next save sends the complete struct
+ * @param sd : Player
+ */
+void chrif_save_reset(struct map_session_data *sd) {
+	if (sd->status_sent) {
+		aFree(sd->status_sent);
+		sd->status_sent = NULL;
+	}
+}
+
+static int chrif_save_reset_sub(struct map_session_data *sd, va_list ap) {
+	chrif_save_reset(sd);
+	return 0;
+}
+
+/**
+ * The char-server could not apply a partial save or could not write a save
+ * 0x2b2c <aid>.L <cid>.L
+ */
+static void chrif_parse_save_reset(int fd) {
+	struct map_session_data *sd = map_id2sd(RFIFOL(fd,2));
+
+	if (sd && sd->status.char_id == RFIFOL(fd,6))
+		chrif_save_reset(sd);
+}
+
 /*==========================================
  * Saves character data.
  * Flag = 1: Character is quitting
@@ -310,28 +497,36 @@ int chrif_save(struct map_session_data *sd, int flag) {
 	if (sd->state.reg_dirty&1)
 		intif_saveregistry(sd, 1); //Save account2 regs
 
-	mmo_charstatus_len = sizeof(sd->status) + 13;
-	WFIFOHEAD(char_fd,mmo_charstatus_len);
-	WFIFOW(char_fd,0) = 0x2b01;
-	WFIFOW(char_fd,2) = mmo_charstatus_len;
-	WFIFOL(char_fd,4) = sd->status.account_id;
-	WFIFOL(char_fd,8) = sd->status.char_id;
-	WFIFOB(char_fd,12) = (flag == 1) ? 1 : 0; //Flag to tell char-server this character is quitting.
-
-	//If the user is on a instance map, we have to fake his current position
-	if (map[sd->bl.m].instance_id) {
-		struct mmo_charstatus status;
-
-		//Copy the whole status
-		memcpy(&status, &sd->status, sizeof(struct mmo_charstatus));
-		//Change his current position to his savepoint
-		memcpy(&status.last_point, &status.save_point, sizeof(struct point));
-		//Copy the copied status into the packet
-		memcpy(WFIFOP(char_fd, 13), &status, sizeof(struct mmo_charstatus));
-	} else //Copy the whole status into the packet
-		memcpy(WFIFOP(char_fd, 13), &sd->status, sizeof(struct mmo_charstatus));
+	if (flag || !delta_save || sd->status_sent == NULL || !chrif_save_delta(sd)) { //Complete struct, unless only the changes can be sent
+		mmo_charstatus_len = sizeof(sd->status) + 13;
+		WFIFOHEAD(char_fd,mmo_charstatus_len);
+		WFIFOW(char_fd,0) = 0x2b01;
+		WFIFOW(char_fd,2) = mmo_charstatus_len;
+		WFIFOL(char_fd,4) = sd->status.account_id;
+		WFIFOL(char_fd,8) = sd->status.char_id;
+		WFIFOB(char_fd,12) = (flag == 1) ? 1 : 0; //Flag to tell char-server this character is quitting.
+
+		//If the user is on a instance map, we have to fake his current position
+		if (map[sd->bl.m].instance_id) {
+			struct mmo_charstatus status;
+
+			//Copy the whole status
+			memcpy(&status, &sd->status, sizeof(struct mmo_charstatus));
+			//Change his current position to his savepoint
+			memcpy(&status.last_point, &status.save_point, sizeof(struct point));
+			//Copy the copied status into the packet
+			memcpy(WFIFOP(char_fd, 13), &status, sizeof(struct mmo_charstatus));
+		} else //Copy the whole status into the packet
+			memcpy(WFIFOP(char_fd, 13), &sd->status, sizeof(struct mmo_charstatus));
+
+		if (delta_save && (!flag || flag == 3)) { //Keep what was sent for the next partial saves
+			if (sd->status_sent == NULL)
+				CREATE(sd->status_sent, struct mmo_charstatus, 1);
+			memcpy(sd->status_sent, WFIFOP(char_fd, 13), sizeof(struct mmo_charstatus));
+		}
 
-	WFIFOSET(char_fd, WFIFOW(char_fd,2));
+		WFIFOSET(char_fd, WFIFOW(char_fd,2));
+	}
 
 	if (sd->status.pet_id > 0 && sd->pd)
 		intif_save_petdata(sd->status.account_id, &sd->pd->pet);
@@ -497,6 +692,9 @@ int chrif_connectack(int fd) {
 
 	chrif_sendmap(fd);
 
+	//The char-server may have lost the saves in transit, send the complete structs again
+	map_foreachpc(chrif_save_reset_sub);
+
 	ShowStatus("Event '"CL_WHITE"OnInterIfInit"CL_RESET"' executed with '"CL_WHITE"%d"CL_RESET"' NPCs.\n", npc_event_doall("OnInterIfInit"));
 	if( !char_init_done ) {
 		char_init_done = true;
@@ -961,9 +1159,7 @@ int chrif_changedsex(int fd) {
 	if ((sd = map_id2sd(acc)) != NULL) {
 		int i;
 
-		for (i = 0; i < SC_MAX; i++) {
-			if (!sd->sc.data[i])
-				continue;
+		for (i = status_change_next(&sd->sc, SC_NONE); i != SC_NONE; i = status_change_next(&sd->sc, i)) {
 			switch (i) {
 				case SC_MOONSTAR:	case SC_SUPER_STAR:
 				case SC_STRANGELIGHTS:	case SC_DECORATION_OF_MUSIC:
@@ -1222,6 +1418,8 @@ int chrif_recvfamelist(int fd) {
 
 	total += num;
 
+	status_bonus_cache_clear(); //Forged weapons of ranked smiths get extra attack
+
 	ShowInfo("Received Fame List of '"CL_WHITE"%d"CL_RESET"' characters.\n", total);
 
 	return 0;
@@ -1262,14 +1460,12 @@ int chrif_save_scdata(struct map_session_data *sd) {
 	chrif_check(-1);
 	tick = gettick();
 
-	WFIFOHEAD(char_fd,14 + SC_MAX * sizeof(struct status_change_data));
+	WFIFOHEAD(char_fd,14 + sc->count * sizeof(struct status_change_data));
 	WFIFOW(char_fd,0) = 0x2b1c;
 	WFIFOL(char_fd,4) = sd->status.account_id;
 	WFIFOL(char_fd,8) = sd->status.char_id;
 
-	for (i = 0; i < SC_MAX; i++) {
-		if (!sc->data[i])
-			continue;
+	for (i = status_change_next(sc, SC_NONE); i != SC_NONE; i = status_change_next(sc, i)) {
 		if (sc->data[i]->timer != INVALID_TIMER) {
 			timer = get_timer(sc->data[i]->timer);
 			if (timer == NULL || timer->func != status_change_timer)
@@ -1774,6 +1970,7 @@ int chrif_parse(int fd) {
 			case 0x2b25: chrif_deadopt(RFIFOL(fd,2), RFIFOL(fd,6), RFIFOL(fd,10)); break;
 			case 0x2b27: chrif_authfail(fd); break;
 			case 0x2b2b: chrif_parse_ack_vipActive(fd); break;
+			case 0x2b2c: chrif_parse_save_reset(fd); break;
 			case 0x2b2f: chrif_bsdata_received(fd); break;
 			default:
 				ShowError("chrif_parse : unknown packet (session #%d): 0x%x. Disconnecting.\n", fd, cmd);
@@ -277,7 +277,7 @@ static bool clif_session_isValid(struct map_session_data *sd) {
 
 /*==========================================
  * sub process of clif_send
- * Called from a map_foreachinarea (grabs all players in specific area and subjects them to this function)
+ * Called from a map_foreachviewer (grabs all players in specific area and subjects them to this function)
  * In order to send area-wise packets, such as:
  * - AREA : everyone nearby your area
  * - AREA_WOSC (AREA WITHOUT SAME CHAT) : Not run for people in the same chat as yours
@@ -409,12 +409,10 @@ int clif_send(const uint8 *buf, int len, struct block_list *bl, enum send_target
 				clif_send(buf, len, bl, SELF);
 		case AREA_WOC:
 		case AREA_WOS:
-			map_foreachinarea(clif_send_sub, bl->m, bl->x - AREA_SIZE, bl->y - AREA_SIZE, bl->x + AREA_SIZE, bl->y + AREA_SIZE,
-				BL_PC, buf, len, bl, type);
+			map_foreachviewer(clif_send_sub, bl->m, bl->x, bl->y, AREA_SIZE, buf, len, bl, type);
 			break;
 		case AREA_CHAT_WOC:
-			map_foreachinarea(clif_send_sub, bl->m, bl->x - (AREA_SIZE - 5), bl->y - (AREA_SIZE - 5),
-				bl->x + (AREA_SIZE - 5), bl->y + (AREA_SIZE - 5), BL_PC, buf, len, bl, AREA_WOC);
+			map_foreachviewer(clif_send_sub, bl->m, bl->x, bl->y, AREA_SIZE - 5, buf, len, bl, AREA_WOC);
 			break;
 
 		case CHAT:
@@ -10614,7 +10612,7 @@ void clif_parse_GlobalMessage(int fd, struct map_session_data *sd)
 	sd->idletime = last_tick;
 
 	//Chat logging type 'O' / Global Chat
-	log_chat(LOG_CHAT_GLOBAL, 0, sd->status.char_id, sd->status.account_id, mapindex_id2name(sd->mapindex), sd->bl.x, sd->bl.y, NULL, message);
+	log_chat(LOG_CHAT_GLOBAL, 0, sd->status.char_id, sd->status.account_id, sd->mapindex, sd->bl.x, sd->bl.y, NULL, message);
 }
 
 
@@ -10895,7 +10893,7 @@ void clif_parse_WisMessage(int fd, struct map_session_data *sd)
 	sd->idletime = last_tick;
 
 	// Chat logging type 'W' / Whisper
-	log_chat(LOG_CHAT_WHISPER, 0, sd->status.char_id, sd->status.account_id, mapindex_id2name(sd->mapindex), sd->bl.x, sd->bl.y, target, message);
+	log_chat(LOG_CHAT_WHISPER, 0, sd->status.char_id, sd->status.account_id, sd->mapindex, sd->bl.x, sd->bl.y, target, message);
 
 	//-------------------------------------------------------//
 	//   Lordalfa - Paperboy - To whisper NPC commands       //
@@ -276,7 +276,7 @@ int intif_main_message(struct map_session_data *sd, const char *message)
 	intif_broadcast2(output, strlen(output) + 1, 0xFE000000, 0, 0, 0, 0);
 
 	//Log the chat message
-	log_chat(LOG_CHAT_MAINCHAT, 0, sd->status.char_id, sd->status.account_id, mapindex_id2name(sd->mapindex), sd->bl.x, sd->bl.y, NULL, message);
+	log_chat(LOG_CHAT_MAINCHAT, 0, sd->status.char_id, sd->status.account_id, sd->mapindex, sd->bl.x, sd->bl.y, NULL, message);
 
 	return 1;
 }
@@ -1407,6 +1407,7 @@ int intif_parse_Registers(int fd)
 	}
 
 	*qty = j;
+	pc_regindex_build(sd, RFIFOB(fd,12));
 
 	if (flag && sd->save_reg.global_num > -1 && sd->save_reg.account_num > -1 && sd->save_reg.account2_num > -1)
 		pc_reg_received(sd); //Received all registry values, execute init scripts and what-not. [Skotlex]
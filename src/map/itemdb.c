@@ -1593,6 +1593,7 @@ void itemdb_reload(void)
 	//Read new data
 	itemdb_read();
 	cashshop_reloaddb();
+	status_bonus_cache_clear();
 
 	//Epoque's awesome @reloaditemdb fix - thanks! [Ind]
 	//- Fixes the need of a @reloadmobdb after a @reloaditemdb to re-link monster drop data
@@ -1660,7 +1661,7 @@ void do_final_itemdb(void) {
  * Initializing Item DB
  */
 void do_init_itemdb(void) {
-	itemdb = uidb_alloc(DB_OPT_BASE);
+	itemdb = uidb_alloc(DB_OPT_FLAT);
 	itemdb_combo = uidb_alloc(DB_OPT_BASE);
 	itemdb_group = uidb_alloc(DB_OPT_BASE);
 	itemdb_create_dummy();
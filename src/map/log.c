@@ -2,10 +2,17 @@
 // For more information, see LICENCE in the main folder
 
 #include "../common/cbasetypes.h"
+#include "../common/atomic.h"
+#include "../common/binlog.h"
+#include "../common/malloc.h"
+#include "../common/mutex.h"
 #include "../common/sql.h" // SQL_INNODB
 #include "../common/strlib.h"
 #include "../common/nullpo.h"
 #include "../common/showmsg.h"
+#include "../common/thread.h"
+#include "../common/timer.h"
+#include "../common/utils.h" // cap_value
 #include "map.h"
 #include "battle.h"
 #include "itemdb.h"
@@ -51,6 +58,97 @@ struct Log_Config log_config;
 #endif
 
 
+/// Log tables (or files), in the order of log_columns
+enum e_log_target {
+	LOG_TARGET_BRANCH = BINLOG_BRANCH,
+	LOG_TARGET_PICK = BINLOG_PICK,
+	LOG_TARGET_ZENY = BINLOG_ZENY,
+	LOG_TARGET_MVPDROP = BINLOG_MVPDROP,
+	LOG_TARGET_GM = BINLOG_GM,
+	LOG_TARGET_NPC = BINLOG_NPC,
+	LOG_TARGET_CHAT = BINLOG_CHAT,
+	LOG_TARGET_CASH = BINLOG_CASH,
+	LOG_TARGET_MAX
+};
+
+
+/// Columns of the log tables, in the order of the values of a log entry
+static const char *log_columns[LOG_TARGET_MAX] = {
+	"`branch_date`, `account_id`, `char_id`, `char_name`, `map`",
+	"`time`, `char_id`, `type`, `nameid`, `amount`, `refine`, `card0`, `card1`, `card2`, `card3`, `map`, `unique_id`, `bound`",
+	"`time`, `char_id`, `src_id`, `type`, `amount`, `map`",
+	"`mvp_date`, `kill_char_id`, `monster_id`, `prize`, `mvpexp`, `map`",
+	"`atcommand_date`, `account_id`, `char_id`, `char_name`, `map`, `command`",
+	"`npc_date`, `account_id`, `char_id`, `char_name`, `map`, `mes`",
+	"`time`, `type`, `type_id`, `src_charid`, `src_accountid`, `src_map`, `src_map_x`, `src_map_y`, `dst_charname`, `message`",
+	"`time`, `char_id`, `type`, `cash_type`, `amount`, `map`",
+};
+
+
+/// Maximum length of the values (SQL) or the line (file) of a log entry
+#define LOG_ENTRY_LENGTH 1024
+
+/// Log entry, written right away or queued for the log writer
+struct log_entry {
+	enum e_log_target target;
+	uint16 length; // Bytes used in data
+	char data[LOG_ENTRY_LENGTH]; // Row of values (SQL), line without newline (file) or record (log_binary)
+};
+
+/// Slot of the log queue
+struct log_slot {
+	volatile int32 seq; // Position the slot can be filled for (pos) or written for (pos + 1)
+	struct log_entry entry;
+};
+
+/// Maximum number of entries the log writer takes from the queue at once
+#define LOG_WRITER_BATCH 512
+
+/// Queue positions wrap around
+#define log_pos_add(a,b) ((int32)((uint32)(a) + (uint32)(b)))
+#define log_pos_diff(a,b) ((int32)((uint32)(a) - (uint32)(b)))
+
+
+/// Log writer (log_async)
+/// Log entries go to a bounded lock-free queue (several producers, one consumer)
+/// and a thread writes them: one INSERT of many rows per table, or one append per file.
+/// It writes when log_async_rows entries are queued or log_async_delay ms passed.
+/// When the queue is full, log_push waits for the thread to make room.
+static struct {
+	rAthread thread;
+	ramutex lock;
+	racond wake;
+	Sql *handle; // Connection of the thread (sql_logs)
+	struct log_slot *slot;
+	int32 mask; // Size of the queue - 1
+	volatile int32 head; // Next position to fill
+	volatile int32 tail; // Next position to write
+	volatile int32 terminate;
+	volatile int32 written, batches, errors, stalls; // Statistics
+	int32 reported_errors, reported_stalls;
+	char error[256]; // Last error of the thread (protected by lock)
+	int timer;
+} log_writer;
+
+/// Queries (SQL) built by the log writer, or by log_push without a writer
+static char log_buffer[65536];
+
+/// Segment file of the binary logs (log_binary), used by whoever calls log_write
+static struct {
+	FILE *fp;
+	uint32 size; // Bytes written to the segment
+	uint32 count; // Segments opened, for the file names
+	uint32 index; // Offset of the last BINLOG_INDEX record, 0 if none
+	uint32 block; // Offset of the first record of the block
+	uint32 records, time_min, time_max; // Log records of the block
+	char maps[MAX_MAPINDEX][MAP_NAME_LENGTH]; // Names of the map numbers, from the BINLOG_MAPNAME entries
+	bool declared[MAX_MAPINDEX]; // Map names written in the block
+} log_segment;
+
+/// Map names given to the binary logs, by map index (game thread)
+static char log_binary_maps[MAX_MAPINDEX][MAP_NAME_LENGTH];
+
+
 /// Obtain log type character for item/zeny logs
 static char log_picktype2char(e_log_pick_type type)
 {
@@ -116,6 +214,420 @@ static char log_cashtype2char( e_log_cash_type type )
 }
 
 
+/// Obtain the table (or file) of a log target
+static const char *log_target_name(enum e_log_target target)
+{
+	switch( target ) {
+		case LOG_TARGET_BRANCH:  return log_config.log_branch;
+		case LOG_TARGET_PICK:    return log_config.log_pick;
+		case LOG_TARGET_ZENY:    return log_config.log_zeny;
+		case LOG_TARGET_MVPDROP: return log_config.log_mvpdrop;
+		case LOG_TARGET_GM:      return log_config.log_gm;
+		case LOG_TARGET_NPC:     return log_config.log_npc;
+		case LOG_TARGET_CHAT:    return log_config.log_chat;
+		case LOG_TARGET_CASH:    return log_config.log_cash;
+	}
+	return "";
+}
+
+
+/// Escapes at most 'maxlen' characters of a string for the values of a log entry.
+/// The output buffer must be at least maxlen*2+1 in size.
+static const char *log_escape(char *out, const char *str, size_t maxlen)
+{
+#ifdef BETA_THREAD_TEST
+	Sql_EscapeStringLen(NULL, out, str, safestrnlen(str, maxlen)); // logmysql_handle belongs to the query thread
+#else
+	Sql_EscapeStringLen(logmysql_handle, out, str, safestrnlen(str, maxlen));
+#endif
+	return out;
+}
+
+
+/// Prints the current time for the lines of the log files
+static const char *log_timestring(char *buf, size_t size)
+{
+	time_t curtime;
+
+	time(&curtime);
+	strftime(buf, size, "%m/%d/%Y %H:%M:%S", localtime(&curtime));
+	return buf;
+}
+
+
+/// Records an error of the log writer thread, shown later by log_writer_timer
+static void log_writer_error(const char *error)
+{
+	ramutex_lock(log_writer.lock);
+	safestrncpy(log_writer.error, error, sizeof(log_writer.error));
+	ramutex_unlock(log_writer.lock);
+	InterlockedIncrement(&log_writer.errors);
+}
+
+
+/// Runs a query of log_write
+static void log_query(bool async, const char *query, size_t len)
+{
+	if( !async ) {
+		if( SQL_ERROR == Sql_QueryStr(logmysql_handle, query) )
+			Sql_ShowDebug(logmysql_handle);
+	} else if( SQL_ERROR == Sql_QueryRaw(log_writer.handle, query, len) )
+		log_writer_error(Sql_Error(log_writer.handle));
+	else
+		InterlockedIncrement(&log_writer.batches);
+}
+
+
+/// Appends data to the segment of the binary logs
+static void log_segment_write(const void *data, size_t length)
+{
+	fwrite(data, 1, length, log_segment.fp);
+	log_segment.size += (uint32)length;
+}
+
+
+/// Ends the current block of the binary logs with its BINLOG_INDEX record
+static void log_segment_index(void)
+{
+	struct binlog_record rec;
+	struct binlog_index index;
+	uint32 offset = log_segment.size;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.time = log_segment.time_max;
+	rec.length = sizeof(index);
+	rec.type = BINLOG_INDEX;
+	index.previous = log_segment.index;
+	index.block = log_segment.block;
+	index.records = log_segment.records;
+	index.time_min = log_segment.time_min;
+	index.time_max = log_segment.time_max;
+	log_segment_write(&rec, sizeof(rec));
+	log_segment_write(&index, sizeof(index));
+
+	log_segment.index = offset;
+	log_segment.block = log_segment.size;
+	log_segment.records = 0;
+	memset(log_segment.declared, 0, sizeof(log_segment.declared)); // Blocks can be read alone
+}
+
+
+/// Starts a new segment of the binary logs, named after the time it was opened
+static bool log_segment_open(bool async)
+{
+	struct binlog_header header;
+	char filename[1024];
+	time_t now = time(NULL);
+
+	safesnprintf(filename, sizeof(filename), "%s/%lu_%u.rlog", log_config.binary_dir, (unsigned long)now, log_segment.count++);
+	if( (log_segment.fp = fopen(filename, "wb")) == NULL ) {
+		if( async )
+			log_writer_error("cannot open a binary log segment");
+		else
+			ShowError("log_segment_open: Cannot open the binary log segment '%s'.\n", filename);
+		return false;
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.magic = BINLOG_MAGIC;
+	header.version = BINLOG_VERSION;
+	header.created = (uint32)now;
+	log_segment.size = 0;
+	log_segment_write(&header, sizeof(header));
+	log_segment.index = 0;
+	log_segment.block = log_segment.size;
+	log_segment.records = 0;
+	memset(log_segment.declared, 0, sizeof(log_segment.declared));
+	return true;
+}
+
+
+/// Closes the segment of the binary logs, so that it ends with a BINLOG_INDEX record
+static void log_segment_close(void)
+{
+	if( log_segment.fp == NULL )
+		return;
+
+	if( log_segment.records )
+		log_segment_index();
+	fclose(log_segment.fp);
+	log_segment.fp = NULL;
+}
+
+
+/// Writes log entries to the segments of the binary logs (log_binary).
+/// Map names come with BINLOG_MAPNAME entries and are written again in
+/// every block, before the first record that uses them.
+static void log_write_binary(struct log_entry **entries, int count, bool async)
+{
+	int i;
+
+	for( i = 0; i < count; i++ ) {
+		struct binlog_record rec;
+
+		memcpy(&rec, entries[i]->data, sizeof(rec));
+		if( rec.type == BINLOG_MAPNAME ) { // New map, or an instance map that took the index of another
+			safestrncpy(log_segment.maps[rec.map], entries[i]->data + sizeof(rec), MAP_NAME_LENGTH);
+			log_segment.declared[rec.map] = false;
+			continue;
+		}
+
+		if( log_segment.fp && log_segment.size >= (uint32)log_config.binary_size<<20 )
+			log_segment_close();
+		if( log_segment.fp == NULL && !log_segment_open(async) )
+			return;
+
+		if( rec.map && !log_segment.declared[rec.map] ) {
+			struct binlog_record name;
+			const char *mapname = log_segment.maps[rec.map];
+
+			memset(&name, 0, sizeof(name));
+			name.time = rec.time;
+			name.length = (uint16)(strlen(mapname) + 1);
+			name.map = rec.map;
+			name.type = BINLOG_MAPNAME;
+			log_segment_write(&name, sizeof(name));
+			log_segment_write(mapname, name.length);
+			log_segment.declared[rec.map] = true;
+		}
+		log_segment_write(entries[i]->data, entries[i]->length);
+
+		if( log_segment.records++ == 0 )
+			log_segment.time_min = log_segment.time_max = rec.time;
+		else {
+			log_segment.time_min = min(log_segment.time_min, rec.time);
+			log_segment.time_max = max(log_segment.time_max, rec.time);
+		}
+		if( log_segment.records >= BINLOG_INDEX_INTERVAL )
+			log_segment_index();
+	}
+
+	if( log_segment.fp ) {
+		if( fflush(log_segment.fp) != 0 || ferror(log_segment.fp) ) {
+			if( async )
+				log_writer_error("cannot write to the binary log segment");
+			else
+				ShowError("log_write_binary: Cannot write to the binary log segment.\n");
+			clearerr(log_segment.fp);
+		} else if( async )
+			InterlockedIncrement(&log_writer.batches);
+	}
+}
+
+
+/// Writes log entries, with one query (or file append) per target.
+/// 'async' is set on the log writer thread, which must not use the memory
+/// manager nor the console.
+static void log_write(struct log_entry **entries, int count, bool async)
+{
+	int target, i;
+
+	if( log_config.binary ) {
+		log_write_binary(entries, count, async);
+		return;
+	}
+
+	for( target = 0; target < LOG_TARGET_MAX; target++ ) {
+		if( log_config.sql_logs ) {
+			size_t len = 0;
+			int rows = 0;
+
+			for( i = 0; i < count; i++ ) {
+				size_t n;
+
+				if( entries[i]->target != target )
+					continue;
+				n = strlen(entries[i]->data);
+				if( rows && len + n + 2 > sizeof(log_buffer) ) { // Query is full
+					log_query(async, log_buffer, len);
+					rows = 0;
+				}
+				if( !rows )
+					len = sprintf(log_buffer, LOG_QUERY " INTO `%s` (%s) VALUES ", log_target_name((enum e_log_target)target), log_columns[target]);
+				else
+					log_buffer[len++] = ',';
+				memcpy(log_buffer + len, entries[i]->data, n + 1);
+				len += n;
+				rows++;
+			}
+			if( rows )
+				log_query(async, log_buffer, len);
+		} else {
+			FILE *logfp = NULL;
+
+			for( i = 0; i < count; i++ ) {
+				if( entries[i]->target != target )
+					continue;
+				if( !logfp && ( logfp = fopen(log_target_name((enum e_log_target)target), "a") ) == NULL ) {
+					if( async )
+						log_writer_error("cannot open the log file");
+					break;
+				}
+				fputs(entries[i]->data, logfp);
+				fputc('\n', logfp);
+			}
+			if( logfp ) {
+				fclose(logfp);
+				if( async )
+					InterlockedIncrement(&log_writer.batches);
+			}
+		}
+	}
+}
+
+
+/// Writes a log entry, or queues it for the log writer.
+/// When the queue is full, waits for the writer to make room (backpressure).
+static void log_push(enum e_log_target target, struct log_entry *entry)
+{
+	struct log_slot *slot;
+	int32 pos;
+	bool stalled = false;
+
+	entry->target = target;
+	if( !log_config.binary ) // Text entries
+		entry->length = (uint16)(strlen(entry->data) + 1);
+	if( log_writer.thread == NULL ) { // Write it right away
+		log_write(&entry, 1, false);
+		return;
+	}
+
+	for(;;) {
+		int32 diff;
+
+		pos = log_writer.head;
+		slot = &log_writer.slot[pos&log_writer.mask];
+		diff = log_pos_diff(slot->seq, pos);
+		if( diff == 0 ) {
+			if( InterlockedCompareExchange(&log_writer.head, log_pos_add(pos, 1), pos) == pos )
+				break; // Slot reserved
+		} else if( diff < 0 ) { // Full, the writer has not written this slot yet
+			if( !stalled ) {
+				InterlockedIncrement(&log_writer.stalls);
+				stalled = true;
+			}
+			racond_signal(log_writer.wake);
+			rathread_yield();
+		}
+	}
+
+	memcpy(&slot->entry, entry, offsetof(struct log_entry, data) + entry->length);
+	InterlockedExchange(&slot->seq, log_pos_add(pos, 1));
+
+	if( log_pos_diff(log_pos_add(pos, 1), log_writer.tail) == log_config.async_rows )
+		racond_signal(log_writer.wake);
+}
+
+
+/// Queues a record of the binary logs.
+/// 'mapid' is the number of the map of the record, from log_binary_map.
+static void log_push_binary(enum binlog_type type, uint16 mapid, const void *data, size_t length)
+{
+	struct log_entry entry;
+	struct binlog_record rec;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.time = (uint32)time(NULL);
+	rec.length = (uint16)length;
+	rec.map = mapid;
+	rec.type = type;
+	memcpy(entry.data, &rec, sizeof(rec));
+	memcpy(entry.data + sizeof(rec), data, length);
+	entry.length = (uint16)(sizeof(rec) + length);
+	log_push((enum e_log_target)type, &entry);
+}
+
+
+/// Obtains the number of a map for the binary logs (its map index).
+/// Queues a BINLOG_MAPNAME record first when the name of the index changed.
+static uint16 log_binary_map(unsigned short mapindex)
+{
+	const char *name;
+
+	if( mapindex == 0 || mapindex >= MAX_MAPINDEX )
+		return 0;
+
+	name = mapindex_id2name(mapindex);
+	if( strncmp(log_binary_maps[mapindex], name, MAP_NAME_LENGTH) != 0 ) {
+		safestrncpy(log_binary_maps[mapindex], name, MAP_NAME_LENGTH);
+		log_push_binary(BINLOG_MAPNAME, mapindex, log_binary_maps[mapindex], strlen(log_binary_maps[mapindex]) + 1);
+	}
+	return mapindex;
+}
+
+
+/// Log writer thread.
+/// Writes the queued entries until do_final_log, then writes what is left.
+static void *log_writer_main(void *param)
+{
+	static struct log_entry *batch[LOG_WRITER_BATCH];
+
+	if( log_writer.handle )
+		Sql_ThreadInit();
+
+	for(;;) {
+		bool terminate = (log_writer.terminate != 0); // Checked first, so the last entries are written too
+		int32 tail = log_writer.tail;
+		int count = 0, i;
+
+		while( count < LOG_WRITER_BATCH ) {
+			struct log_slot *slot = &log_writer.slot[log_pos_add(tail, count)&log_writer.mask];
+
+			if( slot->seq != log_pos_add(tail, count + 1) )
+				break; // Not filled yet
+			batch[count++] = &slot->entry;
+		}
+
+		if( count ) {
+			log_write(batch, count, true);
+			for( i = 0; i < count; i++ ) // Give the slots back
+				InterlockedExchange(&log_writer.slot[log_pos_add(tail, i)&log_writer.mask].seq, log_pos_add(tail, i + log_writer.mask + 1));
+			tail = log_pos_add(tail, count);
+			InterlockedExchange(&log_writer.tail, tail);
+			InterlockedExchangeAdd(&log_writer.written, count);
+			if( log_pos_diff(log_writer.head, tail) >= log_config.async_rows )
+				continue; // Enough for another batch already
+		}
+
+		if( terminate )
+			break;
+
+		ramutex_lock(log_writer.lock);
+		racond_wait(log_writer.wake, log_writer.lock, log_config.async_delay);
+		ramutex_unlock(log_writer.lock);
+	}
+
+	if( log_writer.handle )
+		Sql_ThreadEnd();
+
+	return NULL;
+}
+
+
+/// Reports the errors of the log writer and the times the queue was full
+static int log_writer_timer(int tid, unsigned int tick, int id, intptr_t data)
+{
+	int32 errors = log_writer.errors;
+	int32 stalls = log_writer.stalls;
+
+	if( errors != log_writer.reported_errors ) {
+		char error[256];
+
+		ramutex_lock(log_writer.lock);
+		safestrncpy(error, log_writer.error, sizeof(error));
+		ramutex_unlock(log_writer.lock);
+		ShowSQL("Log writer: %d failed writes, last error: %s\n", errors - log_writer.reported_errors, error);
+		log_writer.reported_errors = errors;
+	}
+	if( stalls != log_writer.reported_stalls ) {
+		ShowWarning("Log writer: the queue was full %d times, the map-server had to wait (see log_async_queue).\n", stalls - log_writer.reported_stalls);
+		log_writer.reported_stalls = stalls;
+	}
+
+	return 0;
+}
+
+
 /// Check if this item should be logged according the settings
 static bool should_log_item(unsigned short nameid, int amount, int refine)
 {
@@ -147,47 +659,43 @@ static bool should_log_item(unsigned short nameid, int amount, int refine)
 /// logs items, that summon monsters
 void log_branch(struct map_session_data *sd)
 {
+	struct log_entry entry;
+
 	nullpo_retv(sd);
 
 	if( !log_config.branch )
 		return;
 
+	if( log_config.binary ) {
+		struct binlog_branch data;
+
+		memset(&data, 0, sizeof(data));
+		data.account_id = sd->status.account_id;
+		data.char_id = sd->status.char_id;
+		safestrncpy(data.name, sd->status.name, NAME_LENGTH);
+		log_push_binary(BINLOG_BRANCH, log_binary_map(sd->mapindex), &data, sizeof(data));
+		return;
+	}
+
 	if( log_config.sql_logs ) {
-#ifdef BETA_THREAD_TEST
-		char entry[512];
-		int e_length = 0;
-		e_length = sprintf(entry, LOG_QUERY " INTO `%s` (`branch_date`, `account_id`, `char_id`, `char_name`, `map`) VALUES (NOW(), '%d', '%d', '%s', '%s')", log_config.log_branch, sd->status.account_id, sd->status.char_id, sd->status.name, mapindex_id2name(sd->mapindex));
-		queryThread_log(entry,e_length);
-#else
-		SqlStmt *stmt;
-		stmt = SqlStmt_Malloc(logmysql_handle);
-		if( SQL_SUCCESS != SqlStmt_Prepare(stmt, LOG_QUERY " INTO `%s` (`branch_date`, `account_id`, `char_id`, `char_name`, `map`) VALUES (NOW(), '%d', '%d', ?, '%s')", log_config.log_branch, sd->status.account_id, sd->status.char_id, mapindex_id2name(sd->mapindex) )
-		||  SQL_SUCCESS != SqlStmt_BindParam(stmt, 0, SQLDT_STRING, sd->status.name, strnlen(sd->status.name, NAME_LENGTH))
-		||  SQL_SUCCESS != SqlStmt_Execute(stmt) )
-		{
-			SqlStmt_ShowDebug(stmt);
-			SqlStmt_Free(stmt);
-			return;
-		}
-		SqlStmt_Free(stmt);
-#endif
+		char esc_name[NAME_LENGTH * 2 + 1];
+
+		safesnprintf(entry.data, sizeof(entry.data), "(FROM_UNIXTIME(%ld), '%d', '%d', '%s', '%s')",
+			(long)time(NULL), sd->status.account_id, sd->status.char_id, log_escape(esc_name, sd->status.name, NAME_LENGTH), mapindex_id2name(sd->mapindex));
 	} else {
 		char timestring[255];
-		time_t curtime;
-		FILE *logfp;
 
-		if( ( logfp = fopen(log_config.log_branch, "a") ) == NULL )
-			return;
-		time(&curtime);
-		strftime(timestring, sizeof(timestring), "%m/%d/%Y %H:%M:%S", localtime(&curtime));
-		fprintf(logfp,"%s - %s[%d:%d]\t%s\n", timestring, sd->status.name, sd->status.account_id, sd->status.char_id, mapindex_id2name(sd->mapindex));
-		fclose(logfp);
+		safesnprintf(entry.data, sizeof(entry.data), "%s - %s[%d:%d]\t%s",
+			log_timestring(timestring, sizeof(timestring)), sd->status.name, sd->status.account_id, sd->status.char_id, mapindex_id2name(sd->mapindex));
 	}
+	log_push(LOG_TARGET_BRANCH, &entry);
 }
 
 /// logs item transactions (generic)
 void log_pick(int id, int16 m, e_log_pick_type type, int amount, struct item *itm)
 {
+	struct log_entry entry;
+
 	nullpo_retv(itm);
 
 	if( ( log_config.enable_logs&type ) == 0 ) { // disabled
@@ -197,33 +705,32 @@ void log_pick(int id, int16 m, e_log_pick_type type, int amount, struct item *it
 	if( !should_log_item(itm->nameid, amount, itm->refine) )
 		return; //we skip logging this item set - it doesn't meet our logging conditions [Lupus]
 
+	if( log_config.binary ) {
+		struct binlog_pick data;
+
+		memset(&data, 0, sizeof(data));
+		data.unique_id = itm->unique_id;
+		data.id = id;
+		data.amount = amount;
+		data.nameid = itm->nameid;
+		memcpy(data.card, itm->card, sizeof(data.card));
+		data.type = log_picktype2char(type);
+		data.refine = itm->refine;
+		data.bound = itm->bound;
+		log_push_binary(BINLOG_PICK, log_binary_map(map[m].index), &data, sizeof(data));
+		return;
+	}
+
 	if( log_config.sql_logs ) {
-#ifdef BETA_THREAD_TEST
-		char entry[512];
-		int e_length = 0;
-		e_length = sprintf(entry, LOG_QUERY " INTO `%s` (`time`, `char_id`, `type`, `nameid`, `amount`, `refine`, `card0`, `card1`, `card2`, `card3`, `map`, `unique_id`, `bound`) VALUES (NOW(), '%d', '%c', '%hu', '%d', '%d', '%hu', '%hu', '%hu', '%hu', '%s', '%"PRIu64"', '%d')",
-			log_config.log_pick, id, log_picktype2char(type), itm->nameid, amount, itm->refine, itm->card[0], itm->card[1], itm->card[2], itm->card[3], (map[m].name ? map[m].name : ""), itm->unique_id, itm->bound);
-		queryThread_log(entry,e_length);
-#else
-		if( SQL_ERROR == Sql_Query(logmysql_handle, LOG_QUERY " INTO `%s` (`time`, `char_id`, `type`, `nameid`, `amount`, `refine`, `card0`, `card1`, `card2`, `card3`, `map`, `unique_id`, `bound`) VALUES (NOW(), '%d', '%c', '%hu', '%d', '%d', '%hu', '%hu', '%hu', '%hu', '%s', '%"PRIu64"', '%d')",
-			log_config.log_pick, id, log_picktype2char(type), itm->nameid, amount, itm->refine, itm->card[0], itm->card[1], itm->card[2], itm->card[3], (map[m].name ? map[m].name : ""), itm->unique_id, itm->bound) )
-		{
-			Sql_ShowDebug(logmysql_handle);
-			return;
-		}
-#endif
+		safesnprintf(entry.data, sizeof(entry.data), "(FROM_UNIXTIME(%ld), '%d', '%c', '%hu', '%d', '%d', '%hu', '%hu', '%hu', '%hu', '%s', '%"PRIu64"', '%d')",
+			(long)time(NULL), id, log_picktype2char(type), itm->nameid, amount, itm->refine, itm->card[0], itm->card[1], itm->card[2], itm->card[3], (map[m].name ? map[m].name : ""), itm->unique_id, itm->bound);
 	} else {
 		char timestring[255];
-		time_t curtime;
-		FILE *logfp;
 
-		if( ( logfp = fopen(log_config.log_pick, "a") ) == NULL )
-			return;
-		time(&curtime);
-		strftime(timestring, sizeof(timestring), "%m/%d/%Y %H:%M:%S", localtime(&curtime));
-		fprintf(logfp,"%s - %d\t%c\t%hu,%d,%d,%hu,%hu,%hu,%hu,%s,'%"PRIu64"',%d\n", timestring, id, log_picktype2char(type), itm->nameid, amount, itm->refine, itm->card[0], itm->card[1], itm->card[2], itm->card[3], (map[m].name ? map[m].name : ""), itm->unique_id, itm->bound);
-		fclose(logfp);
+		safesnprintf(entry.data, sizeof(entry.data), "%s - %d\t%c\t%hu,%d,%d,%hu,%hu,%hu,%hu,%s,'%"PRIu64"',%d",
+			log_timestring(timestring, sizeof(timestring)), id, log_picktype2char(type), itm->nameid, amount, itm->refine, itm->card[0], itm->card[1], itm->card[2], itm->card[3], (map[m].name ? map[m].name : ""), itm->unique_id, itm->bound);
 	}
+	log_push(LOG_TARGET_PICK, &entry);
 }
 
 /// logs item transactions (players)
@@ -244,170 +751,156 @@ void log_pick_mob(struct mob_data *md, e_log_pick_type type, int amount, struct
 /// logs zeny transactions
 void log_zeny(struct map_session_data *sd, e_log_pick_type type, struct map_session_data *src_sd, int amount)
 {
+	struct log_entry entry;
+
 	nullpo_retv(sd);
 
 	if( !log_config.zeny || ( log_config.zeny != 1 && abs(amount) < log_config.zeny ) )
 		return;
 
+	if( log_config.binary ) {
+		struct binlog_zeny data;
+
+		memset(&data, 0, sizeof(data));
+		data.char_id = sd->status.char_id;
+		data.src_id = src_sd->status.char_id;
+		data.amount = amount;
+		data.type = log_picktype2char(type);
+		log_push_binary(BINLOG_ZENY, log_binary_map(sd->mapindex), &data, sizeof(data));
+		return;
+	}
+
 	if( log_config.sql_logs ) {
-#ifdef BETA_THREAD_TEST
-		char entry[512];
-		int e_length = 0;
-		e_length = sprintf(entry,  LOG_QUERY " INTO `%s` (`time`, `char_id`, `src_id`, `type`, `amount`, `map`) VALUES (NOW(), '%d', '%d', '%c', '%d', '%s')",
-				log_config.log_zeny, sd->status.char_id, src_sd->status.char_id, log_picktype2char(type), amount, mapindex_id2name(sd->mapindex));
-		queryThread_log(entry,e_length);
-#else
-		if( SQL_ERROR == Sql_Query(logmysql_handle, LOG_QUERY " INTO `%s` (`time`, `char_id`, `src_id`, `type`, `amount`, `map`) VALUES (NOW(), '%d', '%d', '%c', '%d', '%s')",
-			log_config.log_zeny, sd->status.char_id, src_sd->status.char_id, log_picktype2char(type), amount, mapindex_id2name(sd->mapindex)) )
-		{
-			Sql_ShowDebug(logmysql_handle);
-			return;
-		}
-#endif
+		safesnprintf(entry.data, sizeof(entry.data), "(FROM_UNIXTIME(%ld), '%d', '%d', '%c', '%d', '%s')",
+			(long)time(NULL), sd->status.char_id, src_sd->status.char_id, log_picktype2char(type), amount, mapindex_id2name(sd->mapindex));
 	} else {
 		char timestring[255];
-		time_t curtime;
-		FILE *logfp;
 
-		if( ( logfp = fopen(log_config.log_zeny, "a") ) == NULL )
-			return;
-		time(&curtime);
-		strftime(timestring, sizeof(timestring), "%m/%d/%Y %H:%M:%S", localtime(&curtime));
-		fprintf(logfp, "%s - %s[%d]\t%s[%d]\t%d\t\n", timestring, src_sd->status.name, src_sd->status.account_id, sd->status.name, sd->status.account_id, amount);
-		fclose(logfp);
+		safesnprintf(entry.data, sizeof(entry.data), "%s - %s[%d]\t%s[%d]\t%d\t",
+			log_timestring(timestring, sizeof(timestring)), src_sd->status.name, src_sd->status.account_id, sd->status.name, sd->status.account_id, amount);
 	}
+	log_push(LOG_TARGET_ZENY, &entry);
 }
 
 
 /// logs MVP monster rewards
 void log_mvpdrop(struct map_session_data *sd, int monster_id, unsigned int *log_mvp)
 {
+	struct log_entry entry;
+
 	nullpo_retv(sd);
 
 	if( !log_config.mvpdrop )
 		return;
 
+	if( log_config.binary ) {
+		struct binlog_mvpdrop data;
+
+		memset(&data, 0, sizeof(data));
+		data.char_id = sd->status.char_id;
+		data.monster_id = monster_id;
+		data.prize = (uint16)log_mvp[0];
+		data.mvpexp = log_mvp[1];
+		log_push_binary(BINLOG_MVPDROP, log_binary_map(sd->mapindex), &data, sizeof(data));
+		return;
+	}
+
 	if( log_config.sql_logs ) {
-#ifdef BETA_THREAD_TEST
-		char entry[512];
-		int e_length = 0;
-		e_length = sprintf(entry,  LOG_QUERY " INTO `%s` (`mvp_date`, `kill_char_id`, `monster_id`, `prize`, `mvpexp`, `map`) VALUES (NOW(), '%d', '%d', '%hu', '%d', '%s') ",
-			log_config.log_mvpdrop, sd->status.char_id, monster_id, (unsigned short)log_mvp[0], log_mvp[1], mapindex_id2name(sd->mapindex));
-		queryThread_log(entry,e_length);
-#else
-		if( SQL_ERROR == Sql_Query(logmysql_handle, LOG_QUERY " INTO `%s` (`mvp_date`, `kill_char_id`, `monster_id`, `prize`, `mvpexp`, `map`) VALUES (NOW(), '%d', '%d', '%hu', '%d', '%s') ",
-			log_config.log_mvpdrop, sd->status.char_id, monster_id, (unsigned short)log_mvp[0], log_mvp[1], mapindex_id2name(sd->mapindex)) )
-		{
-			Sql_ShowDebug(logmysql_handle);
-			return;
-		}
-#endif
+		safesnprintf(entry.data, sizeof(entry.data), "(FROM_UNIXTIME(%ld), '%d', '%d', '%hu', '%d', '%s')",
+			(long)time(NULL), sd->status.char_id, monster_id, (unsigned short)log_mvp[0], log_mvp[1], mapindex_id2name(sd->mapindex));
 	} else {
 		char timestring[255];
-		time_t curtime;
-		FILE *logfp;
 
-		if( (logfp = fopen(log_config.log_mvpdrop,"a")) == NULL )
-			return;
-		time(&curtime);
-		strftime(timestring, sizeof(timestring), "%m/%d/%Y %H:%M:%S", localtime(&curtime));
-		fprintf(logfp,"%s - %s[%d:%d]\t%d\t%hu,%u\n", timestring, sd->status.name, sd->status.account_id, sd->status.char_id, monster_id, log_mvp[0], log_mvp[1]);
-		fclose(logfp);
+		safesnprintf(entry.data, sizeof(entry.data), "%s - %s[%d:%d]\t%d\t%hu,%u",
+			log_timestring(timestring, sizeof(timestring)), sd->status.name, sd->status.account_id, sd->status.char_id, monster_id, log_mvp[0], log_mvp[1]);
 	}
+	log_push(LOG_TARGET_MVPDROP, &entry);
+}
+
+
+/// Queues a record of the binary logs for an atcommand or a 'logmes' message
+static void log_binary_message(enum binlog_type type, struct map_session_data *sd, const char *message)
+{
+	struct binlog_message data;
+
+	memset(&data, 0, offsetof(struct binlog_message, message));
+	data.account_id = sd->status.account_id;
+	data.char_id = sd->status.char_id;
+	safestrncpy(data.name, sd->status.name, NAME_LENGTH);
+	safestrncpy(data.message, message, sizeof(data.message));
+	log_push_binary(type, log_binary_map(sd->mapindex), &data, offsetof(struct binlog_message, message) + strlen(data.message) + 1);
 }
 
 
 /// logs used atcommands
 void log_atcommand(struct map_session_data *sd, const char *message)
 {
+	struct log_entry entry;
+
 	nullpo_retv(sd);
 
 	if( !log_config.commands ||
 	    !pc_should_log_commands(sd) )
 		return;
 
+	if( log_config.binary ) {
+		log_binary_message(BINLOG_GM, sd, message);
+		return;
+	}
+
 	if( log_config.sql_logs ) {
-#ifdef BETA_THREAD_TEST
-		char entry[512];
-		int e_length = 0;
-		e_length = sprintf(entry,  LOG_QUERY " INTO `%s` (`atcommand_date`, `account_id`, `char_id`, `char_name`, `map`, `command`) VALUES (NOW(), '%d', '%d', '%s', '%s', '%s')", log_config.log_gm, sd->status.account_id, sd->status.char_id, sd->status.name ,mapindex_id2name(sd->mapindex), message);
-		queryThread_log(entry,e_length);
-#else
-		SqlStmt *stmt;
-
-		stmt = SqlStmt_Malloc(logmysql_handle);
-		if( SQL_SUCCESS != SqlStmt_Prepare(stmt, LOG_QUERY " INTO `%s` (`atcommand_date`, `account_id`, `char_id`, `char_name`, `map`, `command`) VALUES (NOW(), '%d', '%d', ?, '%s', ?)", log_config.log_gm, sd->status.account_id, sd->status.char_id, mapindex_id2name(sd->mapindex) )
-		||  SQL_SUCCESS != SqlStmt_BindParam(stmt, 0, SQLDT_STRING, sd->status.name, strnlen(sd->status.name, NAME_LENGTH))
-		||  SQL_SUCCESS != SqlStmt_BindParam(stmt, 1, SQLDT_STRING, (char *)message, safestrnlen(message, 255))
-		||  SQL_SUCCESS != SqlStmt_Execute(stmt) )
-		{
-			SqlStmt_ShowDebug(stmt);
-			SqlStmt_Free(stmt);
-			return;
-		}
-		SqlStmt_Free(stmt);
-#endif
+		char esc_name[NAME_LENGTH * 2 + 1];
+		char esc_message[255 * 2 + 1];
+
+		safesnprintf(entry.data, sizeof(entry.data), "(FROM_UNIXTIME(%ld), '%d', '%d', '%s', '%s', '%s')",
+			(long)time(NULL), sd->status.account_id, sd->status.char_id, log_escape(esc_name, sd->status.name, NAME_LENGTH), mapindex_id2name(sd->mapindex), log_escape(esc_message, message, 255));
 	} else {
 		char timestring[255];
-		time_t curtime;
-		FILE *logfp;
 
-		if( ( logfp = fopen(log_config.log_gm, "a") ) == NULL )
-			return;
-		time(&curtime);
-		strftime(timestring, sizeof(timestring), "%m/%d/%Y %H:%M:%S", localtime(&curtime));
-		fprintf(logfp, "%s - %s[%d]: %s\n", timestring, sd->status.name, sd->status.account_id, message);
-		fclose(logfp);
+		safesnprintf(entry.data, sizeof(entry.data), "%s - %s[%d]: %s",
+			log_timestring(timestring, sizeof(timestring)), sd->status.name, sd->status.account_id, message);
 	}
+	log_push(LOG_TARGET_GM, &entry);
 }
 
 
 /// logs messages passed to script command 'logmes'
 void log_npc(struct map_session_data *sd, const char *message)
 {
+	struct log_entry entry;
+
 	nullpo_retv(sd);
 
 	if( !log_config.npc )
 		return;
 
+	if( log_config.binary ) {
+		log_binary_message(BINLOG_NPC, sd, message);
+		return;
+	}
+
 	if( log_config.sql_logs ) {
-#ifdef BETA_THREAD_TEST
-		char entry[512];
-		int e_length = 0;
-		e_length = sprintf(entry, LOG_QUERY " INTO `%s` (`npc_date`, `account_id`, `char_id`, `char_name`, `map`, `mes`) VALUES (NOW(), '%d', '%d', '%s', '%s', '%s')", log_config.log_npc, sd->status.account_id, sd->status.char_id, sd->status.name, mapindex_id2name(sd->mapindex), message );
-		queryThread_log(entry,e_length);
-#else
-		SqlStmt *stmt;
-		stmt = SqlStmt_Malloc(logmysql_handle);
-		if( SQL_SUCCESS != SqlStmt_Prepare(stmt, LOG_QUERY " INTO `%s` (`npc_date`, `account_id`, `char_id`, `char_name`, `map`, `mes`) VALUES (NOW(), '%d', '%d', ?, '%s', ?)", log_config.log_npc, sd->status.account_id, sd->status.char_id, mapindex_id2name(sd->mapindex) )
-		||  SQL_SUCCESS != SqlStmt_BindParam(stmt, 0, SQLDT_STRING, sd->status.name, strnlen(sd->status.name, NAME_LENGTH))
-		||  SQL_SUCCESS != SqlStmt_BindParam(stmt, 1, SQLDT_STRING, (char *)message, safestrnlen(message, 255))
-		||  SQL_SUCCESS != SqlStmt_Execute(stmt) )
-		{
-			SqlStmt_ShowDebug(stmt);
-			SqlStmt_Free(stmt);
-			return;
-		}
-		SqlStmt_Free(stmt);
-#endif
+		char esc_name[NAME_LENGTH * 2 + 1];
+		char esc_message[255 * 2 + 1];
+
+		safesnprintf(entry.data, sizeof(entry.data), "(FROM_UNIXTIME(%ld), '%d', '%d', '%s', '%s', '%s')",
+			(long)time(NULL), sd->status.account_id, sd->status.char_id, log_escape(esc_name, sd->status.name, NAME_LENGTH), mapindex_id2name(sd->mapindex), log_escape(esc_message, message, 255));
 	} else {
 		char timestring[255];
-		time_t curtime;
-		FILE *logfp;
 
-		if( ( logfp = fopen(log_config.log_npc, "a") ) == NULL )
-			return;
-		time(&curtime);
-		strftime(timestring, sizeof(timestring), "%m/%d/%Y %H:%M:%S", localtime(&curtime));
-		fprintf(logfp, "%s - %s[%d]: %s\n", timestring, sd->status.name, sd->status.account_id, message);
-		fclose(logfp);
+		safesnprintf(entry.data, sizeof(entry.data), "%s - %s[%d]: %s",
+			log_timestring(timestring, sizeof(timestring)), sd->status.name, sd->status.account_id, message);
 	}
+	log_push(LOG_TARGET_NPC, &entry);
 }
 
 
 /// logs chat
-void log_chat(e_log_chat_type type, int type_id, int src_charid, int src_accid, const char *map, int x, int y, const char *dst_charname, const char *message)
+void log_chat(e_log_chat_type type, int type_id, int src_charid, int src_accid, unsigned short mapindex, int x, int y, const char *dst_charname, const char *message)
 {
+	struct log_entry entry;
+	const char *mapname;
+
 	if( ( log_config.chat&type ) == 0 ) { // disabled
 		return;
 	}
@@ -416,76 +909,152 @@ void log_chat(e_log_chat_type type, int type_id, int src_charid, int src_accid,
 		return;
 	}
 
+	if( log_config.binary ) {
+		struct binlog_chat data;
+
+		memset(&data, 0, offsetof(struct binlog_chat, message));
+		data.type_id = type_id;
+		data.src_charid = src_charid;
+		data.src_accountid = src_accid;
+		data.x = (int16)x;
+		data.y = (int16)y;
+		data.type = log_chattype2char(type);
+		if( dst_charname )
+			safestrncpy(data.dst_name, dst_charname, NAME_LENGTH);
+		safestrncpy(data.message, message, sizeof(data.message));
+		log_push_binary(BINLOG_CHAT, log_binary_map(mapindex), &data, offsetof(struct binlog_chat, message) + strlen(data.message) + 1);
+		return;
+	}
+
+	mapname = mapindex_id2name(mapindex);
 	if( log_config.sql_logs ) {
-#ifdef BETA_THREAD_TEST
-		char entry[512];
-		int e_length = 0;
-		e_length = sprintf(entry, LOG_QUERY " INTO `%s` (`time`, `type`, `type_id`, `src_charid`, `src_accountid`, `src_map`, `src_map_x`, `src_map_y`, `dst_charname`, `message`) VALUES (NOW(), '%c', '%d', '%d', '%d', '%s', '%d', '%d', '%s', '%s')", log_config.log_chat, log_chattype2char(type), type_id, src_charid, src_accid, map, x, y, dst_charname, message );
-		queryThread_log(entry,e_length);
-#else
-		SqlStmt *stmt;
-
-		stmt = SqlStmt_Malloc(logmysql_handle);
-		if( SQL_SUCCESS != SqlStmt_Prepare(stmt, LOG_QUERY " INTO `%s` (`time`, `type`, `type_id`, `src_charid`, `src_accountid`, `src_map`, `src_map_x`, `src_map_y`, `dst_charname`, `message`) VALUES (NOW(), '%c', '%d', '%d', '%d', '%s', '%d', '%d', ?, ?)", log_config.log_chat, log_chattype2char(type), type_id, src_charid, src_accid, map, x, y)
-		||  SQL_SUCCESS != SqlStmt_BindParam(stmt, 0, SQLDT_STRING, (char *)dst_charname, safestrnlen(dst_charname, NAME_LENGTH))
-		||  SQL_SUCCESS != SqlStmt_BindParam(stmt, 1, SQLDT_STRING, (char *)message, safestrnlen(message, CHAT_SIZE_MAX))
-		||  SQL_SUCCESS != SqlStmt_Execute(stmt) )
-		{
-			SqlStmt_ShowDebug(stmt);
-			SqlStmt_Free(stmt);
-			return;
-		}
-		SqlStmt_Free(stmt);
-#endif
+		char esc_name[NAME_LENGTH * 2 + 1];
+		char esc_message[CHAT_SIZE_MAX * 2 + 1];
+
+		safesnprintf(entry.data, sizeof(entry.data), "(FROM_UNIXTIME(%ld), '%c', '%d', '%d', '%d', '%s', '%d', '%d', '%s', '%s')",
+			(long)time(NULL), log_chattype2char(type), type_id, src_charid, src_accid, mapname, x, y, log_escape(esc_name, dst_charname, NAME_LENGTH), log_escape(esc_message, message, CHAT_SIZE_MAX));
 	} else {
 		char timestring[255];
-		time_t curtime;
-		FILE *logfp;
 
-		if( ( logfp = fopen(log_config.log_chat, "a") ) == NULL )
-			return;
-		time(&curtime);
-		strftime(timestring, sizeof(timestring), "%m/%d/%Y %H:%M:%S", localtime(&curtime));
-		fprintf(logfp, "%s - %c,%d,%d,%d,%s,%d,%d,%s,%s\n", timestring, log_chattype2char(type), type_id, src_charid, src_accid, map, x, y, dst_charname, message);
-		fclose(logfp);
+		safesnprintf(entry.data, sizeof(entry.data), "%s - %c,%d,%d,%d,%s,%d,%d,%s,%s",
+			log_timestring(timestring, sizeof(timestring)), log_chattype2char(type), type_id, src_charid, src_accid, mapname, x, y, dst_charname, message);
 	}
+	log_push(LOG_TARGET_CHAT, &entry);
 }
 
 
 /// logs cash transactions
 void log_cash( struct map_session_data *sd, e_log_pick_type type, e_log_cash_type cash_type, int amount ) {
+	struct log_entry entry;
+
 	nullpo_retv( sd );
 
 	if( !log_config.cash )
 		return;
 
+	if( log_config.binary ) {
+		struct binlog_cash data;
+
+		memset( &data, 0, sizeof( data ) );
+		data.char_id = sd->status.char_id;
+		data.amount = amount;
+		data.type = log_picktype2char( type );
+		data.cash_type = log_cashtype2char( cash_type );
+		log_push_binary( BINLOG_CASH, log_binary_map( sd->mapindex ), &data, sizeof( data ) );
+		return;
+	}
+
 	if( log_config.sql_logs ) {
-#ifdef BETA_THREAD_TEST
-		char entry[512];
-		int e_length = 0;
-		e_length = sprintf( entry,  LOG_QUERY " INTO `%s` ( `time`, `char_id`, `type`, `cash_type`, `amount`, `map` ) VALUES ( NOW(), '%d', '%c', '%c', '%d', '%s' )",
-			log_config.log_cash, sd->status.char_id, log_picktype2char( type ), log_cashtype2char( cash_type ), amount, mapindex_id2name( sd->mapindex ) );
-		queryThread_log( entry, e_length );
-#else
-		if( SQL_ERROR == Sql_Query( logmysql_handle, LOG_QUERY " INTO `%s` ( `time`, `char_id`, `type`, `cash_type`, `amount`, `map` ) VALUES ( NOW(), '%d', '%c', '%c', '%d', '%s' )",
-			log_config.log_cash, sd->status.char_id, log_picktype2char( type ), log_cashtype2char( cash_type ), amount, mapindex_id2name( sd->mapindex ) ) )
-		{
-			Sql_ShowDebug( logmysql_handle );
-			return;
-		}
-#endif
+		safesnprintf( entry.data, sizeof( entry.data ), "(FROM_UNIXTIME(%ld), '%d', '%c', '%c', '%d', '%s')",
+			(long)time( NULL ), sd->status.char_id, log_picktype2char( type ), log_cashtype2char( cash_type ), amount, mapindex_id2name( sd->mapindex ) );
 	} else {
 		char timestring[255];
-		time_t curtime;
-		FILE *logfp;
 
-		if( ( logfp = fopen( log_config.log_cash, "a" ) ) == NULL )
-			return;
-		time( &curtime );
-		strftime( timestring, sizeof( timestring ), "%m/%d/%Y %H:%M:%S", localtime( &curtime ) );
-		fprintf( logfp, "%s - %s[%d]\t%d(%c)\t\n", timestring, sd->status.name, sd->status.account_id, amount, log_cashtype2char( cash_type ) );
-		fclose( logfp );
+		safesnprintf( entry.data, sizeof( entry.data ), "%s - %s[%d]\t%d(%c)\t",
+			log_timestring( timestring, sizeof( timestring ) ), sd->status.name, sd->status.account_id, amount, log_cashtype2char( cash_type ) );
 	}
+	log_push( LOG_TARGET_CASH, &entry );
+}
+
+
+/// Opens the first segment of the binary logs (log_binary) and starts the log writer thread (log_async)
+void do_init_log(void)
+{
+	int32 size, i;
+
+	if( log_config.binary )
+		log_segment_open(false);
+
+#ifdef BETA_THREAD_TEST
+	log_config.async = true; // logmysql_handle belongs to the query thread
+#endif
+	if( !log_config.async )
+		return;
+
+	if( log_config.sql_logs ) {
+		log_writer.handle = Sql_Malloc();
+		if( SQL_ERROR == Sql_ConnectThread(log_writer.handle, log_db_id, log_db_pw, log_db_ip, log_db_port, log_db_db) )
+			exit(EXIT_FAILURE);
+		if( strlen(default_codepage) > 0 )
+			if( SQL_ERROR == Sql_SetEncoding(log_writer.handle, default_codepage) )
+				Sql_ShowDebug(log_writer.handle);
+	}
+
+	for( size = 16; size < log_config.async_queue; size <<= 1 );
+	CREATE(log_writer.slot, struct log_slot, size);
+	for( i = 0; i < size; i++ )
+		log_writer.slot[i].seq = i;
+	log_writer.mask = size - 1;
+	log_writer.head = log_writer.tail = 0;
+	log_writer.terminate = 0;
+	log_writer.lock = ramutex_create();
+	log_writer.wake = racond_create();
+
+	if( (log_writer.thread = rathread_create(log_writer_main, NULL)) == NULL ) {
+		ShowError("do_init_log: Cannot start the log writer thread, logs will be written right away.\n");
+		racond_destroy(log_writer.wake);
+		ramutex_destroy(log_writer.lock);
+		aFree(log_writer.slot);
+		log_writer.slot = NULL;
+		if( log_writer.handle ) {
+			Sql_Free(log_writer.handle);
+			log_writer.handle = NULL;
+		}
+		return;
+	}
+
+	add_timer_func_list(log_writer_timer, "log_writer_timer");
+	log_writer.timer = add_timer_interval(gettick() + 1000, log_writer_timer, 0, 0, 1000);
+	ShowStatus("Writing logs from a separate thread (queue of %d entries).\n", size);
+}
+
+
+/// Writes the queued log entries, stops the log writer thread and closes the segment of the binary logs
+void do_final_log(void)
+{
+	if( log_writer.thread == NULL ) {
+		log_segment_close();
+		return;
+	}
+
+	InterlockedIncrement(&log_writer.terminate);
+	racond_signal(log_writer.wake);
+	rathread_wait(log_writer.thread, NULL);
+	log_writer.thread = NULL;
+
+	delete_timer(log_writer.timer, log_writer_timer);
+	log_writer_timer(INVALID_TIMER, gettick(), 0, 0); // Last report
+	ShowStatus("Log writer: %d entries written in %d batches.\n", log_writer.written, log_writer.batches);
+
+	racond_destroy(log_writer.wake);
+	ramutex_destroy(log_writer.lock);
+	aFree(log_writer.slot);
+	log_writer.slot = NULL;
+	if( log_writer.handle ) {
+		Sql_Free(log_writer.handle);
+		log_writer.handle = NULL;
+	}
+	log_segment_close();
 }
 
 
@@ -498,6 +1067,13 @@ void log_set_defaults(void)
 	log_config.rare_items_log   = 100;  // log rare items. drop chance <= 1%
 	log_config.price_items_log  = 1000; // 1000z
 	log_config.amount_items_log = 100;
+
+	log_config.async_rows = 100;
+	log_config.async_delay = 1000;
+	log_config.async_queue = 8192;
+
+	log_config.binary_size = 64;
+	safestrncpy(log_config.binary_dir, "log", sizeof(log_config.binary_dir));
 }
 
 
@@ -524,6 +1100,20 @@ int log_config_read(const char *cfgName)
 				log_config.enable_logs = (e_log_pick_type)config_switch(w2);
 			else if( strcmpi(w1, "sql_logs") == 0 )
 				log_config.sql_logs = (bool)config_switch(w2);
+			else if( strcmpi(w1, "log_async") == 0 )
+				log_config.async = (bool)config_switch(w2);
+			else if( strcmpi(w1, "log_async_rows") == 0 )
+				log_config.async_rows = cap_value(atoi(w2), 1, LOG_WRITER_BATCH);
+			else if( strcmpi(w1, "log_async_delay") == 0 )
+				log_config.async_delay = cap_value(atoi(w2), 10, 60000);
+			else if( strcmpi(w1, "log_async_queue") == 0 )
+				log_config.async_queue = cap_value(atoi(w2), 16, 1048576);
+			else if( strcmpi(w1, "log_binary") == 0 )
+				log_config.binary = (bool)config_switch(w2);
+			else if( strcmpi(w1, "log_binary_dir") == 0 )
+				safestrncpy(log_config.binary_dir, w2, sizeof(log_config.binary_dir));
+			else if( strcmpi(w1, "log_binary_size") == 0 )
+				log_config.binary_size = cap_value(atoi(w2), 1, 2048);
 			//start of common filter settings
 			else if( strcmpi(w1, "rare_items_log") == 0 )
 				log_config.rare_items_log = atoi(w2);
@@ -579,7 +1169,11 @@ int log_config_read(const char *cfgName)
 	fclose(fp);
 
 	if( --count == 0 ) { // report final logging state
-		const char *target = log_config.sql_logs ? "table" : "file";
+		const char *target = ( log_config.sql_logs || log_config.binary ) ? "table" : "file"; // logconv loads binary logs to the tables
+
+		if( log_config.binary ) {
+			ShowInfo("Logging to binary segments in '%s', to be loaded with logconv.\n", log_config.binary_dir);
+		}
 
 		if( log_config.enable_logs && log_config.filter ) {
 			ShowInfo("Logging item transactions to %s '%s'.\n", target, log_config.log_pick);
@@ -64,7 +64,7 @@ void log_pick_mob(struct mob_data *md, e_log_pick_type type, int amount, struct
 void log_zeny(struct map_session_data *sd, e_log_pick_type type, struct map_session_data *src_sd, int amount);
 void log_cash( struct map_session_data *sd, e_log_pick_type type, e_log_cash_type cash_type, int amount );
 void log_npc(struct map_session_data *sd, const char *message);
-void log_chat(e_log_chat_type type, int type_id, int src_charid, int src_accid, const char *map, int x, int y, const char *dst_charname, const char *message);
+void log_chat(e_log_chat_type type, int type_id, int src_charid, int src_accid, unsigned short mapindex, int x, int y, const char *dst_charname, const char *message);
 void log_atcommand(struct map_session_data *sd, const char *message);
 
 /// old, but useful logs
@@ -73,11 +73,19 @@ void log_mvpdrop(struct map_session_data *sd, int monster_id, unsigned int *log_
 
 int log_config_read(const char *cfgName);
 
+void do_init_log(void);
+void do_final_log(void);
+
 extern struct Log_Config
 {
 	e_log_pick_type enable_logs;
 	int filter;
 	bool sql_logs;
+	bool async; // write from a separate thread (log_async)
+	int async_rows, async_delay, async_queue;
+	bool binary; // write binary records to segment files (log_binary)
+	int binary_size; // MB per segment
+	char binary_dir[256];
 	bool log_chat_woe_disable;
 	bool cash;
 	int rare_items_log,refine_items_log,price_items_log,amount_items_log; //for filter
@@ -86,11 +94,4 @@ extern struct Log_Config
 }
 log_config;
 
-#ifdef BETA_THREAD_TEST
-	struct {
-		char **entry;
-		int count;
-	} logThreadData;
-#endif
-
 #endif /* _LOG_H_ */
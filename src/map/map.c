@@ -60,6 +60,23 @@
 #include <unistd.h>
 #endif
 
+// Vectorized block grid filters (see map_blockgrid_getall)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define BLOCKGRID_SSE2
+	#include <emmintrin.h>
+	#if defined(_MSC_VER) && _MSC_VER >= 1700
+		#define BLOCKGRID_AVX2
+		#define BLOCKGRID_TARGET_AVX2
+		#include <intrin.h>
+		#include <immintrin.h>
+	#elif (defined(__clang__) && (__clang_major__ > 3 || (__clang_major__ == 3 && __clang_minor__ >= 8))) || \
+		(!defined(__clang__) && defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+		#define BLOCKGRID_AVX2
+		#define BLOCKGRID_TARGET_AVX2 __attribute__((target("avx2")))
+		#include <immintrin.h>
+	#endif
+#endif
+
 char default_codepage[32] = "";
 
 int map_server_port = 3306;
@@ -127,6 +144,7 @@ int map_port = 0;
 int autosave_interval = DEFAULT_AUTOSAVE_INTERVAL;
 int minsave_interval = 100;
 int save_settings = 0xFFFF;
+int delta_save = 1;
 int agit_flag = 0;
 int agit2_flag = 0;
 int night_flag = 0; // 0 = day, 1 = night [Yor]
@@ -171,6 +189,8 @@ struct s_map_default map_default;
 int console = 0;
 int enable_spy = 0; //To enable/disable @spy commands, which consume too much cpu time when sending packets. [Skotlex]
 int enable_grf = 0;	//To enable/disable reading maps from GRF files, bypassing mapcache [blackhole89]
+int timer_profile_interval = 0; //Seconds between reports of the timer profiler (0 = disabled)
+int mob_ai_threads = 0; //Threads searching the mob target paths ahead of the AI (0 = main thread only)
 
 /*==========================================
  * server player count (of all mapservers)
@@ -285,6 +305,332 @@ static void map_delblcell(struct block_list *bl)
 }
 #endif
 
+/*==========================================
+ * Block grid handling.
+ * Each map block keeps a packed array of the objects standing on it,
+ * with their coordinates and type copied next to the pointer so the
+ * area searches only have to touch the objects that actually match.
+ *------------------------------------------*/
+static inline struct block_grid *map_blockgrid(struct block_list *bl)
+{
+	int pos = bl->x / BLOCK_SIZE + (bl->y / BLOCK_SIZE) * map[bl->m].bxs;
+
+	return (bl->type == BL_MOB ? &map[bl->m].block_mob[pos] : &map[bl->m].block[pos]);
+}
+
+/// Notes that something changed on the block of bl, see map_block_stamp.
+static inline void map_blockgrid_touch(struct block_list *bl)
+{
+	map[bl->m].block[bl->x / BLOCK_SIZE + (bl->y / BLOCK_SIZE) * map[bl->m].bxs].stamp++;
+}
+
+static void map_blockgrid_add(struct block_grid *grid, struct block_list *bl)
+{
+	int i;
+
+	if( grid->count == grid->max ) {
+		grid->max = (grid->max ? grid->max * 2 : 4);
+		RECREATE(grid->x, int16, grid->max);
+		RECREATE(grid->y, int16, grid->max);
+		RECREATE(grid->type, uint16, grid->max);
+		RECREATE(grid->bl, struct block_list *, grid->max);
+	}
+	i = grid->count++;
+	grid->x[i] = bl->x;
+	grid->y[i] = bl->y;
+	grid->type[i] = (uint16)bl->type;
+	grid->bl[i] = bl;
+	bl->grid_idx = i;
+}
+
+static void map_blockgrid_remove(struct block_grid *grid, struct block_list *bl)
+{
+	int i = bl->grid_idx;
+
+	if( i < 0 || i >= grid->count || grid->bl[i] != bl ) {
+		ARR_FIND(0, grid->count, i, grid->bl[i] == bl);
+		if( i == grid->count ) {
+			ShowError("map_blockgrid_remove: block %d not found at (\"%s\",%d,%d)\n", bl->id, map[bl->m].name, bl->x, bl->y);
+			return;
+		}
+		ShowError("map_blockgrid_remove: block %d has a stale grid index (%d, expected %d)\n", bl->id, bl->grid_idx, i);
+	}
+
+	if( i != --grid->count ) { //Fill the hole with the last entry
+		int last = grid->count;
+
+		grid->x[i] = grid->x[last];
+		grid->y[i] = grid->y[last];
+		grid->type[i] = grid->type[last];
+		grid->bl[i] = grid->bl[last];
+		grid->bl[i]->grid_idx = i;
+	}
+	bl->grid_idx = -1;
+}
+
+static void map_blockgrid_free(struct block_grid *grid)
+{
+	aFree(grid->x);
+	aFree(grid->y);
+	aFree(grid->type);
+	aFree(grid->bl);
+}
+
+/// Frees the block grids of a map.
+static void map_blockgrid_final(int16 m)
+{
+	int i, size = map[m].bxs * map[m].bys;
+
+	for( i = 0; i < size; i++ ) {
+		if( map[m].block )
+			map_blockgrid_free(&map[m].block[i]);
+		if( map[m].block_mob )
+			map_blockgrid_free(&map[m].block_mob[i]);
+	}
+	if( map[m].block )
+		aFree(map[m].block);
+	if( map[m].block_mob )
+		aFree(map[m].block_mob);
+	map[m].block = NULL;
+	map[m].block_mob = NULL;
+}
+
+/*==========================================
+ * Block grid filters.
+ * They add to bl_list the entries of a grid of type inside (x0,y0)-(x1,y1).
+ * The SSE2 and AVX2 versions test 8 and 16 entries per comparison and
+ * leave the remainder to the scalar loop. The fastest one supported by
+ * the CPU is picked on the first call.
+ *------------------------------------------*/
+typedef void (*BlockGridFilter)(const struct block_grid *grid, int type, int x0, int y0, int x1, int y1);
+
+static void map_blockgrid_getall_from(const struct block_grid *grid, int i, int type, int x0, int y0, int x1, int y1)
+{
+	for( ; i < grid->count && bl_list_count < BL_LIST_MAX; i++ ) {
+		if( grid->type[i]&type && grid->x[i] >= x0 && grid->x[i] <= x1 && grid->y[i] >= y0 && grid->y[i] <= y1 )
+			bl_list[bl_list_count++] = grid->bl[i];
+	}
+}
+
+static void map_blockgrid_getall_scalar(const struct block_grid *grid, int type, int x0, int y0, int x1, int y1)
+{
+	map_blockgrid_getall_from(grid, 0, type, x0, y0, x1, y1);
+}
+
+#if defined(BLOCKGRID_SSE2) || defined(BLOCKGRID_AVX2)
+/// Adds to bl_list the entries of grid starting at base whose bit is set in mask (2 bits per entry).
+static inline bool map_blockgrid_pushmask(const struct block_grid *grid, int base, unsigned int mask)
+{
+	while( mask ) {
+#ifdef _MSC_VER
+		unsigned long bit;
+
+		_BitScanForward(&bit, mask);
+#else
+		int bit = __builtin_ctz(mask);
+#endif
+		if( bl_list_count >= BL_LIST_MAX )
+			return false;
+		bl_list[bl_list_count++] = grid->bl[base + (bit>>1)];
+		mask &= mask - 1;
+	}
+	return true;
+}
+#endif
+
+#ifdef BLOCKGRID_SSE2
+static void map_blockgrid_getall_sse2(const struct block_grid *grid, int type, int x0, int y0, int x1, int y1)
+{
+	const __m128i vx0 = _mm_set1_epi16((int16)x0), vx1 = _mm_set1_epi16((int16)x1);
+	const __m128i vy0 = _mm_set1_epi16((int16)y0), vy1 = _mm_set1_epi16((int16)y1);
+	const __m128i vtype = _mm_set1_epi16((int16)type), zero = _mm_setzero_si128();
+	int i;
+
+	for( i = 0; i + 8 <= grid->count; i += 8 ) {
+		__m128i x = _mm_loadu_si128((const __m128i *)&grid->x[i]);
+		__m128i y = _mm_loadu_si128((const __m128i *)&grid->y[i]);
+		__m128i t = _mm_and_si128(_mm_loadu_si128((const __m128i *)&grid->type[i]), vtype);
+		__m128i out;
+
+		out = _mm_or_si128(_mm_cmplt_epi16(x, vx0), _mm_cmpgt_epi16(x, vx1));
+		out = _mm_or_si128(out, _mm_or_si128(_mm_cmplt_epi16(y, vy0), _mm_cmpgt_epi16(y, vy1)));
+		out = _mm_or_si128(out, _mm_cmpeq_epi16(t, zero));
+		if( !map_blockgrid_pushmask(grid, i, ~(unsigned int)_mm_movemask_epi8(out)&0x5555) )
+			return;
+	}
+	map_blockgrid_getall_from(grid, i, type, x0, y0, x1, y1);
+}
+#endif
+
+#ifdef BLOCKGRID_AVX2
+static BLOCKGRID_TARGET_AVX2 void map_blockgrid_getall_avx2(const struct block_grid *grid, int type, int x0, int y0, int x1, int y1)
+{
+	const __m256i vx0 = _mm256_set1_epi16((int16)(x0 - 1)), vx1 = _mm256_set1_epi16((int16)x1);
+	const __m256i vy0 = _mm256_set1_epi16((int16)(y0 - 1)), vy1 = _mm256_set1_epi16((int16)y1);
+	const __m256i vtype = _mm256_set1_epi16((int16)type), zero = _mm256_setzero_si256();
+	int i;
+
+	for( i = 0; i + 16 <= grid->count; i += 16 ) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)&grid->x[i]);
+		__m256i y = _mm256_loadu_si256((const __m256i *)&grid->y[i]);
+		__m256i t = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)&grid->type[i]), vtype);
+		__m256i in;
+
+		//AVX2 has no signed less-than, so test x > x0-1 && !(x > x1)
+		in = _mm256_andnot_si256(_mm256_cmpgt_epi16(x, vx1), _mm256_cmpgt_epi16(x, vx0));
+		in = _mm256_and_si256(in, _mm256_andnot_si256(_mm256_cmpgt_epi16(y, vy1), _mm256_cmpgt_epi16(y, vy0)));
+		in = _mm256_andnot_si256(_mm256_cmpeq_epi16(t, zero), in);
+		if( !map_blockgrid_pushmask(grid, i, (unsigned int)_mm256_movemask_epi8(in)&0x55555555) )
+			return;
+	}
+	map_blockgrid_getall_from(grid, i, type, x0, y0, x1, y1);
+}
+
+/// Returns true if both the CPU and the OS support AVX2.
+static bool map_cpu_has_avx2(void)
+{
+#ifdef _MSC_VER
+	int info[4];
+
+	__cpuid(info, 0);
+	if( info[0] < 7 )
+		return false;
+	__cpuid(info, 1);
+	if( (info[2]&0x18000000) != 0x18000000 ) //OSXSAVE and AVX
+		return false;
+	if( (_xgetbv(0)&0x6) != 0x6 ) //XMM and YMM state enabled by the OS
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1]&0x20) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+static void map_blockgrid_getall_init(const struct block_grid *grid, int type, int x0, int y0, int x1, int y1);
+static BlockGridFilter map_blockgrid_getall = map_blockgrid_getall_init;
+
+/// Picks the block grid filter on the first call.
+static void map_blockgrid_getall_init(const struct block_grid *grid, int type, int x0, int y0, int x1, int y1)
+{
+	const char *name = "scalar";
+
+	map_blockgrid_getall = map_blockgrid_getall_scalar;
+#ifdef BLOCKGRID_SSE2
+	map_blockgrid_getall = map_blockgrid_getall_sse2;
+	name = "SSE2";
+#endif
+#ifdef BLOCKGRID_AVX2
+	if( map_cpu_has_avx2() ) {
+		map_blockgrid_getall = map_blockgrid_getall_avx2;
+		name = "AVX2";
+	}
+#endif
+	ShowInfo("Using the "CL_WHITE"%s"CL_RESET" block grid filter.\n", name);
+	map_blockgrid_getall(grid, type, x0, y0, x1, y1);
+}
+
+/*==========================================
+ * Adds to bl_list all the blocks of type inside (x0,y0)-(x1,y1) of map m.
+ * Coordinates must already be ordered and clipped to the map.
+ * Non-mob blocks are collected before the mob ones.
+ *------------------------------------------*/
+static void map_getall_inarea(int16 m, int x0, int y0, int x1, int y1, int type)
+{
+	int bx, by;
+
+	if( type&~BL_MOB )
+		for( by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++ )
+			for( bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++ )
+				map_blockgrid_getall(&map[m].block[bx + by * map[m].bxs], type, x0, y0, x1, y1);
+
+	if( type&BL_MOB )
+		for( by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++ )
+			for( bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++ )
+				map_blockgrid_getall(&map[m].block_mob[bx + by * map[m].bxs], BL_MOB, x0, y0, x1, y1);
+}
+
+#ifdef CIRCULAR_AREA
+/*==========================================
+ * Drops from bl_list[blockcount..] the blocks out of the circular range of center.
+ *------------------------------------------*/
+static void map_filter_circular(struct block_list *center, int16 range, int blockcount)
+{
+	int i, j;
+
+	for( i = j = blockcount; i < bl_list_count; i++ ) {
+		if( check_distance_bl(center, bl_list[i], range) )
+			bl_list[j++] = bl_list[i];
+	}
+	bl_list_count = j;
+}
+#endif
+
+/*==========================================
+ * Block viewers handling.
+ * Every block keeps the list of players standing within
+ * map_viewer_range blocks of it, which covers everyone able to see an
+ * object on that block from up to map_viewer_range * BLOCK_SIZE cells.
+ * The lists are updated as players enter, leave or cross blocks.
+ *------------------------------------------*/
+static int map_viewer_range = 0;
+
+static void map_viewers_update(struct map_session_data *sd, bool add)
+{
+	int16 m = sd->bl.m;
+	int bx0, by0, bx1, by1, bx, by;
+
+	if( !map[m].viewers )
+		return;
+
+	bx0 = max(sd->bl.x / BLOCK_SIZE - map_viewer_range, 0);
+	by0 = max(sd->bl.y / BLOCK_SIZE - map_viewer_range, 0);
+	bx1 = min(sd->bl.x / BLOCK_SIZE + map_viewer_range, map[m].bxs - 1);
+	by1 = min(sd->bl.y / BLOCK_SIZE + map_viewer_range, map[m].bys - 1);
+
+	for( by = by0; by <= by1; by++ ) {
+		for( bx = bx0; bx <= bx1; bx++ ) {
+			struct block_viewers *viewers = &map[m].viewers[bx + by * map[m].bxs];
+			int i;
+
+			if( add ) {
+				if( viewers->count == viewers->max ) {
+					viewers->max = (viewers->max ? viewers->max * 2 : 4);
+					RECREATE(viewers->sd, struct map_session_data *, viewers->max);
+				}
+				viewers->sd[viewers->count++] = sd;
+			} else {
+				ARR_FIND(0, viewers->count, i, viewers->sd[i] == sd);
+				if( i < viewers->count )
+					viewers->sd[i] = viewers->sd[--viewers->count];
+			}
+		}
+	}
+}
+
+/// Allocates the block viewers of a map.
+static void map_viewers_init(int16 m)
+{
+	if( !map_viewer_range )
+		map_viewer_range = max((AREA_SIZE + BLOCK_SIZE - 1) / BLOCK_SIZE, 1);
+	CREATE(map[m].viewers, struct block_viewers, map[m].bxs * map[m].bys);
+}
+
+/// Frees the block viewers of a map.
+static void map_viewers_final(int16 m)
+{
+	int i;
+
+	if( !map[m].viewers )
+		return;
+	for( i = 0; i < map[m].bxs * map[m].bys; i++ )
+		aFree(map[m].viewers[i].sd);
+	aFree(map[m].viewers);
+	map[m].viewers = NULL;
+}
+
 /*==========================================
  * Adds a block to the map.
  * Returns 0 on success, 1 on failure (illegal coordinates).
@@ -292,7 +638,6 @@ static void map_delblcell(struct block_list *bl)
 int map_addblock(struct block_list *bl)
 {
 	int16 m, x, y;
-	int pos;
 
 	nullpo_ret(bl);
 
@@ -313,21 +658,12 @@ int map_addblock(struct block_list *bl)
 		return 1;
 	}
 
-	pos = x / BLOCK_SIZE + (y / BLOCK_SIZE) * map[m].bxs;
-
-	if( bl->type == BL_MOB ) {
-		bl->next = map[m].block_mob[pos];
-		bl->prev = &bl_head;
-		if( bl->next )
-			bl->next->prev = bl;
-		map[m].block_mob[pos] = bl;
-	} else {
-		bl->next = map[m].block[pos];
-		bl->prev = &bl_head;
-		if( bl->next )
-			bl->next->prev = bl;
-		map[m].block[pos] = bl;
-	}
+	map_blockgrid_add(map_blockgrid(bl), bl);
+	map_blockgrid_touch(bl);
+	if( bl->type == BL_PC )
+		map_viewers_update((TBL_PC *)bl, true);
+	bl->next = NULL;
+	bl->prev = &bl_head;
 
 #ifdef CELL_NOSTACK
 	map_addblcell(bl);
@@ -341,10 +677,8 @@ int map_addblock(struct block_list *bl)
  *------------------------------------------*/
 int map_delblock(struct block_list *bl)
 {
-	int pos;
 	nullpo_ret(bl);
 
-	//Blocklist (2ways chainlist)
 	if (bl->prev == NULL) {
 		if (bl->next != NULL) //Can't delete block (already at the beginning of the chain)
 			ShowError("map_delblock error : bl->next!=NULL\n");
@@ -354,19 +688,11 @@ int map_delblock(struct block_list *bl)
 #ifdef CELL_NOSTACK
 	map_delblcell(bl);
 #endif
-	
-	pos = bl->x / BLOCK_SIZE + (bl->y / BLOCK_SIZE) * map[bl->m].bxs;
-
-	if (bl->next)
-		bl->next->prev = bl->prev;
-	if (bl->prev == &bl_head) {
-		//Since the head of the list, update the block_list map of []
-		if (bl->type == BL_MOB)
-			map[bl->m].block_mob[pos] = bl->next;
-		else
-			map[bl->m].block[pos] = bl->next;
-	} else
-		bl->prev->next = bl->next;
+
+	map_blockgrid_remove(map_blockgrid(bl), bl);
+	map_blockgrid_touch(bl);
+	if( bl->type == BL_PC )
+		map_viewers_update((TBL_PC *)bl, false);
 	bl->next = NULL;
 	bl->prev = NULL;
 
@@ -428,11 +754,16 @@ int map_moveblock(struct block_list *bl, int x1, int y1, unsigned int tick)
 	if (moveblock) {
 		if (map_addblock(bl))
 			return 1;
-	}
+	} else {
+		struct block_grid *grid = map_blockgrid(bl);
+
+		grid->x[bl->grid_idx] = x1;
+		grid->y[bl->grid_idx] = y1;
+		map_blockgrid_touch(bl);
 #ifdef CELL_NOSTACK
-	else
 		map_addblcell(bl);
 #endif
+	}
 
 	if (bl->type&BL_CHAR) {
 		skill_unit_move(bl, tick, 3);
@@ -502,8 +833,7 @@ int map_moveblock(struct block_list *bl, int x1, int y1, unsigned int tick)
  *------------------------------------------*/
 int map_count_oncell(int16 m, int16 x, int16 y, int type, int flag)
 {
-	int bx,by;
-	struct block_list *bl;
+	int bx, by, i, pass;
 	int count = 0;
 
 	if (x < 0 || y < 0 || (x >= map[m].xs) || (y >= map[m].ys))
@@ -512,37 +842,29 @@ int map_count_oncell(int16 m, int16 x, int16 y, int type, int flag)
 	bx = x / BLOCK_SIZE;
 	by = y / BLOCK_SIZE;
 
-	if (type&~BL_MOB) {
-		for (bl = map[m].block[bx + by * map[m].bxs]; bl != NULL; bl = bl->next) {
-			if (bl->x == x && bl->y == y && bl->type&type) {
-				if (flag&0x2) {
-					struct status_change *sc = status_get_sc(bl);
-
-					if (sc && (sc->option&OPTION_INVISIBLE))
-						continue;
-				}
-				if (flag&0x1) {
-					struct unit_data *ud = unit_bl2ud(bl);
+	for (pass = 0; pass < 2; pass++) {
+		struct block_grid *grid;
 
-					if (ud && ud->walktimer != INVALID_TIMER)
-						continue;
-				}
-				count++;
-			}
+		if (pass == 0) {
+			if (!(type&~BL_MOB))
+				continue;
+			grid = &map[m].block[bx + by * map[m].bxs];
+		} else {
+			if (!(type&BL_MOB))
+				continue;
+			grid = &map[m].block_mob[bx + by * map[m].bxs];
 		}
-	}
 
-	if (type&BL_MOB) {
-		for (bl = map[m].block_mob[bx + by * map[m].bxs]; bl != NULL; bl = bl->next) {
-			if (bl->x == x && bl->y == y) {
+		for (i = 0; i < grid->count; i++) {
+			if (grid->x[i] == x && grid->y[i] == y && grid->type[i]&type) {
 				if (flag&0x2) {
-					struct status_change *sc = status_get_sc(bl);
+					struct status_change *sc = status_get_sc(grid->bl[i]);
 
 					if (sc && (sc->option&OPTION_INVISIBLE))
 						continue;
 				}
 				if (flag&0x1) {
-					struct unit_data *ud = unit_bl2ud(bl);
+					struct unit_data *ud = unit_bl2ud(grid->bl[i]);
 
 					if (ud && ud->walktimer != INVALID_TIMER)
 						continue;
@@ -555,14 +877,37 @@ int map_count_oncell(int16 m, int16 x, int16 y, int type, int flag)
 	return count;
 }
 
+/*==========================================
+ * Returns a value that changes whenever an object enters, leaves or
+ * moves on one of the blocks within range of (x,y).
+ * Lets callers skip an area search when nothing could have changed.
+ *------------------------------------------*/
+unsigned int map_block_stamp(int16 m, int16 x, int16 y, int16 range)
+{
+	int bx, by, bx0, by0, bx1, by1;
+	unsigned int stamp = 0;
+
+	bx0 = max(x - range, 0) / BLOCK_SIZE;
+	by0 = max(y - range, 0) / BLOCK_SIZE;
+	bx1 = min(x + range, map[m].xs - 1) / BLOCK_SIZE;
+	by1 = min(y + range, map[m].ys - 1) / BLOCK_SIZE;
+
+	for( by = by0; by <= by1; by++ )
+		for( bx = bx0; bx <= bx1; bx++ )
+			stamp += map[m].block[bx + by * map[m].bxs].stamp;
+
+	return stamp;
+}
+
 /**
  * Looks for a skill unit on a given cell
  * flag&1: runs battle_check_target check based on unit->group->target_flag
  */
 struct skill_unit *map_find_skill_unit_oncell(struct block_list *target, int16 x, int16 y, uint16 skill_id, struct skill_unit *out_unit, int flag) {
 	int16 m, bx, by;
-	struct block_list *bl;
+	struct block_grid *grid;
 	struct skill_unit *unit;
+	int i;
 	m = target->m;
 
 	if( x < 0 || y < 0 || (x >= map[m].xs) || (y >= map[m].ys) )
@@ -571,10 +916,11 @@ struct skill_unit *map_find_skill_unit_oncell(struct block_list *target, int16 x
 	bx = x / BLOCK_SIZE;
 	by = y / BLOCK_SIZE;
 
-	for( bl = map[m].block[bx + by * map[m].bxs]; bl != NULL; bl = bl->next ) {
-		if( bl->x != x || bl->y != y || bl->type != BL_SKILL )
+	grid = &map[m].block[bx + by * map[m].bxs];
+	for( i = 0; i < grid->count; i++ ) {
+		if( grid->x[i] != x || grid->y[i] != y || grid->type[i] != BL_SKILL )
 			continue;
-		unit = (struct skill_unit *) bl;
+		unit = (struct skill_unit *) grid->bl[i];
 		if( unit == out_unit || !unit->alive || !unit->group || unit->group->skill_id != skill_id )
 			continue;
 		if( !(flag&1) || battle_check_target(&unit->bl,target,unit->group->target_flag) > 0 )
@@ -588,9 +934,8 @@ struct skill_unit *map_find_skill_unit_oncell(struct block_list *target, int16 x
  *------------------------------------------*/
 int map_foreachinrange(int (*func)(struct block_list *, va_list), struct block_list *center, int16 range, int type, ...)
 {
-	int bx, by, m;
+	int m;
 	int returnCount = 0; //Total sum of returned values of func() [Skotlex]
-	struct block_list *bl;
 	int blockcount = bl_list_count, i;
 	int x0, x1, y0, y1;
 	va_list ap;
@@ -601,40 +946,15 @@ int map_foreachinrange(int (*func)(struct block_list *, va_list), struct block_l
 	x1 = min(center->x + range, map[m].xs - 1);
 	y1 = min(center->y + range, map[m].ys - 1);
 
-	if( type&~BL_MOB ) {
-		for( by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++ ) {
-			for( bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++ ) {
-				for( bl = map[m].block[bx + by * map[m].bxs]; bl != NULL; bl = bl->next ) {
-					if( bl->type&type
-						&& bl->x >= x0 && bl->x <= x1 && bl->y >= y0 && bl->y <= y1
-#ifdef CIRCULAR_AREA
-						&& check_distance_bl(center, bl, range)
-#endif
-						&& bl_list_count < BL_LIST_MAX )
-						bl_list[bl_list_count++] = bl;
-				}
-			}
-		}
-	}
-
-	if( type&BL_MOB ) {
-		for( by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++ ) {
-			for( bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++ ) {
-				for( bl = map[m].block_mob[bx + by * map[m].bxs]; bl != NULL; bl = bl->next ) {
-					if( bl->x >= x0 && bl->x <= x1 && bl->y >= y0 && bl->y <= y1
-#ifdef CIRCULAR_AREA
-						&& check_distance_bl(center, bl, range)
-#endif
-						&& bl_list_count < BL_LIST_MAX )
-						bl_list[bl_list_count++] = bl;
-				}
-			}
-		}
-	}
+	map_getall_inarea(m, x0, y0, x1, y1, type);
 
 	if( bl_list_count >= BL_LIST_MAX )
 		ShowWarning("map_foreachinrange: block count too many!\n");
 
+#ifdef CIRCULAR_AREA
+	map_filter_circular(center, range, blockcount);
+#endif
+
 	map_freeblock_lock();
 
 	for( i = blockcount; i < bl_list_count; i++ ) {
@@ -656,10 +976,9 @@ int map_foreachinrange(int (*func)(struct block_list *, va_list), struct block_l
  *------------------------------------------*/
 int map_foreachinshootrange(int (*func)(struct block_list *, va_list), struct block_list *center, int16 range, int type,...)
 {
-	int bx, by, m;
+	int m;
 	int returnCount = 0; //Total sum of returned values of func() [Skotlex]
-	struct block_list *bl;
-	int blockcount = bl_list_count, i;
+	int blockcount = bl_list_count, i, j;
 	int x0, x1, y0, y1;
 	va_list ap;
 
@@ -672,41 +991,20 @@ int map_foreachinshootrange(int (*func)(struct block_list *, va_list), struct bl
 	x1 = min(center->x + range, map[m].xs - 1);
 	y1 = min(center->y + range, map[m].ys - 1);
 
-	if( type&~BL_MOB ) {
-		for( by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++ ) {
-			for( bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++ ) {
-				for( bl = map[m].block[bx + by * map[m].bxs]; bl != NULL; bl = bl->next ) {
-					if( bl->type&type
-						&& bl->x >= x0 && bl->x <= x1 && bl->y >= y0 && bl->y <= y1
-#ifdef CIRCULAR_AREA
-						&& check_distance_bl(center, bl, range)
-#endif
-						&& path_search_long(NULL, center->m, center->x, center->y, bl->x, bl->y, CELL_CHKWALL)
-					  	&& bl_list_count < BL_LIST_MAX )
-						bl_list[bl_list_count++] = bl;
-				}
-			}
-		}
-	}
+	map_getall_inarea(m, x0, y0, x1, y1, type);
+
+	if( bl_list_count >= BL_LIST_MAX )
+		ShowWarning("map_foreachinrange: block count too many!\n");
 
-	if( type&BL_MOB ) {
-		for( by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++ ) {
-			for( bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++ ) {
-				for( bl = map[m].block_mob[bx + by * map[m].bxs]; bl != NULL; bl = bl->next ) {
-					if( bl->x >= x0 && bl->x <= x1 && bl->y >= y0 && bl->y <= y1
 #ifdef CIRCULAR_AREA
-						&& check_distance_bl(center, bl, range)
+	map_filter_circular(center, range, blockcount);
 #endif
-						&& path_search_long(NULL, center->m, center->x, center->y, bl->x, bl->y, CELL_CHKWALL)
-						&& bl_list_count < BL_LIST_MAX )
-						bl_list[bl_list_count++] = bl;
-				}
-			}
-		}
-	}
 
-	if( bl_list_count >= BL_LIST_MAX )
-		ShowWarning("map_foreachinrange: block count too many!\n");
+	for( i = j = blockcount; i < bl_list_count; i++ ) {
+		if( path_search_long(NULL, center->m, center->x, center->y, bl_list[i]->x, bl_list[i]->y, CELL_CHKWALL) )
+			bl_list[j++] = bl_list[i];
+	}
+	bl_list_count = j;
 
 	map_freeblock_lock();
 
@@ -731,9 +1029,7 @@ int map_foreachinshootrange(int (*func)(struct block_list *, va_list), struct bl
  *------------------------------------------*/
 int map_foreachinarea(int (*func)(struct block_list *, va_list), int16 m, int16 x0, int16 y0, int16 x1, int16 y1, int type, ...)
 {
-	int bx, by;
 	int returnCount = 0; //Total sum of returned values of func() [Skotlex]
-	struct block_list *bl;
 	int blockcount = bl_list_count, i;
 	va_list ap;
 
@@ -751,19 +1047,7 @@ int map_foreachinarea(int (*func)(struct block_list *, va_list), int16 m, int16
 	x1 = min(x1, map[m].xs - 1);
 	y1 = min(y1, map[m].ys - 1);
 
-	if( type&~BL_MOB )
-		for( by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++ )
-			for( bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++ )
-				for( bl = map[m].block[bx + by * map[m].bxs]; bl != NULL; bl = bl->next )
-					if( bl->type&type && bl->x >= x0 && bl->x <= x1 && bl->y >= y0 && bl->y <= y1 && bl_list_count < BL_LIST_MAX )
-						bl_list[bl_list_count++] = bl;
-
-	if( type&BL_MOB )
-		for( by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++ )
-			for( bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++ )
-				for( bl = map[m].block_mob[bx + by * map[m].bxs]; bl != NULL; bl = bl->next )
-					if( bl->x >= x0 && bl->x <= x1 && bl->y >= y0 && bl->y <= y1 && bl_list_count < BL_LIST_MAX )
-						bl_list[bl_list_count++] = bl;
+	map_getall_inarea(m, x0, y0, x1, y1, type);
 
 	if( bl_list_count >= BL_LIST_MAX )
 		ShowWarning("map_foreachinarea: block count too many!\n");
@@ -789,9 +1073,8 @@ int map_foreachinarea(int (*func)(struct block_list *, va_list), int16 m, int16
  *------------------------------------------*/
 int map_forcountinrange(int (*func)(struct block_list *, va_list), struct block_list *center, int16 range, int count, int type, ...)
 {
-	int bx, by, m;
+	int m;
 	int returnCount = 0; //Total sum of returned values of func() [Skotlex]
-	struct block_list *bl;
 	int blockcount = bl_list_count, i;
 	int x0, x1, y0, y1;
 	va_list ap;
@@ -802,40 +1085,15 @@ int map_forcountinrange(int (*func)(struct block_list *, va_list), struct block_
 	x1 = min(center->x + range, map[m].xs - 1);
 	y1 = min(center->y + range, map[m].ys - 1);
 
-	if( type&~BL_MOB ) {
-		for( by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++ ) {
-			for( bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++ ) {
-				for( bl = map[m].block[bx + by * map[m].bxs]; bl != NULL; bl = bl->next ) {
-					if( bl->type&type
-						&& bl->x >= x0 && bl->x <= x1 && bl->y >= y0 && bl->y <= y1
-#ifdef CIRCULAR_AREA
-						&& check_distance_bl(center, bl, range)
-#endif
-					  	&& bl_list_count < BL_LIST_MAX )
-						bl_list[bl_list_count++] = bl;
-				}
-			}
-		}
-	}
-
-	if( type&BL_MOB ) {
-		for( by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++ ) {
-			for( bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++ ){
-				for( bl = map[m].block_mob[bx + by * map[m].bxs]; bl != NULL; bl = bl->next ) {
-					if( bl->x >= x0 && bl->x <= x1 && bl->y >= y0 && bl->y <= y1
-#ifdef CIRCULAR_AREA
-						&& check_distance_bl(center, bl, range)
-#endif
-						&& bl_list_count < BL_LIST_MAX )
-						bl_list[bl_list_count++] = bl;
-				}
-			}
-		}
-	}
+	map_getall_inarea(m, x0, y0, x1, y1, type);
 
 	if( bl_list_count >= BL_LIST_MAX )
 		ShowWarning("map_forcountinrange: block count too many!\n");
 
+#ifdef CIRCULAR_AREA
+	map_filter_circular(center, range, blockcount);
+#endif
+
 	map_freeblock_lock();
 
 	for( i = blockcount; i < bl_list_count; i++ ) {
@@ -856,9 +1114,7 @@ int map_forcountinrange(int (*func)(struct block_list *, va_list), struct block_
 
 int map_forcountinarea(int (*func)(struct block_list *, va_list), int16 m, int16 x0, int16 y0, int16 x1, int16 y1, int count, int type, ...)
 {
-	int bx, by;
 	int returnCount = 0; //Total sum of returned values of func() [Skotlex]
-	struct block_list *bl;
 	int blockcount = bl_list_count, i;
 	va_list ap;
 
@@ -876,19 +1132,7 @@ int map_forcountinarea(int (*func)(struct block_list *, va_list), int16 m, int16
 	x1 = min(x1, map[m].xs - 1);
 	y1 = min(y1, map[m].ys - 1);
 
-	if( type&~BL_MOB )
-		for( by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++ )
-			for( bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++ )
-				for( bl = map[m].block[bx + by * map[m].bxs]; bl != NULL; bl = bl->next )
-					if( bl->type&type && bl->x >= x0 && bl->x <= x1 && bl->y >= y0 && bl->y <= y1 && bl_list_count < BL_LIST_MAX )
-						bl_list[bl_list_count++] = bl;
-
-	if( type&BL_MOB )
-		for( by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++ )
-			for( bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++ )
-				for( bl = map[m].block_mob[bx + by * map[m].bxs]; bl != NULL; bl = bl->next )
-					if( bl->x >= x0 && bl->x <= x1 && bl->y >= y0 && bl->y <= y1 && bl_list_count < BL_LIST_MAX )
-						bl_list[bl_list_count++] = bl;
+	map_getall_inarea(m, x0, y0, x1, y1, type);
 
 	if( bl_list_count >= BL_LIST_MAX )
 		ShowWarning("map_foreachinarea: block count too many!\n");
@@ -918,10 +1162,10 @@ int map_forcountinarea(int (*func)(struct block_list *, va_list), int16 m, int16
  *------------------------------------------*/
 int map_foreachinmovearea(int (*func)(struct block_list *, va_list), struct block_list *center, int16 range, int16 dx, int16 dy, int type, ...)
 {
-	int bx, by, m;
+	int m;
 	int returnCount = 0; //Total sum of returned values of func() [Skotlex]
 	struct block_list *bl;
-	int blockcount = bl_list_count, i;
+	int blockcount = bl_list_count, i, j;
 	int x0, x1, y0, y1;
 	va_list ap;
 
@@ -962,62 +1206,25 @@ int map_foreachinmovearea(int (*func)(struct block_list *, va_list), struct bloc
 		x1 = min(x1, map[m].xs - 1);
 		y1 = min(y1, map[m].ys - 1);
 
-		for( by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++ ) {
-			for( bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++ ) {
-				if( type&~BL_MOB ) {
-					for( bl = map[m].block[bx + by * map[m].bxs]; bl != NULL; bl = bl->next ) {
-						if( bl->type&type &&
-							bl->x >= x0 && bl->x <= x1 &&
-							bl->y >= y0 && bl->y <= y1 &&
-							bl_list_count < BL_LIST_MAX )
-							bl_list[bl_list_count++] = bl;
-					}
-				}
-				if( type&BL_MOB ) {
-					for( bl = map[m].block_mob[bx + by * map[m].bxs]; bl != NULL; bl = bl->next ) {
-						if( bl->x >= x0 && bl->x <= x1 &&
-							bl->y >= y0 && bl->y <= y1 &&
-							bl_list_count < BL_LIST_MAX )
-							bl_list[bl_list_count++] = bl;
-					}
-				}
-			}
-		}
+		map_getall_inarea(m, x0, y0, x1, y1, type);
 	} else { // Diagonal movement
 		x0 = max(x0, 0);
 		y0 = max(y0, 0);
 		x1 = min(x1, map[m].xs - 1);
 		y1 = min(y1, map[m].ys - 1);
 
-		for( by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++ ) {
-			for( bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++ ) {
-				if( type & ~BL_MOB ) {
-					for( bl = map[m].block[bx + by * map[m].bxs]; bl != NULL; bl = bl->next ) {
-						if( bl->type&type &&
-							bl->x >= x0 && bl->x <= x1 &&
-							bl->y >= y0 && bl->y <= y1 &&
-							bl_list_count < BL_LIST_MAX )
-						if( (dx > 0 && bl->x < x0 + dx) ||
-							(dx < 0 && bl->x > x1 + dx) ||
-							(dy > 0 && bl->y < y0 + dy) ||
-							(dy < 0 && bl->y > y1 + dy) )
-							bl_list[bl_list_count++] = bl;
-					}
-				}
-				if( type&BL_MOB ) {
-					for( bl = map[m].block_mob[bx + by * map[m].bxs]; bl != NULL; bl = bl->next ) {
-						if( bl->x >= x0 && bl->x <= x1 &&
-							bl->y >= y0 && bl->y <= y1 &&
-							bl_list_count < BL_LIST_MAX)
-						if( (dx > 0 && bl->x < x0 + dx) ||
-							(dx < 0 && bl->x > x1 + dx) ||
-							(dy > 0 && bl->y < y0 + dy) ||
-							(dy < 0 && bl->y > y1 + dy) )
-							bl_list[bl_list_count++] = bl;
-					}
-				}
-			}
+		map_getall_inarea(m, x0, y0, x1, y1, type);
+
+		//Only keep the blocks on the strips that just came into view
+		for( i = j = blockcount; i < bl_list_count; i++ ) {
+			bl = bl_list[i];
+			if( (dx > 0 && bl->x < x0 + dx) ||
+				(dx < 0 && bl->x > x1 + dx) ||
+				(dy > 0 && bl->y < y0 + dy) ||
+				(dy < 0 && bl->y > y1 + dy) )
+				bl_list[j++] = bl;
 		}
+		bl_list_count = j;
 	}
 
 	if( bl_list_count >= BL_LIST_MAX )
@@ -1045,27 +1252,14 @@ int map_foreachinmovearea(int (*func)(struct block_list *, va_list), struct bloc
 //
 int map_foreachincell(int (*func)(struct block_list *, va_list), int16 m, int16 x, int16 y, int type, ...)
 {
-	int bx, by;
 	int returnCount = 0; //Total sum of returned values of func() [Skotlex]
-	struct block_list *bl;
 	int blockcount = bl_list_count, i;
 	va_list ap;
 
 	if( x < 0 || y < 0 || x >= map[m].xs || y >= map[m].ys )
 		return 0;
 
-	by = y / BLOCK_SIZE;
-	bx = x / BLOCK_SIZE;
-
-	if( type&~BL_MOB )
-		for( bl = map[m].block[bx + by * map[m].bxs]; bl != NULL; bl = bl->next )
-			if( bl->type&type && bl->x == x && bl->y == y && bl_list_count < BL_LIST_MAX )
-				bl_list[bl_list_count++] = bl;
-
-	if( type&BL_MOB )
-		for( bl = map[m].block_mob[bx + by * map[m].bxs]; bl != NULL; bl = bl->next )
-			if( bl->x == x && bl->y == y && bl_list_count < BL_LIST_MAX)
-				bl_list[bl_list_count++] = bl;
+	map_getall_inarea(m, x, y, x, y, type);
 
 	if( bl_list_count >= BL_LIST_MAX )
 		ShowWarning("map_foreachincell: block count too many!\n");
@@ -1126,9 +1320,8 @@ int map_foreachinpath(int (*func)(struct block_list *, va_list), int16 m, int16
 // kRO
 
 	//Generic map_foreach* variables
-	int i, blockcount = bl_list_count;
+	int i, j, blockcount = bl_list_count;
 	struct block_list *bl;
-	int bx, by;
 	//method specific variables
 	int magnitude2, len_limit; //The square of the magnitude
 	int k, xi, yi, xu, yu;
@@ -1184,73 +1377,36 @@ int map_foreachinpath(int (*func)(struct block_list *, va_list), int16 m, int16
 
 	range *= range << 8; //Values are shifted later on for higher precision using int math.
 
-	if( type&~BL_MOB ) {
-		for( by = my0 / BLOCK_SIZE; by <= my1 / BLOCK_SIZE; by++ ) {
-			for( bx = mx0 / BLOCK_SIZE; bx <= mx1 / BLOCK_SIZE; bx++ ) {
-				for( bl = map[m].block[bx + by * map[m].bxs]; bl != NULL; bl = bl->next ) {
-					if( bl->prev && bl->type&type && bl_list_count < BL_LIST_MAX ) {
-						xi = bl->x;
-						yi = bl->y;
-
-						k = (xi - x0) * (x1 - x0) + (yi - y0) * (y1 - y0);
-
-						if( k < 0 || k > len_limit ) //Since more skills use this, check for ending point as well
-							continue;
-
-						if( k > magnitude2 && !path_search_long(NULL, m, x0, y0, xi, yi, CELL_CHKWALL) )
-							continue; //Targets beyond the initial ending point need the wall check
+	map_getall_inarea(m, mx0, my0, mx1, my1, type);
 
-						//All these shifts are to increase the precision of the intersection point and distance considering how it's int math
-						k  = (k<<4) / magnitude2; //k will be between 1~16 instead of 0~1
-						xi <<= 4;
-						yi <<= 4;
-						xu = (x0<<4) + k * (x1 - x0);
-						yu = (y0<<4) + k * (y1 - y0);
-						k  = MAGNITUDE2(xi, yi, xu, yu);
-
-						//If all dot coordinates were <<4 the square of the magnitude is <<8
-						if( k > range )
-							continue;
-
-						bl_list[bl_list_count++] = bl;
-					}
-				}
-			}
-		}
-	}
+	for( i = j = blockcount; i < bl_list_count; i++ ) {
+		bl = bl_list[i];
+		xi = bl->x;
+		yi = bl->y;
 
-	 if( type&BL_MOB ) {
-		for( by = my0 / BLOCK_SIZE; by <= my1 / BLOCK_SIZE; by++ ) {
-			for( bx = mx0 / BLOCK_SIZE; bx <= mx1 / BLOCK_SIZE; bx++ ) {
-				for( bl = map[m].block_mob[bx + by * map[m].bxs]; bl != NULL; bl = bl->next ) {
-					if( bl->prev && bl_list_count < BL_LIST_MAX ) {
-						xi = bl->x;
-						yi = bl->y;
-						k = (xi - x0) * (x1 - x0) + (yi - y0) * (y1 - y0);
+		k = (xi - x0) * (x1 - x0) + (yi - y0) * (y1 - y0);
 
-						if( k < 0 || k > len_limit )
-							continue;
+		if( k < 0 || k > len_limit ) //Since more skills use this, check for ending point as well
+			continue;
 
-						if( k > magnitude2 && !path_search_long(NULL, m, x0, y0, xi, yi, CELL_CHKWALL) )
-							continue; //Targets beyond the initial ending point need the wall check
+		if( k > magnitude2 && !path_search_long(NULL, m, x0, y0, xi, yi, CELL_CHKWALL) )
+			continue; //Targets beyond the initial ending point need the wall check
 
-						k  = (k<<4) / magnitude2; //k will be between 1~16 instead of 0~1
-						xi <<= 4;
-						yi <<= 4;
-						xu = (x0<<4) + k * (x1 - x0);
-						yu = (y0<<4) + k * (y1 - y0);
-						k  = MAGNITUDE2(xi, yi, xu, yu);
+		//All these shifts are to increase the precision of the intersection point and distance considering how it's int math
+		k  = (k<<4) / magnitude2; //k will be between 1~16 instead of 0~1
+		xi <<= 4;
+		yi <<= 4;
+		xu = (x0<<4) + k * (x1 - x0);
+		yu = (y0<<4) + k * (y1 - y0);
+		k  = MAGNITUDE2(xi, yi, xu, yu);
 
-						//If all dot coordinates were <<4 the square of the magnitude is <<8
-						if( k > range )
-							continue;
+		//If all dot coordinates were <<4 the square of the magnitude is <<8
+		if( k > range )
+			continue;
 
-						bl_list[bl_list_count++] = bl;
-					}
-				}
-			}
-		}
+		bl_list[j++] = bl;
 	}
+	bl_list_count = j;
 
 	if( bl_list_count >= BL_LIST_MAX )
 		ShowWarning("map_foreachinpath: block count too many!\n");
@@ -1277,23 +1433,22 @@ int map_foreachinmap(int (*func)(struct block_list*, va_list), int16 m, int type
 {
 	int b, bsize;
 	int returnCount = 0; //Total sum of returned values of func() [Skotlex]
-	struct block_list *bl;
-	int blockcount = bl_list_count, i;
+	int blockcount = bl_list_count, i, j;
 	va_list ap;
 
 	bsize = map[m].bxs * map[m].bys;
 
 	if( type&~BL_MOB )
 		for( b = 0; b < bsize; b++ )
-			for( bl = map[m].block[b]; bl != NULL; bl = bl->next )
-				if( bl->type&type && bl_list_count < BL_LIST_MAX )
-					bl_list[bl_list_count++] = bl;
+			for( j = 0; j < map[m].block[b].count; j++ )
+				if( map[m].block[b].type[j]&type && bl_list_count < BL_LIST_MAX )
+					bl_list[bl_list_count++] = map[m].block[b].bl[j];
 
 	if( type&BL_MOB )
 		for( b = 0; b < bsize; b++ )
-			for( bl = map[m].block_mob[b]; bl != NULL; bl = bl->next )
+			for( j = 0; j < map[m].block_mob[b].count; j++ )
 				if( bl_list_count < BL_LIST_MAX )
-					bl_list[bl_list_count++] = bl;
+					bl_list[bl_list_count++] = map[m].block_mob[b].bl[j];
 
 	if( bl_list_count >= BL_LIST_MAX )
 		ShowWarning("map_foreachinmap: block count too many!\n");
@@ -1314,6 +1469,57 @@ int map_foreachinmap(int (*func)(struct block_list*, va_list), int16 m, int type
 	return returnCount;
 }
 
+/*==========================================
+ * Same as map_foreachinarea(func, m, x - range, y - range, x + range, y + range, BL_PC, ...),
+ * but takes the players from the viewer list of the block at (x,y) instead
+ * of searching the area. Used for the area packet broadcasts.
+ *------------------------------------------*/
+int map_foreachviewer(int (*func)(struct block_list *, va_list), int16 m, int16 x, int16 y, int16 range, ...)
+{
+	int returnCount = 0;
+	int blockcount = bl_list_count, i;
+	int x0, x1, y0, y1;
+	va_list ap;
+
+	if( m < 0 || m >= map_num || x < 0 || y < 0 || x >= map[m].xs || y >= map[m].ys )
+		return 0;
+
+	x0 = max(x - range, 0);
+	y0 = max(y - range, 0);
+	x1 = min(x + range, map[m].xs - 1);
+	y1 = min(y + range, map[m].ys - 1);
+
+	if( map[m].viewers && range <= map_viewer_range * BLOCK_SIZE ) {
+		struct block_viewers *viewers = &map[m].viewers[x / BLOCK_SIZE + (y / BLOCK_SIZE) * map[m].bxs];
+
+		for( i = 0; i < viewers->count && bl_list_count < BL_LIST_MAX; i++ ) {
+			struct block_list *bl = &viewers->sd[i]->bl;
+
+			if( bl->x >= x0 && bl->x <= x1 && bl->y >= y0 && bl->y <= y1 )
+				bl_list[bl_list_count++] = bl;
+		}
+	} else //Range grew past what the lists cover (area_size reloaded)
+		map_getall_inarea(m, x0, y0, x1, y1, BL_PC);
+
+	if( bl_list_count >= BL_LIST_MAX )
+		ShowWarning("map_foreachviewer: block count too many!\n");
+
+	map_freeblock_lock();
+
+	for( i = blockcount; i < bl_list_count; i++ ) {
+		if( bl_list[i]->prev ) { //func() may delete this bl_list[] slot, checking for prev ensures it wasn't queued for deletion
+			va_start(ap, range);
+			returnCount += func(bl_list[i], ap);
+			va_end(ap);
+		}
+	}
+
+	map_freeblock_unlock();
+
+	bl_list_count = blockcount;
+	return returnCount;
+}
+
 
 /// Generates a new flooritem object id from the interval [MIN_FLOORITEM, MAX_FLOORITEM).
 /// Used for floor items, skill units and chatroom objects.
@@ -2430,9 +2636,11 @@ int map_addinstancemap(const char *name, int id)
 	CREATE(map[dst_m].cell, struct mapcell, num_cell);
 	memcpy(map[dst_m].cell, map[src_m].cell, num_cell * sizeof(struct mapcell));
 
-	size = map[dst_m].bxs * map[dst_m].bys * sizeof(struct block_list *);
-	map[dst_m].block = (struct block_list **)aCalloc(1,size);
-	map[dst_m].block_mob = (struct block_list **)aCalloc(1,size);
+	size = map[dst_m].bxs * map[dst_m].bys * sizeof(struct block_grid);
+	map[dst_m].block = (struct block_grid *)aCalloc(1,size);
+	map[dst_m].block_mob = (struct block_grid *)aCalloc(1,size);
+	map_viewers_init(dst_m);
+	map[dst_m].path_cache = NULL;
 
 	map[dst_m].index = mapindex_addmap(-1, map[dst_m].name);
 	map[dst_m].channel = NULL;
@@ -2509,8 +2717,9 @@ int map_delinstancemap(int m)
 
 	// Free memory
 	aFree(map[m].cell);
-	aFree(map[m].block);
-	aFree(map[m].block_mob);
+	map_blockgrid_final(m);
+	map_viewers_final(m);
+	path_cache_final(m);
 
 	map_removemapdb(&map[m]);
 	memset(&map[m], 0x00, sizeof(map[0]));
@@ -2930,6 +3139,7 @@ void map_setcell(int16 m, int16 x, int16 y, cell_t cell, bool flag)
 		return;
 
 	j = x + y*map[m].xs;
+	map[m].cell_stamp++;
 
 	switch( cell ) {
 		case CELL_WALKABLE:      map[m].cell[j].walkable = flag;      break;
@@ -2959,6 +3169,7 @@ void map_setgatcell(int16 m, int16 x, int16 y, int gat)
 		return;
 
 	j = x + y*map[m].xs;
+	map[m].cell_stamp++;
 
 	cell = map_gat2cell(gat);
 	map[m].cell[j].walkable = cell.walkable;
@@ -3301,11 +3512,9 @@ void do_final_maps(void) {
 		if( map[i].cell )
 			aFree(map[i].cell);
 
-		if( map[i].block )
-			aFree(map[i].block);
-
-		if( map[i].block_mob )
-			aFree(map[i].block_mob);
+		map_blockgrid_final(i);
+		map_viewers_final(i);
+		path_cache_final(i);
 
 		if( battle_config.dynamic_mobs ) { //Dynamic mobs flag by [random]
 			int j;
@@ -3555,9 +3764,10 @@ int map_readallmaps (void)
 		map[i].bxs = (map[i].xs + BLOCK_SIZE - 1) / BLOCK_SIZE;
 		map[i].bys = (map[i].ys + BLOCK_SIZE - 1) / BLOCK_SIZE;
 
-		size = map[i].bxs * map[i].bys * sizeof(struct block_list *);
-		map[i].block = (struct block_list**)aCalloc(size, 1);
-		map[i].block_mob = (struct block_list**)aCalloc(size, 1);
+		size = map[i].bxs * map[i].bys * sizeof(struct block_grid);
+		map[i].block = (struct block_grid *)aCalloc(size, 1);
+		map[i].block_mob = (struct block_grid *)aCalloc(size, 1);
+		map_viewers_init(i);
 	}
 
 	//Intialization and configuration-dependent adjustments of mapflags
@@ -3598,6 +3808,7 @@ int parse_console(const char *buf) {
 	struct map_session_data sd;
 
 	memset(&sd, 0, sizeof(struct map_session_data));
+	status_change_init_data(&sd.sc); //Commands read sd.sc.data
 	strcpy(sd.status.name, "console");
 
 	if( (n = sscanf(buf, "%63[^:]:%63[^:]:%63s %hd %hd[^\n]", type, command, map, &x, &y)) < 5 ) {
@@ -3640,17 +3851,48 @@ int parse_console(const char *buf) {
 		}
 	} else if( strcmpi("ers_report", type) == 0 ) {
 		ers_report();
+	} else if( strcmpi("timer_report", type) == 0 ) {
+		timer_report();
+	} else if( strcmpi("timer_profile", type) == 0 ) {
+		if( strcmpi("on", command) == 0 ) {
+			timer_profile_enable(true);
+			ShowInfo("Timer profiler enabled.\n");
+		} else if( strcmpi("off", command) == 0 ) {
+			timer_profile_enable(false);
+			ShowInfo("Timer profiler disabled.\n");
+		} else if( strcmpi("reset", command) == 0 )
+			timer_profile_reset();
+		else
+			timer_profile_report();
+	} else if( strcmpi("path_report", type) == 0 ) {
+		path_cache_report();
+	} else if( strcmpi("path_bench", type) == 0 ) {
+		path_benchmark(n == 2 ? atoi(command) : 0);
 	} else if( strcmpi("help", type) == 0 ) {
 		ShowInfo("Available commands:\n");
 		ShowInfo("\t admin:@<atcommand> => Uses an atcommand. Do NOT use commands requiring an attached player.\n");
 		ShowInfo("\t admin:map:<map> <x> <y> => Changes the map from which console commands are executed.\n");
 		ShowInfo("\t server:shutdown => Stops the server.\n");
 		ShowInfo("\t ers_report => Displays database usage.\n");
+		ShowInfo("\t timer_report => Displays the number of timers of each timer function.\n");
+		ShowInfo("\t timer_profile[:on|off|reset] => Displays the execution time and delay of each timer function, or enables/disables/resets the profiler.\n");
+		ShowInfo("\t path_report => Displays and resets the hit rate of the path caches.\n");
+		ShowInfo("\t path_bench[:<count>] => Measures <count> (default 1000) uncached path searches on every map.\n");
 	}
 
 	return 0;
 }
 
+/*==========================================
+ * Displays and resets the timer profiler data
+ *------------------------------------------*/
+static int map_timer_profile_timer(int tid, unsigned int tick, int id, intptr_t data)
+{
+	timer_profile_report();
+	timer_profile_reset();
+	return 0;
+}
+
 /*==========================================
  * Read map server configuration files (conf/map_athena.conf...)
  *------------------------------------------*/
@@ -3724,6 +3966,8 @@ int map_config_read(char *cfgName)
 				minsave_interval = 1;
 		} else if (strcmpi(w1, "save_settings") == 0)
 			save_settings = atoi(w2);
+		else if (strcmpi(w1, "delta_save") == 0)
+			delta_save = config_switch(w2);
 		else if (strcmpi(w1, "motd_txt") == 0)
 			strcpy(motd_txt, w2);
 		else if (strcmpi(w1, "help_txt") == 0)
@@ -3744,6 +3988,10 @@ int map_config_read(char *cfgName)
 			enable_grf = config_switch(w2);
 		else if (strcmpi(w1, "console_msg_log") == 0)
 			console_msg_log = atoi(w2);//[Ind]
+		else if (strcmpi(w1, "timer_profile_interval") == 0)
+			timer_profile_interval = atoi(w2);
+		else if (strcmpi(w1, "mob_ai_threads") == 0)
+			mob_ai_threads = cap_value(atoi(w2), 0, 15);
 		else if (strcmpi(w1, "import") == 0)
 			map_config_read(w2);
 		else
@@ -4198,6 +4446,7 @@ void do_final(void)
 	ers_destroy(map_skill_damage_ers);
 #endif
 
+	do_final_log(); // After everything that could log
 	map_sql_close();
 
 	ShowStatus("Finished.\n");
@@ -4340,14 +4589,14 @@ int do_init(int argc, char *argv[])
 	inter_config_read(INTER_CONF_NAME);
 	log_config_read(LOG_CONF_NAME);
 
-	id_db = idb_alloc(DB_OPT_BASE);
-	pc_db = idb_alloc(DB_OPT_BASE);	//Added for reliable map_id2sd() use. [Skotlex]
-	mobid_db = idb_alloc(DB_OPT_BASE);	//Added to lower the load of the lazy mob ai. [Skotlex]
-	bossid_db = idb_alloc(DB_OPT_BASE); // Used for Convex Mirror quick MVP search
+	id_db = idb_alloc(DB_OPT_FLAT);
+	pc_db = idb_alloc(DB_OPT_FLAT);	//Added for reliable map_id2sd() use. [Skotlex]
+	mobid_db = idb_alloc(DB_OPT_FLAT);	//Added to lower the load of the lazy mob ai. [Skotlex]
+	bossid_db = idb_alloc(DB_OPT_FLAT); // Used for Convex Mirror quick MVP search
 	map_db = uidb_alloc(DB_OPT_BASE);
 	nick_db = idb_alloc(DB_OPT_BASE);
-	charid_db = idb_alloc(DB_OPT_BASE);
-	regen_db = idb_alloc(DB_OPT_BASE); // efficient status_natural_heal processing
+	charid_db = idb_alloc(DB_OPT_FLAT);
+	regen_db = idb_alloc(DB_OPT_FLAT); // efficient status_natural_heal processing
 
 	iwall_db = strdb_alloc(DB_OPT_RELEASE_DATA, 2 * NAME_LENGTH + 2 + 1); // [Zephyrus] Invisible Walls
 
@@ -4358,6 +4607,7 @@ int do_init(int argc, char *argv[])
 	map_sql_init();
 	if (log_config.sql_logs)
 		log_sql_init();
+	do_init_log();
 
 	mapindex_init();
 	if (enable_grf)
@@ -4421,6 +4671,12 @@ int do_init(int argc, char *argv[])
 		add_timer_interval(gettick() + 1000, parse_console_timer, 0, 0, 1000); // Start in 1s each 1sec
 	}
 
+	if (timer_profile_interval > 0) { // Periodic timer profiler reports
+		timer_profile_enable(true);
+		add_timer_func_list(map_timer_profile_timer, "map_timer_profile_timer");
+		add_timer_interval(gettick() + timer_profile_interval * 1000, map_timer_profile_timer, 0, 0, timer_profile_interval * 1000);
+	}
+
 	return 0;
 }
 
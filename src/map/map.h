@@ -354,6 +354,25 @@ struct block_list {
 	enum bl_type type;
 	int64 damage; //Damage holding [exneval]
 	int val1;
+	int grid_idx; // Position in the entry array of its map block (only valid while on a map)
+};
+
+// Packed copy of the data the area searches filter on, so a block can be
+// scanned without dereferencing every object in it.
+// Kept as parallel arrays so the filters can compare several entries at once.
+struct block_grid {
+	int16 *x, *y;
+	uint16 *type; // enum bl_type
+	struct block_list **bl;
+	int count, max;
+	unsigned int stamp; // Changes whenever an object enters, leaves or moves inside the block (see map_block_stamp)
+};
+
+// Players close enough to a map block to see the objects on it.
+// Lets area broadcasts skip the range query (see map_foreachviewer).
+struct block_viewers {
+	struct map_session_data **sd;
+	int count, max;
 };
 
 // Mob List Held in memory for Dynamic Mobs [Wizputer]
@@ -581,8 +600,11 @@ struct map_data {
 	char name[MAP_NAME_LENGTH];
 	uint16 index; // The map index used by the mapindex* functions.
 	struct mapcell* cell; // Holds the information of each map cell (NULL if the map is not on this map-server).
-	struct block_list **block;
-	struct block_list **block_mob;
+	unsigned int cell_stamp; // Changes whenever a cell is changed, for results computed from the cells.
+	struct path_cache *path_cache; // Recent walk paths (see path_search).
+	struct block_grid *block;
+	struct block_grid *block_mob;
+	struct block_viewers *viewers;
 	int16 m;
 	int16 xs,ys; // Map dimensions (in cells)
 	int16 bxs,bys; // Map dimensions (in blocks)
@@ -721,10 +743,12 @@ extern int map_num;
 extern int autosave_interval;
 extern int minsave_interval;
 extern int save_settings;
+extern int delta_save;
 extern int agit_flag;
 extern int agit2_flag;
 extern int night_flag; // 0 = day, 1 = night [Yor]
 extern int enable_spy; // Determines if @spy commands are active.
+extern int mob_ai_threads; // Threads searching the mob target paths ahead of the AI (0 = main thread only).
 extern char db_path[256];
 
 extern char motd_txt[];
@@ -763,8 +787,10 @@ int map_foreachinmovearea(int (*func)(struct block_list *, va_list), struct bloc
 int map_foreachincell(int (*func)(struct block_list *, va_list), int16 m, int16 x, int16 y, int type, ...);
 int map_foreachinpath(int (*func)(struct block_list *, va_list), int16 m, int16 x0, int16 y0, int16 x1, int16 y1, int16 range, int length, int type, ...);
 int map_foreachinmap(int (*func)(struct block_list *, va_list), int16 m, int type, ...);
+int map_foreachviewer(int (*func)(struct block_list *, va_list), int16 m, int16 x, int16 y, int16 range, ...);
 // Blocklist nb in one cell
 int map_count_oncell(int16 m, int16 x, int16 y, int type, int flag);
+unsigned int map_block_stamp(int16 m, int16 x, int16 y, int16 range);
 struct skill_unit *map_find_skill_unit_oncell(struct block_list *, int16 x, int16 y, uint16 skill_id, struct skill_unit *, int flag);
 // search and creation
 int map_get_new_object_id(void);
@@ -907,21 +933,22 @@ typedef struct elemental_data	TBL_ELEM;
 
 #ifdef BETA_THREAD_TEST
 
-extern char default_codepage[32];
 extern int map_server_port;
 extern char map_server_ip[32];
 extern char map_server_id[32];
 extern char map_server_pw[32];
 extern char map_server_db[32];
 
+#endif
+
+extern char default_codepage[32];
+
 extern char log_db_ip[32];
 extern int log_db_port;
 extern char log_db_id[32];
 extern char log_db_pw[32];
 extern char log_db_db[32];
 
-#endif
-
 #include "../common/sql.h"
 
 extern int db_use_sqldbs;
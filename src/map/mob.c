@@ -12,6 +12,9 @@
 #include "../common/strlib.h"
 #include "../common/utils.h"
 #include "../common/socket.h"
+#include "../common/atomic.h"
+#include "../common/thread.h"
+#include "../common/mutex.h"
 
 #include "map.h"
 #include "path.h"
@@ -106,6 +109,44 @@ static struct {
 const int mob_manuk[8] = { MOBID_TATACHO, MOBID_CENTIPEDE, MOBID_NEPENTHES, MOBID_HILLSRION, MOBID_HARDROCK_MOMMOTH, MOBID_G_TATACHO, MOBID_G_HILLSRION, MOBID_CENTIPEDE_LARVA };
 const int mob_splendide[5] = { MOBID_TENDRILRION, MOBID_CORNUS, MOBID_NAGA, MOBID_LUCIOLA_VESPA, MOBID_PINGUICULA };
 
+//Mobs near players gathered by mob_ai_hard, each one once per run
+struct s_mob_ai_queue {
+	struct mob_data *md;
+	int path, path_count; //Paths of its target search in mob_ai_path
+};
+static struct s_mob_ai_queue *mob_ai_queue = NULL;
+static int mob_ai_queue_count = 0, mob_ai_queue_max = 0;
+static struct s_mob_ai_queue *mob_ai_current = NULL; //Entry of the mob thinking
+
+//Walk paths to the possible targets of the queued mobs, searched ahead by the AI threads
+struct s_mob_ai_path {
+	int target_id;
+	int16 m, x0, y0, x1, y1;
+	unsigned int cell_stamp;
+	bool found;
+	uint8 path_len;
+};
+static struct s_mob_ai_path *mob_ai_path = NULL;
+static int mob_ai_path_count = 0, mob_ai_path_max = 0;
+
+//AI threads (see mob_ai_threads), woken up for each batch of paths
+static struct {
+	int count;
+	rAthread thread[15];
+	ramutex lock;
+	racond cond_work, cond_done;
+	volatile int32 next; //Next path to search
+	int busy; //Threads still searching
+	unsigned int run; //Batch number
+	bool terminate;
+} mob_ai_pool;
+
+//AI evaluations since startup: mobs near players, idle mobs near players that had nothing to do and mobs away from players
+static struct {
+	unsigned int start;
+	unsigned int active, idle, lazy;
+} mob_ai_count;
+
 /*==========================================
  * Local prototype declaration (only required thing)
  *------------------------------------------*/
@@ -1053,6 +1094,32 @@ int mob_target(struct mob_data *md, struct block_list *bl, int dist)
 /*==========================================
  * The search routine of an active monster
  *------------------------------------------*/
+/*==========================================
+ * Walk path length from md to bl, -1 when there's no path
+ * Uses the path searched ahead by the AI threads while md and bl haven't moved
+ * and the cells haven't changed, so the result is always the same as searching now
+ *------------------------------------------*/
+static int mob_ai_path_len(struct mob_data *md, struct block_list *bl)
+{
+	struct walkpath_data wpd;
+
+	if(mob_ai_current && mob_ai_current->md == md) {
+		int i;
+
+		for(i = mob_ai_current->path; i < mob_ai_current->path + mob_ai_current->path_count; i++) {
+			struct s_mob_ai_path *p = &mob_ai_path[i];
+
+			if(p->target_id == bl->id && p->m == md->bl.m && p->x0 == md->bl.x && p->y0 == md->bl.y &&
+				p->x1 == bl->x && p->y1 == bl->y && p->cell_stamp == map[p->m].cell_stamp)
+				return (p->found ? p->path_len : -1);
+		}
+	}
+
+	if(!path_search(&wpd,md->bl.m,md->bl.x,md->bl.y,bl->x,bl->y,0,CELL_CHKWALL))
+		return -1;
+	return wpd.path_len;
+}
+
 static int mob_ai_sub_hard_activesearch(struct block_list *bl,va_list ap)
 {
 	struct mob_data *md;
@@ -1086,13 +1153,13 @@ static int mob_ai_sub_hard_activesearch(struct block_list *bl,va_list ap)
 			if(((*target) == NULL || !check_distance_bl(&md->bl,*target,dist)) &&
 				battle_check_range(&md->bl,bl,md->db->range2)) { //Pick closest target?
 #ifdef ACTIVEPATHSEARCH
-			struct walkpath_data wpd;
+			int path_len = mob_ai_path_len(md,bl); //Count walk path cells
 
-			if(!path_search(&wpd,md->bl.m,md->bl.x,md->bl.y,bl->x,bl->y,0,CELL_CHKWALL)) //Count walk path cells
+			if(path_len < 0)
 				return 0;
 			//Standing monsters use range2, walking monsters use range3
-			if((md->ud.walktimer == INVALID_TIMER && wpd.path_len > md->db->range2) ||
-				(md->ud.walktimer != INVALID_TIMER && wpd.path_len > md->db->range3))
+			if((md->ud.walktimer == INVALID_TIMER && path_len > md->db->range2) ||
+				(md->ud.walktimer != INVALID_TIMER && path_len > md->db->range3))
 				return 0;
 #endif
 				(*target) = bl;
@@ -1409,6 +1476,7 @@ static bool mob_ai_sub_hard(struct mob_data *md, unsigned int tick)
 		return false;
 
 	md->last_thinktime = tick;
+	mob_ai_count.active++;
 
 	if(md->ud.skilltimer != INVALID_TIMER)
 		return false;
@@ -1662,17 +1730,171 @@ static bool mob_ai_sub_hard(struct mob_data *md, unsigned int tick)
 	return true;
 }
 
-static int mob_ai_sub_hard_timer(struct block_list *bl,va_list ap)
+/*==========================================
+ * Whether the thinking of an idle mob near a player can be skipped until its next random walk
+ * Only for mobs with nothing to react to: no target to keep or look for,
+ * no statuses and no idle or walk skills to trigger
+ *------------------------------------------*/
+static bool mob_ai_sub_hard_idle(struct mob_data *md, unsigned int tick)
+{
+	int i;
+
+	if(md->bl.prev == NULL || md->status.hp == 0 || DIFF_TICK(tick, md->last_thinktime) < MIN_MOBTHINKTIME)
+		return false;
+
+	if(md->target_id || md->attacked_id || md->master_id || md->bg_id || md->special_state.ai != AI_NONE || md->sc.count ||
+		md->state.skillstate != MSS_IDLE || md->ud.walktimer != INVALID_TIMER || md->ud.skilltimer != INVALID_TIMER ||
+		DIFF_TICK(md->next_walktime, tick) <= 0 || battle_config.official_cell_stack_limit)
+		return false;
+
+	if(status_get_mode(&md->bl)&(MD_AGGRESSIVE|MD_LOOTER|MD_ANGRY))
+		return false;
+
+	for(i = 0; i < md->db->maxskill; i++) {
+		if(md->db->skill[i].state == MSS_IDLE || md->db->skill[i].state == MSS_WALK || md->db->skill[i].state == MSS_ANY)
+			return false;
+	}
+	return true;
+}
+
+static void mob_ai_sub_hard_timer(struct mob_data *md, unsigned int tick)
+{
+	if(mob_ai_sub_hard_idle(md, tick)) { //Nothing to do until the next random walk
+		md->last_thinktime = tick;
+		mob_ai_count.idle++;
+	} else if(!mob_ai_sub_hard(md, tick))
+		return;
+	//Hard AI triggered
+	if(!md->state.spotted)
+		md->state.spotted = 1;
+	md->last_pcneartime = tick;
+}
+
+/*==========================================
+ * Queues the mobs near a player for mob_ai_hard, mobs near several players are queued once
+ *------------------------------------------*/
+static int mob_ai_sub_hard_queue(struct block_list *bl,va_list ap)
 {
 	struct mob_data *md = (struct mob_data *)bl;
 	unsigned int tick = va_arg(ap, unsigned int);
 
-	if(mob_ai_sub_hard(md, tick)) { //Hard AI triggered
-		if(!md->state.spotted)
-			md->state.spotted = 1;
-		md->last_pcneartime = tick;
+	if(md->ai_tick == tick)
+		return 0; //Already queued
+	md->ai_tick = tick;
+
+	if(mob_ai_queue_count == mob_ai_queue_max) {
+		mob_ai_queue_max = (mob_ai_queue_max ? mob_ai_queue_max * 2 : 256);
+		RECREATE(mob_ai_queue, struct s_mob_ai_queue, mob_ai_queue_max);
 	}
-	return 0;
+	mob_ai_queue[mob_ai_queue_count].md = md;
+	mob_ai_queue[mob_ai_queue_count].path = mob_ai_queue[mob_ai_queue_count].path_count = 0;
+	mob_ai_queue_count++;
+	return 1;
+}
+
+/*==========================================
+ * Queues the path from an aggressive mob to a possible target for the AI threads
+ *------------------------------------------*/
+static int mob_ai_sub_hard_pathqueue(struct block_list *bl,va_list ap)
+{
+	struct mob_data *md = va_arg(ap, struct mob_data *);
+	struct s_mob_ai_path *p;
+
+	if(bl->id == md->bl.id || status_isdead(bl) || !check_distance_bl(&md->bl, bl, md->db->range2))
+		return 0;
+
+	if(mob_ai_path_count == mob_ai_path_max) {
+		mob_ai_path_max = (mob_ai_path_max ? mob_ai_path_max * 2 : 256);
+		RECREATE(mob_ai_path, struct s_mob_ai_path, mob_ai_path_max);
+	}
+	p = &mob_ai_path[mob_ai_path_count++];
+	p->target_id = bl->id;
+	p->m = md->bl.m;
+	p->x0 = md->bl.x;
+	p->y0 = md->bl.y;
+	p->x1 = bl->x;
+	p->y1 = bl->y;
+	p->cell_stamp = map[md->bl.m].cell_stamp;
+	p->found = false;
+	p->path_len = 0;
+	return 1;
+}
+
+/*==========================================
+ * Searches the queued paths until there are none left
+ * Runs on the AI threads and the main thread at once, only reading the map cells
+ *------------------------------------------*/
+static void mob_ai_path_search(void)
+{
+	int32 i;
+
+	while((i = InterlockedIncrement(&mob_ai_pool.next) - 1) < mob_ai_path_count) {
+		struct s_mob_ai_path *p = &mob_ai_path[i];
+		struct walkpath_data wpd;
+
+		if((p->found = path_search(&wpd, p->m, p->x0, p->y0, p->x1, p->y1, 2, CELL_CHKWALL)))
+			p->path_len = wpd.path_len;
+	}
+}
+
+static void *mob_ai_thread(void *param)
+{
+	unsigned int run = 0;
+
+	ramutex_lock(mob_ai_pool.lock);
+	for(;;) {
+		while(!mob_ai_pool.terminate && mob_ai_pool.run == run)
+			racond_wait(mob_ai_pool.cond_work, mob_ai_pool.lock, -1);
+		if(mob_ai_pool.terminate)
+			break;
+		run = mob_ai_pool.run;
+		ramutex_unlock(mob_ai_pool.lock);
+		mob_ai_path_search();
+		ramutex_lock(mob_ai_pool.lock);
+		if(--mob_ai_pool.busy == 0)
+			racond_signal(mob_ai_pool.cond_done);
+	}
+	ramutex_unlock(mob_ai_pool.lock);
+	return NULL;
+}
+
+/*==========================================
+ * Read-only phase of mob_ai_hard
+ * Queues the paths the target search of the aggressive mobs will need
+ * and searches them on the AI threads, while nothing else runs
+ *------------------------------------------*/
+static void mob_ai_hard_prepare(unsigned int tick)
+{
+	int i;
+
+	mob_ai_path_count = 0;
+	for(i = 0; i < mob_ai_queue_count; i++) {
+		struct mob_data *md = mob_ai_queue[i].md;
+
+		if(md->bl.prev == NULL || md->status.hp == 0 || md->target_id || md->ud.skilltimer != INVALID_TIMER ||
+			DIFF_TICK(tick, md->last_thinktime) < MIN_MOBTHINKTIME || !(status_get_mode(&md->bl)&MD_AGGRESSIVE))
+			continue; //Not searching for a target this run
+		mob_ai_queue[i].path = mob_ai_path_count;
+		map_foreachinrange(mob_ai_sub_hard_pathqueue, &md->bl, md->db->range2, DEFAULT_ENEMY_TYPE(md), md);
+		mob_ai_queue[i].path_count = mob_ai_path_count - mob_ai_queue[i].path;
+	}
+
+	if(!mob_ai_path_count)
+		return;
+
+	mob_ai_pool.next = 0;
+	ramutex_lock(mob_ai_pool.lock);
+	mob_ai_pool.busy = mob_ai_pool.count;
+	mob_ai_pool.run++;
+	racond_broadcast(mob_ai_pool.cond_work);
+	ramutex_unlock(mob_ai_pool.lock);
+
+	mob_ai_path_search(); //Take a share too
+
+	ramutex_lock(mob_ai_pool.lock);
+	while(mob_ai_pool.busy)
+		racond_wait(mob_ai_pool.cond_done, mob_ai_pool.lock, -1);
+	ramutex_unlock(mob_ai_pool.lock);
 }
 
 /*==========================================
@@ -1682,7 +1904,7 @@ static int mob_ai_sub_foreachclient(struct map_session_data *sd,va_list ap)
 {
 	unsigned int tick = va_arg(ap, unsigned int);
 
-	map_foreachinrange(mob_ai_sub_hard_timer, &sd->bl, AREA_SIZE + ACTIVE_AI_RANGE, BL_MOB, tick);
+	map_foreachinrange(mob_ai_sub_hard_queue, &sd->bl, AREA_SIZE + ACTIVE_AI_RANGE, BL_MOB, tick);
 	return 0;
 }
 
@@ -1724,6 +1946,7 @@ static int mob_ai_sub_lazy(struct mob_data *md, va_list args)
 		return 0;
 
 	md->last_thinktime = tick;
+	mob_ai_count.lazy++;
 
 	if(md->master_id) {
 		mob_ai_sub_hard_slavemob(md, tick);
@@ -1757,8 +1980,24 @@ static int mob_ai_hard(int tid, unsigned int tick, int id, intptr_t data)
 {
 	if (battle_config.mob_ai&0x20)
 		map_foreachmob(mob_ai_sub_lazy,tick);
-	else
+	else {
+		int i;
+
+		//Gather first so that every mob thinks once, no matter how many players are around
+		mob_ai_queue_count = 0;
 		map_foreachpc(mob_ai_sub_foreachclient,tick);
+		if (mob_ai_pool.count)
+			mob_ai_hard_prepare(tick);
+		//Then act one after the other, in the order they were gathered
+		map_freeblock_lock();
+		for (i = 0; i < mob_ai_queue_count; i++) {
+			mob_ai_current = &mob_ai_queue[i];
+			if (mob_ai_current->md->bl.prev) //Mobs removed by an earlier one are only freed after the unlock
+				mob_ai_sub_hard_timer(mob_ai_current->md,tick);
+		}
+		mob_ai_current = NULL;
+		map_freeblock_unlock();
+	}
 	return 0;
 }
 
@@ -4810,6 +5049,8 @@ void mob_clear_spawninfo() { //Clear spawn related information for a script relo
  *------------------------------------------*/
 void do_init_mob(void)
 { //Initialize the mob database
+	int i;
+
 	memset(mob_db_data,0,sizeof(mob_db_data)); //Clear the array
 	mob_db_data[0] = (struct mob_db*)aCalloc(1, sizeof (struct mob_db));	//This mob is used for random spawns
 	mob_makedummymobdb(0); //The first time this is invoked, it creates the dummy mob
@@ -4826,6 +5067,26 @@ void do_init_mob(void)
 	add_timer_func_list(mob_timer_delete,"mob_timer_delete");
 	add_timer_func_list(mob_spawn_guardian_sub,"mob_spawn_guardian_sub");
 	add_timer_func_list(mob_respawn,"mob_respawn");
+	mob_ai_count.start = gettick();
+	if (mob_ai_threads > 0) {
+		mob_ai_pool.lock = ramutex_create();
+		mob_ai_pool.cond_work = racond_create();
+		mob_ai_pool.cond_done = racond_create();
+		for (i = 0; i < mob_ai_threads && i < ARRAYLENGTH(mob_ai_pool.thread); i++) {
+			if ((mob_ai_pool.thread[i] = rathread_createEx(mob_ai_thread, NULL, 1024 * 1024, RAT_PRIO_NORMAL)) == NULL) {
+				ShowError("do_init_mob: Could not create AI thread %d, using %d.\n", i + 1, i);
+				break;
+			}
+		}
+		mob_ai_pool.count = i;
+		if (mob_ai_pool.count)
+			ShowStatus("Searching monster target paths on '"CL_WHITE"%d"CL_RESET"' AI threads.\n", mob_ai_pool.count);
+		else {
+			racond_destroy(mob_ai_pool.cond_work);
+			racond_destroy(mob_ai_pool.cond_done);
+			ramutex_destroy(mob_ai_pool.lock);
+		}
+	}
 	add_timer_interval(gettick() + MIN_MOBTHINKTIME,mob_ai_hard,0,0,MIN_MOBTHINKTIME);
 	add_timer_interval(gettick() + MIN_MOBTHINKTIME * 10,mob_ai_lazy,0,0,MIN_MOBTHINKTIME * 10);
 }
@@ -4837,6 +5098,35 @@ void do_final_mob(void)
 {
 	int i;
 
+	if (mob_ai_count.active || mob_ai_count.idle || mob_ai_count.lazy) {
+		unsigned int secs = max(DIFF_TICK(gettick(), mob_ai_count.start) / 1000, 1);
+
+		ShowInfo("mob_ai: '"CL_WHITE"%u"CL_RESET"' active, '"CL_WHITE"%u"CL_RESET"' idle and '"CL_WHITE"%u"CL_RESET"' lazy evaluations per second.\n",
+			mob_ai_count.active / secs, mob_ai_count.idle / secs, mob_ai_count.lazy / secs);
+	}
+	if (mob_ai_pool.count) {
+		ramutex_lock(mob_ai_pool.lock);
+		mob_ai_pool.terminate = true;
+		racond_broadcast(mob_ai_pool.cond_work);
+		ramutex_unlock(mob_ai_pool.lock);
+		for (i = 0; i < mob_ai_pool.count; i++)
+			rathread_wait(mob_ai_pool.thread[i], NULL);
+		racond_destroy(mob_ai_pool.cond_work);
+		racond_destroy(mob_ai_pool.cond_done);
+		ramutex_destroy(mob_ai_pool.lock);
+		mob_ai_pool.count = 0;
+	}
+	if (mob_ai_queue) {
+		aFree(mob_ai_queue);
+		mob_ai_queue = NULL;
+		mob_ai_queue_count = mob_ai_queue_max = 0;
+	}
+	if (mob_ai_path) {
+		aFree(mob_ai_path);
+		mob_ai_path = NULL;
+		mob_ai_path_count = mob_ai_path_max = 0;
+	}
+
 	if (mob_dummy) {
 		aFree(mob_dummy);
 		mob_dummy = NULL;
@@ -231,6 +231,7 @@ struct mob_data {
 	unsigned int bg_id; //BattleGround System
 
 	unsigned int next_walktime,last_thinktime,last_linktime,last_pcneartime,dmgtick;
+	unsigned int ai_tick; //Last mob_ai_hard run that queued this mob
 	short move_fail_count;
 	short lootitem_count;
 	short min_chase;
@@ -2276,7 +2276,9 @@ struct npc_data *npc_create_npc(int m, int x, int y)
 	nd->bl.m = m;
 	nd->bl.x = x;
 	nd->bl.y = y;
+	nd->bl.type = BL_NPC;
 	nd->area_size = AREA_SIZE + 1;
+	status_change_init(&nd->bl);
 
 	return nd;
 }
@@ -3502,9 +3504,7 @@ static const char *npc_parse_function(char *w1, char *w2, char *w3, char *w4, co
 	{
 		struct script_code *oldscript = (struct script_code*)db_data2ptr(&old_data);
 		ShowWarning("npc_parse_function: Overwriting user function [%s] in file '%s', line '%d'.\n", w3, filepath, strline(buffer,start - buffer));
-		script_free_vars(oldscript->script_vars);
-		aFree(oldscript->script_buf);
-		aFree(oldscript);
+		script_free_code(oldscript);
 	}
 
 	return end;
@@ -4468,8 +4468,8 @@ void do_init_npc(void)
 	for (i = MAX_NPC_CLASS2_START; i < MAX_NPC_CLASS2_END; i++)
 		npc_viewdb2[i - MAX_NPC_CLASS2_START].class_ = i;
 
-	ev_db = strdb_alloc((DBOptions)(DB_OPT_DUP_KEY|DB_OPT_RELEASE_DATA),2 * NAME_LENGTH + 2 + 1);
-	npcname_db = strdb_alloc(DB_OPT_BASE,NAME_LENGTH);
+	ev_db = strdb_alloc((DBOptions)(DB_OPT_DUP_KEY|DB_OPT_RELEASE_DATA|DB_OPT_FLAT),2 * NAME_LENGTH + 2 + 1);
+	npcname_db = strdb_alloc(DB_OPT_FLAT,NAME_LENGTH);
 	npc_path_db = strdb_alloc(DB_OPT_BASE|DB_OPT_DUP_KEY|DB_OPT_RELEASE_DATA,80);
 #if PACKETVER >= 20131223
 	NPCMarketDB = strdb_alloc(DB_OPT_BASE, NAME_LENGTH+1);
@@ -4507,6 +4507,7 @@ void do_init_npc(void)
 	npc_script++;
 	fake_nd->bl.type = BL_NPC;
 	fake_nd->subtype = NPCTYPE_SCRIPT;
+	status_change_init(&fake_nd->bl);
 
 	strdb_put(npcname_db, fake_nd->exname, fake_nd);
 	fake_nd->u.scr.timerid = INVALID_TIMER;
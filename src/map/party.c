@@ -867,7 +867,7 @@ int party_send_message(struct map_session_data *sd,const char *mes,int len)
 	party_recv_message(sd->status.party_id,sd->status.account_id,mes,len);
 
 	//Chat logging type 'P' / Party Chat
-	log_chat(LOG_CHAT_PARTY,sd->status.party_id,sd->status.char_id,sd->status.account_id,mapindex_id2name(sd->mapindex),sd->bl.x,sd->bl.y,NULL,mes);
+	log_chat(LOG_CHAT_PARTY,sd->status.party_id,sd->status.char_id,sd->status.account_id,sd->mapindex,sd->bl.x,sd->bl.y,NULL,mes);
 
 	return 0;
 }
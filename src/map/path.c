@@ -7,6 +7,7 @@
 #include "../common/nullpo.h"
 #include "../common/random.h"
 #include "../common/showmsg.h"
+#include "../common/timer.h"
 #include "map.h"
 #include "battle.h"
 #include "path.h"
@@ -50,6 +51,34 @@ BHEAP_STRUCT_DECL(node_heap, struct path_node*);
 #define heuristic(x0, y0, x1, y1) (MOVE_COST * (abs((x1) - (x0)) + abs((y1) - (y0)))) // Manhattan distance
 /// @}
 
+/// @name Path cache
+/// Recent A* results of a map, reused as long as the cells of the map do not
+/// change (see map_data::cell_stamp).
+/// @{
+
+/// Number of results kept per map
+#define PATH_CACHE_SIZE 16
+
+/// Cached path search
+struct path_cache_entry {
+	unsigned int stamp; ///< map_data::cell_stamp at the time of the search
+	unsigned int used; ///< Last lookup, for least recently used replacement
+	int16 x0, y0, x1, y1; ///< Start and destination
+	cell_chk cell; ///< Type of obstruction checked for
+	bool found; ///< Result of the search
+	struct walkpath_data wpd; ///< Path found
+};
+
+/// Path cache of a map
+struct path_cache {
+	unsigned int clock; ///< Lookup counter
+	struct path_cache_entry entry[PATH_CACHE_SIZE];
+};
+
+static unsigned int path_cache_hits = 0;
+static unsigned int path_cache_misses = 0;
+/// @}
+
 // Translates dx,dy into walking direction
 static const unsigned char walk_choices [3][3] =
 {
@@ -181,11 +210,11 @@ bool path_search_long(struct shootpath_data *spd,int16 m,int16 x0,int16 y0,int16
 /// @{
 
 /// Pushes path_node to the binary node_heap.
-/// Ensures there is enough space in array to store new element.
+/// The heap is backed by an array as big as the node table and a node is
+/// never in it twice, so there's always enough space for the new element.
 static void heap_push_node(struct node_heap *heap, struct path_node *node)
 {
 #ifndef __clang_analyzer__ // @TODO: Figure out why clang's static analyzer doesn't like this
-	BHEAP_ENSURE(*heap, 1, 256);
 	BHEAP_PUSH2(*heap, node, NODE_MINTOPCMP, swap_ptr);
 #endif // __clang_analyzer__
 }
@@ -241,10 +270,168 @@ static int add_path(struct node_heap *heap, struct path_node *tp, int16 x, int16
 }
 ///@}
 
+/// A* search of a walk path from (x0,y0) to (x1,y1), see path_search.
+/// Only reads the map, so it is safe outside of the main thread.
+static bool path_search_astar(struct walkpath_data *wpd, struct map_data *md, int16 x0, int16 y0, int16 x1, int16 y1, cell_chk cell)
+{
+	// A* (A-star) pathfinding
+	// We always use A* for finding walkpaths because it is what game client uses
+	// Easy pathfinding cuts corners of non-walkable cells, but client always walks around it
+
+	// FIXME: This array is too small to ensure all paths shorter than MAX_WALKPATH
+	// can be found without node collision: calc_index(node1) = calc_index(node2)
+	// Figure out more proper size or another way to keep track of known nodes
+	struct path_node tp[MAX_WALKPATH * MAX_WALKPATH];
+	// 'Open' set, kept on the stack so that no memory is allocated and
+	// the search can run outside the main thread (see mob_ai_threads)
+	struct path_node *open_nodes[MAX_WALKPATH * MAX_WALKPATH];
+	struct node_heap open_set;
+	struct path_node *current, *it;
+	int i, x, y, dx, dy;
+	int xs = md->xs - 1;
+	int ys = md->ys - 1;
+	int len = 0;
+	int j;
+
+	memset(tp, 0, sizeof(tp));
+	BHEAP_DATA(open_set) = open_nodes;
+	BHEAP_LENGTH(open_set) = 0;
+	BHEAP_CAPACITY(open_set) = ARRAYLENGTH(open_nodes);
+
+	// Start node
+	i = calc_index(x0, y0);
+	tp[i].parent = NULL;
+	tp[i].x      = x0;
+	tp[i].y      = y0;
+	tp[i].g_cost = 0;
+	tp[i].f_cost = heuristic(x0, y0, x1, y1);
+	tp[i].flag   = SET_OPEN;
+
+	heap_push_node(&open_set, &tp[i]); // Put start node to 'open' set
+
+	for(;;) {
+		int e = 0; // error flag
+
+		// Saves allowed directions for the current cell. Diagonal directions
+		// are only allowed if both directions around it are allowed. This is
+		// to prevent cutting corner of nearby wall.
+		// For example, you can only go NW from the current cell, if you can
+		// go N *and* you can go W. Otherwise you need to walk around the
+		// (corner of the) non-walkable cell.
+		int allowed_dirs = 0;
+
+		int g_cost;
+
+		if (BHEAP_LENGTH(open_set) == 0)
+			return false;
+
+		current = BHEAP_PEEK(open_set); // Look for the lowest f_cost node in the 'open' set
+		BHEAP_POP2(open_set, NODE_MINTOPCMP, swap_ptr); // Remove it from 'open' set
+
+		x      = current->x;
+		y      = current->y;
+		g_cost = current->g_cost;
+
+		current->flag = SET_CLOSED; // Add current node to 'closed' set
+
+		if (x == x1 && y == y1)
+			break;
+
+		if (y < ys && !map_getcellp(md, x, y+1, cell)) allowed_dirs |= DIR_NORTH;
+		if (y >  0 && !map_getcellp(md, x, y-1, cell)) allowed_dirs |= DIR_SOUTH;
+		if (x < xs && !map_getcellp(md, x+1, y, cell)) allowed_dirs |= DIR_EAST;
+		if (x >  0 && !map_getcellp(md, x-1, y, cell)) allowed_dirs |= DIR_WEST;
+
+#define chk_dir(d) ((allowed_dirs & (d)) == (d))
+		// Process neighbors of current node
+		if (chk_dir(DIR_SOUTH|DIR_EAST) && !map_getcellp(md, x+1, y-1, cell))
+			e += add_path(&open_set, tp, x+1, y-1, g_cost + MOVE_DIAGONAL_COST, current, heuristic(x+1, y-1, x1, y1)); // (x+1, y-1) 5
+		if (chk_dir(DIR_EAST))
+			e += add_path(&open_set, tp, x+1, y, g_cost + MOVE_COST, current, heuristic(x+1, y, x1, y1)); // (x+1, y) 6
+		if (chk_dir(DIR_NORTH|DIR_EAST) && !map_getcellp(md, x+1, y+1, cell))
+			e += add_path(&open_set, tp, x+1, y+1, g_cost + MOVE_DIAGONAL_COST, current, heuristic(x+1, y+1, x1, y1)); // (x+1, y+1) 7
+		if (chk_dir(DIR_NORTH))
+			e += add_path(&open_set, tp, x, y+1, g_cost + MOVE_COST, current, heuristic(x, y+1, x1, y1)); // (x, y+1) 0
+		if (chk_dir(DIR_NORTH|DIR_WEST) && !map_getcellp(md, x-1, y+1, cell))
+			e += add_path(&open_set, tp, x-1, y+1, g_cost + MOVE_DIAGONAL_COST, current, heuristic(x-1, y+1, x1, y1)); // (x-1, y+1) 1
+		if (chk_dir(DIR_WEST))
+			e += add_path(&open_set, tp, x-1, y, g_cost + MOVE_COST, current, heuristic(x-1, y, x1, y1)); // (x-1, y) 2
+		if (chk_dir(DIR_SOUTH|DIR_WEST) && !map_getcellp(md, x-1, y-1, cell))
+			e += add_path(&open_set, tp, x-1, y-1, g_cost + MOVE_DIAGONAL_COST, current, heuristic(x-1, y-1, x1, y1)); // (x-1, y-1) 3
+		if (chk_dir(DIR_SOUTH))
+			e += add_path(&open_set, tp, x, y-1, g_cost + MOVE_COST, current, heuristic(x, y-1, x1, y1)); // (x, y-1) 4
+#undef chk_dir
+		if (e)
+			return false;
+	}
+
+	for (it = current; it->parent != NULL; it = it->parent, len++);
+	if (len > sizeof(wpd->path))
+		return false;
+
+	// Recreate path
+	wpd->path_len = len;
+	wpd->path_pos = 0;
+
+	for (it = current, j = len-1; j >= 0; it = it->parent, j--) {
+		dx = it->x - it->parent->x;
+		dy = it->y - it->parent->y;
+		wpd->path[j] = walk_choices[-dy + 1][dx + 1];
+	}
+
+	return true;
+}
+
+/// A* search through the path cache of the map.
+/// A result is reused while the cells of the map are unchanged, otherwise
+/// the least recently used result of the map is replaced.
+static bool path_search_cached(struct walkpath_data *wpd, struct map_data *md, int16 x0, int16 y0, int16 x1, int16 y1, cell_chk cell)
+{
+	struct path_cache *pc;
+	struct path_cache_entry *e, *slot;
+	int i;
+
+	if (md->path_cache == NULL)
+		CREATE(md->path_cache, struct path_cache, 1);
+	pc = md->path_cache;
+	pc->clock++;
+
+	slot = &pc->entry[0];
+	for (i = 0; i < PATH_CACHE_SIZE; i++) {
+		e = &pc->entry[i];
+		if (e->used && e->stamp != md->cell_stamp)
+			e->used = 0; // Outdated, replace it first
+		if (e->used && e->x0 == x0 && e->y0 == y0 && e->x1 == x1 && e->y1 == y1 && e->cell == cell) {
+			e->used = pc->clock;
+			path_cache_hits++;
+			if (e->found)
+				memcpy(wpd, &e->wpd, sizeof(*wpd));
+			return e->found;
+		}
+		if (e->used < slot->used)
+			slot = e;
+	}
+
+	path_cache_misses++;
+	slot->found = path_search_astar(wpd, md, x0, y0, x1, y1, cell);
+	slot->stamp = md->cell_stamp;
+	slot->used = pc->clock;
+	slot->x0 = x0;
+	slot->y0 = y0;
+	slot->x1 = x1;
+	slot->y1 = y1;
+	slot->cell = cell;
+	if (slot->found)
+		memcpy(&slot->wpd, wpd, sizeof(*wpd));
+
+	return slot->found;
+}
+
 /*==========================================
  * path search (x0,y0)->(x1,y1)
  * wpd: path info will be written here
  * flag: &1 = easy path search only
+ *       &2 = don't use the path cache (for searches outside of the main thread)
  * cell: type of obstruction to check for
  *------------------------------------------*/
 bool path_search(struct walkpath_data *wpd, int16 m, int16 x0, int16 y0, int16 x1, int16 y1, int flag, cell_chk cell)
@@ -309,116 +496,83 @@ bool path_search(struct walkpath_data *wpd, int16 m, int16 x0, int16 y0, int16 x
 		}
 
 		return false; // easy path unsuccessful
-	} else { // !(flag&1)
-		// A* (A-star) pathfinding
-		// We always use A* for finding walkpaths because it is what game client uses
-		// Easy pathfinding cuts corners of non-walkable cells, but client always walks around it
-
-		BHEAP_STRUCT_VAR(node_heap, open_set); // 'Open' set
-
-		// FIXME: This array is too small to ensure all paths shorter than MAX_WALKPATH
-		// can be found without node collision: calc_index(node1) = calc_index(node2)
-		// Figure out more proper size or another way to keep track of known nodes
-		struct path_node tp[MAX_WALKPATH * MAX_WALKPATH];
-		struct path_node *current, *it;
-		int xs = md->xs - 1;
-		int ys = md->ys - 1;
-		int len = 0;
-		int j;
-
-		memset(tp, 0, sizeof(tp));
-
-		// Start node
-		i = calc_index(x0, y0);
-		tp[i].parent = NULL;
-		tp[i].x      = x0;
-		tp[i].y      = y0;
-		tp[i].g_cost = 0;
-		tp[i].f_cost = heuristic(x0, y0, x1, y1);
-		tp[i].flag   = SET_OPEN;
-
-		heap_push_node(&open_set, &tp[i]); // Put start node to 'open' set
-
-		for(;;) {
-			int e = 0; // error flag
-
-			// Saves allowed directions for the current cell. Diagonal directions
-			// are only allowed if both directions around it are allowed. This is
-			// to prevent cutting corner of nearby wall.
-			// For example, you can only go NW from the current cell, if you can
-			// go N *and* you can go W. Otherwise you need to walk around the
-			// (corner of the) non-walkable cell.
-			int allowed_dirs = 0;
-
-			int g_cost;
-
-			if (BHEAP_LENGTH(open_set) == 0) {
-				BHEAP_CLEAR(open_set);
-				return false;
-			}
-
-			current = BHEAP_PEEK(open_set); // Look for the lowest f_cost node in the 'open' set
-			BHEAP_POP2(open_set, NODE_MINTOPCMP, swap_ptr); // Remove it from 'open' set
-
-			x      = current->x;
-			y      = current->y;
-			g_cost = current->g_cost;
+	} else if (flag&2) // Not on the main thread, leave the cache alone
+		return path_search_astar(wpd, md, x0, y0, x1, y1, cell);
+#ifdef CELL_NOSTACK
+	else if (cell == CELL_CHKNOPASS) // Depends on the units on the cells too
+		return path_search_astar(wpd, md, x0, y0, x1, y1, cell);
+#endif
+	else
+		return path_search_cached(wpd, md, x0, y0, x1, y1, cell);
+}
 
-			current->flag = SET_CLOSED; // Add current node to 'closed' set
+/// Frees the path cache of a map.
+void path_cache_final(int16 m)
+{
+	if (map[m].path_cache) {
+		aFree(map[m].path_cache);
+		map[m].path_cache = NULL;
+	}
+}
 
-			if (x == x1 && y == y1) {
-				BHEAP_CLEAR(open_set);
-				break;
-			}
+/// Displays and resets the hit rate of the path caches.
+void path_cache_report(void)
+{
+	unsigned int total = path_cache_hits + path_cache_misses;
 
-			if (y < ys && !map_getcellp(md, x, y+1, cell)) allowed_dirs |= DIR_NORTH;
-			if (y >  0 && !map_getcellp(md, x, y-1, cell)) allowed_dirs |= DIR_SOUTH;
-			if (x < xs && !map_getcellp(md, x+1, y, cell)) allowed_dirs |= DIR_EAST;
-			if (x >  0 && !map_getcellp(md, x-1, y, cell)) allowed_dirs |= DIR_WEST;
+	ShowInfo("Path cache: %u searches, %u hits (%u%%).\n", total, path_cache_hits, total ? (unsigned int)((uint64)path_cache_hits * 100 / total) : 0);
+	path_cache_hits = path_cache_misses = 0;
+}
 
-#define chk_dir(d) ((allowed_dirs & (d)) == (d))
-			// Process neighbors of current node
-			if (chk_dir(DIR_SOUTH|DIR_EAST) && !map_getcellp(md, x+1, y-1, cell))
-				e += add_path(&open_set, tp, x+1, y-1, g_cost + MOVE_DIAGONAL_COST, current, heuristic(x+1, y-1, x1, y1)); // (x+1, y-1) 5
-			if (chk_dir(DIR_EAST))
-				e += add_path(&open_set, tp, x+1, y, g_cost + MOVE_COST, current, heuristic(x+1, y, x1, y1)); // (x+1, y) 6
-			if (chk_dir(DIR_NORTH|DIR_EAST) && !map_getcellp(md, x+1, y+1, cell))
-				e += add_path(&open_set, tp, x+1, y+1, g_cost + MOVE_DIAGONAL_COST, current, heuristic(x+1, y+1, x1, y1)); // (x+1, y+1) 7
-			if (chk_dir(DIR_NORTH))
-				e += add_path(&open_set, tp, x, y+1, g_cost + MOVE_COST, current, heuristic(x, y+1, x1, y1)); // (x, y+1) 0
-			if (chk_dir(DIR_NORTH|DIR_WEST) && !map_getcellp(md, x-1, y+1, cell))
-				e += add_path(&open_set, tp, x-1, y+1, g_cost + MOVE_DIAGONAL_COST, current, heuristic(x-1, y+1, x1, y1)); // (x-1, y+1) 1
-			if (chk_dir(DIR_WEST))
-				e += add_path(&open_set, tp, x-1, y, g_cost + MOVE_COST, current, heuristic(x-1, y, x1, y1)); // (x-1, y) 2
-			if (chk_dir(DIR_SOUTH|DIR_WEST) && !map_getcellp(md, x-1, y-1, cell))
-				e += add_path(&open_set, tp, x-1, y-1, g_cost + MOVE_DIAGONAL_COST, current, heuristic(x-1, y-1, x1, y1)); // (x-1, y-1) 3
-			if (chk_dir(DIR_SOUTH))
-				e += add_path(&open_set, tp, x, y-1, g_cost + MOVE_COST, current, heuristic(x, y-1, x1, y1)); // (x, y-1) 4
-#undef chk_dir
-			if (e) {
-				BHEAP_CLEAR(open_set);
-				return false;
-			}
+/// Measures the A* search on every map, with 'count' searches between
+/// random walkable cells in walking range of each other per map.
+/// The cache is not used, so this is the cost of a cache miss.
+void path_benchmark(int count)
+{
+	unsigned int tick, total_time = 0, worst_time = 0;
+	int m, worst_m = -1, maps = 0, searches = 0, found = 0;
+
+	if (count <= 0)
+		count = 1000;
+
+	for (m = 0; m < map_num; m++) {
+		struct map_data *md = &map[m];
+		int i, tries = 0;
+
+		if (md->cell == NULL || md->instance_id)
+			continue;
+
+		tick = gettick_nocache();
+		for (i = 0; i < count && tries < count * 10; tries++) {
+			struct walkpath_data wpd;
+			int16 x0 = rnd()%md->xs, y0 = rnd()%md->ys;
+			int16 x1 = x0 + rnd()%(MAX_WALKPATH - 1) - MAX_WALKPATH / 2 + 1;
+			int16 y1 = y0 + rnd()%(MAX_WALKPATH - 1) - MAX_WALKPATH / 2 + 1;
+
+			if (map_getcellp(md, x0, y0, CELL_CHKNOREACH) || x1 < 0 || x1 >= md->xs || y1 < 0 || y1 >= md->ys ||
+				(x0 == x1 && y0 == y1) || map_getcellp(md, x1, y1, CELL_CHKNOREACH))
+				continue;
+			if (path_search_astar(&wpd, md, x0, y0, x1, y1, CELL_CHKNOREACH))
+				found++;
+			i++;
 		}
-
-		for (it = current; it->parent != NULL; it = it->parent, len++);
-		if (len > sizeof(wpd->path))
-			return false;
-
-		// Recreate path
-		wpd->path_len = len;
-		wpd->path_pos = 0;
-
-		for (it = current, j = len-1; j >= 0; it = it->parent, j--) {
-			dx = it->x - it->parent->x;
-			dy = it->y - it->parent->y;
-			wpd->path[j] = walk_choices[-dy + 1][dx + 1];
+		tick = DIFF_TICK(gettick_nocache(), tick);
+
+		searches += i;
+		total_time += tick;
+		maps++;
+		if (worst_m < 0 || tick > worst_time) {
+			worst_m = m;
+			worst_time = tick;
 		}
+	}
 
-		return true;
-	} // A* end
-
-	return false;
+	if (!searches) {
+		ShowInfo("Path benchmark: no walkable maps.\n");
+		return;
+	}
+	ShowInfo("Path benchmark: %d searches on %d maps in %u ms (%u us per search), %d paths found.\n", searches, maps, total_time, (unsigned int)((uint64)total_time * 1000 / searches), found);
+	ShowInfo("Path benchmark: slowest map '%s' (%u ms).\n", map[worst_m].name, worst_time);
 }
 
 // Distance functions, taken from http://www.flipcode.com/articles/article_fastdistance.shtml
@@ -46,6 +46,11 @@ int path_blownpos(int16 m,int16 x0,int16 y0,int16 dx,int16 dy,int count);
 // tries to find a walkable path
 bool path_search(struct walkpath_data *wpd,int16 m,int16 x0,int16 y0,int16 x1,int16 y1,int flag,cell_chk cell);
 
+// path cache
+void path_cache_final(int16 m);
+void path_cache_report(void);
+void path_benchmark(int count);
+
 // tries to find a shootable path
 bool path_search_long(struct shootpath_data *spd,int16 m,int16 x0,int16 y0,int16 x1,int16 y1,cell_chk cell);
 
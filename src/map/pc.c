@@ -725,6 +725,7 @@ void pc_setnewpc(struct map_session_data *sd, int account_id, int char_id, int l
 	//Required to prevent homunculus copuing a base speed of 0
 	sd->battle_status.speed = sd->base_status.speed = DEFAULT_WALK_SPEED;
 	sd->state.warp_clean = 1;
+	status_change_init(&sd->bl);
 }
 
 /**
@@ -8636,70 +8637,153 @@ bool pc_setregstr(struct map_session_data *sd, int reg, const char *str)
 	return true;
 }
 
-int pc_readregistry(struct map_session_data *sd,const char *reg,int type)
+/*==========================================
+ * Permanent registry index.
+ * Variables are found by hashing their name into a per-session table
+ * instead of comparing it with every entry, and their integer value is
+ * kept parsed so reading them doesn't need atoi().
+ *------------------------------------------*/
+static struct global_reg *pc_regindex_array(struct map_session_data *sd, int type, int **num)
 {
-	struct global_reg *sd_reg;
-	int i, max;
-
-	nullpo_ret(sd);
-	switch (type) {
+	switch( type ) {
 		case 3: //Char reg
-			sd_reg = sd->save_reg.global;
-			max = sd->save_reg.global_num;
-			break;
+			*num = &sd->save_reg.global_num;
+			return sd->save_reg.global;
 		case 2: //Account reg
-			sd_reg = sd->save_reg.account;
-			max = sd->save_reg.account_num;
-			break;
+			*num = &sd->save_reg.account_num;
+			return sd->save_reg.account;
 		case 1: //Account2 reg
-			sd_reg = sd->save_reg.account2;
-			max = sd->save_reg.account2_num;
+			*num = &sd->save_reg.account2_num;
+			return sd->save_reg.account2;
+	}
+	return NULL;
+}
+
+static uint32 pc_regindex_hash(const char *str)
+{
+	uint32 hash = 2166136261u; //FNV-1a
+
+	while( *str ) {
+		hash ^= (unsigned char)*str++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/// Returns the position of reg in the registry of type, or -1 if not set.
+static int pc_regindex_find(struct map_session_data *sd, int type, const char *reg)
+{
+	struct reg_index *idx = &sd->reg_index[type - 1];
+	struct global_reg *sd_reg;
+	uint32 hash = pc_regindex_hash(reg);
+	int s, *num;
+
+	sd_reg = pc_regindex_array(sd, type, &num);
+	for( s = hash&(REG_INDEX_SIZE - 1); idx->slot[s]; s = (s + 1)&(REG_INDEX_SIZE - 1) ) {
+		int i = idx->slot[s] - 1;
+
+		if( idx->hash[i] == hash && !strcmp(sd_reg[i].str, reg) )
+			return i;
+	}
+	return -1;
+}
+
+/// Adds the entry at position i of the registry of type to its index.
+static void pc_regindex_insert(struct map_session_data *sd, int type, int i)
+{
+	struct reg_index *idx = &sd->reg_index[type - 1];
+	struct global_reg *sd_reg;
+	int s, *num;
+
+	sd_reg = pc_regindex_array(sd, type, &num);
+	idx->hash[i] = pc_regindex_hash(sd_reg[i].str);
+	idx->value[i] = atoi(sd_reg[i].value);
+	for( s = idx->hash[i]&(REG_INDEX_SIZE - 1); idx->slot[s]; s = (s + 1)&(REG_INDEX_SIZE - 1) )
+		;
+	idx->slot[s] = i + 1;
+}
+
+/// Removes the entry at position i from the index of the registry of type,
+/// before the last entry (at position last) is moved into its place.
+static void pc_regindex_delete(struct map_session_data *sd, int type, int i, int last)
+{
+	struct reg_index *idx = &sd->reg_index[type - 1];
+	int s, j;
+
+	for( s = idx->hash[i]&(REG_INDEX_SIZE - 1); idx->slot[s] != i + 1; s = (s + 1)&(REG_INDEX_SIZE - 1) )
+		;
+	//Shift back the following entries of the cluster that would become unreachable
+	for( j = s; ; ) {
+		int k;
+
+		j = (j + 1)&(REG_INDEX_SIZE - 1);
+		if( !idx->slot[j] )
 			break;
-		default:
-			return 0;
+		k = idx->hash[idx->slot[j] - 1]&(REG_INDEX_SIZE - 1);
+		if( s <= j ? (s < k && k <= j) : (s < k || k <= j) )
+			continue;
+		idx->slot[s] = idx->slot[j];
+		s = j;
 	}
-	if (max == -1) {
+	idx->slot[s] = 0;
+
+	if( i != last ) { //Point the last entry to its new position
+		for( s = idx->hash[last]&(REG_INDEX_SIZE - 1); idx->slot[s] != last + 1; s = (s + 1)&(REG_INDEX_SIZE - 1) )
+			;
+		idx->slot[s] = i + 1;
+		idx->hash[i] = idx->hash[last];
+		idx->value[i] = idx->value[last];
+	}
+}
+
+/// Rebuilds the index of the registry of type, after it has been received.
+void pc_regindex_build(struct map_session_data *sd, int type)
+{
+	int i, *num;
+
+	nullpo_retv(sd);
+	if( pc_regindex_array(sd, type, &num) == NULL )
+		return;
+	memset(sd->reg_index[type - 1].slot, 0, sizeof(sd->reg_index[type - 1].slot));
+	for( i = 0; i < *num; i++ )
+		pc_regindex_insert(sd, type, i);
+}
+
+int pc_readregistry(struct map_session_data *sd,const char *reg,int type)
+{
+	int i, *max;
+
+	nullpo_ret(sd);
+	if (pc_regindex_array(sd, type, &max) == NULL)
+		return 0;
+	if (*max == -1) {
 		ShowError("pc_readregistry: Trying to read reg value %s (type %d) before it's been loaded!\n", reg, type);
 		//This really shouldn't happen, so it's possible the data was lost somewhere, we should request it again.
 		intif_request_registry(sd, type == 3 ? 4 : type);
 		return 0;
 	}
 
-	ARR_FIND(0, max, i, strcmp(sd_reg[i].str,reg) == 0);
-	return (i < max) ? atoi(sd_reg[i].value) : 0;
+	i = pc_regindex_find(sd, type, reg);
+	return (i >= 0) ? sd->reg_index[type - 1].value[i] : 0;
 }
 
 char *pc_readregistry_str(struct map_session_data *sd,const char *reg,int type)
 {
 	struct global_reg *sd_reg;
-	int i, max;
+	int i, *max;
 	
 	nullpo_ret(sd);
-	switch (type) {
-		case 3: //Char reg
-			sd_reg = sd->save_reg.global;
-			max = sd->save_reg.global_num;
-			break;
-		case 2: //Account reg
-			sd_reg = sd->save_reg.account;
-			max = sd->save_reg.account_num;
-			break;
-		case 1: //Account2 reg
-			sd_reg = sd->save_reg.account2;
-			max = sd->save_reg.account2_num;
-			break;
-		default:
-			return NULL;
-	}
-	if (max == -1) {
+	if ((sd_reg = pc_regindex_array(sd, type, &max)) == NULL)
+		return NULL;
+	if (*max == -1) {
 		ShowError("pc_readregistry: Trying to read reg value %s (type %d) before it's been loaded!\n", reg, type);
 		//This really shouldn't happen, so it's possible the data was lost somewhere, we should request it again.
 		intif_request_registry(sd, type == 3 ? 4 : type);
 		return NULL;
 	}
 
-	ARR_FIND(0, max, i, strcmp(sd_reg[i].str,reg) == 0);
-	return (i < max) ? sd_reg[i].value : NULL;
+	i = pc_regindex_find(sd, type, reg);
+	return (i >= 0) ? sd_reg[i].value : NULL;
 }
 
 bool pc_setregistry(struct map_session_data *sd,const char *reg,int val,int type)
@@ -8720,8 +8804,6 @@ bool pc_setregistry(struct map_session_data *sd,const char *reg,int val,int type
 				val = cap_value(val,0,1999);
 				sd->cook_mastery = val;
 			}
-			sd_reg = sd->save_reg.global;
-			max = &sd->save_reg.global_num;
 			regmax = GLOBAL_REG_NUM;
 			break;
 		case 2: //Account reg
@@ -8732,28 +8814,27 @@ bool pc_setregistry(struct map_session_data *sd,const char *reg,int val,int type
 				val = cap_value(val,0,MAX_ZENY);
 				sd->kafraPoints = val;
 			}
-			sd_reg = sd->save_reg.account;
-			max = &sd->save_reg.account_num;
 			regmax = ACCOUNT_REG_NUM;
 			break;
 		case 1: //Account2 reg
-			sd_reg = sd->save_reg.account2;
-			max = &sd->save_reg.account2_num;
 			regmax = ACCOUNT_REG2_NUM;
 			break;
 		default:
 			return false;
 	}
+	sd_reg = pc_regindex_array(sd, type, &max);
 
 	if( *max == -1 ) {
 		ShowError("pc_setregistry : refusing to set %s (type %d) until vars are received.\n",reg,type);
 		return true;
 	}
-	
+
+	i = pc_regindex_find(sd, type, reg);
+
 	//Delete reg
 	if( val == 0 ) {
-		ARR_FIND(0,*max,i,strcmp(sd_reg[i].str,reg) == 0);
-		if( i < *max ) {
+		if( i >= 0 ) {
+			pc_regindex_delete(sd, type, i, *max - 1);
 			if( i != *max - 1 )
 				memcpy(&sd_reg[i],&sd_reg[*max - 1],sizeof(struct global_reg));
 			memset(&sd_reg[*max - 1],0,sizeof(struct global_reg));
@@ -8763,19 +8844,23 @@ bool pc_setregistry(struct map_session_data *sd,const char *reg,int val,int type
 		return true;
 	}
 	//Change value if found
-	ARR_FIND(0,*max,i,strcmp(sd_reg[i].str,reg) == 0);
-	if( i < *max ) {
+	if( i >= 0 ) {
+		if( sd->reg_index[type - 1].value[i] == val && strchr(reg, '$') == NULL )
+			return true; //Unchanged, nothing to save
 		safesnprintf(sd_reg[i].value,sizeof(sd_reg[i].value),"%d",val);
+		sd->reg_index[type - 1].value[i] = val;
 		sd->state.reg_dirty |= 1<<(type - 1);
 		return true;
 	}
 
 	//Add value if not found
+	i = *max;
 	if( i < regmax ) {
 		memset(&sd_reg[i],0,sizeof(struct global_reg));
 		safestrncpy(sd_reg[i].str,reg,sizeof(sd_reg[i].str));
 		safesnprintf(sd_reg[i].value,sizeof(sd_reg[i].value),"%d",val);
 		(*max)++;
+		pc_regindex_insert(sd, type, i);
 		sd->state.reg_dirty |= 1<<(type - 1);
 		return true;
 	}
@@ -8798,32 +8883,29 @@ bool pc_setregistry_str(struct map_session_data *sd,const char *reg,const char *
 
 	switch (type) {
 		case 3: //Char reg
-			sd_reg = sd->save_reg.global;
-			max = &sd->save_reg.global_num;
 			regmax = GLOBAL_REG_NUM;
 			break;
 		case 2: //Account reg
-			sd_reg = sd->save_reg.account;
-			max = &sd->save_reg.account_num;
 			regmax = ACCOUNT_REG_NUM;
 			break;
 		case 1: //Account2 reg
-			sd_reg = sd->save_reg.account2;
-			max = &sd->save_reg.account2_num;
 			regmax = ACCOUNT_REG2_NUM;
 			break;
 		default:
 			return false;
 	}
+	sd_reg = pc_regindex_array(sd, type, &max);
 	if (*max == -1) {
 		ShowError("pc_setregistry_str : refusing to set %s (type %d) until vars are received.\n", reg, type);
 		return false;
 	}
-	
+
+	i = pc_regindex_find(sd, type, reg);
+
 	//Delete reg
 	if (!val || strcmp(val,"") == 0) {
-		ARR_FIND(0, *max, i, strcmp(sd_reg[i].str, reg) == 0);
-		if (i < *max) {
+		if (i >= 0) {
+			pc_regindex_delete(sd, type, i, *max - 1);
 			if (i != *max - 1)
 				memcpy(&sd_reg[i], &sd_reg[*max - 1], sizeof(struct global_reg));
 			memset(&sd_reg[*max - 1], 0, sizeof(struct global_reg));
@@ -8835,20 +8917,24 @@ bool pc_setregistry_str(struct map_session_data *sd,const char *reg,const char *
 	}
 
 	//Change value if found
-	ARR_FIND(0, *max, i, strcmp(sd_reg[i].str, reg) == 0);
-	if (i < *max) {
+	if (i >= 0) {
+		if (strncmp(sd_reg[i].value, val, sizeof(sd_reg[i].value) - 1) == 0)
+			return true; //Unchanged, nothing to save
 		safestrncpy(sd_reg[i].value, val, sizeof(sd_reg[i].value));
+		sd->reg_index[type - 1].value[i] = atoi(sd_reg[i].value);
 		sd->state.reg_dirty |= 1<<(type - 1); //Mark this registry as "need to be saved"
 		if (type != 3) intif_saveregistry(sd, type);
 		return true;
 	}
 
 	//Add value if not found
+	i = *max;
 	if (i < regmax) {
 		memset(&sd_reg[i], 0, sizeof(struct global_reg));
 		safestrncpy(sd_reg[i].str, reg, sizeof(sd_reg[i].str));
 		safestrncpy(sd_reg[i].value, val, sizeof(sd_reg[i].value));
 		(*max)++;
+		pc_regindex_insert(sd, type, i);
 		sd->state.reg_dirty |= 1<<(type - 1); //Mark this registry as "need to be saved"
 		if (type != 3) intif_saveregistry(sd, type);
 		return true;
@@ -28,6 +28,7 @@
 #define DAMAGELOG_SIZE_PC 100 //Damage log
 #define MAX_DEVOTION 5 //Max Devotion slots
 #define BANK_VAULT_VAR "#BANKVAULT"
+#define REG_INDEX_SIZE 512 //Hash slots of a registry index (power of 2, above GLOBAL_REG_NUM)
 
 //Update this max as necessary. 85 is the value needed for Expanded Super Novice
 #define MAX_SKILL_TREE 85
@@ -173,6 +174,13 @@ struct s_bonus_script_entry {
 	int tid;
 };
 
+//Hash index and parsed integer values of a permanent registry (see pc_regindex_build)
+struct reg_index {
+	uint16 slot[REG_INDEX_SIZE]; //Entry position + 1, 0 if unused
+	uint32 hash[GLOBAL_REG_NUM]; //Hash of the name of each entry
+	int value[GLOBAL_REG_NUM]; //Value of each entry as an integer
+};
+
 struct map_session_data {
 	struct block_list bl;
 	struct unit_data ud;
@@ -260,7 +268,9 @@ struct map_session_data {
 
 	uint32 packet_ver;  //5: old, 6: 7july04, 7: 13july04, 8: 26july04, 9: 9aug04/16aug04/17aug04, 10: 6sept04, 11: 21sept04, 12: 18oct04, 13: 25oct04 ... 18
 	struct mmo_charstatus status;
+	struct mmo_charstatus *status_sent; //Status the char-server has, for partial saves (delta_save)
 	struct registry save_reg;
+	struct reg_index reg_index[3]; //Indexed by registry type - 1
 
 	struct item_data *inventory_data[MAX_INVENTORY]; //Direct pointers to itemdb entries (faster than doing item_id lookups)
 	short equip_index[EQI_MAX];
@@ -628,6 +638,8 @@ struct map_session_data {
 	struct s_pc_itemgrouphealrate **itemgrouphealrate; //List of Item Group Heal rate bonus
 	uint8 itemgrouphealrate_count; //Number of rate bonuses
 
+	struct s_status_bonus_cache *bonus_cache; //Outcome of the last equipment bonus pass (status.c)
+
 	int storage_size; //Holds player storage size (VIP system).
 #ifdef VIP_ENABLE
 	struct vip_info vip;
@@ -1004,6 +1016,7 @@ bool pc_setregstr(struct map_session_data *sd,int reg,const char *str);
 #define pc_setaccountreg2(sd,reg,val) pc_setregistry(sd,reg,val,1)
 #define pc_readaccountreg2str(sd,reg) pc_readregistry_str(sd,reg,1)
 #define pc_setaccountreg2str(sd,reg,val) pc_setregistry_str(sd,reg,val,1)
+void pc_regindex_build(struct map_session_data *sd, int type);
 int pc_readregistry(struct map_session_data *,const char *,int);
 bool pc_setregistry(struct map_session_data *,const char *,int,int);
 char *pc_readregistry_str(struct map_session_data *,const char *,int);
@@ -1138,6 +1151,7 @@ void pc_bonus_script_clear(struct map_session_data *sd, uint16 flag);
 
 void pc_cell_basilica(struct map_session_data *sd);
 
+void pc_itemgrouphealrate(struct map_session_data *sd, uint16 group_id, short rate);
 void pc_itemgrouphealrate_clear(struct map_session_data *sd);
 short pc_get_itemgroup_bonus(struct map_session_data *sd, unsigned short nameid);
 short pc_get_itemgroup_bonus_group(struct map_session_data *sd, uint16 group_id);
@@ -272,6 +272,7 @@ static struct str_data_struct {
 	int (*func)(struct script_state *st);
 	int val;
 	int next;
+	uint8 pure; // see script_pure_buildin
 } *str_data = NULL;
 static int str_data_size = 0; // Size of the data
 static int str_num = LABEL_START; // Next id to be assigned
@@ -301,6 +302,21 @@ static int buildin_set_ref = 0;
 static int buildin_callsub_ref = 0;
 static int buildin_callfunc_ref = 0;
 static int buildin_getelementofarray_ref = 0;
+static int buildin_readparam_ref = 0;
+
+/// Buildin functions that only add bonuses or read the equipment, class, levels and stats of the attached player.
+/// Functions with arg 2 take an optional player argument, only calls with a single constant argument qualify.
+/// Functions with arg 3 assign their first argument.
+static const struct {
+	const char *name;
+	uint8 arg;
+} script_pure_buildin[] = {
+	{ "bonus", 1 }, { "bonus2", 1 }, { "bonus3", 1 }, { "bonus4", 1 }, { "bonus5", 1 },
+	{ "set", 3 }, { "setr", 3 }, { "setarray", 3 }, { "cleararray", 3 }, { "getarraysize", 1 }, { "getelementofarray", 1 },
+	{ "goto", 1 }, { "jump_zero", 1 }, { "callsub", 1 }, { "getarg", 1 }, { "return", 1 }, { "end", 1 },
+	{ "getrefine", 1 }, { "isequipped", 1 }, { "isequippedcnt", 1 }, { "getequipcardid", 1 }, { "getiteminfo", 1 }, { "pow", 1 },
+	{ "readparam", 2 }, { "getequipid", 2 }, { "getequiprefinerycnt", 2 }, { "getequipweaponlv", 2 },
+};
 
 // Caches compiled autoscript item code
 // NOTE: This is not cleared when reloading itemdb
@@ -310,6 +326,7 @@ struct Script_Config script_config = {
 	1, //warn_func_mismatch_argtypes
 	1, 65535, 2048, //warn_func_mismatch_paramnum/check_cmdcount/check_gotocount
 	0, INT_MAX, //input_min_value/input_max_value
+	1, //optimize_scripts
 	"OnPCDieEvent", //die_event_name
 	"OnPCKillEvent", //kill_pc_event_name
 	"OnNPCKillEvent", //kill_mob_event_name
@@ -332,6 +349,9 @@ static int         error_report; // If the error should produce output
 static const char *parser_current_src;
 static const char *parser_current_file;
 static int         parser_current_line;
+// Used by the constant folding and dead code removal
+static int         parser_saved_bytes; // bytes removed from the current script
+static int         parser_label_pos; // position of the last label the script can reference
 
 // For advanced scripting support ( nested if, switch, while, for, do-while, function, etc )
 // [Eoe / jA 1080, 1081, 1094, 1164]
@@ -360,6 +380,9 @@ static struct {
 		int count;
 		int flag;
 		struct linkdb_node *case_label;
+		int jump_pos; // start of the current if/else branch
+		unsigned dead : 1; // current if/else branch is never run
+		unsigned taken : 1; // an earlier if/else branch is always run
 	} curly[256];		// Information right parenthesis
 	int curly_count;	// The number of right brackets
 	int index;			// Number of the syntax used in the script
@@ -381,6 +404,8 @@ int potion_target = 0;
 
 c_op get_com(unsigned char *script,int *pos);
 int get_num(unsigned char *script,int *pos);
+static void script_decode_code(struct script_code *code);
+static bool script_code_is_pure(struct script_code *code);
 
 typedef struct script_function {
 	int (*func)(struct script_state *st);
@@ -420,7 +445,7 @@ struct {
  * (Only those needed) local declaration prototype
  *------------------------------------------*/
 const char *parse_subexpr(const char *p,int limit);
-int run_func(struct script_state *st);
+int run_func(struct script_state *st, const struct script_insn *insn);
 int script_instancegetid(struct script_state *st);
 
 enum {
@@ -925,6 +950,9 @@ void set_label(int l,int pos, const char *script_pos)
 	}
 	str_data[l].type = (str_data[l].type == C_USERFUNC ? C_USERFUNC_POS : C_POS);
 	str_data[l].label = pos;
+	//Labels generated by parse_syntax are only referenced inside their block, except switch cases
+	if( l < LABEL_START || strncmp(get_str(l), "__", 2) != 0 || strncmp(get_str(l), "__SW", 4) == 0 )
+		parser_label_pos = max(parser_label_pos, pos);
 	for(i = str_data[l].backpatch; i >= 0 && i != 0x00ffffff;) {
 		int next = GETVALUE(script_buf,i);
 
@@ -934,6 +962,181 @@ void set_label(int l,int pos, const char *script_pos)
 	}
 }
 
+/*==========================================
+ * Constant folding and dead code removal
+ * Only applied if script_config.optimize_scripts is set.
+ *------------------------------------------*/
+/// Checks if the code from start to end is an integer constant.
+static bool parse_const_int(int start, int end, int *val)
+{
+	int i = start, v;
+
+	if( start >= end || get_com(script_buf, &i) != C_INT )
+		return false;
+	v = get_num(script_buf, &i);
+	if( i < end && get_com(script_buf, &i) == C_NEG )
+		v = -v;
+	if( i != end )
+		return false;
+	*val = v;
+	return true;
+}
+
+/// Checks if the code from start to end is a string constant.
+static bool parse_const_str(int start, int end)
+{
+	return (start < end && script_buf[start] == C_STR && start + 2 + (int)strlen((char *)script_buf + start + 1) == end);
+}
+
+/// Replaces the code from pos to the end of the buffer with an integer constant.
+static void parse_set_const_int(int pos, int val)
+{
+	script_pos = pos;
+	add_scripti(abs(val));
+	if( val < 0 )
+		add_scriptc(C_NEG);
+}
+
+/// Removes the code from pos to the end of the buffer.
+/// Fails if a label that can be referenced later points there.
+/// References to unresolved labels and variables in the removed code are dropped.
+static bool parse_truncate(int pos)
+{
+	int i;
+
+	if( parser_label_pos >= pos )
+		return false;
+	for( i = 0; i < str_num; i++ ) {
+		if( str_data[i].type != C_NOP && str_data[i].type != C_USERFUNC )
+			continue;
+		while( str_data[i].backpatch >= pos ) {
+			int next = GETVALUE(script_buf, str_data[i].backpatch);
+
+			str_data[i].backpatch = (next == 0x00ffffff ? -1 : next);
+		}
+	}
+	parser_saved_bytes += script_pos - pos;
+	script_pos = pos;
+	return true;
+}
+
+/// Folds an unary operator applied to the constant from pos to the end of the buffer.
+/// Returns true if the operator doesn't need to be added.
+static bool parse_fold_op1(int pos, int op)
+{
+	int i1, old_pos = script_pos;
+
+	if( !script_config.optimize_scripts || !parse_const_int(pos, script_pos, &i1) || i1 == INT_MIN )
+		return false;
+	switch( op ) {
+		case C_NEG: i1 = -i1; break;
+		case C_NOT: i1 = ~i1; break;
+		case C_LNOT: i1 = !i1; break;
+		default: return false;
+	}
+	if( i1 == INT_MIN )
+		return false;
+	parse_set_const_int(pos, i1);
+	parser_saved_bytes += old_pos + 1 - script_pos;
+	return true;
+}
+
+/// Folds a binary operator applied to the constants from pos to rpos and from rpos to the end of the buffer.
+/// Returns true if the operator doesn't need to be added.
+static bool parse_fold_op2(int pos, int rpos, int op)
+{
+	int i1, i2, old_pos = script_pos;
+	int64 ret;
+
+	if( !script_config.optimize_scripts )
+		return false;
+	if( op == C_ADD && parse_const_str(pos, rpos) && parse_const_str(rpos, script_pos) ) { //String concatenation
+		memmove(script_buf + rpos - 1, script_buf + rpos + 1, script_pos - rpos - 1);
+		script_pos -= 2;
+		parser_saved_bytes += old_pos + 1 - script_pos;
+		return true;
+	}
+	if( !parse_const_int(pos, rpos, &i1) || !parse_const_int(rpos, script_pos, &i2) )
+		return false;
+	switch( op ) {
+		case C_ADD: ret = (int64)i1 + i2; break;
+		case C_SUB: ret = (int64)i1 - i2; break;
+		case C_MUL: ret = (int64)i1 * i2; break;
+		case C_DIV:
+		case C_MOD:
+			if( i2 == 0 ) //Left for the run-time error
+				return false;
+			ret = (op == C_DIV ? (int64)i1 / i2 : (int64)i1 % i2);
+			break;
+		case C_AND: ret = i1 & i2; break;
+		case C_OR: ret = i1 | i2; break;
+		case C_XOR: ret = i1 ^ i2; break;
+		case C_LAND: ret = (i1 && i2); break;
+		case C_LOR: ret = (i1 || i2); break;
+		case C_EQ: ret = (i1 == i2); break;
+		case C_NE: ret = (i1 != i2); break;
+		case C_GT: ret = (i1 > i2); break;
+		case C_GE: ret = (i1 >= i2); break;
+		case C_LT: ret = (i1 < i2); break;
+		case C_LE: ret = (i1 <= i2); break;
+		case C_R_SHIFT:
+		case C_L_SHIFT:
+			if( i2 < 0 || i2 > 31 )
+				return false;
+			ret = (op == C_R_SHIFT ? i1>>i2 : i1<<i2);
+			break;
+		default:
+			return false;
+	}
+	if( ret <= INT_MIN || ret > INT_MAX ) //Left for the run-time overflow warning
+		return false;
+	parse_set_const_int(pos, (int)ret);
+	parser_saved_bytes += old_pos + 1 - script_pos;
+	return true;
+}
+
+/// Folds a ternary operator whose condition (pos to apos) and values
+/// (apos to bpos and bpos to the end of the buffer) are constants.
+/// Returns true if the operator doesn't need to be added.
+static bool parse_fold_op3(int pos, int apos, int bpos)
+{
+	int cond, val, start, end, old_pos = script_pos;
+
+	if( !script_config.optimize_scripts || !parse_const_int(pos, apos, &cond) )
+		return false;
+	if( !(parse_const_int(apos, bpos, &val) || parse_const_str(apos, bpos)) ||
+		!(parse_const_int(bpos, script_pos, &val) || parse_const_str(bpos, script_pos)) )
+		return false;
+	start = (cond ? apos : bpos);
+	end = (cond ? bpos : script_pos);
+	memmove(script_buf + pos, script_buf + start, end - start);
+	script_pos = pos + end - start;
+	parser_saved_bytes += old_pos + 1 - script_pos;
+	return true;
+}
+
+/// Checks the condition from cond_pos to the end of the buffer of the if/else-if
+/// branch being parsed. A constant true condition removes the conditional jump,
+/// a constant false one marks the branch as dead so it's removed when closed.
+/// Returns true if the conditional jump was removed.
+static bool parse_syntax_if_cond(int pos, int cond_pos)
+{
+	int cond;
+
+	if( !script_config.optimize_scripts )
+		return false;
+	if( syntax.curly[pos].taken || (parse_const_int(cond_pos, script_pos, &cond) && !cond) ) {
+		syntax.curly[pos].dead = 1;
+		return false;
+	}
+	if( !parse_const_int(cond_pos, script_pos, &cond) )
+		return false;
+	parser_saved_bytes += script_pos - syntax.curly[pos].jump_pos + 5; // and the label reference + C_FUNC
+	script_pos = syntax.curly[pos].jump_pos;
+	syntax.curly[pos].taken = 1;
+	return true;
+}
+
 /// Skips spaces and/or comments.
 const char *skip_space(const char *p)
 {
@@ -1430,7 +1633,7 @@ const char *parse_simpleexpr(const char *p)
  *------------------------------------------*/
 const char *parse_subexpr(const char *p,int limit)
 {
-	int op, opl, len;
+	int op, opl, len, pos = script_pos, rpos, bpos;
 
 	p = skip_space(p);
 	if( *p == '-' ) {
@@ -1447,7 +1650,8 @@ const char *parse_subexpr(const char *p,int limit)
 		p = parse_variable(p);
 	else if( (op = C_NEG, *p == '-') || (op = C_LNOT, *p == '!') || (op = C_NOT, *p == '~') ) { // Unary - ! ~ operators
 		p = parse_subexpr(p + 1, 11);
-		add_scriptc(op);
+		if( !parse_fold_op1(pos, op) )
+			add_scriptc(op);
 	} else
 		p = parse_simpleexpr(p);
 	p = skip_space(p);
@@ -1472,16 +1676,21 @@ const char *parse_subexpr(const char *p,int limit)
 			(op = C_LE, opl = 7, len = 2, *p == '<' && p[1] == '=') ||
 			(op = C_LT, opl = 7, len = 1, *p == '<')) && opl > limit) {
 		p += len;
+		rpos = script_pos;
 		if( op == C_OP3 ) {
 			p = parse_subexpr(p, -1);
 			p = skip_space(p);
 			if( *(p++) != ':' )
 				disp_error_message("parse_subexpr: expected ':'", p - 1);
+			bpos = script_pos;
 			p = parse_subexpr(p, -1);
-		} else
+			if( !parse_fold_op3(pos, rpos, bpos) )
+				add_scriptc(op);
+		} else {
 			p = parse_subexpr(p, opl);
-
-		add_scriptc(op);
+			if( !parse_fold_op2(pos, rpos, op) )
+				add_scriptc(op);
+		}
 		p = skip_space(p);
 	}
 
@@ -1968,6 +2177,7 @@ const char *parse_syntax(const char *p)
 			if(p2 - p == 2 && !strncasecmp(p,"if",2)) {
 				// If process
 				char label[256];
+				int cond_pos;
 				p=skip_space(p2);
 				if(*p != '(') { //Prevent if this {} non-c syntax. from Rayce (jA)
 					disp_error_message("need '('",p);
@@ -1976,14 +2186,20 @@ const char *parse_syntax(const char *p)
 				syntax.curly[syntax.curly_count].count = 1;
 				syntax.curly[syntax.curly_count].index = syntax.index++;
 				syntax.curly[syntax.curly_count].flag  = 0;
+				syntax.curly[syntax.curly_count].jump_pos = script_pos;
+				syntax.curly[syntax.curly_count].dead = 0;
+				syntax.curly[syntax.curly_count].taken = 0;
 				sprintf(label,"__IF%x_%x",syntax.curly[syntax.curly_count].index,syntax.curly[syntax.curly_count].count);
 				syntax.curly_count++;
 				add_scriptl(add_str("jump_zero"));
 				add_scriptc(C_ARG);
+				cond_pos = script_pos;
 				p=parse_expr(p);
 				p=skip_space(p);
-				add_scriptl(add_str(label));
-				add_scriptc(C_FUNC);
+				if(!parse_syntax_if_cond(syntax.curly_count - 1,cond_pos)) {
+					add_scriptl(add_str(label));
+					add_scriptc(C_FUNC);
+				}
 				return p;
 			}
 			break;
@@ -2074,15 +2290,24 @@ const char *parse_syntax_close_sub(const char *p,int *flag)
 	} else if(syntax.curly[pos].type == TYPE_IF) {
 		const char *bp = p;
 		const char *p2;
+		int cond_pos;
+		bool last;
 
 		// if-block and else-block end is a new line
 		parse_nextline(false, p);
 
 		// Skip to the last location if
-		sprintf(label,"goto __IF%x_FIN;",syntax.curly[pos].index);
-		syntax.curly[syntax.curly_count++].type = TYPE_NULL;
-		parse_line(label);
-		syntax.curly_count--;
+		p2 = skip_space(p);
+		last = (syntax.curly[pos].flag || skip_word(p2) - p2 != 4 || strncasecmp(p2,"else",4));
+		if(syntax.curly[pos].dead && parse_truncate(syntax.curly[pos].jump_pos)) {
+			// The dead branch was removed
+		} else if(!last || !script_config.optimize_scripts) {
+			// Jump to the final location, unless this is the end of the last branch
+			sprintf(label,"goto __IF%x_FIN;",syntax.curly[pos].index);
+			syntax.curly[syntax.curly_count++].type = TYPE_NULL;
+			parse_line(label);
+			syntax.curly_count--;
+		}
 
 		// Put the label of the location
 		sprintf(label,"__IF%x_%x",syntax.curly[pos].index,syntax.curly[pos].count);
@@ -2103,18 +2328,25 @@ const char *parse_syntax_close_sub(const char *p,int *flag)
 					disp_error_message("need '('",p);
 				}
 				sprintf(label,"__IF%x_%x",syntax.curly[pos].index,syntax.curly[pos].count);
+				syntax.curly[pos].jump_pos = script_pos;
+				syntax.curly[pos].dead = 0;
 				add_scriptl(add_str("jump_zero"));
 				add_scriptc(C_ARG);
+				cond_pos = script_pos;
 				p=parse_expr(p);
 				p=skip_space(p);
-				add_scriptl(add_str(label));
-				add_scriptc(C_FUNC);
+				if(!parse_syntax_if_cond(pos,cond_pos)) {
+					add_scriptl(add_str(label));
+					add_scriptc(C_FUNC);
+				}
 				*flag = 0;
 				return p;
 			} else {
 				// else
 				if(!syntax.curly[pos].flag) {
 					syntax.curly[pos].flag = 1;
+					syntax.curly[pos].jump_pos = script_pos;
+					syntax.curly[pos].dead = syntax.curly[pos].taken;
 					*flag = 0;
 					return p;
 				}
@@ -2273,8 +2505,16 @@ static void add_buildin_func(void)
 			else if( !strcmp(buildin_func[i].name, "callsub") ) buildin_callsub_ref = n;
 			else if( !strcmp(buildin_func[i].name, "callfunc") ) buildin_callfunc_ref = n;
 			else if( !strcmp(buildin_func[i].name, "getelementofarray") ) buildin_getelementofarray_ref = n;
+			else if( !strcmp(buildin_func[i].name, "readparam") ) buildin_readparam_ref = n;
 		}
 	}
+
+	for( i = 0; i < ARRAYLENGTH(script_pure_buildin); i++ ) {
+		int n = search_str(script_pure_buildin[i].name);
+
+		if( n >= 0 && str_data[n].type == C_FUNC )
+			str_data[n].pure = script_pure_buildin[i].arg;
+	}
 }
 
 /// Retrieves the value of a constant.
@@ -2524,6 +2764,8 @@ struct script_code* parse_script(const char *src,const char *file,int line,int o
 	script_buf = (unsigned char *)aMalloc(SCRIPT_BLOCK_SIZE*sizeof(unsigned char));
 	script_pos = 0;
 	script_size = SCRIPT_BLOCK_SIZE;
+	parser_saved_bytes = 0;
+	parser_label_pos = -1;
 	parse_nextline(true, NULL);
 
 	//Who called parse_script is responsible for clearing the database after using it, but just in case... lets clear it here
@@ -2638,6 +2880,9 @@ struct script_code* parse_script(const char *src,const char *file,int line,int o
 		disp_error_message("parse_script: unresolved function references", p);
 	}
 
+	if( script_config.optimize_scripts == 2 && parser_saved_bytes )
+		ShowInfo("parse_script: Optimized script in file '"CL_WHITE"%s"CL_RESET"', line '"CL_WHITE"%d"CL_RESET"', saved %d bytes (%d -> %d).\n", file, line, parser_saved_bytes, script_size + parser_saved_bytes, script_size);
+
 #ifdef DEBUG_DISP
 	for( i = 0; i < script_pos; i++ ) {
 		if( (i&15) == 0 ) ShowMessage("%04x : ",i);
@@ -2682,6 +2927,8 @@ struct script_code* parse_script(const char *src,const char *file,int line,int o
 	code->script_buf  = script_buf;
 	code->script_size = script_size;
 	code->script_vars = idb_alloc(DB_OPT_RELEASE_DATA);
+	script_decode_code(code);
+	code->pure = script_code_is_pure(code);
 	return code;
 }
 
@@ -3194,6 +3441,8 @@ void script_free_code(struct script_code* code)
 
 	script_free_vars(code->script_vars);
 	aFree(code->script_buf);
+	if( code->insn )
+		aFree(code->insn);
 	aFree(code);
 }
 
@@ -3278,6 +3527,171 @@ int get_num(unsigned char *script,int *pos)
 	return i+((script[(*pos)++]&0x7f)<<j);
 }
 
+/*==========================================
+ * Pre-decoding of the bytecode.
+ * The instructions of a script are decoded once after it is parsed, so
+ * run_script_main doesn't need to parse the variable length encoding of
+ * every instruction it executes. Positions stay byte offsets in
+ * script_buf; jumps are mapped back to an instruction by binary search.
+ * Each C_FUNC gets the builtin named before the C_ARG of its arguments.
+ *------------------------------------------*/
+#define SCRIPT_INSN_UNKNOWN 0xFF
+
+static void script_decode_insn(unsigned char *buf, int *pos, struct script_insn *insn)
+{
+	int start = *pos, val = 0;
+	c_op op = get_com(buf, pos);
+
+	switch( op ) {
+		case C_INT:
+			val = get_num(buf, pos);
+			break;
+		case C_POS:
+		case C_NAME:
+			val = GETVALUE(buf, *pos);
+			*pos += 3;
+			break;
+		case C_STR:
+			val = *pos;
+			while( buf[(*pos)++] );
+			break;
+	}
+	if( insn ) {
+		insn->pos = start;
+		if( op >= 0 && op < SCRIPT_INSN_UNKNOWN ) {
+			insn->op = (uint8)op;
+			insn->val = val;
+		} else {
+			insn->op = SCRIPT_INSN_UNKNOWN;
+			insn->val = op;
+		}
+	}
+}
+
+/// Resolves the builtin of every C_FUNC.
+/// Calls are nested in the bytecode: C_NAME(<command>) C_ARG <arguments> C_FUNC.
+static void script_decode_funcs(struct script_code *code)
+{
+	int *frame, depth = 0, i;
+
+	CREATE(frame, int, code->insn_count + 1);
+	for( i = 0; i < code->insn_count; i++ ) {
+		struct script_insn *insn = &code->insn[i];
+
+		if( insn->op == C_ARG )
+			frame[depth++] = i - 1; //C_NAME of the command
+		else if( insn->op == C_FUNC ) {
+			struct script_insn *name = (depth > 0 && frame[depth - 1] >= 0 ? &code->insn[frame[depth - 1]] : NULL);
+
+			if( depth > 0 )
+				depth--;
+			insn->val = -1;
+			if( name && name->op == C_NAME && name->val >= 0 && name->val < str_num && str_data[name->val].type == C_FUNC ) {
+				insn->val = name->val;
+				insn->func = str_data[name->val].func;
+			}
+		}
+	}
+	aFree(frame);
+}
+
+static void script_decode_code(struct script_code *code)
+{
+	int pos, n;
+
+	for( pos = 0, n = 0; pos < code->script_size; n++ )
+		script_decode_insn(code->script_buf, &pos, NULL);
+	CREATE(code->insn, struct script_insn, n + 2);
+	for( pos = 0, n = 0; pos < code->script_size; n++ )
+		script_decode_insn(code->script_buf, &pos, &code->insn[n]);
+	code->insn_count = n;
+	//End markers, so the position after the last instruction can always be read
+	code->insn[n].pos = code->insn[n + 1].pos = code->script_size;
+	code->insn[n].op = code->insn[n + 1].op = C_NOP;
+	script_decode_funcs(code);
+}
+
+/// Returns the index of the instruction starting at pos, or -1 if there's none.
+static int script_insn_find(struct script_code *code, int pos)
+{
+	int min = 0, max = code->insn_count;
+
+	while( min < max ) {
+		int mid = (min + max) / 2;
+
+		if( code->insn[mid].pos < pos )
+			min = mid + 1;
+		else
+			max = mid;
+	}
+	return (code->insn[min].pos == pos ? min : -1);
+}
+
+/// Parameters that only depend on the class, levels and base stats of the player.
+static bool script_param_is_pure(int type)
+{
+	switch( type ) {
+		case SP_STR: case SP_AGI: case SP_VIT: case SP_INT: case SP_DEX: case SP_LUK:
+		case SP_BASELEVEL: case SP_JOBLEVEL: case SP_CLASS: case SP_BASEJOB:
+		case SP_BASECLASS: case SP_UPPER: case SP_SEX:
+			return true;
+	}
+	return false;
+}
+
+/// Returns true if running the script has no side effects besides adding bonuses to the attached player,
+/// and its result only depends on the equipment, class, levels and base stats of that player (see status_calc_pc_).
+static bool script_code_is_pure(struct script_code *code)
+{
+	int i;
+
+	for( i = 0; i < code->insn_count; i++ ) {
+		struct script_insn *insn = &code->insn[i];
+		int n;
+
+		if( insn->op == SCRIPT_INSN_UNKNOWN )
+			return false;
+		if( insn->op != C_NAME )
+			continue;
+		n = insn->val;
+		if( n < 0 || n >= str_num )
+			return false;
+		switch( str_data[n].type ) {
+			case C_FUNC:
+				if( !str_data[n].pure )
+					return false;
+				if( str_data[n].pure == 2 ) { // func C_ARG constant C_FUNC
+					if( insn[1].op != C_ARG || insn[2].op != C_INT || insn[3].op != C_FUNC )
+						return false;
+					if( n == buildin_readparam_ref && !script_param_is_pure(insn[2].val) )
+						return false;
+				}
+				break;
+			case C_PARAM:
+				if( !script_param_is_pure(str_data[n].val) )
+					return false;
+				if( i >= 2 && insn[-1].op == C_ARG && insn[-2].op == C_NAME && insn[-2].val >= 0 && insn[-2].val < str_num &&
+					str_data[insn[-2].val].pure == 3 ) // Only read, never assigned
+					return false;
+				break;
+			case C_NAME: { // Variable, only script-local ones
+					const char *name = get_str(n);
+
+					if( name[0] != '.' || name[1] != '@' )
+						return false;
+				}
+				break;
+			case C_POS:
+			case C_USERFUNC:
+			case C_USERFUNC_POS:
+				break;
+			default:
+				return false;
+		}
+	}
+	return true;
+}
+
 /*==========================================
  * Remove the value from the stack
  *------------------------------------------*/
@@ -3595,10 +4009,11 @@ static void script_check_buildin_argtype(struct script_state *st, int func)
 
 /// Executes a buildin command.
 /// Stack: C_NAME(<command>) C_ARG <arg0> <arg1> ... <argN>
-int run_func(struct script_state *st)
+int run_func(struct script_state *st, const struct script_insn *insn)
 {
 	struct script_data *data;
 	int i,start_sp,end_sp,func;
+	int (*buildin)(struct script_state *st);
 
 	end_sp = st->stack->sp;// position after the last argument
 	for( i = end_sp-1; i > 0 ; --i )
@@ -3615,8 +4030,13 @@ int run_func(struct script_state *st)
 	st->end = end_sp;
 
 	data = &st->stack->stack_data[st->start];
-	if( data->type == C_NAME && str_data[data->u.num].type == C_FUNC ) {
+	if( insn && insn->func && data->type == C_NAME && data->u.num == insn->val ) { // Resolved when the script was decoded
+		func = insn->val;
+		buildin = insn->func;
+		st->funcname = reference_getname(data);
+	} else if( data->type == C_NAME && str_data[data->u.num].type == C_FUNC ) {
 		func = data->u.num;
+		buildin = str_data[func].func;
 		st->funcname = reference_getname(data);
 	} else {
 		ShowError("script:run_func: not a buildin command.\n");
@@ -3629,8 +4049,8 @@ int run_func(struct script_state *st)
 	if( script_config.warn_func_mismatch_argtypes )
 		script_check_buildin_argtype(st, func);
 
-	if(str_data[func].func) {
-		if (str_data[func].func(st)) //Report error
+	if(buildin) {
+		if (buildin(st)) //Report error
 			script_reportsrc(st);
 	} else {
 		ShowError("script:run_func: '%s' (id=%d type=%s) has no C function. please report this!!!\n", get_str(func), func, script_op2name(str_data[func].type));
@@ -3814,105 +4234,193 @@ static void script_attach_state(struct script_state *st)
 
 /*==========================================
  * The main part of the script execution
+ * Instructions are dispatched with computed gotos where the compiler
+ * supports them (each handler jumps straight to the next one), and
+ * with a switch otherwise.
  *------------------------------------------*/
+#if defined(__GNUC__)
+	#define SCRIPT_COMPUTED_GOTO
+#endif
+
+#ifdef SCRIPT_COMPUTED_GOTO
+	#define VM_DISPATCH() goto *dispatch[insn->op]
+	#define VM_CASE(op) case op: vm_##op
+#else
+	#define VM_DISPATCH() goto vm_dispatch
+	#define VM_CASE(op) case op
+#endif
+// Fetches the next instruction
+#define VM_FETCH() \
+	insn = &code->insn[idx++]; \
+	st->pos = code->insn[idx].pos
+// Ends an instruction: checks the state and the operation count, then runs the next one
+#define VM_NEXT() \
+	do { \
+		if( !st->freeloop && cmdcount > 0 && (--cmdcount) <= 0 ) { \
+			ShowError("run_script: too many opeartions being processed non-stop !\n"); \
+			script_reportsrc(st); \
+			st->state = END; \
+		} \
+		if( st->state != RUN ) \
+			goto vm_exit; \
+		if( st->script != code || st->pos != code->insn[idx].pos ) \
+			goto vm_sync; /* jumped */ \
+		VM_FETCH(); \
+		VM_DISPATCH(); \
+	} while( 0 )
+
 void run_script_main(struct script_state *st)
 {
 	int cmdcount = script_config.check_cmdcount;
 	int gotocount = script_config.check_gotocount;
 	TBL_PC *sd;
 	struct script_stack *stack = st->stack;
+	struct script_code *code;
+	struct script_insn *insn;
+	int idx;
+#ifdef SCRIPT_COMPUTED_GOTO
+	static const void *dispatch[SCRIPT_INSN_UNKNOWN + 1];
+
+	if( dispatch[0] == NULL ) {
+		int i;
+
+		for( i = 0; i <= SCRIPT_INSN_UNKNOWN; i++ )
+			dispatch[i] = &&vm_unknown;
+		dispatch[C_EOL] = &&vm_C_EOL;
+		dispatch[C_INT] = &&vm_C_INT;
+		dispatch[C_POS] = &&vm_C_POS;
+		dispatch[C_NAME] = &&vm_C_NAME;
+		dispatch[C_ARG] = &&vm_C_ARG;
+		dispatch[C_STR] = &&vm_C_STR;
+		dispatch[C_FUNC] = &&vm_C_FUNC;
+		dispatch[C_REF] = &&vm_C_REF;
+		dispatch[C_NEG] = &&vm_C_NEG;
+		dispatch[C_NOT] = &&vm_C_NOT;
+		dispatch[C_LNOT] = &&vm_C_LNOT;
+		dispatch[C_ADD] = &&vm_C_ADD;
+		dispatch[C_SUB] = &&vm_C_SUB;
+		dispatch[C_MUL] = &&vm_C_MUL;
+		dispatch[C_DIV] = &&vm_C_DIV;
+		dispatch[C_MOD] = &&vm_C_MOD;
+		dispatch[C_EQ] = &&vm_C_EQ;
+		dispatch[C_NE] = &&vm_C_NE;
+		dispatch[C_GT] = &&vm_C_GT;
+		dispatch[C_GE] = &&vm_C_GE;
+		dispatch[C_LT] = &&vm_C_LT;
+		dispatch[C_LE] = &&vm_C_LE;
+		dispatch[C_AND] = &&vm_C_AND;
+		dispatch[C_OR] = &&vm_C_OR;
+		dispatch[C_XOR] = &&vm_C_XOR;
+		dispatch[C_LAND] = &&vm_C_LAND;
+		dispatch[C_LOR] = &&vm_C_LOR;
+		dispatch[C_R_SHIFT] = &&vm_C_R_SHIFT;
+		dispatch[C_L_SHIFT] = &&vm_C_L_SHIFT;
+		dispatch[C_OP3] = &&vm_C_OP3;
+		dispatch[C_NOP] = &&vm_C_NOP;
+	}
+#endif
 
 	script_attach_state(st);
 
 	if (st->state == RERUNLINE) {
-		run_func(st);
+		run_func(st, NULL);
 		if (st->state == GOTO)
 			st->state = RUN;
 	} else if (st->state != END)
 		st->state = RUN;
 
-	while (st->state == RUN) {
-		enum c_op c = get_com(st->script->script_buf,&st->pos);
+	if (st->state != RUN)
+		goto vm_exit;
 
-		switch (c) {
-			case C_EOL:
-				if (stack->defsp > stack->sp)
-					ShowError("script:run_script_main: unexpected stack position (defsp=%d sp=%d). please report this!!!\n", stack->defsp, stack->sp);
-				else
-					pop_stack(st, stack->defsp, stack->sp); //Pop unused stack data (unused return value)
-				break;
-			case C_INT:
-				push_val(stack,C_INT,get_num(st->script->script_buf,&st->pos));
-				break;
-			case C_POS:
-			case C_NAME:
-				push_val(stack,c,GETVALUE(st->script->script_buf,st->pos));
-				st->pos += 3;
-				break;
-			case C_ARG:
-				push_val(stack,c,0);
-				break;
-			case C_STR:
-				push_str(stack,C_CONSTSTR,(char *)(st->script->script_buf + st->pos));
-				while (st->script->script_buf[st->pos++]);
-				break;
-			case C_FUNC:
-				run_func(st);
-				if (st->state == GOTO) {
-					st->state = RUN;
-					if (!st->freeloop && gotocount > 0 && (--gotocount) <= 0) {
-						ShowError("run_script: infinity loop !\n");
-						script_reportsrc(st);
-						st->state = END;
-					}
+vm_sync:
+	//Find the instruction at the current position (start, jump or call)
+	code = st->script;
+	if ((idx = script_insn_find(code, st->pos)) < 0) {
+		ShowError("run_script: invalid script position %d\n", st->pos);
+		script_reportsrc(st);
+		st->state = END;
+		goto vm_exit;
+	}
+	VM_FETCH();
+
+#ifndef SCRIPT_COMPUTED_GOTO
+vm_dispatch:
+#endif
+	switch (insn->op) {
+		VM_CASE(C_EOL):
+			if (stack->defsp > stack->sp)
+				ShowError("script:run_script_main: unexpected stack position (defsp=%d sp=%d). please report this!!!\n", stack->defsp, stack->sp);
+			else
+				pop_stack(st, stack->defsp, stack->sp); //Pop unused stack data (unused return value)
+			VM_NEXT();
+		VM_CASE(C_INT):
+			push_val(stack,C_INT,insn->val);
+			VM_NEXT();
+		VM_CASE(C_POS):
+		VM_CASE(C_NAME):
+			push_val(stack,(c_op)insn->op,insn->val);
+			VM_NEXT();
+		VM_CASE(C_ARG):
+			push_val(stack,C_ARG,0);
+			VM_NEXT();
+		VM_CASE(C_STR):
+			push_str(stack,C_CONSTSTR,(char *)(code->script_buf + insn->val));
+			VM_NEXT();
+		VM_CASE(C_FUNC):
+			run_func(st, insn);
+			if (st->state == GOTO) {
+				st->state = RUN;
+				if (!st->freeloop && gotocount > 0 && (--gotocount) <= 0) {
+					ShowError("run_script: infinity loop !\n");
+					script_reportsrc(st);
+					st->state = END;
 				}
-				break;
-			case C_REF:
-				st->op2ref = 1;
-				break;
-			case C_NEG:
-			case C_NOT:
-			case C_LNOT:
-				op_1(st,c);
-				break;
-			case C_ADD:
-			case C_SUB:
-			case C_MUL:
-			case C_DIV:
-			case C_MOD:
-			case C_EQ:
-			case C_NE:
-			case C_GT:
-			case C_GE:
-			case C_LT:
-			case C_LE:
-			case C_AND:
-			case C_OR:
-			case C_XOR:
-			case C_LAND:
-			case C_LOR:
-			case C_R_SHIFT:
-			case C_L_SHIFT:
-				op_2(st,c);
-				break;
-			case C_OP3:
-				op_3(st,c);
-				break;
-			case C_NOP:
-				st->state = END;
-				break;
-			default:
-				ShowError("unknown command : %d @ %d\n",c,st->pos);
-				st->state = END;
-				break;
-		}
-		if (!st->freeloop && cmdcount > 0 && (--cmdcount) <= 0) {
-			ShowError("run_script: too many opeartions being processed non-stop !\n");
-			script_reportsrc(st);
+			}
+			VM_NEXT();
+		VM_CASE(C_REF):
+			st->op2ref = 1;
+			VM_NEXT();
+		VM_CASE(C_NEG):
+		VM_CASE(C_NOT):
+		VM_CASE(C_LNOT):
+			op_1(st,(c_op)insn->op);
+			VM_NEXT();
+		VM_CASE(C_ADD):
+		VM_CASE(C_SUB):
+		VM_CASE(C_MUL):
+		VM_CASE(C_DIV):
+		VM_CASE(C_MOD):
+		VM_CASE(C_EQ):
+		VM_CASE(C_NE):
+		VM_CASE(C_GT):
+		VM_CASE(C_GE):
+		VM_CASE(C_LT):
+		VM_CASE(C_LE):
+		VM_CASE(C_AND):
+		VM_CASE(C_OR):
+		VM_CASE(C_XOR):
+		VM_CASE(C_LAND):
+		VM_CASE(C_LOR):
+		VM_CASE(C_R_SHIFT):
+		VM_CASE(C_L_SHIFT):
+			op_2(st,(c_op)insn->op);
+			VM_NEXT();
+		VM_CASE(C_OP3):
+			op_3(st,(c_op)insn->op);
+			VM_NEXT();
+		VM_CASE(C_NOP):
 			st->state = END;
-		}
+			VM_NEXT();
+		default:
+#ifdef SCRIPT_COMPUTED_GOTO
+		vm_unknown:
+#endif
+			ShowError("unknown command : %d @ %d\n",(insn->op == SCRIPT_INSN_UNKNOWN ? insn->val : insn->op),st->pos);
+			st->state = END;
+			VM_NEXT();
 	}
 
+vm_exit:
 	if (st->sleep.tick > 0) {
 		//Restore previous script
 		script_detach_state(st, false);
@@ -3982,6 +4490,8 @@ int script_config_read(char *cfgName)
 			script_config.input_max_value = config_switch(w2);
 		else if (strcmpi(w1,"warn_func_mismatch_argtypes") == 0)
 			script_config.warn_func_mismatch_argtypes = config_switch(w2);
+		else if (strcmpi(w1,"optimize_scripts") == 0)
+			script_config.optimize_scripts = config_switch(w2);
 		else if (strcmpi(w1,"import") == 0)
 			script_config_read(w2);
 		else
@@ -4164,23 +4674,6 @@ void queryThread_add(struct script_state *st, bool type) {
 	/* unlock the queryThread */
 	racond_signal(queryThreadCond);
 }
-/* adds a new log to the queue */
-void queryThread_log(char * entry, int length) {
-	int idx = logThreadData.count;
-	
-	EnterSpinLock(&queryThreadLock);
-	
-	if( logThreadData.count++ != 0 )
-		RECREATE(logThreadData.entry, char *, logThreadData.count);
-	
-	CREATE(logThreadData.entry[idx], char, length + 1 );
-	safestrncpy(logThreadData.entry[idx], entry, length + 1 );
-	
-	LeaveSpinLock(&queryThreadLock);
-
-	/* unlock the queryThread */
-	racond_signal(queryThreadCond);
-}
 
 /* queryThread_main */
 static void *queryThread_main(void *x) {
@@ -4228,16 +4721,6 @@ static void *queryThread_main(void *x) {
 			entry->ok = true;/* we're done with this */
 		}
 		
-		/* also check for any logs in need to be sent */
-		if( log_config.sql_logs ) {
-			for( i = 0; i < logThreadData.count; i++ ) {
-				if( SQL_ERROR == Sql_Query(logmysql_handle, logThreadData.entry[i]) )
-					Sql_ShowDebug(logmysql_handle);
-				aFree(logThreadData.entry[i]);
-			}
-			logThreadData.count = 0;
-		}
-		
 		LeaveSpinLock(&queryThreadLock);
 		
 		ramutex_lock( queryThreadMutex );
@@ -4356,27 +4839,20 @@ void do_final_script(void) {
 		aFree(queryThreadData.entry[i]);
 
 	aFree(queryThreadData.entry);
-
-	for(i = 0; i < logThreadData.count; i++)
-		aFree(logThreadData.entry[i]);
-
-	aFree(logThreadData.entry);
 #endif
 }
 /*==========================================
  * Initialization
  *------------------------------------------*/
 void do_init_script(void) {
-	userfunc_db = strdb_alloc(DB_OPT_DUP_KEY,0);
-	scriptlabel_db = strdb_alloc(DB_OPT_DUP_KEY,50);
+	userfunc_db = strdb_alloc(DB_OPT_DUP_KEY|DB_OPT_FLAT,0);
+	scriptlabel_db = strdb_alloc(DB_OPT_DUP_KEY|DB_OPT_FLAT,50);
 	autobonus_db = strdb_alloc(DB_OPT_DUP_KEY,0);
 
 	mapreg_init();
 #ifdef BETA_THREAD_TEST
 	CREATE(queryThreadData.entry, struct queryThreadEntry*, 1);
 	queryThreadData.count = 0;
-	CREATE(logThreadData.entry, char *, 1);
-	logThreadData.count = 0;
 	/* QueryThread Start */
 	
 	InitializeSpinLock(&queryThreadLock);
@@ -13408,6 +13884,7 @@ int atcommand_sub(struct script_state *st,int type) {
 		sd = &dummy_sd;
 		fd = 0;
 		memset(&dummy_sd,0,sizeof(TBL_PC));
+		status_change_init_data(&dummy_sd.sc); //Commands read sd->sc.data
 		if( st->oid ) {
 			struct block_list *bl = map_id2bl(st->oid);
 
@@ -14622,8 +15099,10 @@ BUILDIN_FUNC(setbattleflag)
 	
 	if (battle_set_value(flag, value) == 0)
 		ShowWarning("buildin_setbattleflag: unknown battle_config flag '%s'\n",flag);
-	else
+	else {
+		status_bonus_cache_clear(); // The cached bonuses may depend on the flag
 		ShowInfo("buildin_setbattleflag: battle_config flag '%s' is now set to '%s'.\n",flag,value);
+	}
 
 	return SCRIPT_CMD_SUCCESS;
 }
@@ -7,6 +7,7 @@
 #define NUM_WHISPER_VAR 10
 
 struct map_session_data;
+struct script_state;
 
 extern int potion_flag; //For use on Alchemist improved potions/Potion Pitcher [Skotlex]
 extern int potion_hp, potion_per_hp, potion_sp, potion_per_sp;
@@ -19,6 +20,7 @@ extern struct Script_Config {
 	int check_gotocount;
 	int input_min_value;
 	int input_max_value;
+	int optimize_scripts;
 
 	const char *die_event_name;
 	const char *kill_pc_event_name;
@@ -98,12 +100,23 @@ struct script_data {
 	struct DBMap **ref;
 };
 
+// Pre-decoded instruction of a script_code (see script_decode_code)
+struct script_insn {
+	int pos; // position of the instruction in script_buf
+	int val; // C_INT value, C_POS/C_NAME id, C_STR offset in script_buf or C_FUNC builtin id (-1 if unknown)
+	uint8 op; // enum c_op, SCRIPT_INSN_UNKNOWN if out of range
+	int (*func)(struct script_state *st); // C_FUNC builtin, resolved when the script is decoded
+};
+
 // Moved defsp from script_state to script_stack since
 // it must be saved when script state is RERUNLINE. [Eoe / jA 1094]
 struct script_code {
 	int script_size;
 	unsigned char *script_buf;
 	struct DBMap *script_vars;
+	struct script_insn *insn; // instructions in script_buf order, followed by end markers at script_size
+	int insn_count;
+	bool pure; // only adds bonuses, result depends on the equipment, class, levels and base stats of the attached player
 };
 
 struct script_stack {
@@ -198,8 +211,4 @@ void script_reload(void);
 // @commands (script based)
 void setd_sub(struct script_state *st, TBL_PC *sd, const char *varname, int elem, void *value, struct DBMap **ref);
 
-#ifdef BETA_THREAD_TEST
-void queryThread_log(char * entry, int length);
-#endif
-
 #endif /* _SCRIPT_H_ */
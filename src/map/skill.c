@@ -3217,7 +3217,7 @@ int skill_area_sub(struct block_list *bl, va_list ap)
 {
 	struct block_list *src;
 	uint16 skill_id,skill_lv;
-	int flag;
+	int flag, ret;
 	unsigned int tick;
 	SkillFunc func;
 
@@ -3236,7 +3236,10 @@ int skill_area_sub(struct block_list *bl, va_list ap)
 			clif_skill_damage(src,bl,tick,status_get_amotion(src),0,-30000,1,skill_id,skill_lv,DMG_SKILL);
 		if (flag&(SD_SPLASH|SD_PREAMBLE))
 			skill_area_temp[2]++;
-		return func(src,bl,skill_id,skill_lv,tick,flag);
+		battle_area_begin(src->id,skill_id,skill_lv,tick);
+		ret = func(src,bl,skill_id,skill_lv,tick,flag);
+		battle_area_end();
+		return ret;
 	}
 	return 0;
 }
@@ -7203,9 +7206,7 @@ int skill_castend_nodamage_id(struct block_list *src, struct block_list *bl, uin
 						pc_bonus_script_clear(dstsd,BSF_REM_ON_DISPELL);
 					if( !tsc || !tsc->count )
 						break;
-					for( i = 0; i < SC_MAX; i++ ) {
-						if( !tsc->data[i] )
-							continue;
+					for( i = status_change_next(tsc, SC_NONE); i != SC_NONE; i = status_change_next(tsc, i) ) {
 						switch( i ) {
 							case SC_WEIGHT50:			case SC_WEIGHT90:		case SC_HALLUCINATION:
 							case SC_STRIPWEAPON:			case SC_STRIPSHIELD:		case SC_STRIPARMOR:
@@ -8753,9 +8754,7 @@ int skill_castend_nodamage_id(struct block_list *src, struct block_list *bl, uin
 						pc_bonus_script_clear(dstsd,BSF_REM_ON_CLEARANCE);
 					if( !tsc || !tsc->count )
 						break;
-					for( i = 0; i < SC_MAX; i++ ) {
-						if( !tsc->data[i] )
-							continue;
+					for( i = status_change_next(tsc, SC_NONE); i != SC_NONE; i = status_change_next(tsc, i) ) {
 						switch( i ) {
 							case SC_WEIGHT50:			case SC_WEIGHT90:		case SC_HALLUCINATION:
 							case SC_STRIPWEAPON:			case SC_STRIPSHIELD:		case SC_STRIPARMOR:
@@ -8927,9 +8926,7 @@ int skill_castend_nodamage_id(struct block_list *src, struct block_list *bl, uin
 			clif_skill_nodamage(src,bl,skill_id,skill_lv,sc_start(src,bl,type,100,skill_lv,skill_get_time(skill_id,skill_lv)));
 			if( !tsc || !tsc->count )
 				break;
-			for( i = 0; i < SC_MAX; i++) {
-				if( !tsc->data[i] )
-					continue;
+			for( i = status_change_next(tsc, SC_NONE); i != SC_NONE; i = status_change_next(tsc, i) ) {
 				switch( i ) {
 					case SC_BLIND:		case SC_CURSE:
 					case SC_POISON:		case SC_HALLUCINATION:
@@ -10567,9 +10564,7 @@ int skill_castend_nodamage_id(struct block_list *src, struct block_list *bl, uin
 						pc_bonus_script_clear(dstsd,BSF_REM_ON_BANISHING_BUSTER);
 					if( !tsc || !tsc->count )
 						break;
-					for( i = 0; i < SC_MAX && n > 0; i++ ) {
-						if( !tsc->data[i] )
-							continue;
+					for( i = status_change_next(tsc, SC_NONE); i != SC_NONE && n > 0; i = status_change_next(tsc, i) ) {
 						switch( i ) {
 							case SC_WEIGHT50:			case SC_WEIGHT90:		case SC_HALLUCINATION:
 							case SC_STRIPWEAPON:			case SC_STRIPSHIELD:		case SC_STRIPARMOR:
@@ -12270,6 +12265,7 @@ static int skill_dance_overlap_sub(struct block_list *bl, va_list ap)
 		target->val2 |= UF_ENSEMBLE; //Add ensemble to signal this unit is overlapping
 	else //Remove dissonance
 		target->val2 &= ~UF_ENSEMBLE;
+	target->due = gettick(); //Its targets are affected by the other group now
 
 	clif_getareachar_skillunit(&target->bl, target, AREA, 0); //Update look of affected cell
 
@@ -13184,6 +13180,9 @@ static int skill_unit_onplace(struct skill_unit *unit, struct block_list *bl, un
 	return skill_id;
 }
 
+//When the target being processed by skill_unit_timer_sub_onplace can be affected again
+static unsigned int skill_unit_target_due;
+
 /**
  * Process skill unit each interval (group->interval, see interval field of skill_unit_db.txt)
  * @param unit Skill unit
@@ -13258,11 +13257,13 @@ static int skill_unit_onplace_timer(struct skill_unit *unit, struct block_list *
 
 	if ((ts = skill_unitgrouptickset_search(bl,group,tick))) {
 		diff = DIFF_TICK(tick,ts->tick);
+		skill_unit_target_due = ts->tick;
 		if (diff < 0)
 			return 0; //Not all have it, eg: Traps don't have it even though they can be hit by Heaven's Drive [Skotlex]
 		ts->tick = tick + group->interval;
 		if ((skill_id == CR_GRANDCROSS || skill_id == NPC_GRANDDARKNESS) && !battle_config.gx_allhit)
 			ts->tick += group->interval * (map_count_oncell(bl->m,bl->x,bl->y,BL_CHAR,0) - 1);
+		skill_unit_target_due = ts->tick;
 	}
 
 	//Wall of Thorn damaged by Fire element unit [Cydh]
@@ -17573,6 +17574,8 @@ struct skill_unit *skill_initunit(struct skill_unit_group *group, int idx, int x
 	unit->val3 = val3;
 	unit->val4 = val4;
 	unit->prev = 0;
+	unit->due = gettick();
+	unit->stamp = 0;
 
 	//Stores new skill unit
 	idb_put(skillunit_db, unit->bl.id, unit);
@@ -17985,6 +17988,15 @@ struct skill_unit_group_tickset *skill_unitgrouptickset_search(struct block_list
 	return &set[j];
 }
 
+/// Earliest tick one of the targets found by skill_unit_timer_sub can be affected again
+static unsigned int skill_unit_due;
+
+static inline void skill_unit_due_at(unsigned int tick)
+{
+	if( DIFF_TICK(tick,skill_unit_due) < 0 )
+		skill_unit_due = tick;
+}
+
 /*==========================================
  * Check for validity skill unit that triggered by skill_unit_timer_sub
  * And trigger skill_unit_onplace_timer for object that maybe stands there (catched object is *bl)
@@ -18003,14 +18015,24 @@ int skill_unit_timer_sub_onplace(struct block_list *bl, va_list ap)
 
 	group = unit->group;
 
+	//Land Protector and the relation to the target rarely change in place, look again after an interval
 	if( !(skill_get_inf2(group->skill_id)&(INF2_TRAP)) && !(skill_get_inf3(group->skill_id)&(INF3_NOLP)) &&
-		map_getcell(unit->bl.m,unit->bl.x,unit->bl.y,CELL_CHKLANDPROTECTOR) )
+		map_getcell(unit->bl.m,unit->bl.x,unit->bl.y,CELL_CHKLANDPROTECTOR) ) {
+		skill_unit_due_at(tick + group->interval);
 		return 0; //AoE skills are ineffective except non-essamble dance skills, traps and barriers
+	}
 
-	if( group->skill_id != GN_WALLOFTHORN && battle_check_target(&unit->bl,bl,group->target_flag) <= 0 )
+	if( group->skill_id != GN_WALLOFTHORN && battle_check_target(&unit->bl,bl,group->target_flag) <= 0 ) {
+		skill_unit_due_at(tick + group->interval);
 		return 0;
+	}
 
+	//Targets without a tickset are affected on every run
+	skill_unit_target_due = tick + SKILLUNITTIMER_INTERVAL;
+	battle_area_begin(group->src_id,group->skill_id,group->skill_lv,tick);
 	skill_unit_onplace_timer(unit,bl,tick);
+	battle_area_end();
+	skill_unit_due_at(skill_unit_target_due);
 	return 1;
 }
 
@@ -18173,6 +18195,7 @@ static int skill_unit_timer_sub(DBKey key, DBData *data, va_list ap)
 				skill_delunit(unit);
 				break;
 		}
+		unit->due = tick; //Look again at what's on the unit in its new state
 	} else { //Skill unit is still active
 		switch( group->unit_id ) {
 			case UNT_ICEWALL: //Icewall loses 50 hp every second
@@ -18222,11 +18245,16 @@ static int skill_unit_timer_sub(DBKey key, DBData *data, va_list ap)
 
 	dissonance = skill_dance_switch(unit,0);
 
-	if( unit->range >= 0 && group->interval != -1 && unit->bl.id != unit->prev ) {
+	//Only look for targets when one of those found last time is due or something changed around the unit
+	if( unit->range >= 0 && group->interval != -1 && unit->bl.id != unit->prev &&
+		(DIFF_TICK(tick,unit->due) >= 0 || map_block_stamp(bl->m,bl->x,bl->y,unit->range) != unit->stamp) ) {
+		skill_unit_due = group->tick + min(group->limit,unit->limit); //Nothing to affect, wait for a change or the expiration
 		if( battle_config.skill_wall_check )
 			map_foreachinshootrange(skill_unit_timer_sub_onplace,bl,unit->range,group->bl_flag,bl,tick);
 		else
 			map_foreachinrange(skill_unit_timer_sub_onplace,bl,unit->range,group->bl_flag,bl,tick);
+		unit->due = skill_unit_due;
+		unit->stamp = map_block_stamp(bl->m,bl->x,bl->y,unit->range);
 		if( unit->range == -1 ) //Unit disabled, but it should not be deleted yet
 			group->unit_id = UNT_USED_TRAPS;
 		else if( group->unit_id == UNT_TATAMIGAESHI ) {
@@ -18486,6 +18514,7 @@ void skill_unit_move_unit_group(struct skill_unit_group *group, int16 m, int16 d
 				skill_dance_overlap(unit1,1);
 			clif_getareachar_skillunit(&unit1->bl,unit1,AREA,0);
 			map_foreachincell(skill_unit_effect,unit1->bl.m,unit1->bl.x,unit1->bl.y,group->bl_flag,&unit1->bl,tick,1);
+			unit1->due = tick;
 		}
 	}
 	aFree(m_flag);
@@ -21074,11 +21103,11 @@ void skill_reload (void) {
  *------------------------------------------*/
 void do_init_skill(void)
 {
-	skilldb_name2id = strdb_alloc(DB_OPT_DUP_KEY|DB_OPT_RELEASE_DATA, 0);
+	skilldb_name2id = strdb_alloc(DB_OPT_DUP_KEY|DB_OPT_RELEASE_DATA|DB_OPT_FLAT, 0);
 	skill_readdb();
 
-	skillunit_group_db = idb_alloc(DB_OPT_BASE);
-	skillunit_db = idb_alloc(DB_OPT_BASE);
+	skillunit_group_db = idb_alloc(DB_OPT_FLAT);
+	skillunit_db = idb_alloc(DB_OPT_FLAT);
 	skillusave_db = idb_alloc(DB_OPT_RELEASE_DATA);
 	bowling_db = idb_alloc(DB_OPT_BASE);
 	skill_unit_ers = ers_new(sizeof(struct skill_unit_group),"skill.c::skill_unit_ers",ERS_OPT_NONE);
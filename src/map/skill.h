@@ -248,6 +248,8 @@ struct skill_unit {
 	int val1, val2, val3, val4;
 	short alive, range;
 	int prev;
+	unsigned int due; //Tick from which skill_unit_timer has to look for targets again
+	unsigned int stamp; //map_block_stamp of its range when it last looked for targets
 };
 
 #define MAX_SKILLUNITGROUPTICKSET 25
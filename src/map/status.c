@@ -53,6 +53,7 @@ enum e_regen {
 static int atkmods[3][MAX_WEAPON_TYPE];	/// ATK weapon modification for size (size_fix.txt)
 
 static struct eri *sc_data_ers; /// For sc_data entries
+static struct status_change_entry *sc_data_empty[SC_MAX]; /// Table of units without status changes, never written
 static struct status_data dummy_status;
 
 short current_equip_item_index; /// Contains inventory index of an equipped item. To pass it into the EQUP_SCRIPT [Lupus]
@@ -3017,184 +3018,230 @@ static unsigned int status_calc_maxhpsp_pc(struct map_session_data *sd, bool isH
 	return (unsigned int)cap_value(max, 1, UINT_MAX);
 }
 
-//Calculates player data from scratch without counting SC adjustments.
-//Should be invoked whenever players raise stats, learn passive skills or change equipment.
-int status_calc_pc_(struct map_session_data *sd, enum e_status_calc_opt opt)
-{
-	static int calculating = 0; //Check for recursive call preemption [Skotlex]
-	struct status_data *status; //Pointer to the player's base status
-	const struct status_change *sc = &sd->sc;
-	struct s_skill b_skill[MAX_SKILL]; //Previous skill tree
-	int b_weight, b_max_weight, b_cart_weight_max, //Previous weight
-	i, refinedef = 0;
-	uint16 lv;
-	short index = -1;
+/**
+ * Equipment bonus cache.
+ * The bonus pass of status_calc_pc_ runs the scripts of every equipped item, card and combo. While all of
+ * them are pure (see script_code_is_pure in script.c) its outcome only depends on what status_calc_pc_bonus_key
+ * collects, so the fields it writes are kept per player and restored until that key changes.
+ */
+#define STATUS_BONUS_COMBO_MAX 16
+
+struct s_status_bonus_key {
+	unsigned int gen; //status_bonus_cache_gen at the time of the pass
+	uint32 class_;
+	int job, sex, base_level, job_level;
+	short param[6];
+	unsigned short speed;
+	unsigned char size;
+	short weapontype1, weapontype2;
+	bool all_equip;
+	struct {
+		short index;
+		unsigned short nameid, card[MAX_SLOTS];
+		char refine;
+		unsigned int equip;
+		uint8 noequip; //Bit 0: item effects nullified on this map, bit 1 + n: card n nullified
+	} slot[EQI_MAX];
+	uint8 combo_count;
+	struct {
+		unsigned short id;
+		bool noequip;
+	} combo[STATUS_BONUS_COMBO_MAX];
+};
 
-	if (++calculating > 10) //Too many recursive calls!
-		return -1;
+struct s_status_bonus_cache {
+	struct s_status_bonus_key key;
+	int max_weight; //Weight limit added by the bonuses
+	unsigned regen_block : 2;
+	uint8 healrate_count;
+	struct s_pc_itemgrouphealrate *healrate; //Item group heal rates added by the bonuses
+	uint8 *data; //See status_bonus_region
+};
 
-	//Remember player-specific values that are currently being shown to the client (for refresh purposes)
-	memcpy(b_skill, &sd->status.skill, sizeof(b_skill));
-	b_weight = sd->weight;
-	b_max_weight = sd->max_weight;
-	b_cart_weight_max = sd->cart_weight_max;
+#define STATUS_BONUS_REGION(first, last) { offsetof(struct map_session_data, first), offsetof(struct map_session_data, last) + sizeof(((struct map_session_data *)0)->last) - offsetof(struct map_session_data, first) }
+
+//Parts of map_session_data written by the bonus pass
+static const struct {
+	size_t offset, size;
+} status_bonus_region[] = {
+	STATUS_BONUS_REGION(right_weapon, left_weapon),
+	STATUS_BONUS_REGION(param_bonus, sp_gain_race),
+	STATUS_BONUS_REGION(autospell, sp_vanish_race),
+	STATUS_BONUS_REGION(bonus, bonus),
+	STATUS_BONUS_REGION(castrate, mdef2_rate),
+	STATUS_BONUS_REGION(special_state, special_state),
+	{ offsetof(struct map_session_data, base_status) + offsetof(struct status_data, max_hp), sizeof(struct status_data) - offsetof(struct status_data, max_hp) },
+};
 
-	pc_calc_skilltree(sd); //SkillTree calculation
+static unsigned int status_bonus_cache_gen = 0; //Bumped when the databases the bonus pass reads are reloaded
 
-	sd->max_weight = job_info[pc_class2idx(sd->status.class_)].max_weight_base + sd->status.str * 300;
+static struct {
+	unsigned int full, partial; //Bonus passes that ran the scripts, bonus passes restored from the cache
+} status_bonus_count;
 
-	if (opt&SCO_FIRST) {
-		//Load Hp/SP from char-received data.
-		sd->battle_status.hp = sd->status.hp;
-		sd->battle_status.sp = sd->status.sp;
-		sd->regen.sregen = &sd->sregen;
-		sd->regen.ssregen = &sd->ssregen;
-		sd->weight = 0;
-		for (i = 0; i < MAX_INVENTORY; i++) {
-			if (sd->status.inventory[i].nameid == 0 || sd->inventory_data[i] == NULL)
-				continue;
-			sd->weight += sd->inventory_data[i]->weight * sd->status.inventory[i].amount;
-		}
-		sd->cart_weight = 0;
-		sd->cart_num = 0;
-		for (i = 0; i < MAX_CART; i++) {
-			if (sd->status.cart[i].nameid == 0)
+/// Collects everything the bonus pass of a player depends on.
+/// Returns false if the pass can't be cached, because not all of its scripts are pure or other bonuses are involved.
+static bool status_calc_pc_bonus_key(struct map_session_data *sd, enum e_status_calc_opt opt, struct s_status_bonus_key *key)
+{
+	const struct status_change *sc = &sd->sc;
+	bool all_equip;
+	int i, j;
+
+	if ((opt&SCO_FIRST) || sd->pd || sd->bonus_script.count || (sc->count && sc->data[SC_ITEMSCRIPT]) || sd->combos.count > STATUS_BONUS_COMBO_MAX)
+		return false;
+	for (i = 0; i < MAX_PC_BONUS; i++) { //Restored autobonuses are already applied
+		if (sd->autobonus[i].active != INVALID_TIMER || sd->autobonus2[i].active != INVALID_TIMER || sd->autobonus3[i].active != INVALID_TIMER)
+			return false;
+	}
+
+	memset(key, 0, sizeof(*key));
+	key->gen = status_bonus_cache_gen;
+	key->class_ = sd->class_;
+	key->job = sd->status.class_;
+	key->sex = sd->status.sex;
+	key->base_level = sd->status.base_level;
+	key->job_level = sd->status.job_level;
+	key->param[0] = sd->status.str;
+	key->param[1] = sd->status.agi;
+	key->param[2] = sd->status.vit;
+	key->param[3] = sd->status.int_;
+	key->param[4] = sd->status.dex;
+	key->param[5] = sd->status.luk;
+	key->speed = sd->base_status.speed;
+	key->size = sd->base_status.size;
+	key->weapontype1 = sd->weapontype1;
+	key->weapontype2 = sd->weapontype2;
+	key->all_equip = all_equip = pc_has_permission(sd, PC_PERM_USE_ALL_EQUIPMENT);
+
+	for (i = 0; i < EQI_MAX; i++) {
+		short index = sd->equip_index[i];
+		struct item *item;
+		struct item_data *id;
+
+		key->slot[i].index = index;
+		if (index < 0 || !(id = sd->inventory_data[index]))
+			continue;
+		if (id->script && !id->script->pure)
+			return false;
+		item = &sd->status.inventory[index];
+		key->slot[i].nameid = item->nameid;
+		key->slot[i].refine = item->refine;
+		key->slot[i].equip = item->equip;
+		if (!all_equip && itemdb_isNoEquip(id, sd->bl.m))
+			key->slot[i].noequip |= 1;
+		for (j = 0; j < MAX_SLOTS; j++) {
+			struct item_data *card;
+
+			key->slot[i].card[j] = item->card[j];
+			if (itemdb_isspecial(item->card[0]) || !item->card[j] || !(card = itemdb_exists(item->card[j])))
 				continue;
-			sd->cart_weight += itemdb_weight(sd->status.cart[i].nameid) * sd->status.cart[i].amount;
-			sd->cart_num++;
+			if (card->script && !card->script->pure)
+				return false;
+			if (!all_equip && itemdb_isNoEquip(card, sd->bl.m))
+				key->slot[i].noequip |= 2<<j;
 		}
 	}
 
-	status = &sd->base_status;
-	//These are not zeroed [zzo]
-	sd->hprate = 100;
-	sd->sprate = 100;
-	sd->castrate = 100;
-	sd->delayrate = 100;
-	sd->dsprate = 100;
-	sd->hprecov_rate = 100;
-	sd->sprecov_rate = 100;
-	sd->matk_rate = 100;
-	sd->critical_rate = sd->hit_rate = sd->flee_rate = sd->flee2_rate = 100;
-	sd->def_rate = sd->def2_rate = sd->mdef_rate = sd->mdef2_rate = 100;
-	sd->regen.state.block = 0;
-
-	//Zeroed arrays, order follows the order in pc.h
-	//Add new arrays to the end of zeroed area in pc.h (see comments) and size here [zzo]
-	memset(sd->param_bonus, 0, sizeof(sd->param_bonus)
-		+ sizeof(sd->param_equip)
-		+ sizeof(sd->subele)
-		+ sizeof(sd->subdefele)
-		+ sizeof(sd->subrace)
-		+ sizeof(sd->subrace2)
-		+ sizeof(sd->subclass)
-		+ sizeof(sd->subsize)
-		+ sizeof(sd->reseff)
-		+ sizeof(sd->weapon_coma_ele)
-		+ sizeof(sd->weapon_coma_race)
-		+ sizeof(sd->weapon_coma_class)
-		+ sizeof(sd->weapon_atk)
-		+ sizeof(sd->weapon_atk_rate)
-		+ sizeof(sd->arrow_adddefele)
-		+ sizeof(sd->arrow_addrace)
-		+ sizeof(sd->arrow_addclass)
-		+ sizeof(sd->arrow_addsize)
-		+ sizeof(sd->magic_adddefele)
-		+ sizeof(sd->magic_addrace)
-		+ sizeof(sd->magic_addclass)
-		+ sizeof(sd->magic_addsize)
-		+ sizeof(sd->magic_atkele)
-		+ sizeof(sd->critaddrace)
-		+ sizeof(sd->expaddrace)
-		+ sizeof(sd->expaddclass)
-		+ sizeof(sd->ignore_mdef_by_race)
-		+ sizeof(sd->ignore_mdef_by_class)
-		+ sizeof(sd->ignore_def_by_race)
-		+ sizeof(sd->ignore_def_by_class)
-		+ sizeof(sd->sp_gain_race)
-		);
-
-	memset(&sd->right_weapon.overrefine, 0, sizeof(sd->right_weapon) - sizeof(sd->right_weapon.atkmods));
-	memset(&sd->left_weapon.overrefine, 0, sizeof(sd->left_weapon) - sizeof(sd->left_weapon.atkmods));
-
-	if (sd->special_state.intravision && !sc->data[SC_INTRAVISION]) //Clear intravision as long as nothing else is using it
-		clif_status_load(&sd->bl, SI_INTRAVISION, 0);
+	key->combo_count = sd->combos.count;
+	for (i = 0; i < sd->combos.count; i++) {
+		struct item_combo *combo;
 
-	memset(&sd->special_state, 0, sizeof(sd->special_state));
-
-	if (!sd->state.permanent_speed) {
-		memset(&status->max_hp, 0, sizeof(struct status_data) - (sizeof(status->hp) + sizeof(status->sp)));
-		status->speed = DEFAULT_WALK_SPEED;
-	} else {
-		int pSpeed = status->speed;
+		key->combo[i].id = sd->combos.id[i];
+		if (!sd->combos.bonus[i] || !(combo = itemdb_combo_exists(sd->combos.id[i])))
+			continue;
+		if (!sd->combos.bonus[i]->pure)
+			return false;
+		for (j = 0; j < combo->count && !all_equip; j++) {
+			struct item_data *id = itemdb_exists(combo->nameid[j]);
 
-		memset(&status->max_hp, 0, sizeof(struct status_data) - (sizeof(status->hp) + sizeof(status->sp)));
-		status->speed = pSpeed;
+			if (id && itemdb_isNoEquip(id, sd->bl.m)) {
+				key->combo[i].noequip = true;
+				break;
+			}
+		}
 	}
+	return true;
+}
 
-	//FIXME: Most of these stuff should be calculated once, but how do I fix the memset above to do that? [Skotlex]
-	//Give them all modes except these (useful for clones)
-	status->mode = (enum e_mode)(MD_MASK&~(MD_BOSS|MD_PLANT|MD_DETECTOR|MD_ANGRY|MD_TARGETWEAK));
+/// Stores the outcome of a bonus pass, max_weight is the weight limit before it.
+static void status_calc_pc_bonus_save(struct map_session_data *sd, struct s_status_bonus_key *key, int max_weight)
+{
+	struct s_status_bonus_cache *cache = sd->bonus_cache;
+	uint8 *p;
+	int i;
 
-	status->size = (sd->class_&JOBL_BABY) ? SZ_SMALL : SZ_MEDIUM;
-	if (battle_config.character_size && (pc_isriding(sd) || pc_isridingdragon(sd))) { //[Lupus]
-		if (sd->class_&JOBL_BABY) {
-			if (battle_config.character_size&SZ_BIG)
-				status->size++;
-		} else if (battle_config.character_size&SZ_MEDIUM)
-			status->size++;
-	}
-	status->aspd_rate = 1000;
-	status->ele_lv = 1;
-	status->race = RC_DEMIHUMAN;
-	status->class_ = CLASS_NORMAL;
+	if (!cache) {
+		size_t size = 0;
+
+		for (i = 0; i < ARRAYLENGTH(status_bonus_region); i++)
+			size += status_bonus_region[i].size;
+		CREATE(cache, struct s_status_bonus_cache, 1);
+		CREATE(cache->data, uint8, size);
+		sd->bonus_cache = cache;
+	}
+	memcpy(&cache->key, key, sizeof(cache->key));
+	cache->max_weight = sd->max_weight - max_weight;
+	cache->regen_block = sd->regen.state.block;
+	for (i = 0, p = cache->data; i < ARRAYLENGTH(status_bonus_region); p += status_bonus_region[i].size, i++)
+		memcpy(p, (uint8 *)sd + status_bonus_region[i].offset, status_bonus_region[i].size);
+	if (sd->itemgrouphealrate_count) {
+		RECREATE(cache->healrate, struct s_pc_itemgrouphealrate, sd->itemgrouphealrate_count);
+		for (i = 0; i < sd->itemgrouphealrate_count; i++)
+			cache->healrate[i] = *sd->itemgrouphealrate[i];
+	} else if (cache->healrate) {
+		aFree(cache->healrate);
+		cache->healrate = NULL;
+	}
+	cache->healrate_count = sd->itemgrouphealrate_count;
+}
 
-	//Zero up structures
-	memset(&sd->autospell,0,sizeof(sd->autospell)
-		+ sizeof(sd->autospell2)
-		+ sizeof(sd->autospell3)
-		+ sizeof(sd->addeff)
-		+ sizeof(sd->addeff2)
-		+ sizeof(sd->addeff3)
-		+ sizeof(sd->skillatk)
-		+ sizeof(sd->skillusesprate)
-		+ sizeof(sd->skillusesp)
-		+ sizeof(sd->skillheal)
-		+ sizeof(sd->skillheal2)
-		+ sizeof(sd->hp_loss)
-		+ sizeof(sd->sp_loss)
-		+ sizeof(sd->hp_regen)
-		+ sizeof(sd->sp_regen)
-		+ sizeof(sd->skillblown)
-		+ sizeof(sd->skillcast)
-		+ sizeof(sd->add_def)
-		+ sizeof(sd->add_mdef)
-		+ sizeof(sd->add_mdmg)
-		+ sizeof(sd->add_drop)
-		+ sizeof(sd->itemhealrate)
-		+ sizeof(sd->subele2)
-		+ sizeof(sd->cooldown)
-		+ sizeof(sd->skillfixcast)
-		+ sizeof(sd->skillvarcast)
-		+ sizeof(sd->skillfixcastrate)
-		+ sizeof(sd->def_set_race)
-		+ sizeof(sd->mdef_set_race)
-		+ sizeof(sd->norecover_state_race)
-		+ sizeof(sd->hp_vanish_race)
-		+ sizeof(sd->sp_vanish_race)
-		+ sizeof(sd->subskill)
-	);
+/// Restores the outcome of the last bonus pass if it was made with the same key.
+static bool status_calc_pc_bonus_load(struct map_session_data *sd, struct s_status_bonus_key *key)
+{
+	struct s_status_bonus_cache *cache = sd->bonus_cache;
+	uint8 *p;
+	int i;
 
-	memset(&sd->bonus, 0, sizeof(sd->bonus));
+	if (!cache || memcmp(&cache->key, key, sizeof(cache->key)))
+		return false;
+	for (i = 0, p = cache->data; i < ARRAYLENGTH(status_bonus_region); p += status_bonus_region[i].size, i++)
+		memcpy((uint8 *)sd + status_bonus_region[i].offset, p, status_bonus_region[i].size);
+	sd->max_weight += cache->max_weight;
+	sd->regen.state.block = cache->regen_block;
+	for (i = 0; i < cache->healrate_count; i++)
+		pc_itemgrouphealrate(sd, cache->healrate[i].group_id, cache->healrate[i].rate);
+	if (sd->special_state.intravision)
+		clif_status_load(&sd->bl, SI_INTRAVISION, 1);
+	return true;
+}
 
-	//Autobonus
-	pc_delautobonus(sd, sd->autobonus, ARRAYLENGTH(sd->autobonus), true);
-	pc_delautobonus(sd, sd->autobonus2, ARRAYLENGTH(sd->autobonus2), true);
-	pc_delautobonus(sd, sd->autobonus3, ARRAYLENGTH(sd->autobonus3), true);
+/// Releases the equipment bonus cache of a player.
+void status_bonus_cache_free(struct map_session_data *sd)
+{
+	if (!sd->bonus_cache)
+		return;
+	if (sd->bonus_cache->healrate)
+		aFree(sd->bonus_cache->healrate);
+	aFree(sd->bonus_cache->data);
+	aFree(sd->bonus_cache);
+	sd->bonus_cache = NULL;
+}
 
-	pc_itemgrouphealrate_clear(sd);
+/// Invalidates the equipment bonus cache of all players.
+/// Call it after reloading anything the bonus pass reads besides the player itself.
+void status_bonus_cache_clear(void)
+{
+	status_bonus_cache_gen++;
+}
 
-	npc_script_event(sd, NPCE_STATCALC);
+/// Runs the scripts of the equipment, cards, combos, item script status, bonus scripts and pet of a player.
+/// Returns 1 if one of them retriggered status_calc_pc, 0 otherwise.
+static int status_calc_pc_bonus(struct map_session_data *sd, enum e_status_calc_opt opt, int *calculating)
+{
+	struct status_data *status = &sd->base_status;
+	const struct status_change *sc = &sd->sc;
+	int i, refinedef = 0;
+	short index = -1;
 
 	//Parse equipment
 	for(i = 0; i < EQI_MAX; i++) {
@@ -3214,7 +3261,7 @@ int status_calc_pc_(struct map_session_data *sd, enum e_status_calc_opt opt)
 		if((opt&SCO_FIRST) && sd->inventory_data[index]->equip_script && (pc_has_permission(sd,PC_PERM_USE_ALL_EQUIPMENT) ||
 			!itemdb_isNoEquip(sd->inventory_data[index],sd->bl.m))) { //Execute equip-script on login
 			run_script(sd->inventory_data[index]->equip_script,0,sd->bl.id,0);
-			if (!calculating)
+			if (!*calculating)
 				return 1;
 		}
 		//Sanitize the refine level in case someone decreased the value inbetween
@@ -3254,7 +3301,7 @@ int status_calc_pc_(struct map_session_data *sd, enum e_status_calc_opt opt)
 					sd->state.lr_flag = 0;
 				} else
 					run_script(sd->inventory_data[index]->script,0,sd->bl.id,0);
-				if(!calculating) //Abort, run_script retriggered this [Skotlex]
+				if(!*calculating) //Abort, run_script retriggered this [Skotlex]
 					return 1;
 			}
 			if(sd->status.inventory[index].card[0] == CARD0_FORGE) { //Forged weapon
@@ -3278,14 +3325,14 @@ int status_calc_pc_(struct map_session_data *sd, enum e_status_calc_opt opt)
 				run_script(sd->inventory_data[index]->script,0,sd->bl.id,0);
 				if(i == EQI_HAND_L) //Shield
 					sd->state.lr_flag = 0;
-				if(!calculating) //Abort, run_script retriggered this [Skotlex]
+				if(!*calculating) //Abort, run_script retriggered this [Skotlex]
 					return 1;
 			}
 		} else if(sd->inventory_data[index]->type == IT_SHADOWGEAR) { //Shadow System
 			if(sd->inventory_data[index]->script && (pc_has_permission(sd,PC_PERM_USE_ALL_EQUIPMENT) ||
 				!itemdb_isNoEquip(sd->inventory_data[index],sd->bl.m))) {
 				run_script(sd->inventory_data[index]->script,0,sd->bl.id,0);
-				if(!calculating)
+				if(!*calculating)
 					return 1;
 			}
 		}
@@ -3299,7 +3346,7 @@ int status_calc_pc_(struct map_session_data *sd, enum e_status_calc_opt opt)
 			if(sd->inventory_data[index]->look != A_THROWWEAPON)
 				run_script(sd->inventory_data[index]->script,0,sd->bl.id,0);
 			sd->state.lr_flag = 0;
-			if(!calculating) //Abort, run_script retriggered status_calc_pc [Skotlex]
+			if(!*calculating) //Abort, run_script retriggered status_calc_pc [Skotlex]
 				return 1;
 		}
 	}
@@ -3329,7 +3376,7 @@ int status_calc_pc_(struct map_session_data *sd, enum e_status_calc_opt opt)
 			if(no_run)
 				continue;
 			run_script(sd->combos.bonus[i],0,sd->bl.id,0);
-			if(!calculating) //Abort, run_script retriggered this
+			if(!*calculating) //Abort, run_script retriggered this
 				return 1;
 		}
 	}
@@ -3370,7 +3417,7 @@ int status_calc_pc_(struct map_session_data *sd, enum e_status_calc_opt opt)
 				if((opt&SCO_FIRST) && data->equip_script && (pc_has_permission(sd,PC_PERM_USE_ALL_EQUIPMENT) ||
 					!itemdb_isNoEquip(data,sd->bl.m))) { //Execute equip-script on login
 					run_script(data->equip_script,0,sd->bl.id,0);
-					if(!calculating)
+					if(!*calculating)
 						return 1;
 				}
 				if(!data->script)
@@ -3383,7 +3430,7 @@ int status_calc_pc_(struct map_session_data *sd, enum e_status_calc_opt opt)
 					sd->state.lr_flag = 0;
 				} else
 					run_script(data->script,0,sd->bl.id,0);
-				if(!calculating) //Abort, run_script his function [Skotlex]
+				if(!*calculating) //Abort, run_script his function [Skotlex]
 					return 1;
 			}
 		}
@@ -3403,7 +3450,7 @@ int status_calc_pc_(struct map_session_data *sd, enum e_status_calc_opt opt)
 
 		if(pd && pd->petDB && pd->petDB->pet_friendly_script && pd->pet.intimate >= battle_config.pet_bonus_min_friendly) {
 			run_script(pd->petDB->pet_friendly_script,0,sd->bl.id,0);
-			if(!calculating)
+			if(!*calculating)
 				return 1;
 		}
 		if(pd && pd->pet.intimate > 0 && (!battle_config.pet_equip_required || pd->pet.equip > 0) && pd->state.skillbonus == 1 && pd->bonus) {
@@ -3414,6 +3461,203 @@ int status_calc_pc_(struct map_session_data *sd, enum e_status_calc_opt opt)
 		}
 	}
 
+	return 0;
+}
+
+//Calculates player data from scratch without counting SC adjustments.
+//Should be invoked whenever players raise stats, learn passive skills or change equipment.
+int status_calc_pc_(struct map_session_data *sd, enum e_status_calc_opt opt)
+{
+	static int calculating = 0; //Check for recursive call preemption [Skotlex]
+	struct status_data *status; //Pointer to the player's base status
+	const struct status_change *sc = &sd->sc;
+	struct s_skill b_skill[MAX_SKILL]; //Previous skill tree
+	struct s_status_bonus_key key;
+	int b_weight, b_max_weight, b_cart_weight_max, //Previous weight
+	i;
+	uint16 lv;
+	short index = -1;
+
+	if (++calculating > 10) //Too many recursive calls!
+		return -1;
+
+	//Remember player-specific values that are currently being shown to the client (for refresh purposes)
+	memcpy(b_skill, &sd->status.skill, sizeof(b_skill));
+	b_weight = sd->weight;
+	b_max_weight = sd->max_weight;
+	b_cart_weight_max = sd->cart_weight_max;
+
+	pc_calc_skilltree(sd); //SkillTree calculation
+
+	sd->max_weight = job_info[pc_class2idx(sd->status.class_)].max_weight_base + sd->status.str * 300;
+
+	if (opt&SCO_FIRST) {
+		//Load Hp/SP from char-received data.
+		sd->battle_status.hp = sd->status.hp;
+		sd->battle_status.sp = sd->status.sp;
+		sd->regen.sregen = &sd->sregen;
+		sd->regen.ssregen = &sd->ssregen;
+		sd->weight = 0;
+		for (i = 0; i < MAX_INVENTORY; i++) {
+			if (sd->status.inventory[i].nameid == 0 || sd->inventory_data[i] == NULL)
+				continue;
+			sd->weight += sd->inventory_data[i]->weight * sd->status.inventory[i].amount;
+		}
+		sd->cart_weight = 0;
+		sd->cart_num = 0;
+		for (i = 0; i < MAX_CART; i++) {
+			if (sd->status.cart[i].nameid == 0)
+				continue;
+			sd->cart_weight += itemdb_weight(sd->status.cart[i].nameid) * sd->status.cart[i].amount;
+			sd->cart_num++;
+		}
+	}
+
+	status = &sd->base_status;
+	//These are not zeroed [zzo]
+	sd->hprate = 100;
+	sd->sprate = 100;
+	sd->castrate = 100;
+	sd->delayrate = 100;
+	sd->dsprate = 100;
+	sd->hprecov_rate = 100;
+	sd->sprecov_rate = 100;
+	sd->matk_rate = 100;
+	sd->critical_rate = sd->hit_rate = sd->flee_rate = sd->flee2_rate = 100;
+	sd->def_rate = sd->def2_rate = sd->mdef_rate = sd->mdef2_rate = 100;
+	sd->regen.state.block = 0;
+
+	//Zeroed arrays, order follows the order in pc.h
+	//Add new arrays to the end of zeroed area in pc.h (see comments) and size here [zzo]
+	memset(sd->param_bonus, 0, sizeof(sd->param_bonus)
+		+ sizeof(sd->param_equip)
+		+ sizeof(sd->subele)
+		+ sizeof(sd->subdefele)
+		+ sizeof(sd->subrace)
+		+ sizeof(sd->subrace2)
+		+ sizeof(sd->subclass)
+		+ sizeof(sd->subsize)
+		+ sizeof(sd->reseff)
+		+ sizeof(sd->weapon_coma_ele)
+		+ sizeof(sd->weapon_coma_race)
+		+ sizeof(sd->weapon_coma_class)
+		+ sizeof(sd->weapon_atk)
+		+ sizeof(sd->weapon_atk_rate)
+		+ sizeof(sd->arrow_adddefele)
+		+ sizeof(sd->arrow_addrace)
+		+ sizeof(sd->arrow_addclass)
+		+ sizeof(sd->arrow_addsize)
+		+ sizeof(sd->magic_adddefele)
+		+ sizeof(sd->magic_addrace)
+		+ sizeof(sd->magic_addclass)
+		+ sizeof(sd->magic_addsize)
+		+ sizeof(sd->magic_atkele)
+		+ sizeof(sd->critaddrace)
+		+ sizeof(sd->expaddrace)
+		+ sizeof(sd->expaddclass)
+		+ sizeof(sd->ignore_mdef_by_race)
+		+ sizeof(sd->ignore_mdef_by_class)
+		+ sizeof(sd->ignore_def_by_race)
+		+ sizeof(sd->ignore_def_by_class)
+		+ sizeof(sd->sp_gain_race)
+		);
+
+	memset(&sd->right_weapon.overrefine, 0, sizeof(sd->right_weapon) - sizeof(sd->right_weapon.atkmods));
+	memset(&sd->left_weapon.overrefine, 0, sizeof(sd->left_weapon) - sizeof(sd->left_weapon.atkmods));
+
+	if (sd->special_state.intravision && !sc->data[SC_INTRAVISION]) //Clear intravision as long as nothing else is using it
+		clif_status_load(&sd->bl, SI_INTRAVISION, 0);
+
+	memset(&sd->special_state, 0, sizeof(sd->special_state));
+
+	if (!sd->state.permanent_speed) {
+		memset(&status->max_hp, 0, sizeof(struct status_data) - (sizeof(status->hp) + sizeof(status->sp)));
+		status->speed = DEFAULT_WALK_SPEED;
+	} else {
+		int pSpeed = status->speed;
+
+		memset(&status->max_hp, 0, sizeof(struct status_data) - (sizeof(status->hp) + sizeof(status->sp)));
+		status->speed = pSpeed;
+	}
+
+	//FIXME: Most of these stuff should be calculated once, but how do I fix the memset above to do that? [Skotlex]
+	//Give them all modes except these (useful for clones)
+	status->mode = (enum e_mode)(MD_MASK&~(MD_BOSS|MD_PLANT|MD_DETECTOR|MD_ANGRY|MD_TARGETWEAK));
+
+	status->size = (sd->class_&JOBL_BABY) ? SZ_SMALL : SZ_MEDIUM;
+	if (battle_config.character_size && (pc_isriding(sd) || pc_isridingdragon(sd))) { //[Lupus]
+		if (sd->class_&JOBL_BABY) {
+			if (battle_config.character_size&SZ_BIG)
+				status->size++;
+		} else if (battle_config.character_size&SZ_MEDIUM)
+			status->size++;
+	}
+	status->aspd_rate = 1000;
+	status->ele_lv = 1;
+	status->race = RC_DEMIHUMAN;
+	status->class_ = CLASS_NORMAL;
+
+	//Zero up structures
+	memset(&sd->autospell,0,sizeof(sd->autospell)
+		+ sizeof(sd->autospell2)
+		+ sizeof(sd->autospell3)
+		+ sizeof(sd->addeff)
+		+ sizeof(sd->addeff2)
+		+ sizeof(sd->addeff3)
+		+ sizeof(sd->skillatk)
+		+ sizeof(sd->skillusesprate)
+		+ sizeof(sd->skillusesp)
+		+ sizeof(sd->skillheal)
+		+ sizeof(sd->skillheal2)
+		+ sizeof(sd->hp_loss)
+		+ sizeof(sd->sp_loss)
+		+ sizeof(sd->hp_regen)
+		+ sizeof(sd->sp_regen)
+		+ sizeof(sd->skillblown)
+		+ sizeof(sd->skillcast)
+		+ sizeof(sd->add_def)
+		+ sizeof(sd->add_mdef)
+		+ sizeof(sd->add_mdmg)
+		+ sizeof(sd->add_drop)
+		+ sizeof(sd->itemhealrate)
+		+ sizeof(sd->subele2)
+		+ sizeof(sd->cooldown)
+		+ sizeof(sd->skillfixcast)
+		+ sizeof(sd->skillvarcast)
+		+ sizeof(sd->skillfixcastrate)
+		+ sizeof(sd->def_set_race)
+		+ sizeof(sd->mdef_set_race)
+		+ sizeof(sd->norecover_state_race)
+		+ sizeof(sd->hp_vanish_race)
+		+ sizeof(sd->sp_vanish_race)
+		+ sizeof(sd->subskill)
+	);
+
+	memset(&sd->bonus, 0, sizeof(sd->bonus));
+
+	//Autobonus
+	pc_delautobonus(sd, sd->autobonus, ARRAYLENGTH(sd->autobonus), true);
+	pc_delautobonus(sd, sd->autobonus2, ARRAYLENGTH(sd->autobonus2), true);
+	pc_delautobonus(sd, sd->autobonus3, ARRAYLENGTH(sd->autobonus3), true);
+
+	pc_itemgrouphealrate_clear(sd);
+
+	//The bonus pass only depends on what status_calc_pc_bonus_key collects, reuse its last result while that doesn't change
+	if (npc_script_event(sd, NPCE_STATCALC) || !status_calc_pc_bonus_key(sd, opt, &key)) {
+		if (status_calc_pc_bonus(sd, opt, &calculating))
+			return 1;
+		status_bonus_count.full++;
+	} else if (status_calc_pc_bonus_load(sd, &key))
+		status_bonus_count.partial++;
+	else {
+		int max_weight = sd->max_weight;
+
+		if (status_calc_pc_bonus(sd, opt, &calculating))
+			return 1;
+		status_calc_pc_bonus_save(sd, &key, max_weight);
+		status_bonus_count.full++;
+	}
+
 	//Param_bonus now holds card bonuses
 	if(status->rhw.range < 1)
 		status->rhw.range = 1;
@@ -4684,6 +4928,8 @@ void status_calc_bl_(struct block_list *bl, enum scb_flag flag, enum e_status_ca
 		}
 	}
 
+	battle_area_clear(bl); //Area attacks of bl look their values up again
+
 	//Remember previous values
 	status = status_get_status_data(bl);
 	memcpy(&b_status, status, sizeof(struct status_data));
@@ -7004,7 +7250,89 @@ void status_change_init(struct block_list *bl)
 
 	nullpo_retv(sc);
 
+	if( sc->data && sc->data != sc_data_empty ) {
+		aFree(sc->data);
+		aFree(sc->active);
+	}
+	status_change_init_data(sc);
+}
+
+/**
+ * Clears a status change and gives it the shared empty table.
+ * Also used for the dummy characters of the console and of scripts, which are not units of a map.
+ */
+void status_change_init_data(struct status_change *sc)
+{
 	memset(sc,0,sizeof (struct status_change));
+	sc->data = sc_data_empty;
+}
+
+/**
+ * Adds an entry to the status change table of a unit.
+ * The table is allocated when the first entry is added.
+ */
+static void status_change_add(struct status_change *sc, sc_type type, struct status_change_entry *sce)
+{
+	int i;
+
+	if( sc->data == sc_data_empty )
+		sc->data = (struct status_change_entry **)aCalloc(SC_MAX, sizeof(struct status_change_entry *));
+	if( sc->active_count == sc->active_max ) {
+		sc->active_max += 16;
+		RECREATE(sc->active, unsigned short, sc->active_max);
+	}
+	for( i = sc->active_count; i > 0 && sc->active[i - 1] > type; i-- )
+		sc->active[i] = sc->active[i - 1];
+	sc->active[i] = type;
+	sc->active_count++;
+	sc->data[type] = sce;
+}
+
+/**
+ * Removes an entry from the status change table of a unit.
+ * The table is released back to the shared empty one when no entry is left.
+ */
+static void status_change_remove(struct status_change *sc, sc_type type)
+{
+	int i;
+
+	ARR_FIND(0, sc->active_count, i, sc->active[i] == type);
+	if( i < sc->active_count ) {
+		sc->active_count--;
+		memmove(sc->active + i, sc->active + i + 1, (sc->active_count - i) * sizeof(sc->active[0]));
+	}
+	sc->data[type] = NULL;
+	if( !sc->active_count ) {
+		aFree(sc->data);
+		aFree(sc->active);
+		sc->data = sc_data_empty;
+		sc->active = NULL;
+		sc->active_max = 0;
+	}
+}
+
+/**
+ * Returns the first active status change after type, in ascending order.
+ * Loop over all active status changes with:
+ *   for( i = status_change_next(sc, SC_NONE); i != SC_NONE; i = status_change_next(sc, i) )
+ * Status changes can be started or ended inside the loop.
+ * @param sc: Status change data
+ * @param type: Previous type (SC_NONE to start)
+ * @return Next active type or SC_NONE
+ */
+sc_type status_change_next(struct status_change *sc, int type)
+{
+	int min = 0, max = sc->active_count;
+
+	while( min < max ) {
+		int mid = (min + max) / 2;
+
+		if( sc->active[mid] <= type )
+			min = mid + 1;
+		else
+			max = mid;
+	}
+	return (min < sc->active_count ? (sc_type)sc->active[min] : SC_NONE);
 }
 
 /**
@@ -10395,7 +10723,8 @@ int status_change_start(struct block_list *src, struct block_list *bl, enum sc_t
 		sc_isnew = false;
 	} else { //New sc
 		++sc->count;
-		sce = sc->data[type] = ers_alloc(sc_data_ers,struct status_change_entry);
+		sce = ers_alloc(sc_data_ers,struct status_change_entry);
+		status_change_add(sc,type,sce);
 	}
 
 	sce->val1 = val1;
@@ -10510,9 +10839,7 @@ int status_change_clear(struct block_list *bl,int type)
 	if(!sc || !sc->count)
 		return 0;
 
-	for(i = 0; i < SC_MAX; i++) {
-		if(!sc->data[i])
-			continue;
+	for(i = status_change_next(sc, SC_NONE); i != SC_NONE; i = status_change_next(sc, i)) {
 		if(type == 0) {
 			switch(i) { //Type 0: PC killed -> Place here statuses that do not dispel on death
 				case SC_ELEMENTALCHANGE: //Only when its Holy or Dark that it doesn't dispell on death
@@ -10644,7 +10971,7 @@ int status_change_clear(struct block_list *bl,int type)
 			if(sc->data[i]->timer != INVALID_TIMER)
 				delete_timer(sc->data[i]->timer,status_change_timer);
 			ers_free(sc_data_ers,sc->data[i]);
-			sc->data[i] = NULL;
+			status_change_remove(sc,(sc_type)i);
 		}
 	}
 
@@ -10726,7 +11053,7 @@ int status_change_end_(struct block_list *bl, enum sc_type type, int tid, const
 	if (StatusChangeStateTable[type])
 		status_calc_state(bl,sc,(enum scs_flag)StatusChangeStateTable[type],false);
 
-	sc->data[type] = NULL;
+	status_change_remove(sc,type);
 
 	if (sd && StatusDisplayType[type])
 		status_display_remove(sd,type);
@@ -12569,9 +12896,7 @@ void status_change_clear_buffs(struct block_list *bl, int type)
 		for( i = SC_COMMON_MIN; i <= SC_COMMON_MAX; i++ )
 			status_change_end(bl, (sc_type)i, INVALID_TIMER);
 
-	for( i = SC_COMMON_MAX + 1; i < SC_MAX; i++ ) {
-		if( !sc->data[i] )
-			continue;
+	for( i = status_change_next(sc, SC_COMMON_MAX); i != SC_NONE; i = status_change_next(sc, i) ) {
 		switch( i ) {
 			//Stuff that cannot be removed
 			case SC_WEIGHT50:
@@ -12777,8 +13102,8 @@ int status_change_spread(struct block_list *src, struct block_list *bl, bool typ
 	if( (status_get_mode(src)&MD_BOSS) || (status_get_mode(bl)&MD_BOSS) )
 		return 0;
 
-	for( i = SC_COMMON_MIN; i < SC_MAX; i++ ) {
-		if( !sc->data[i] || i == SC_COMMON_MAX )
+	for( i = status_change_next(sc, SC_COMMON_MIN - 1); i != SC_NONE; i = status_change_next(sc, i) ) {
+		if( i == SC_COMMON_MAX )
 			continue;
 		switch( i ) {
 			//Buffs that can be spreaded through Deadly Infect
@@ -13118,6 +13443,7 @@ int status_readdb(void)
 	//path,filename,separator,mincol,maxcol,maxrow,func_parsor
 	sv_readdb(db_path, DBPATH"size_fix.txt", ',', MAX_WEAPON_TYPE, MAX_WEAPON_TYPE, ARRAYLENGTH(atkmods), &status_readdb_sizefix);
 	sv_readdb(db_path, DBPATH"refine_db.txt", ',', 4 + MAX_REFINE, 4 + MAX_REFINE, ARRAYLENGTH(refine_info), &status_readdb_refine);
+	status_bonus_cache_clear();
 	return 0;
 }
 
@@ -13139,5 +13465,7 @@ int do_init_status(void)
 
 void do_final_status(void)
 {
+	if (status_bonus_count.full || status_bonus_count.partial)
+		ShowInfo("status_calc_pc: '"CL_WHITE"%u"CL_RESET"' full and '"CL_WHITE"%u"CL_RESET"' cached equipment bonus passes.\n", status_bonus_count.full, status_bonus_count.partial);
 	ers_destroy(sc_data_ers);
 }
@@ -2056,7 +2056,11 @@ struct status_change {
 	unsigned char sg_counter; //Storm gust counter (previous hits from storm gust)
 #endif
 	unsigned char bs_counter; //Blood Sucker counter
-	struct status_change_entry *data[SC_MAX];
+	//Entries by type. Units without active status changes share an empty table,
+	//so data is only written by status_change_start/status_change_end
+	struct status_change_entry **data;
+	unsigned short *active; //Types of the active entries, in ascending order (see status_change_next)
+	unsigned short active_count, active_max;
 };
 
 //For looking up associated data
@@ -2150,7 +2154,11 @@ int status_get_race2(struct block_list *bl);
 struct view_data *status_get_viewdata(struct block_list *bl);
 void status_set_viewdata(struct block_list *bl, int class_);
 void status_change_init(struct block_list *bl);
+void status_change_init_data(struct status_change *sc);
 struct status_change *status_get_sc(struct block_list *bl);
+sc_type status_change_next(struct status_change *sc, int type);
+void status_bonus_cache_free(struct map_session_data *sd);
+void status_bonus_cache_clear(void);
 
 int status_isdead(struct block_list *bl);
 int status_isimmune(struct block_list *bl);
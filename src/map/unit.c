@@ -3028,6 +3028,7 @@ int unit_free(struct block_list *bl, clr_type clrtype)
 				pc_inventory_rental_clear(sd);
 				pc_delspiritball(sd, sd->spiritball, 1);
 				pc_delspiritcharm(sd, sd->spiritcharm, sd->spiritcharm_type);
+				chrif_save_reset(sd);
 				if( sd->reg ) { //Double logout already freed pointer fix [Skotlex]
 					aFree(sd->reg);
 					sd->reg = NULL;
@@ -3069,6 +3070,7 @@ int unit_free(struct block_list *bl, clr_type clrtype)
 				if( sd->bonus_script.head )
 					pc_bonus_script_clear(sd, BSF_REM_ALL);
 				pc_itemgrouphealrate_clear(sd);
+				status_bonus_cache_free(sd);
 			}
 			break;
 		case BL_PET: {
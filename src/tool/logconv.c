@@ -0,0 +1,418 @@
+// Copyright (c) Athena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../common/cbasetypes.h"
+#include "../common/binlog.h"
+#include "../common/malloc.h"
+#include "../common/mmo.h"
+#include "../common/showmsg.h"
+#include "../common/strlib.h"
+
+// Converts the segments of the binary logs of the map-server (log_binary) to
+// tab separated files, and writes a script that loads them into the log tables
+// with LOAD DATA.
+
+char log_conf_file[256] = "conf/log_athena.conf";
+char out_dir[256] = ".";
+uint32 time_from = 0;
+uint32 time_to = UINT32_MAX;
+
+// Log records come first in enum binlog_type, one per table
+#define TABLE_COUNT BINLOG_MAPNAME
+
+// Log tables, by type of record
+struct log_table {
+	const char *setting; // Setting of conf/log_athena.conf
+	char name[64];
+	const char *date; // Column of the time
+	const char *columns; // Other columns, in the order of the files
+	char file[512];
+	FILE *fp;
+	int rows;
+} tables[TABLE_COUNT] = {
+	{ "log_branch_db",  "branchlog",   "branch_date",    "`account_id`, `char_id`, `char_name`, `map`" },
+	{ "log_pick_db",    "picklog",     "time",           "`char_id`, `type`, `nameid`, `amount`, `refine`, `card0`, `card1`, `card2`, `card3`, `map`, `unique_id`, `bound`" },
+	{ "log_zeny_db",    "zenylog",     "time",           "`char_id`, `src_id`, `type`, `amount`, `map`" },
+	{ "log_mvpdrop_db", "mvplog",      "mvp_date",       "`kill_char_id`, `monster_id`, `prize`, `mvpexp`, `map`" },
+	{ "log_gm_db",      "atcommandlog", "atcommand_date", "`account_id`, `char_id`, `char_name`, `map`, `command`" },
+	{ "log_npc_db",     "npclog",      "npc_date",       "`account_id`, `char_id`, `char_name`, `map`, `mes`" },
+	{ "log_chat_db",    "chatlog",     "time",           "`type`, `type_id`, `src_charid`, `src_accountid`, `src_map`, `src_map_x`, `src_map_y`, `dst_charname`, `message`" },
+	{ "log_cash_db",    "cashlog",     "time",           "`char_id`, `type`, `cash_type`, `amount`, `map`" },
+};
+
+// Names of the map numbers, from the BINLOG_MAPNAME records
+char map_names[UINT16_MAX + 1][MAP_NAME_LENGTH];
+
+int segment_count = 0;
+int record_count = 0;
+
+
+// Reads the names of the log tables from the log configuration
+void read_config(const char *cfgName)
+{
+	char line[1024], w1[1024], w2[1024];
+	FILE *fp;
+	int i;
+
+	if( (fp = fopen(cfgName, "r")) == NULL ) {
+		ShowWarning("Log configuration file not found at: %s, using the default tables.\n", cfgName);
+		return;
+	}
+
+	while( fgets(line, sizeof(line), fp) ) {
+		if( line[0] == '/' && line[1] == '/' )
+			continue;
+		if( sscanf(line, "%1023[^:]: %1023[^\r\n]", w1, w2) != 2 )
+			continue;
+		if( strcmpi(w1, "import") == 0 ) {
+			read_config(w2);
+			continue;
+		}
+		for( i = 0; i < TABLE_COUNT; i++ ) {
+			if( strcmpi(w1, tables[i].setting) == 0 )
+				safestrncpy(tables[i].name, w2, sizeof(tables[i].name));
+		}
+	}
+
+	fclose(fp);
+}
+
+// Writes a string as a field of a tab separated file (LOAD DATA escapes)
+void write_string(FILE *fp, const char *str, size_t maxlen)
+{
+	size_t i;
+
+	fputc('\t', fp);
+	for( i = 0; i < maxlen && str[i]; i++ ) {
+		switch( str[i] ) {
+			case '\\': fputs("\\\\", fp); break;
+			case '\t': fputs("\\t", fp); break;
+			case '\n': fputs("\\n", fp); break;
+			case '\r': fputs("\\r", fp); break;
+			default:   fputc(str[i], fp); break;
+		}
+	}
+}
+
+// Starts a row of a log table
+FILE *write_row(int type, uint32 date)
+{
+	struct log_table *table = &tables[type];
+
+	if( table->fp == NULL ) {
+		safesnprintf(table->file, sizeof(table->file), "%s/%s.txt", out_dir, table->name);
+		if( (table->fp = fopen(table->file, "wb")) == NULL ) {
+			ShowError("Failure when opening the output file %s\n", table->file);
+			exit(EXIT_FAILURE);
+		}
+	}
+	table->rows++;
+	record_count++;
+	fprintf(table->fp, "%u", date);
+	return table->fp;
+}
+
+// Writes a log record to the file of its table
+void convert_record(struct binlog_record *rec, const void *data)
+{
+	const char *map = map_names[rec->map];
+	FILE *fp;
+
+	if( rec->time < time_from || rec->time > time_to )
+		return;
+
+	fp = write_row(rec->type, rec->time);
+	switch( rec->type ) {
+		case BINLOG_BRANCH: {
+			const struct binlog_branch *p = (const struct binlog_branch *)data;
+			fprintf(fp, "\t%d\t%d", p->account_id, p->char_id);
+			write_string(fp, p->name, NAME_LENGTH);
+			write_string(fp, map, MAP_NAME_LENGTH);
+			break;
+		}
+		case BINLOG_PICK: {
+			const struct binlog_pick *p = (const struct binlog_pick *)data;
+			fprintf(fp, "\t%d\t%c\t%hu\t%d\t%d\t%hu\t%hu\t%hu\t%hu", p->id, p->type, p->nameid, p->amount, p->refine, p->card[0], p->card[1], p->card[2], p->card[3]);
+			write_string(fp, map, MAP_NAME_LENGTH);
+			fprintf(fp, "\t%"PRIu64"\t%d", p->unique_id, p->bound);
+			break;
+		}
+		case BINLOG_ZENY: {
+			const struct binlog_zeny *p = (const struct binlog_zeny *)data;
+			fprintf(fp, "\t%d\t%d\t%c\t%d", p->char_id, p->src_id, p->type, p->amount);
+			write_string(fp, map, MAP_NAME_LENGTH);
+			break;
+		}
+		case BINLOG_MVPDROP: {
+			const struct binlog_mvpdrop *p = (const struct binlog_mvpdrop *)data;
+			fprintf(fp, "\t%d\t%d\t%hu\t%u", p->char_id, p->monster_id, p->prize, p->mvpexp);
+			write_string(fp, map, MAP_NAME_LENGTH);
+			break;
+		}
+		case BINLOG_GM:
+		case BINLOG_NPC: {
+			const struct binlog_message *p = (const struct binlog_message *)data;
+			fprintf(fp, "\t%d\t%d", p->account_id, p->char_id);
+			write_string(fp, p->name, NAME_LENGTH);
+			write_string(fp, map, MAP_NAME_LENGTH);
+			write_string(fp, p->message, BINLOG_MESSAGE_LENGTH);
+			break;
+		}
+		case BINLOG_CHAT: {
+			const struct binlog_chat *p = (const struct binlog_chat *)data;
+			fprintf(fp, "\t%c\t%d\t%d\t%d", p->type, p->type_id, p->src_charid, p->src_accountid);
+			write_string(fp, map, MAP_NAME_LENGTH);
+			fprintf(fp, "\t%d\t%d", p->x, p->y);
+			write_string(fp, p->dst_name, NAME_LENGTH);
+			write_string(fp, p->message, BINLOG_MESSAGE_LENGTH);
+			break;
+		}
+		case BINLOG_CASH: {
+			const struct binlog_cash *p = (const struct binlog_cash *)data;
+			fprintf(fp, "\t%d\t%c\t%c\t%d", p->char_id, p->type, p->cash_type, p->amount);
+			write_string(fp, map, MAP_NAME_LENGTH);
+			break;
+		}
+	}
+	fputc('\n', fp);
+}
+
+// Reads the records of a segment from 'start' to 'end'
+void convert_records(FILE *fp, const char *path, uint32 start, uint32 end)
+{
+	static union { // Data of a record, aligned for the structures
+		uint64 align;
+		char buf[UINT16_MAX + 1 + sizeof(struct binlog_chat)];
+	} data;
+	uint32 pos = start;
+
+	fseek(fp, start, SEEK_SET);
+	while( pos + sizeof(struct binlog_record) <= end ) {
+		struct binlog_record rec;
+
+		if( fread(&rec, sizeof(rec), 1, fp) != 1 || pos + sizeof(rec) + rec.length > end || rec.type >= BINLOG_MAX ) {
+			ShowWarning("Segment %s is cut or damaged at offset %u, skipping the rest.\n", path, pos);
+			return;
+		}
+		if( rec.length && fread(data.buf, rec.length, 1, fp) != 1 ) {
+			ShowWarning("Segment %s is cut or damaged at offset %u, skipping the rest.\n", path, pos);
+			return;
+		}
+		memset(data.buf + rec.length, 0, sizeof(struct binlog_chat)); // Rest of the structure when the data is cut
+		pos += sizeof(rec) + rec.length;
+
+		if( rec.type == BINLOG_MAPNAME )
+			safestrncpy(map_names[rec.map], data.buf, MAP_NAME_LENGTH);
+		else if( rec.type != BINLOG_INDEX )
+			convert_record(&rec, data.buf);
+	}
+}
+
+// Reads the index of a segment from its last record.
+// Returns the number of blocks found and puts them in file order in 'blocks',
+// or 0 if the segment was not closed properly.
+int read_index(FILE *fp, uint32 size, struct binlog_index **blocks, uint32 **ends)
+{
+	struct binlog_record rec;
+	struct binlog_index index;
+	uint32 offset;
+	int count = 0, max = 16, i;
+
+	if( size < sizeof(struct binlog_header) + sizeof(rec) + sizeof(index) )
+		return 0;
+	offset = size - sizeof(rec) - sizeof(index);
+
+	CREATE(*blocks, struct binlog_index, max);
+	CREATE(*ends, uint32, max);
+	for(;;) {
+		fseek(fp, offset, SEEK_SET);
+		if( fread(&rec, sizeof(rec), 1, fp) != 1 || fread(&index, sizeof(index), 1, fp) != 1 ||
+			rec.type != BINLOG_INDEX || rec.length != sizeof(index) ||
+			index.block < sizeof(struct binlog_header) || index.block > offset || index.previous >= offset ) {
+			aFree(*blocks);
+			aFree(*ends);
+			return 0; // Not an index, read the whole segment
+		}
+		if( count == max ) {
+			max *= 2;
+			RECREATE(*blocks, struct binlog_index, max);
+			RECREATE(*ends, uint32, max);
+		}
+		(*blocks)[count] = index;
+		(*ends)[count] = offset;
+		count++;
+		if( index.previous == 0 )
+			break;
+		offset = index.previous;
+	}
+
+	for( i = 0; i < count / 2; i++ ) { // File order
+		struct binlog_index b = (*blocks)[i];
+		uint32 e = (*ends)[i];
+
+		(*blocks)[i] = (*blocks)[count - 1 - i];
+		(*blocks)[count - 1 - i] = b;
+		(*ends)[i] = (*ends)[count - 1 - i];
+		(*ends)[count - 1 - i] = e;
+	}
+	return count;
+}
+
+// Converts a segment, skipping the blocks outside of -from and -to
+void convert_segment(const char *path)
+{
+	struct binlog_header header;
+	struct binlog_index *blocks;
+	uint32 *ends;
+	uint32 size;
+	int count, skipped = 0, i;
+	FILE *fp;
+
+	if( (fp = fopen(path, "rb")) == NULL ) {
+		ShowError("Failure when opening segment %s\n", path);
+		return;
+	}
+	if( fread(&header, sizeof(header), 1, fp) != 1 || header.magic != BINLOG_MAGIC ) {
+		ShowError("%s is not a binary log segment.\n", path);
+		fclose(fp);
+		return;
+	}
+	if( header.version != BINLOG_VERSION ) {
+		ShowError("Segment %s has version %d, expected %d.\n", path, header.version, BINLOG_VERSION);
+		fclose(fp);
+		return;
+	}
+	fseek(fp, 0, SEEK_END);
+	size = (uint32)ftell(fp);
+
+	ShowStatus("Converting segment: %s\n", path);
+	if( (count = read_index(fp, size, &blocks, &ends)) > 0 ) {
+		for( i = 0; i < count; i++ ) {
+			if( blocks[i].time_max < time_from || blocks[i].time_min > time_to )
+				skipped++;
+			else
+				convert_records(fp, path, blocks[i].block, ends[i]);
+		}
+		if( skipped )
+			ShowInfo("Skipped %d of %d blocks outside of the time range.\n", skipped, count);
+		aFree(blocks);
+		aFree(ends);
+	} else {
+		ShowNotice("Segment %s was not closed properly, reading all of it.\n", path);
+		convert_records(fp, path, sizeof(header), size);
+	}
+
+	fclose(fp);
+	segment_count++;
+}
+
+// Writes the script that loads the files into the log tables
+void write_load_script(void)
+{
+	char path[512];
+	FILE *fp;
+	int i;
+
+	safesnprintf(path, sizeof(path), "%s/load.sql", out_dir);
+	if( (fp = fopen(path, "wb")) == NULL ) {
+		ShowError("Failure when opening the output file %s\n", path);
+		exit(EXIT_FAILURE);
+	}
+
+	fprintf(fp, "-- Generated by logconv, run with: mysql --local-infile=1 <log database> < %s\n", path);
+	for( i = 0; i < TABLE_COUNT; i++ ) {
+		struct log_table *table = &tables[i];
+		const char *c;
+
+		if( table->fp == NULL )
+			continue;
+		fputs("LOAD DATA LOCAL INFILE '", fp);
+		for( c = table->file; *c; c++ ) {
+			if( *c == '\\' || *c == '\'' )
+				fputc('\\', fp);
+			fputc(*c, fp);
+		}
+		fprintf(fp, "' INTO TABLE `%s` (@date, %s) SET `%s` = FROM_UNIXTIME(@date);\n", table->name, table->columns, table->date);
+	}
+
+	fclose(fp);
+	ShowStatus("Load script written: %s\n", path);
+}
+
+void display_help(void)
+{
+	ShowInfo("Usage: logconv [options] <segment files>\n");
+	ShowInfo("Options:\n");
+	ShowInfo("  -conf <file>    log configuration with the names of the tables (default: %s)\n", log_conf_file);
+	ShowInfo("  -out <dir>      directory of the output files (default: %s)\n", out_dir);
+	ShowInfo("  -from <time>    skip records older than this unix time\n");
+	ShowInfo("  -to <time>      skip records newer than this unix time\n");
+	ShowInfo("Writes one tab separated file per log table and load.sql, which loads them with LOAD DATA.\n");
+}
+
+// Processes command-line arguments, returns the index of the first segment file
+int process_args(int argc, char *argv[])
+{
+	int i;
+
+	for(i = 1; i < argc; i++) {
+		if(strcmp(argv[i], "-conf") == 0) {
+			if(++i < argc)
+				safestrncpy(log_conf_file, argv[i], sizeof(log_conf_file));
+		} else if(strcmp(argv[i], "-out") == 0) {
+			if(++i < argc)
+				safestrncpy(out_dir, argv[i], sizeof(out_dir));
+		} else if(strcmp(argv[i], "-from") == 0) {
+			if(++i < argc)
+				time_from = (uint32)strtoul(argv[i], NULL, 10);
+		} else if(strcmp(argv[i], "-to") == 0) {
+			if(++i < argc)
+				time_to = (uint32)strtoul(argv[i], NULL, 10);
+		} else if(strcmp(argv[i], "-help") == 0 || strcmp(argv[i], "--help") == 0) {
+			display_help();
+			exit(EXIT_SUCCESS);
+		} else
+			break;
+	}
+
+	return i;
+}
+
+int do_init(int argc, char** argv)
+{
+	int i;
+
+	// Process the command-line arguments
+	i = process_args(argc, argv);
+	if(i >= argc) {
+		display_help();
+		exit(EXIT_FAILURE);
+	}
+
+	ShowStatus("Reading the log tables from %s\n", log_conf_file);
+	read_config(log_conf_file);
+
+	for(; i < argc; i++)
+		convert_segment(argv[i]);
+
+	for(i = 0; i < TABLE_COUNT; i++) {
+		if(tables[i].fp == NULL)
+			continue;
+		fclose(tables[i].fp);
+		ShowInfo("%d rows for table '"CL_WHITE"%s"CL_RESET"' in %s\n", tables[i].rows, tables[i].name, tables[i].file);
+	}
+	if(record_count)
+		write_load_script();
+
+	ShowInfo("%d records converted from %d segments\n", record_count, segment_count);
+
+	return 0;
+}
+
+void do_final(void)
+{
+}